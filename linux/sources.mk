@@ -1,5 +1,8 @@
 SOURCES = \
 	../contrib/stb_image/stb_image.c \
+	../src/q3bsp/Q3BspCollision.cpp \
+	../src/q3bsp/Q3BspEntities.cpp \
+	../src/q3bsp/Q3BspLightGrid.cpp \
 	../src/q3bsp/Q3BspLoader.cpp \
 	../src/q3bsp/Q3BspMap.cpp \
 	../src/q3bsp/Q3BspPatch.cpp \
@@ -10,20 +13,28 @@ SOURCES = \
 	../src/renderer/vulkan/Device.cpp \
 	../src/renderer/vulkan/Image.cpp \
 	../src/renderer/vulkan/Pipeline.cpp \
+	../src/renderer/vulkan/Upload.cpp \
 	../src/renderer/vulkan/Validation.cpp \
 	../src/renderer/vulkan/VkMemAlloc.cpp \
 	../src/renderer/Camera.cpp \
 	../src/renderer/CameraDirector.cpp \
 	../src/renderer/Font.cpp \
 	../src/renderer/GameTexture.cpp \
+	../src/renderer/ImageWriter.cpp \
+	../src/renderer/MeshOptimizer.cpp \
+	../src/renderer/PipelineVariants.cpp \
 	../src/renderer/RenderContext.cpp \
+	../src/renderer/TextureCompressor.cpp \
+	../src/renderer/TextureContainer.cpp \
 	../src/renderer/TextureManager.cpp \
+	../src/renderer/TextureStreamer.cpp \
 	../src/Application.cpp \
 	../src/Frustum.cpp \
 	../src/InputHandlers.cpp \
 	../src/main.cpp \
 	../src/Math.cpp \
-	../src/StringHelpers.cpp \
+	../src/MathBenchmark.cpp \
+	../src/Metrics.cpp \
 	../src/ThreadProcessor.cpp \
 	../src/Utils.cpp
 
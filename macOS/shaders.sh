@@ -2,5 +2,8 @@
 
 $VULKAN_SDK/macOS/bin/glslangValidator -V res/Basic.vert -o res/Basic_vert.spv
 $VULKAN_SDK/macOS/bin/glslangValidator -V res/Basic.frag -o res/Basic_frag.spv
+$VULKAN_SDK/macOS/bin/glslangValidator -V res/Patch.vert -o res/Patch_vert.spv
+$VULKAN_SDK/macOS/bin/glslangValidator -V res/Patch.tesc -o res/Patch_tesc.spv
+$VULKAN_SDK/macOS/bin/glslangValidator -V res/Patch.tese -o res/Patch_tese.spv
 $VULKAN_SDK/macOS/bin/glslangValidator -V res/Font.vert -o res/Font_vert.spv
 $VULKAN_SDK/macOS/bin/glslangValidator -V res/Font.frag -o res/Font_frag.spv
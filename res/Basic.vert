@@ -4,10 +4,13 @@
 layout(binding = 0) uniform UniformBufferObject
 {
     mat4 ModelViewProjectionMatrix;
+    vec4 PositionScale; // packed vertex position decoding
+    vec4 PositionBias;
 } ubo;
 
 layout(push_constant) uniform BspPushConstants
 {
+    mat4 modelMatrix;
     float worldScaleFactor;
     int renderLightmaps;
     int useLightmaps;
@@ -29,7 +32,9 @@ out gl_PerVertex {
 };
 
 void main() {
-    gl_Position = ubo.ModelViewProjectionMatrix * vec4(inVertex * pc.worldScaleFactor, 1.0);
+    vec3 position = ubo.PositionBias.xyz + inVertex * ubo.PositionScale.xyz;
+    position = (pc.modelMatrix * vec4(position, 1.0)).xyz;
+    gl_Position = ubo.ModelViewProjectionMatrix * vec4(position * pc.worldScaleFactor, 1.0);
     TexCoord = inTexCoord;
     TexCoordLightmap = inTexCoordLightmap;
     renderLightmaps = pc.renderLightmaps;
@@ -0,0 +1,29 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(push_constant) uniform BspTessPushConstants
+{
+    mat4 modelMatrix;
+    float worldScaleFactor;
+    int renderLightmaps;
+    int useLightmaps;
+    int useAlphaTest;
+    vec2 viewportSize;
+    float pixelsPerEdge;
+    float maxTessLevel;
+} pc;
+
+layout(location = 0) in vec3 inVertex;
+layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in vec2 inTexCoordLightmap;
+
+// biquadratic patch control point - evaluated in tesselation shaders
+layout(location = 0) out vec3 ControlPoint;
+layout(location = 1) out vec2 TexCoord;
+layout(location = 2) out vec2 TexCoordLightmap;
+
+void main() {
+    ControlPoint = (pc.modelMatrix * vec4(inVertex, 1.0)).xyz * pc.worldScaleFactor;
+    TexCoord = inTexCoord;
+    TexCoordLightmap = inTexCoordLightmap;
+}
@@ -1,4 +1,7 @@
 %VULKAN_SDK%\bin32\glslangValidator.exe -V res/Basic.vert -o res/Basic_vert.spv
 %VULKAN_SDK%\bin32\glslangValidator.exe -V res/Basic.frag -o res/Basic_frag.spv
+%VULKAN_SDK%\bin32\glslangValidator.exe -V res/Patch.vert -o res/Patch_vert.spv
+%VULKAN_SDK%\bin32\glslangValidator.exe -V res/Patch.tesc -o res/Patch_tesc.spv
+%VULKAN_SDK%\bin32\glslangValidator.exe -V res/Patch.tese -o res/Patch_tese.spv
 %VULKAN_SDK%\bin32\glslangValidator.exe -V res/Font.vert -o res/Font_vert.spv
 %VULKAN_SDK%\bin32\glslangValidator.exe -V res/Font.frag -o res/Font_frag.spv
\ No newline at end of file
@@ -1,22 +1,29 @@
 #include <SDL.h>
 #include "Application.hpp"
-#include "StringHelpers.hpp"
+#include "MathBenchmark.hpp"
+#include "Metrics.hpp"
 #include "ThreadProcessor.hpp"
 #ifdef __APPLE__
 #include "apple/AppleUtils.hpp"
 #endif
 #include "renderer/CameraDirector.hpp"
 #include "renderer/RenderContext.hpp"
+#include "renderer/TextureManager.hpp"
 #include "q3bsp/Q3BspLoader.hpp"
 #include "q3bsp/Q3BspStatsUI.hpp"
+#include <algorithm>
 
 extern RenderContext  g_renderContext;
 extern CameraDirector g_cameraDirector;
 extern ThreadProcessor g_threadProcessor;
+extern Metrics         g_metrics;
 
 // append number of threads to application title
 static void AddThreadsToTitle()
 {
+    if (!g_renderContext.window)
+        return;
+
     int threadCnt = g_threadProcessor.NumThreads();
     std::string windowTitle(g_renderContext.WindowTitle());
     windowTitle.append(" (" + std::to_string(threadCnt) + " thread" + (threadCnt > 1 ? "s)" : ")"));
@@ -57,6 +64,10 @@ void Application::OnStart(int argc, char **argv)
 #elif TARGET_OS_IPHONE
     m_q3map = loader.Load((getResourcePath() + "maps/ntkjidm2.bsp").c_str());
 #else
+    const char *metricsPath = nullptr;
+    Metrics::Format metricsFormat = Metrics::FormatJSON;
+    float metricsInterval = 1.f;
+
     // assume the parameter with a string ".bsp" is the map we want to load
     for (int i = 1; i < argc; ++i)
     {
@@ -70,9 +81,83 @@ void Application::OnStart(int argc, char **argv)
             // spawn thread workers if MT is enabled
             g_threadProcessor.SpawnWorkers();
         }
+
+        if (!strcmp(argv[i], "-bake"))
+        {
+            // compress all textures of the map into .qtx containers with precomputed mips
+            TextureManager::GetInstance()->SetBakeTextures(true);
+        }
+
+        if (!strcmp(argv[i], "-views") && i + 1 < argc)
+        {
+            // render several views of the map at once, laid out in a grid
+            m_numViews = std::max(1, atoi(argv[++i]));
+        }
+
+        if (!strcmp(argv[i], "-tracebench") && i + 1 < argc)
+        {
+            // measure collision trace throughput on map load (results are shown in stats)
+            m_traceBenchmark = std::max(1, atoi(argv[++i]));
+        }
+
+        if (!strcmp(argv[i], "-leafbench") && i + 1 < argc)
+        {
+            // measure batched point to leaf query throughput on map load (results are shown in stats)
+            m_leafBenchmark = std::max(1, atoi(argv[++i]));
+        }
+
+        if (!strcmp(argv[i], "-entitybench") && i + 1 < argc)
+        {
+            // measure entity lump parse and classname lookup throughput on map load (results are shown in stats)
+            m_entityBenchmark = std::max(1, atoi(argv[++i]));
+        }
+
+        if (!strcmp(argv[i], "-mathbench") && i + 1 < argc)
+        {
+            // compare SIMD math kernels against their scalar versions and measure throughput of both (results are printed)
+            // mismatching results end the application with a non-zero exit code, so that the check can be scripted
+            if (!MathBenchmark::Run(std::max(1, atoi(argv[++i]))))
+            {
+                m_exitCode = 1;
+                Terminate();
+            }
+        }
+
+        if (!strcmp(argv[i], "-metrics") && i + 1 < argc)
+        {
+            // export frame and culling metrics to a file ("-" for stdout) - CSV if the file has .csv extension, JSON lines otherwise
+            metricsPath = argv[++i];
+            if (strlen(metricsPath) > 4 && !strcmp(metricsPath + strlen(metricsPath) - 4, ".csv"))
+                metricsFormat = Metrics::FormatCSV;
+        }
+
+        if (!strcmp(argv[i], "-metricsformat") && i + 1 < argc)
+        {
+            ++i;
+            metricsFormat = !strcmp(argv[i], "csv") ? Metrics::FormatCSV : Metrics::FormatJSON;
+        }
+
+        if (!strcmp(argv[i], "-metricsinterval") && i + 1 < argc)
+        {
+            // seconds between metrics exports
+            metricsInterval = (float)atof(argv[++i]);
+        }
+
+        if (!strcmp(argv[i], "-texbudget") && i + 1 < argc)
+        {
+            // override texture memory budget (in MB) - by default it's derived from device memory budget
+            TextureManager::GetInstance()->SetBudget((VkDeviceSize)atoi(argv[++i]) * 1024 * 1024);
+        }
     }
+
+    if (metricsPath)
+        g_metrics.Start(metricsPath, metricsFormat, metricsInterval);
 #endif
 
+    // stats overlay shows timings which differ between runs - keep offscreen frames reproducible
+    if (g_renderContext.Headless())
+        m_debugRenderState &= ~RenderMapStats;
+
     // print in window title how many threads are being used
     AddThreadsToTitle();
 
@@ -80,13 +165,28 @@ void Application::OnStart(int argc, char **argv)
     if (!m_q3map)
         m_q3map = new Q3BspMap(false);
 
+    m_q3map->SetNumViews(m_numViews);
+    m_q3map->SetTraceBenchmark(m_traceBenchmark);
+    m_q3map->SetLeafBenchmark(m_leafBenchmark);
+    m_q3map->SetEntityBenchmark(m_entityBenchmark);
     m_q3map->Init();
     m_q3map->ToggleRenderFlag(Q3RenderUseLightmaps);
 
-    // try to locate the first info_player_deathmatch entity and place the camera there
+    // map data is uploaded in the background while the rest of the scene is set up
+    vk::UploadQueue &uploads = *g_renderContext.Device().uploadQueue;
+    vk::flushUploads(g_renderContext.Device(), uploads);
+    LOG_MESSAGE("Load-time uploads: " << uploads.numCopies << " copies, " << uploads.numBytes / 1024 << "KB in " << uploads.numSubmits << " submissions");
+
+    // try to locate a player spawn entity and place the camera there
     Math::Vector3f startPos;
     if (m_q3map->Valid())
-        startPos = FindPlayerStart(static_cast<Q3BspMap *>(m_q3map)->entities.ents);
+    {
+        startPos = FindPlayerStart(static_cast<Q3BspMap *>(m_q3map)->entityTable);
+
+        // offscreen frames are kept reproducible, so movers stay in place
+        if (!g_renderContext.Headless())
+            FindMovers(static_cast<Q3BspMap *>(m_q3map)->entityTable);
+    }
 
     g_cameraDirector.AddCamera(startPos / Q3BspMap::s_worldScale,
                                Math::Vector3f(0.f, 0.f, 1.f),
@@ -95,6 +195,24 @@ void Application::OnStart(int argc, char **argv)
 
     // set to "clean" perspective matrix
     g_cameraDirector.GetActiveCamera()->SetMode(Camera::CAM_FPS);
+    m_viewCameras.push_back(g_cameraDirector.GetActiveCamera());
+
+    // extra views look around from the start position, evenly spread on the horizontal plane
+    for (int i = 1; i < m_numViews; ++i)
+    {
+        int camIdx = g_cameraDirector.AddCamera(startPos / Q3BspMap::s_worldScale,
+                                                Math::Vector3f(0.f, 0.f, 1.f),
+                                                Math::Vector3f(1.f, 0.f, 0.f),
+                                                Math::Vector3f(0.f, 1.f, 0.f)) - 1;
+
+        Camera *camera = g_cameraDirector.GetCamera(camIdx);
+        camera->SetMode(Camera::CAM_FPS);
+        camera->rotateY((float)(2.0 * PI * i / m_numViews));
+        m_viewCameras.push_back(camera);
+    }
+
+    // player keeps controlling the first camera
+    g_cameraDirector.SetActiveCamera(0);
 
     m_q3stats = new Q3StatsUI(m_q3map);
 }
@@ -127,9 +245,12 @@ void Application::OnUpdate(float dt)
 {
     UpdateCamera(dt);
 
+    // movers have to be in place before visibility is calculated
+    AnimateMovers(dt);
+
     // determine which faces are visible
     if (m_q3map->Valid() && !m_noRedraw)
-        m_q3map->OnUpdate(g_cameraDirector.GetActiveCamera()->Position());
+        UpdateViews();
 }
 
 void Application::UpdateStats()
@@ -144,6 +265,7 @@ void Application::UpdateStats()
 void Application::OnTerminate()
 {
     vkDeviceWaitIdle(g_renderContext.Device().logical);
+    g_metrics.Stop();
     delete m_q3stats;
     delete m_q3map;
 }
@@ -187,8 +309,6 @@ void Application::OnKeyPress(KeyCode key)
     case KEY_F8:
         m_q3map->ToggleRenderFlag(Q3Multisampling);
         g_renderContext.ToggleMSAA();
-        m_q3map->RebuildPipeline();
-        m_q3stats->RebuildPipeline();
         break;
     case KEY_F9:
         // reset window title if disabling thread statistics
@@ -196,6 +316,15 @@ void Application::OnKeyPress(KeyCode key)
             AddThreadsToTitle();
         m_debugRenderState ^= PrintThreadStats;
         break;
+    case KEY_F10:
+        m_q3map->ToggleRenderFlag(Q3RenderUseMDI);
+        break;
+    case KEY_F11:
+        m_q3map->ToggleRenderFlag(Q3RenderHWTesselation);
+        break;
+    case KEY_N:
+        m_cameraCollision = !m_cameraCollision;
+        break;
     case KEY_TILDE:
         m_debugRenderState ^= RenderMapStats;
         break;
@@ -220,6 +349,7 @@ void Application::OnMouseMove(int x, int y)
 void Application::UpdateCamera(float dt)
 {
     static const float movementSpeed = 8.f;
+    Math::Vector3f oldPosition = g_cameraDirector.GetActiveCamera()->Position();
 
     if (KeyPressed(KEY_A))
         g_cameraDirector.GetActiveCamera()->Strafe(-movementSpeed * dt);
@@ -246,75 +376,164 @@ void Application::UpdateCamera(float dt)
 
     if (KeyPressed(KEY_F))
         g_cameraDirector.GetActiveCamera()->MoveUpward(-movementSpeed * dt);
+
+    if (m_cameraCollision && m_q3map->Valid())
+        ClipCameraMove(oldPosition);
 }
 
-Math::Vector3f Application::FindPlayerStart(const char *entities)
+void Application::ClipCameraMove(const Math::Vector3f &oldPosition)
 {
-    std::string str(entities);
-    Math::Vector3f result(0.0f, 0.0f, 4.0f); // some arbitrary position in case there's no info_player_deathmatch on map
-    size_t pos = 0;
+    static const float cameraRadius = 8.f; // in bsp units
+    static const int   maxClipPlanes = 3;  // enough to slide out of corners
 
-    std::string playerStartCoords("");
+    Camera *camera = g_cameraDirector.GetActiveCamera();
+    Math::Vector3f start = oldPosition * Q3BspMap::s_worldScale;
+    Math::Vector3f end = camera->Position() * Q3BspMap::s_worldScale;
 
-    while (pos != std::string::npos)
+    for (int i = 0; i < maxClipPlanes; ++i)
     {
-        size_t posOpen = str.find("{", pos);
-        size_t posClose = str.find("}", posOpen);
+        BspTrace trace;
+        trace.start = start;
+        trace.end = end;
+        trace.mins = Math::Vector3f(-cameraRadius, -cameraRadius, -cameraRadius);
+        trace.maxs = Math::Vector3f(cameraRadius, cameraRadius, cameraRadius);
+        m_q3map->Trace(trace);
+
+        // camera is already stuck in a brush (e.g. collision was just enabled) - let it move out freely
+        if (trace.startSolid)
+            return;
+
+        start = trace.endPos;
+        if (trace.fraction == 1.f)
+            break;
+
+        // slide along the hit plane: remove the part of remaining move going into it
+        Math::Vector3f remaining = end - start;
+        end = end - trace.normal * remaining.DotProduct(trace.normal);
+    }
 
-        if (posOpen != std::string::npos)
-        {
-            std::string entity = str.substr(posOpen + 1, posClose - posOpen - 1);
-            if (FindEntityAttribute(entity, "info_player_deathmatch", "origin", playerStartCoords))
-                break;
-        }
+    camera->SetPosition(start / Q3BspMap::s_worldScale);
+}
 
-        pos = posClose;
-    }
+void Application::UpdateViews()
+{
+    // lay out views in a grid - each view keeps the aspect ratio of its cell
+    int cols = (int)ceilf(sqrtf((float)m_viewCameras.size()));
+    int rows = ((int)m_viewCameras.size() + cols - 1) / cols;
 
-    if (!playerStartCoords.empty())
+    std::vector<BspView> views(m_viewCameras.size());
+    for (size_t i = 0; i < m_viewCameras.size(); ++i)
     {
-        auto coords = StringHelpers::tokenizeString(playerStartCoords.c_str(), ' ');
-
-        result.m_x = std::stof(coords[0]);
-        result.m_y = std::stof(coords[1]);
-        result.m_z = std::stof(coords[2]);
+        Camera *camera = m_viewCameras[i];
+        camera->SetAspectRatio(g_renderContext.scrRatio * rows / cols);
+        camera->UpdateView();
+
+        views[i].position = camera->Position();
+        views[i].viewProjection = camera->ViewMatrix() * camera->ProjectionMatrix();
+        views[i].x = (float)(i % cols) / cols;
+        views[i].y = (float)(i / cols) / rows;
+        views[i].width  = 1.f / cols;
+        views[i].height = 1.f / rows;
     }
 
-    return result;
+    m_q3map->OnUpdate(views);
 }
 
-bool Application::FindEntityAttribute(const std::string &entity, const char *entityName, const char *attribName, std::string &output)
+Math::Vector3f Application::FindPlayerStart(const Q3BspEntities &entities)
 {
-    output.clear();
-    std::string trimmedEntity = StringHelpers::trim(entity, '\n');
-    std::string attribValueFinal("");
-    std::string attribValueRead("");
-    bool attribFound = false;
+    Math::Vector3f result(0.0f, 0.0f, 4.0f); // some arbitrary position in case there are no player spawns on map
 
-    auto tokens = StringHelpers::tokenizeString(trimmedEntity.c_str(), '\n');
+    // prefer deathmatch spawns, then any other info_player_* entity (info_player_start, info_player_intermission)
+    std::vector<int> spawns = entities.FindByClassname("info_player_deathmatch");
+    entities.FindByClassnamePrefix("info_player_", spawns);
 
-    for (auto &t : tokens)
+    for (int spawn : spawns)
     {
-        auto attribs = StringHelpers::tokenizeString(t.c_str(), ' ', 2);
+        if (entities.FindVector(spawn, "origin", result))
+            break;
+    }
+
+    return result;
+}
 
-        for (auto &a : attribs)
+void Application::FindMovers(const Q3BspEntities &entities)
+{
+    static const char *classnames[] = { "func_rotating", "func_bobbing" };
+
+    for (const char *classname : classnames)
+    {
+        for (int e : entities.FindByClassname(classname))
         {
-            a = StringHelpers::trim(a, '"');
+            Q3BspEntityString model;
+            if (!entities.FindValue(e, "model", model) || !model.StartsWith("*"))
+                continue;
+
+            Mover mover;
+            mover.model = atoi(model.ToString().c_str() + 1);
+            mover.rotating = !strcmp(classname, "func_rotating");
+
+            Math::Vector3f origin;
+            if (entities.FindVector(e, "origin", origin))
+            {
+                mover.origin[0] = origin.m_x;
+                mover.origin[1] = origin.m_y;
+                mover.origin[2] = origin.m_z;
+            }
+
+            // same defaults and spawnflags as in Quake III game code
+            float spawnflags = 0.f;
+            entities.FindFloat(e, "spawnflags", spawnflags);
+            int flags = (int)spawnflags;
+
+            if (mover.rotating)
+            {
+                mover.speed = 100.f;
+                mover.axis  = (flags & 4) ? 0 : (flags & 8) ? 1 : 2;
+            }
+            else
+            {
+                mover.speed  = 4.f;
+                mover.height = 32.f;
+                mover.axis   = (flags & 1) ? 0 : (flags & 2) ? 1 : 2;
+                entities.FindFloat(e, "height", mover.height);
+                entities.FindFloat(e, "phase", mover.phase);
+            }
+
+            entities.FindFloat(e, "speed", mover.speed);
+            m_movers.push_back(mover);
         }
+    }
+}
+
+// movers only change their transform - map geometry is never touched
+void Application::AnimateMovers(float dt)
+{
+    m_moverTime += dt;
+
+    for (const auto &mover : m_movers)
+    {
+        Math::Matrix4f transform;
+        float position[3] = { mover.origin[0], mover.origin[1], mover.origin[2] };
 
-        if (!strncmp(attribs[0].c_str(), attribName, strlen(attribs[0].c_str())))
+        if (mover.rotating)
         {
-            attribValueRead = attribs[1];
+            // rotation around entity origin (column-major matrix)
+            float angle = fmodf(m_moverTime * mover.speed, 360.f) * (float)PI / 180.f;
+            int a = (mover.axis + 1) % 3;
+            int b = (mover.axis + 2) % 3;
+            transform[a * 4 + a] =  cosf(angle);
+            transform[a * 4 + b] =  sinf(angle);
+            transform[b * 4 + a] = -sinf(angle);
+            transform[b * 4 + b] =  cosf(angle);
         }
-
-        if (!strncmp(attribs[1].c_str(), entityName, strlen(attribs[1].c_str())))
+        else if (mover.speed > 0.f)
         {
-            attribFound = true;
+            position[mover.axis] += sinf((m_moverTime / mover.speed + mover.phase) * 2.f * (float)PI) * mover.height;
         }
-    }
 
-    if (attribFound)
-        output = attribValueRead;
-
-    return attribFound;
+        transform[12] = position[0];
+        transform[13] = position[1];
+        transform[14] = position[2];
+        m_q3map->SetModelTransform(mover.model, transform);
+    }
 }
@@ -3,10 +3,13 @@
 
 #include <map>
 #include <string>
+#include <vector>
 #include "InputHandlers.hpp"
 #include "Math.hpp"
 
 class BspMap;
+class Camera;
+class Q3BspEntities;
 class StatsUI;
 
 /*
@@ -27,11 +30,14 @@ public:
 
     inline bool Running() const { return m_running; }
     inline void Terminate() { m_running = false; }
+    inline int  ExitCode() const { return m_exitCode; }
 
     bool KeyPressed(KeyCode key);
     void OnKeyPress(KeyCode key);
     void OnKeyRelease(KeyCode key);
     void OnMouseMove(int x, int y);
+
+    inline bool CameraCollision() const { return m_cameraCollision; }
 private:
     enum DebugRender : uint8_t
     {
@@ -41,17 +47,42 @@ private:
     };
 
     void UpdateCamera(float dt);
+    void ClipCameraMove(const Math::Vector3f &oldPosition);
+    void UpdateViews();
     inline void SetKeyPressed(KeyCode key, bool pressed) { m_keyStates[key] = pressed; }
 
-    // helper functions for parsing Quake entities
-    Math::Vector3f FindPlayerStart(const char *entities);
-    bool FindEntityAttribute(const std::string &entity, const char *entityName, const char *attribName, std::string &output);
+    // camera start position from map entities
+    Math::Vector3f FindPlayerStart(const Q3BspEntities &entities);
+
+    // brush models moving on their own, animated the same way as in Quake III
+    struct Mover
+    {
+        int   model    = 0;
+        bool  rotating = false; // func_rotating, otherwise func_bobbing
+        int   axis     = 2;     // axis of rotation or movement
+        float speed    = 0.f;   // degrees per second (rotating) or seconds per cycle (bobbing)
+        float height   = 0.f;   // bobbing amplitude (bsp units)
+        float phase    = 0.f;   // bobbing phase (fraction of a cycle)
+        float origin[3] = { 0.f, 0.f, 0.f };
+    };
+
+    void FindMovers(const Q3BspEntities &entities);
+    void AnimateMovers(float dt);
 
     bool m_running     = true;    // application is running
+    int  m_exitCode    = 0;       // returned from main() - non-zero if a requested benchmark failed
     bool m_noRedraw    = false;   // do not perform window redraw
     BspMap  *m_q3map   = nullptr; // loaded map
     StatsUI *m_q3stats = nullptr; // map stats UI
     uint8_t  m_debugRenderState = RenderMapStats;
+    int      m_numViews = 1;      // number of views rendered side by side
+    int      m_traceBenchmark = 0; // number of random traces fired to measure collision throughput (0 - disabled)
+    int      m_leafBenchmark  = 0; // number of random points classified into leaves to measure query throughput (0 - disabled)
+    int      m_entityBenchmark = 0; // number of times the entity lump is parsed to measure parse and lookup throughput (0 - disabled)
+    bool     m_cameraCollision = false; // camera slides along map brushes instead of flying through them
+    std::vector<Camera *> m_viewCameras; // camera of each view (first one is controlled by the player)
+    std::vector<Mover> m_movers;
+    float m_moverTime = 0.f;
 
     std::map<KeyCode, bool> m_keyStates;
 };
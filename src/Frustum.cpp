@@ -4,17 +4,22 @@
 extern RenderContext g_renderContext;
 
 void Frustum::UpdatePlanes()
+{
+    UpdatePlanes(g_renderContext.ModelViewProjectionMatrix);
+}
+
+void Frustum::UpdatePlanes(const Math::Matrix4f &mvpMatrix)
 {
     // extract each plane from MVP matrix
-    ExtractPlane(m_planes[0], g_renderContext.ModelViewProjectionMatrix,  1);
-    ExtractPlane(m_planes[1], g_renderContext.ModelViewProjectionMatrix, -1);
-    ExtractPlane(m_planes[2], g_renderContext.ModelViewProjectionMatrix,  2);
-    ExtractPlane(m_planes[3], g_renderContext.ModelViewProjectionMatrix, -2);
-    ExtractPlane(m_planes[4], g_renderContext.ModelViewProjectionMatrix,  3);
-    ExtractPlane(m_planes[5], g_renderContext.ModelViewProjectionMatrix, -3);
+    ExtractPlane(m_planes[0], mvpMatrix,  1);
+    ExtractPlane(m_planes[1], mvpMatrix, -1);
+    ExtractPlane(m_planes[2], mvpMatrix,  2);
+    ExtractPlane(m_planes[3], mvpMatrix, -2);
+    ExtractPlane(m_planes[4], mvpMatrix,  3);
+    ExtractPlane(m_planes[5], mvpMatrix, -3);
 }
 
-bool Frustum::BoxInFrustum(const Math::Vector3f *vertices)
+bool Frustum::BoxInFrustum(const Math::Vector3f *vertices) const
 {
     for (int i = 0; i < 6; ++i)
     {
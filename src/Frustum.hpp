@@ -16,7 +16,8 @@ class Frustum
 {
 public:
     void UpdatePlanes();
-    bool BoxInFrustum(const Math::Vector3f *vertices);
+    void UpdatePlanes(const Math::Matrix4f &mvpMatrix);
+    bool BoxInFrustum(const Math::Vector3f *vertices) const;
 
 private:
     void ExtractPlane(Plane &plane, const Math::Matrix4f &mvpMatrix, int row);
@@ -1,4 +1,12 @@
 #include "Math.hpp"
+#if defined(MATH_SSE)
+#include <emmintrin.h>
+#elif defined(MATH_NEON)
+#include <arm_neon.h>
+#endif
+
+// matrices are often members of heap allocated objects, which may be only 8 byte aligned on 32 bit platforms - inputs
+// are read with unaligned loads (no slower than aligned ones on aligned data), aligned stores only target locals
 
 namespace Math
 {
@@ -76,34 +84,38 @@ namespace Math
 
     Vector4f Matrix4f::operator*(const Vector4f &v) const
     {
-        return Vector4f(m_m[0]  * v.m_x + m_m[1]  * v.m_y + m_m[2]  * v.m_z + m_m[3]  * 1.f,
-                        m_m[4]  * v.m_x + m_m[5]  * v.m_y + m_m[6]  * v.m_z + m_m[7]  * 1.f,
-                        m_m[8]  * v.m_x + m_m[9]  * v.m_y + m_m[10] * v.m_z + m_m[11] * 1.f,
-                        m_m[12] * v.m_x + m_m[13] * v.m_y + m_m[14] * v.m_z + m_m[15] * 1.f);
+#if defined(MATH_SSE)
+        // transposed rows are matrix columns - result is their sum weighted by vector components
+        __m128 c0 = _mm_loadu_ps(&m_m[0]);
+        __m128 c1 = _mm_loadu_ps(&m_m[4]);
+        __m128 c2 = _mm_loadu_ps(&m_m[8]);
+        __m128 c3 = _mm_loadu_ps(&m_m[12]);
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+        __m128 r = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(v.m_x)), _mm_mul_ps(c1, _mm_set1_ps(v.m_y)));
+        r = _mm_add_ps(_mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(v.m_z))), c3);
+
+        Vector4f result;
+        _mm_store_ps(&result.m_x, r);
+        return result;
+#elif defined(MATH_NEON)
+        // interleaved load splits the matrix into columns
+        float32x4x4_t c = vld4q_f32(m_m);
+        float32x4_t r = vaddq_f32(vmulq_n_f32(c.val[0], v.m_x), vmulq_n_f32(c.val[1], v.m_y));
+        r = vaddq_f32(vaddq_f32(r, vmulq_n_f32(c.val[2], v.m_z)), c.val[3]);
+
+        Vector4f result;
+        vst1q_f32(&result.m_x, r);
+        return result;
+#else
+        return Scalar::Multiply(*this, v);
+#endif
     }
 
     Matrix4f Matrix4f::operator*(const Matrix4f &m2) const
     {
-        return Matrix4f(m_m[0] * m2[0] + m_m[1] * m2[4] + m_m[2] * m2[8]  + m_m[3] * m2[12],
-                        m_m[0] * m2[1] + m_m[1] * m2[5] + m_m[2] * m2[9]  + m_m[3] * m2[13],
-                        m_m[0] * m2[2] + m_m[1] * m2[6] + m_m[2] * m2[10] + m_m[3] * m2[14],
-                        m_m[0] * m2[3] + m_m[1] * m2[7] + m_m[2] * m2[11] + m_m[3] * m2[15], 
-                        
-                        m_m[4] * m2[0] + m_m[5] * m2[4] + m_m[6] * m2[8]  + m_m[7] * m2[12],
-                        m_m[4] * m2[1] + m_m[5] * m2[5] + m_m[6] * m2[9]  + m_m[7] * m2[13],
-                        m_m[4] * m2[2] + m_m[5] * m2[6] + m_m[6] * m2[10] + m_m[7] * m2[14],
-                        m_m[4] * m2[3] + m_m[5] * m2[7] + m_m[6] * m2[11] + m_m[7] * m2[15],
-
-                        m_m[8] * m2[0] + m_m[9] * m2[4] + m_m[10] * m2[8]  + m_m[11] * m2[12],
-                        m_m[8] * m2[1] + m_m[9] * m2[5] + m_m[10] * m2[9]  + m_m[11] * m2[13],
-                        m_m[8] * m2[2] + m_m[9] * m2[6] + m_m[10] * m2[10] + m_m[11] * m2[14],
-                        m_m[8] * m2[3] + m_m[9] * m2[7] + m_m[10] * m2[11] + m_m[11] * m2[15],
-
-                        m_m[12] * m2[0] + m_m[13] * m2[4] + m_m[14] * m2[8]  + m_m[15] * m2[12],
-                        m_m[12] * m2[1] + m_m[13] * m2[5] + m_m[14] * m2[9]  + m_m[15] * m2[13],
-                        m_m[12] * m2[2] + m_m[13] * m2[6] + m_m[14] * m2[10] + m_m[15] * m2[14],
-                        m_m[12] * m2[3] + m_m[13] * m2[7] + m_m[14] * m2[11] + m_m[15] * m2[15]
-                        );
+        // compilers vectorize the scalar version about as well as hand written intrinsics
+        return Scalar::Multiply(*this, m2);
     }
 
 /*
@@ -194,10 +206,40 @@ namespace Math
 
     Quaternion Quaternion::operator*(const Quaternion &q2) const
     {
-        return Quaternion( m_w*q2.m_x + m_x*q2.m_w + m_y*q2.m_z - m_z*q2.m_y,
-                           m_w*q2.m_y - m_x*q2.m_z + m_y*q2.m_w + m_z*q2.m_x,
-                           m_w*q2.m_z + m_x*q2.m_y - m_y*q2.m_x + m_z*q2.m_w,
-                           m_w*q2.m_w - m_x*q2.m_x - m_y*q2.m_y - m_z*q2.m_z );
+#if defined(MATH_SSE)
+        // lanes hold x, y, z, w - every component of this quaternion scales a swizzled and sign flipped q2
+        const __m128 signs1 = _mm_castsi128_ps(_mm_set_epi32((int)0x80000000, 0, (int)0x80000000, 0));
+        const __m128 signs2 = _mm_castsi128_ps(_mm_set_epi32((int)0x80000000, (int)0x80000000, 0, 0));
+        const __m128 signs3 = _mm_castsi128_ps(_mm_set_epi32((int)0x80000000, 0, 0, (int)0x80000000));
+        const __m128 b = _mm_loadu_ps(&q2.m_x);
+
+        __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m_w), b),
+                              _mm_mul_ps(_mm_set1_ps(m_x), _mm_xor_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 1, 2, 3)), signs1)));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m_y), _mm_xor_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2)), signs2)));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m_z), _mm_xor_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1)), signs3)));
+
+        Quaternion result;
+        _mm_store_ps(&result.m_x, r);
+        return result;
+#elif defined(MATH_NEON)
+        static const float signs1[4] = { 1.f, -1.f,  1.f, -1.f };
+        static const float signs2[4] = { 1.f,  1.f, -1.f, -1.f };
+        static const float signs3[4] = { -1.f, 1.f,  1.f, -1.f };
+        const float32x4_t b = vld1q_f32(&q2.m_x);
+        const float32x4_t bZWXY = vcombine_f32(vget_high_f32(b), vget_low_f32(b));
+        const float32x4_t bWZYX = vrev64q_f32(bZWXY);
+        const float32x4_t bYXWZ = vrev64q_f32(b);
+
+        float32x4_t r = vaddq_f32(vmulq_n_f32(b, m_w), vmulq_n_f32(vmulq_f32(bWZYX, vld1q_f32(signs1)), m_x));
+        r = vaddq_f32(r, vmulq_n_f32(vmulq_f32(bZWXY, vld1q_f32(signs2)), m_y));
+        r = vaddq_f32(r, vmulq_n_f32(vmulq_f32(bYXWZ, vld1q_f32(signs3)), m_z));
+
+        Quaternion result;
+        vst1q_f32(&result.m_x, r);
+        return result;
+#else
+        return Scalar::Multiply(*this, q2);
+#endif
     }
 
 
@@ -237,6 +279,27 @@ namespace Math
         return y;
     }
 
+    unsigned short FloatToHalf( float number )
+    {
+        unsigned int i = * ( unsigned int * ) &number;
+        unsigned int sign = ( i >> 16 ) & 0x8000;
+        int exponent = (int)( ( i >> 23 ) & 0xff ) - 127 + 15;
+        unsigned int mantissa = i & 0x7fffff;
+
+        if( exponent <= 0 )
+            return (unsigned short)sign;
+
+        if( exponent >= 31 )
+            return (unsigned short)( sign | 0x7c00 );
+
+        // round to nearest - a carry into the exponent still yields correct result
+        unsigned int half = sign | ( exponent << 10 ) | ( mantissa >> 13 );
+        if( mantissa & 0x1000 )
+            ++half;
+
+        return (unsigned short)half;
+    }
+
     int PointPlanePos(float normalX, float normalY, float normalZ, float intercept, const Math::Vector3f &point)
     {
         float distance = point.m_x * normalX + point.m_y * normalY + point.m_z * normalZ - intercept;
@@ -290,6 +353,102 @@ namespace Math
         matrix[15] *= sw;
     }
 
+    void TransformPoints(const Matrix4f &matrix, const Vector3f *points, size_t count, Vector3f *out)
+    {
+        static_assert(sizeof(Vector3f) == sizeof(float) * 3, "points are accessed as packed floats");
+        size_t i = 0;
+#if defined(MATH_SSE)
+        const __m128 m0 = _mm_set1_ps(matrix[0]), m1 = _mm_set1_ps(matrix[1]), m2  = _mm_set1_ps(matrix[2]),  m3  = _mm_set1_ps(matrix[3]);
+        const __m128 m4 = _mm_set1_ps(matrix[4]), m5 = _mm_set1_ps(matrix[5]), m6  = _mm_set1_ps(matrix[6]),  m7  = _mm_set1_ps(matrix[7]);
+        const __m128 m8 = _mm_set1_ps(matrix[8]), m9 = _mm_set1_ps(matrix[9]), m10 = _mm_set1_ps(matrix[10]), m11 = _mm_set1_ps(matrix[11]);
+
+        // 4 points at a time: 12 packed floats are shuffled into x, y, z lanes and back after transforming
+        for (; i + 4 <= count; i += 4)
+        {
+            const float *src = &points[i].m_x;
+            __m128 a = _mm_loadu_ps(src);     // x0 y0 z0 x1
+            __m128 b = _mm_loadu_ps(src + 4); // y1 z1 x2 y2
+            __m128 c = _mm_loadu_ps(src + 8); // z2 x3 y3 z3
+
+            __m128 x = _mm_shuffle_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 0, 0)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+
+            __m128 rx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x), _mm_mul_ps(m1, y)), _mm_mul_ps(m2,  z)), m3);
+            __m128 ry = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m4, x), _mm_mul_ps(m5, y)), _mm_mul_ps(m6,  z)), m7);
+            __m128 rz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m8, x), _mm_mul_ps(m9, y)), _mm_mul_ps(m10, z)), m11);
+
+            float *dst = &out[i].m_x;
+            _mm_storeu_ps(dst,     _mm_shuffle_ps(_mm_shuffle_ps(rx, ry, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(rz, rx, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(dst + 4, _mm_shuffle_ps(_mm_shuffle_ps(ry, rz, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(rx, ry, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(dst + 8, _mm_shuffle_ps(_mm_shuffle_ps(rz, rx, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(ry, rz, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+        }
+#elif defined(MATH_NEON)
+        // interleaved loads and stores split 4 points into x, y, z lanes and back
+        for (; i + 4 <= count; i += 4)
+        {
+            float32x4x3_t p = vld3q_f32(&points[i].m_x);
+            float32x4x3_t r;
+
+            r.val[0] = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_n_f32(p.val[0], matrix[0]), vmulq_n_f32(p.val[1], matrix[1])), vmulq_n_f32(p.val[2], matrix[2])),  vdupq_n_f32(matrix[3]));
+            r.val[1] = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_n_f32(p.val[0], matrix[4]), vmulq_n_f32(p.val[1], matrix[5])), vmulq_n_f32(p.val[2], matrix[6])),  vdupq_n_f32(matrix[7]));
+            r.val[2] = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_n_f32(p.val[0], matrix[8]), vmulq_n_f32(p.val[1], matrix[9])), vmulq_n_f32(p.val[2], matrix[10])), vdupq_n_f32(matrix[11]));
+            vst3q_f32(&out[i].m_x, r);
+        }
+#endif
+        // remaining points (or all of them in scalar builds)
+        if (i < count)
+            Scalar::TransformPoints(matrix, points + i, count - i, out + i);
+    }
+
+    namespace Scalar
+    {
+        Vector4f Multiply(const Matrix4f &m, const Vector4f &v)
+        {
+            return Vector4f(m[0]  * v.m_x + m[1]  * v.m_y + m[2]  * v.m_z + m[3]  * 1.f,
+                            m[4]  * v.m_x + m[5]  * v.m_y + m[6]  * v.m_z + m[7]  * 1.f,
+                            m[8]  * v.m_x + m[9]  * v.m_y + m[10] * v.m_z + m[11] * 1.f,
+                            m[12] * v.m_x + m[13] * v.m_y + m[14] * v.m_z + m[15] * 1.f);
+        }
+
+        Matrix4f Multiply(const Matrix4f &m1, const Matrix4f &m2)
+        {
+            return Matrix4f(m1[0] * m2[0] + m1[1] * m2[4] + m1[2] * m2[8]  + m1[3] * m2[12],
+                            m1[0] * m2[1] + m1[1] * m2[5] + m1[2] * m2[9]  + m1[3] * m2[13],
+                            m1[0] * m2[2] + m1[1] * m2[6] + m1[2] * m2[10] + m1[3] * m2[14],
+                            m1[0] * m2[3] + m1[1] * m2[7] + m1[2] * m2[11] + m1[3] * m2[15],
+
+                            m1[4] * m2[0] + m1[5] * m2[4] + m1[6] * m2[8]  + m1[7] * m2[12],
+                            m1[4] * m2[1] + m1[5] * m2[5] + m1[6] * m2[9]  + m1[7] * m2[13],
+                            m1[4] * m2[2] + m1[5] * m2[6] + m1[6] * m2[10] + m1[7] * m2[14],
+                            m1[4] * m2[3] + m1[5] * m2[7] + m1[6] * m2[11] + m1[7] * m2[15],
+
+                            m1[8] * m2[0] + m1[9] * m2[4] + m1[10] * m2[8]  + m1[11] * m2[12],
+                            m1[8] * m2[1] + m1[9] * m2[5] + m1[10] * m2[9]  + m1[11] * m2[13],
+                            m1[8] * m2[2] + m1[9] * m2[6] + m1[10] * m2[10] + m1[11] * m2[14],
+                            m1[8] * m2[3] + m1[9] * m2[7] + m1[10] * m2[11] + m1[11] * m2[15],
+
+                            m1[12] * m2[0] + m1[13] * m2[4] + m1[14] * m2[8]  + m1[15] * m2[12],
+                            m1[12] * m2[1] + m1[13] * m2[5] + m1[14] * m2[9]  + m1[15] * m2[13],
+                            m1[12] * m2[2] + m1[13] * m2[6] + m1[14] * m2[10] + m1[15] * m2[14],
+                            m1[12] * m2[3] + m1[13] * m2[7] + m1[14] * m2[11] + m1[15] * m2[15]);
+        }
+
+        Quaternion Multiply(const Quaternion &q1, const Quaternion &q2)
+        {
+            return Quaternion( q1.m_w*q2.m_x + q1.m_x*q2.m_w + q1.m_y*q2.m_z - q1.m_z*q2.m_y,
+                               q1.m_w*q2.m_y - q1.m_x*q2.m_z + q1.m_y*q2.m_w + q1.m_z*q2.m_x,
+                               q1.m_w*q2.m_z + q1.m_x*q2.m_y - q1.m_y*q2.m_x + q1.m_z*q2.m_w,
+                               q1.m_w*q2.m_w - q1.m_x*q2.m_x - q1.m_y*q2.m_y - q1.m_z*q2.m_z );
+        }
+
+        void TransformPoints(const Matrix4f &matrix, const Vector3f *points, size_t count, Vector3f *out)
+        {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = matrix * points[i];
+        }
+    }
+
     // create perspective projection matrix
     void MakePerspective(Math::Matrix4f &matrix, float fov, float scrRatio, float nearPlane, float farPlane)
     {
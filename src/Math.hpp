@@ -2,11 +2,19 @@
 #define MATH_INCLUDED
 
 #include <math.h>
+#include <stddef.h>
 
 /*
  * Basic math structures (vectors, quaternions, matrices)
  */
 
+// matrix-vector, quaternion and batched point transforms use SIMD where available - define MATH_FORCE_SCALAR to build plain C++ versions
+#if !defined(MATH_FORCE_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MATH_SSE
+#elif !defined(MATH_FORCE_SCALAR) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define MATH_NEON
+#endif
+
 #define PI 3.1415926535897932384626433832795
 #define PIdiv180inv 57.29577951308f
 #define PIdiv180    0.01745329251f
@@ -53,7 +61,7 @@ namespace Math
     };
 
     // 4D vector
-    struct Vector4f
+    struct alignas(16) Vector4f
     {
         Vector4f() {}
         Vector4f(float x, float y, float z, float w) : m_x(x), m_y(y), m_z(z), m_w(w) {}
@@ -64,7 +72,7 @@ namespace Math
         float m_w = 0.f;
     };
 
-    struct Matrix4f
+    struct alignas(16) Matrix4f
     {
         Matrix4f()
         {
@@ -132,7 +140,7 @@ namespace Math
 
 
     // quaternion
-    class Quaternion
+    class alignas(16) Quaternion
     {
     public:
         Quaternion() {}
@@ -171,9 +179,24 @@ namespace Math
     // quick inverse square root
     float QuickInverseSqrt( float number );
 
+    // convert 32 bit float to 16 bit half float (denormals are flushed to zero)
+    unsigned short FloatToHalf( float number );
+
     // determine whether a point is in front of or behind a plane (based on its normal vector)
     int PointPlanePos(float normalX, float normalY, float normalZ, float intercept, const Math::Vector3f &point);
 
+    // transform count points by matrix (same as matrix * point) - points and out may be the same array
+    void TransformPoints(const Matrix4f &matrix, const Vector3f *points, size_t count, Vector3f *out);
+
+    // plain C++ implementations - reference for validating and measuring SIMD versions (Matrix4f * Matrix4f always uses this one)
+    namespace Scalar
+    {
+        Vector4f   Multiply(const Matrix4f &m, const Vector4f &v);
+        Matrix4f   Multiply(const Matrix4f &m1, const Matrix4f &m2);
+        Quaternion Multiply(const Quaternion &q1, const Quaternion &q2);
+        void TransformPoints(const Matrix4f &matrix, const Vector3f *points, size_t count, Vector3f *out);
+    }
+
     // translate matrix by (x,y,z)
     void Translate(Matrix4f &matrix, float x, float y=0.0f, float z=0.0f);
     // scale matrix by (x,y,z)
@@ -0,0 +1,97 @@
+#include "MathBenchmark.hpp"
+#include "Math.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+static const float s_tolerance = 1e-5f; // relative to magnitude of compared values
+
+static float relativeError(const float *a, const float *b, int count)
+{
+    float maxError = 0.f;
+    for (int i = 0; i < count; ++i)
+        maxError = std::max(maxError, fabsf(a[i] - b[i]) / std::max(1.f, fabsf(b[i])));
+
+    return maxError;
+}
+
+// run func for each element and return time spent in seconds
+template<typename Func>
+static float measure(int count, Func func)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < count; ++i)
+        func(i);
+
+    return std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// printed in release builds too - the benchmark is run explicitly and its output is the whole point
+static void logResult(const char *name, int count, float scalarTime, float simdTime, float error)
+{
+    std::stringstream msgStr;
+    msgStr << name << ": " << (scalarTime > 0.f ? count / scalarTime : 0.f) << " ops/s scalar, "
+           << (simdTime > 0.f ? count / simdTime : 0.f) << " ops/s SIMD, max error " << error;
+    LogError(msgStr.str().c_str());
+}
+
+bool MathBenchmark::Run(int iterations)
+{
+    if (iterations <= 0)
+        return true;
+
+    // fixed seed - results are comparable between runs
+    std::mt19937 rng(1337);
+    std::uniform_real_distribution<float> r(-100.f, 100.f);
+
+    std::vector<Math::Matrix4f> matrices(iterations);
+    std::vector<Math::Vector4f> vectors(iterations), vectorResults(iterations), vectorReference(iterations);
+    std::vector<Math::Quaternion> quats(iterations), quatResults(iterations), quatReference(iterations);
+    std::vector<Math::Vector3f> points(iterations), pointResults(iterations), pointReference(iterations);
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (int j = 0; j < 16; ++j)
+            matrices[i][j] = r(rng);
+
+        vectors[i] = Math::Vector4f(r(rng), r(rng), r(rng), 1.f);
+        quats[i] = Math::Quaternion(Math::Vector3f(r(rng), r(rng), r(rng)), r(rng));
+        quats[i].Normalize();
+        points[i] = Math::Vector3f(r(rng), r(rng), r(rng));
+    }
+
+    // each op uses a neighbouring element as second operand, so that it can't be hoisted out of the loop
+    const Math::Matrix4f &transform = matrices[0];
+    auto next = [iterations](int i) { return i + 1 < iterations ? i + 1 : 0; };
+    float scalarTime, simdTime, error, maxError = 0.f;
+
+    scalarTime = measure(iterations, [&](int i) { vectorReference[i] = Math::Scalar::Multiply(matrices[i], vectors[i]); });
+    simdTime   = measure(iterations, [&](int i) { vectorResults[i] = matrices[i] * vectors[i]; });
+    error = relativeError(&vectorResults[0].m_x, &vectorReference[0].m_x, iterations * 4);
+    maxError = std::max(maxError, error);
+    logResult("Matrix4f * Vector4f", iterations, scalarTime, simdTime, error);
+
+    scalarTime = measure(iterations, [&](int i) { quatReference[i] = Math::Scalar::Multiply(quats[i], quats[next(i)]); });
+    simdTime   = measure(iterations, [&](int i) { quatResults[i] = quats[i] * quats[next(i)]; });
+    error = relativeError(&quatResults[0].m_x, &quatReference[0].m_x, iterations * 4);
+    maxError = std::max(maxError, error);
+    logResult("Quaternion * Quaternion", iterations, scalarTime, simdTime, error);
+
+    scalarTime = measure(1, [&](int) { Math::Scalar::TransformPoints(transform, points.data(), points.size(), pointReference.data()); });
+    simdTime   = measure(1, [&](int) { Math::TransformPoints(transform, points.data(), points.size(), pointResults.data()); });
+    error = relativeError(&pointResults[0].m_x, &pointReference[0].m_x, iterations * 3);
+    maxError = std::max(maxError, error);
+    logResult("TransformPoints", iterations, scalarTime, simdTime, error);
+
+    if (maxError > s_tolerance)
+    {
+        std::stringstream msgStr;
+        msgStr << "SIMD math results differ from scalar versions (max error " << maxError << ", tolerance " << s_tolerance << ")!";
+        LogError(msgStr.str().c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,14 @@
+#ifndef MATHBENCHMARK_INCLUDED
+#define MATHBENCHMARK_INCLUDED
+
+/*
+ * Validation and throughput measurement of SIMD math kernels against their scalar reference versions
+ */
+
+namespace MathBenchmark
+{
+    // returns false if any SIMD result differs from scalar one by more than a small tolerance (results are logged)
+    bool Run(int iterations);
+}
+
+#endif
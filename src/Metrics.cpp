@@ -0,0 +1,285 @@
+#include "Metrics.hpp"
+#include "renderer/RenderContext.hpp"
+#include "ThreadProcessor.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <string.h>
+
+extern RenderContext   g_renderContext;
+extern ThreadProcessor g_threadProcessor;
+
+static const char *s_names[Metrics::NumMetrics] = {
+    "frame_time_us",
+    "cull_time_us",
+    "visible_faces",
+    "visible_patches",
+    "draw_calls",
+    "binds",
+    "upload_bytes",
+    "worker_utilisation_pct"
+};
+
+static int highestBit(uint64_t value)
+{
+    int e = 0;
+    while (value >>= 1)
+        ++e;
+
+    return e;
+}
+
+void Metrics::Histogram::Add(uint64_t value)
+{
+    int idx = (int)value;
+    if (value >= SUB_BUCKETS)
+    {
+        int e = highestBit(value);
+        idx = (e - 2) * SUB_BUCKETS + (int)((value >> (e - 3)) & (SUB_BUCKETS - 1));
+    }
+
+    ++buckets[idx];
+    ++count;
+    sum += value;
+    min = std::min(min, value);
+    max = std::max(max, value);
+}
+
+// middle of the bucket containing requested percentile, clamped to exact extremes
+uint64_t Metrics::Histogram::Percentile(float p) const
+{
+    if (count == 0)
+        return 0;
+
+    uint32_t rank = std::max(1u, (uint32_t)(p * count + 0.5f));
+    uint32_t seen = 0;
+    int idx = 0;
+    for (; idx < NUM_BUCKETS - 1; ++idx)
+    {
+        seen += buckets[idx];
+        if (seen >= rank)
+            break;
+    }
+
+    uint64_t value = idx;
+    if (idx >= SUB_BUCKETS)
+    {
+        int e = idx / SUB_BUCKETS + 2;
+        uint64_t width = 1ull << (e - 3);
+        value = (uint64_t)(SUB_BUCKETS + idx % SUB_BUCKETS) * width + width / 2;
+    }
+
+    return std::min(max, std::max(min, value));
+}
+
+void Metrics::Histogram::Reset()
+{
+    memset(buckets, 0, sizeof(buckets));
+    count = 0;
+    sum = 0;
+    min = UINT64_MAX;
+    max = 0;
+}
+
+Metrics::~Metrics()
+{
+    Stop();
+}
+
+bool Metrics::Start(const char *path, Format format, float interval)
+{
+    Stop();
+
+    m_output = strcmp(path, "-") ? fopen(path, "a") : stdout;
+    if (!m_output)
+    {
+        LOG_MESSAGE("Could not open metrics output: " << path);
+        return false;
+    }
+
+    m_format   = format;
+    m_interval = std::max(interval, 0.01f);
+    m_elapsed  = 0.f;
+    m_started  = false;
+
+    m_enabled = true;
+    return true;
+}
+
+void Metrics::Stop()
+{
+    if (!m_output)
+        return;
+
+    // flush partial interval, so that short runs report something
+    if (m_started && m_histograms[FrameTime].count > 0)
+        Export();
+
+    if (m_output != stdout)
+        fclose(m_output);
+    else
+        fflush(m_output);
+
+    m_output  = nullptr;
+    m_enabled = false;
+    m_started = false;
+    g_threadProcessor.SetTaskTiming(false);
+}
+
+void Metrics::EndFrame(float dt)
+{
+    if (!Enabled())
+        return;
+
+    const vk::UploadQueue *uploads = g_renderContext.Device().uploadQueue;
+    uint64_t uploadBytes = uploads ? uploads->numBytes : 0;
+    int numWorkers = std::min((int)g_threadProcessor.NumThreads(), MAX_THREADS);
+
+    // workers are spawned and resources uploaded during startup - take baselines on the first frame that follows
+    if (!m_started)
+    {
+        g_threadProcessor.SetTaskTiming(true);
+        m_numThreads = numWorkers;
+        m_lastUploadBytes = uploadBytes;
+        for (int t = 0; t < MAX_THREADS; ++t)
+            m_lastBusyTime[t] = g_threadProcessor.BusyTime(t);
+
+        memset(m_threadTotals, 0, sizeof(m_threadTotals));
+        for (auto &h : m_histograms)
+            h.Reset();
+
+        if (m_format == FormatCSV)
+        {
+            fprintf(m_output, "time,frames,metric,avg,min,max,p50,p95,p99");
+            for (int t = 0; t < m_numThreads; ++t)
+                fprintf(m_output, ",thread%d", t);
+            fprintf(m_output, "\n");
+        }
+
+        // anything accumulated so far belongs to startup, which would skew the first interval
+        for (int t = 0; t < MAX_THREADS; ++t)
+        {
+            for (auto &v : m_threads[t].values)
+                v.store(0, std::memory_order_relaxed);
+        }
+
+        m_startTime = std::chrono::steady_clock::now();
+        m_started = true;
+        return;
+    }
+
+    uint64_t frameValues[NumMetrics] = {};
+    frameValues[FrameTime] = (uint64_t)(dt * 1000000.f);
+    frameValues[UploadBytes] = uploadBytes - m_lastUploadBytes;
+    m_lastUploadBytes = uploadBytes;
+
+    for (int t = 0; t < m_numThreads; ++t)
+    {
+        // metrics accumulated by workers (everything between frame time and upload bytes)
+        for (int m = CullTime; m < UploadBytes; ++m)
+        {
+            uint64_t value = m_threads[t].values[m].exchange(0, std::memory_order_relaxed);
+            frameValues[m] += value;
+            m_threadTotals[t][m] += value;
+        }
+
+        // utilisation is kept as busy time until it's divided by frame time
+        uint64_t busyTime = g_threadProcessor.BusyTime(t);
+        frameValues[WorkerUtilisation] += busyTime - m_lastBusyTime[t];
+        m_threadTotals[t][WorkerUtilisation] += busyTime - m_lastBusyTime[t];
+        m_lastBusyTime[t] = busyTime;
+    }
+
+    if (frameValues[FrameTime] > 0)
+        frameValues[WorkerUtilisation] = frameValues[WorkerUtilisation] * 100 / (frameValues[FrameTime] * std::max(m_numThreads, 1));
+    else
+        frameValues[WorkerUtilisation] = 0;
+
+    for (int m = 0; m < NumMetrics; ++m)
+        m_histograms[m].Add(frameValues[m]);
+
+    m_elapsed += dt;
+    if (m_elapsed >= m_interval)
+    {
+        Export();
+        m_elapsed = 0.f;
+    }
+}
+
+void Metrics::Export()
+{
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count();
+
+    if (m_format == FormatJSON)
+        WriteJSON(time);
+    else
+        WriteCSV(time);
+
+    fflush(m_output);
+
+    memset(m_threadTotals, 0, sizeof(m_threadTotals));
+    for (auto &h : m_histograms)
+        h.Reset();
+}
+
+// per-thread values are averages per frame, except utilisation which is relative to total frame time of the interval
+static double threadValue(int metric, uint64_t total, uint64_t frameTime, uint32_t frames)
+{
+    if (metric == Metrics::WorkerUtilisation)
+        return frameTime > 0 ? 100.0 * total / frameTime : 0.0;
+
+    return frames > 0 ? (double)total / frames : 0.0;
+}
+
+void Metrics::WriteJSON(double time)
+{
+    uint32_t frames = m_histograms[FrameTime].count;
+    uint64_t frameTime = m_histograms[FrameTime].sum;
+
+    fprintf(m_output, "{\"time\":%.3f,\"frames\":%u,\"threads\":%d,\"metrics\":{", time, frames, m_numThreads);
+    for (int m = 0; m < NumMetrics; ++m)
+    {
+        const Histogram &h = m_histograms[m];
+        fprintf(m_output, "%s\"%s\":{\"avg\":%.2f,\"min\":%llu,\"max\":%llu,\"p50\":%llu,\"p95\":%llu,\"p99\":%llu",
+                m > 0 ? "," : "", s_names[m], h.count > 0 ? (double)h.sum / h.count : 0.0, (unsigned long long)(h.count > 0 ? h.min : 0),
+                (unsigned long long)h.max, (unsigned long long)h.Percentile(0.5f), (unsigned long long)h.Percentile(0.95f),
+                (unsigned long long)h.Percentile(0.99f));
+
+        // frame time and uploads are measured on main thread only
+        if (m != FrameTime && m != UploadBytes)
+        {
+            fprintf(m_output, ",\"threads\":[");
+            for (int t = 0; t < m_numThreads; ++t)
+                fprintf(m_output, "%s%.2f", t > 0 ? "," : "", threadValue(m, m_threadTotals[t][m], frameTime, frames));
+            fprintf(m_output, "]");
+        }
+
+        fprintf(m_output, "}");
+    }
+
+    fprintf(m_output, "}}\n");
+}
+
+void Metrics::WriteCSV(double time)
+{
+    uint32_t frames = m_histograms[FrameTime].count;
+    uint64_t frameTime = m_histograms[FrameTime].sum;
+
+    for (int m = 0; m < NumMetrics; ++m)
+    {
+        const Histogram &h = m_histograms[m];
+        fprintf(m_output, "%.3f,%u,%s,%.2f,%llu,%llu,%llu,%llu,%llu", time, frames, s_names[m], h.count > 0 ? (double)h.sum / h.count : 0.0,
+                (unsigned long long)(h.count > 0 ? h.min : 0), (unsigned long long)h.max, (unsigned long long)h.Percentile(0.5f),
+                (unsigned long long)h.Percentile(0.95f), (unsigned long long)h.Percentile(0.99f));
+
+        // metrics measured on main thread only leave thread columns empty
+        for (int t = 0; t < m_numThreads; ++t)
+        {
+            if (m != FrameTime && m != UploadBytes)
+                fprintf(m_output, ",%.2f", threadValue(m, m_threadTotals[t][m], frameTime, frames));
+            else
+                fprintf(m_output, ",");
+        }
+
+        fprintf(m_output, "\n");
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef METRICS_INCLUDED
+#define METRICS_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ *  Frame and culling metrics exported for external dashboards. Worker threads accumulate per-frame values in their
+ *  own cache line with relaxed atomics (no locks, no sharing), main thread collects them once per frame into
+ *  histograms and periodically writes a summary as JSON lines or CSV rows to a file or stdout. While export is
+ *  disabled every update is a single predictable branch - define METRICS_DISABLED to compile updates out entirely.
+ */
+
+class Metrics
+{
+public:
+    enum Metric
+    {
+        FrameTime,         // us
+        CullTime,          // us, summed over threads
+        VisibleFaces,
+        VisiblePatches,
+        DrawCalls,
+        Binds,             // pipeline, buffer and descriptor set binds
+        UploadBytes,
+        WorkerUtilisation, // % of frame time spent running worker tasks (average of all workers)
+        NumMetrics
+    };
+
+    enum Format
+    {
+        FormatJSON, // one JSON object per line and interval
+        FormatCSV   // one row per metric and interval
+    };
+
+    static const int MAX_THREADS = 64;
+
+    ~Metrics();
+
+    // path "-" writes to stdout, anything else is appended to (a named pipe works too) - interval is in seconds
+    bool Start(const char *path, Format format, float interval);
+    void Stop();
+
+#ifdef METRICS_DISABLED
+    bool Enabled() const { return false; }
+#else
+    bool Enabled() const { return m_enabled; }
+#endif
+
+    // accumulate value of current frame from given worker thread (indices past MAX_THREADS share slots, which is still safe)
+    void Add(Metric metric, int threadIndex, uint64_t value)
+    {
+        if (!Enabled())
+            return;
+
+        m_threads[threadIndex % MAX_THREADS].values[metric].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    // collect values of finished frame and export them if interval elapsed (main thread only, after all tasks completed)
+    void EndFrame(float dt);
+private:
+    // log-linear histogram of per-frame values: 8 buckets per power of two (under 12.5% error)
+    struct Histogram
+    {
+        static const int SUB_BUCKETS = 8;
+        static const int NUM_BUCKETS = 64 * SUB_BUCKETS;
+
+        void Add(uint64_t value);
+        uint64_t Percentile(float p) const;
+        void Reset();
+
+        uint32_t buckets[NUM_BUCKETS];
+        uint32_t count;
+        uint64_t sum;
+        uint64_t min;
+        uint64_t max;
+    };
+
+    // values of current frame written by a single thread
+    struct alignas(64) ThreadSlot
+    {
+        std::atomic<uint64_t> values[NumMetrics];
+    };
+
+    void Export();
+    void WriteJSON(double time);
+    void WriteCSV(double time);
+
+    bool   m_enabled  = false;
+    bool   m_started  = false; // baselines taken in first EndFrame()
+    FILE  *m_output   = nullptr;
+    Format m_format   = FormatJSON;
+    float  m_interval = 1.f;
+    float  m_elapsed  = 0.f;
+    int    m_numThreads = 0;
+
+    ThreadSlot m_threads[MAX_THREADS];
+    Histogram  m_histograms[NumMetrics];
+    uint64_t   m_threadTotals[MAX_THREADS][NumMetrics]; // values of each thread summed over interval
+    uint64_t   m_lastUploadBytes = 0;
+    uint64_t   m_lastBusyTime[MAX_THREADS];
+    std::chrono::steady_clock::time_point m_startTime;
+};
+
+#endif
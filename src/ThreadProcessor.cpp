@@ -1,5 +1,6 @@
 #include "ThreadProcessor.hpp"
 #include "Utils.hpp"
+#include <chrono>
 
 ThreadProcessor::Worker::Worker()
 {
@@ -28,10 +29,19 @@ void ThreadProcessor::Worker::Work()
         if(finish)
             break;
         execTask = tasks.front();
+        bool timeTask = timed;
 
         // run task (no lock, so that more tasks can arrive during execution)
         queueLock.unlock();
-        execTask();
+        if (timeTask)
+        {
+            auto taskStart = std::chrono::high_resolution_clock::now();
+            execTask();
+            auto taskTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - taskStart);
+            busyTime.fetch_add((uint64_t)taskTime.count(), std::memory_order_relaxed);
+        }
+        else
+            execTask();
 
         // remove from task list
         queueLock.lock();
@@ -88,6 +98,20 @@ void ThreadProcessor::Wait()
     }
 }
 
+void ThreadProcessor::SetTaskTiming(bool enabled)
+{
+    for (auto &worker : m_workers)
+    {
+        std::unique_lock<std::mutex> lock(worker.taskMutex);
+        worker.timed = enabled;
+    }
+}
+
+uint64_t ThreadProcessor::BusyTime(unsigned int threadIdx) const
+{
+    return threadIdx < m_workers.size() ? m_workers[threadIdx].busyTime.load(std::memory_order_relaxed) : 0;
+}
+
 void ThreadProcessor::Finish()
 {
     for (auto &worker : m_workers)
@@ -1,6 +1,7 @@
 #ifndef THREADPROCESSOR_HPP
 #define THREADPROCESSOR_HPP
 
+#include <atomic>
 #include <condition_variable>
 #include <functional>
 #include <mutex>
@@ -20,6 +21,10 @@ public:
     void AddTask(uint8_t threadId, ThreadTask &&task);
     void Wait();
     void Finish();
+    // measure time spent running tasks (off by default, so that tasks aren't slowed down by timer queries)
+    void SetTaskTiming(bool enabled);
+    // total time in microseconds given worker spent running tasks while timing was enabled
+    uint64_t BusyTime(unsigned int threadIdx) const;
 private:
     // worker is a set of tasks executed per-thread
     struct Worker
@@ -35,6 +40,8 @@ private:
         std::thread thread;
         std::condition_variable cv;
         bool finish = false;
+        bool timed = false;
+        std::atomic<uint64_t> busyTime{ 0 }; // us
     };
 
     unsigned int m_numThreads = 1;
@@ -1,8 +1,44 @@
 #ifndef BSPMAP_INCLUDED
 #define BSPMAP_INCLUDED
 
+#include "q3bsp/Q3Bsp.hpp"
 #include "q3bsp/Q3BspRenderHelpers.hpp"
 
+// single view of the map: a camera rendered into its own area of the render target
+struct BspView
+{
+    Math::Vector3f position;       // camera position
+    Math::Matrix4f viewProjection; // view * projection matrix of the camera
+    float x = 0.f, y = 0.f, width = 1.f, height = 1.f; // viewport, normalized to render target size
+};
+
+// swept box trace through map brushes (a ray if mins and maxs are zero) - all positions are in bsp units
+struct BspTrace
+{
+    Math::Vector3f start;
+    Math::Vector3f end;
+    Math::Vector3f mins;    // box bounds relative to start/end
+    Math::Vector3f maxs;
+    int contentsMask = ContentsSolid; // brushes with any of these contents block the trace
+
+    // results
+    float fraction = 1.f;   // portion of the move completed (1 - nothing was hit)
+    Math::Vector3f endPos;  // position where the trace stopped
+    Math::Vector3f normal;  // normal of the hit plane
+    int  contents     = 0;  // contents of the hit brush
+    int  surfaceFlags = 0;  // surface flags of the hit brush side
+    bool startSolid = false; // trace started inside a brush
+    bool allSolid   = false; // trace never left a brush
+};
+
+// lighting at a point sampled from the map's light grid (colors in 0-1 range)
+struct BspLightSample
+{
+    Math::Vector3f ambient;
+    Math::Vector3f directed;  // color of light arriving from direction
+    Math::Vector3f direction; // normalized direction towards the light
+};
+
 /*
  *  Base class for renderable bsp map. Future reference for other BSP format support.
  */
@@ -15,22 +51,44 @@ public:
 
     virtual void Init() = 0;
     virtual void OnRender()        = 0; // perform rendering
-    virtual void OnUpdate(const Math::Vector3f &cameraPosition) = 0; // update BSP visibility info for given camera position
-    virtual void RebuildPipeline()          = 0; // rebuild Vulkan pipelines from scratch
+    virtual void OnUpdate(const std::vector<BspView> &views) = 0; // update BSP visibility info for given views
     virtual std::string ThreadAndBspStats() = 0; // update BSP per-frame statistics and return a formatted string with thread workload
 
     virtual bool ClusterVisible(int cameraCluster, int testCluster) const   = 0;  // determine bsp cluster visibility
     virtual int  FindCameraLeaf(const Math::Vector3f &cameraPosition) const = 0;  // return bsp leaf index containing the camera
-    virtual void CalculateVisibleFaces(int threadIndex, int cameraLeaf)     = 0;  // determine which bsp faces are visible
+    virtual void FindLeaves(const std::vector<Math::Vector3f> &points, std::vector<int> &leaves, std::vector<int> &clusters) const = 0; // batched FindCameraLeaf() with cluster of each leaf
+    virtual void CalculateVisibleFaces(int threadIndex)                     = 0;  // determine which bsp faces are visible in each view
+
+    // collision queries
+    virtual void Trace(BspTrace &trace) const                               = 0;
+    virtual void TraceBatch(std::vector<BspTrace> &traces) const            = 0;  // traces are spread across thread workers
+    virtual int  PointContents(const Math::Vector3f &point) const           = 0;  // combined contents of all brushes containing the point
+
+    // lighting for dynamic objects (positions in bsp units)
+    virtual void SampleLight(const Math::Vector3f &position, BspLightSample &sample) const = 0;
+    virtual void SampleLightBatch(const std::vector<Math::Vector3f> &positions, std::vector<BspLightSample> &samples) const = 0;
+
+    // brush models (doors, platforms) are rendered with their own transform (bsp units) - model 0 is the world and can't be moved
+    // has to be called before OnUpdate(), since visibility of models is calculated with their current bounds
+    virtual void SetModelTransform(int model, const Math::Matrix4f &transform) = 0;
 
     // render helpers - extra flags + map statistics
     virtual void ToggleRenderFlag(int flag) = 0;
+    inline void  SetNumViews(int numViews) { m_numViews = numViews; } // max number of views rendered per frame - has to be set before Init()
+    inline void  SetTraceBenchmark(int numTraces) { m_traceBenchmark = numTraces; } // measure collision throughput in Init()
+    inline void  SetLeafBenchmark(int numPoints)  { m_leafBenchmark = numPoints; }  // measure point to leaf query throughput in Init()
+    inline void  SetEntityBenchmark(int numParses) { m_entityBenchmark = numParses; } // measure entity lump parse and lookup throughput in Init()
     inline bool  HasRenderFlag(int flag) const { return (m_renderFlags & flag) == flag; }
+    inline int   RenderFlags() const { return m_renderFlags; }
     inline bool  Valid() const { return m_bspValid; }
     inline const BspStats &GetMapStats() const { return m_mapStats; }
 protected:
     int      m_renderFlags = 0;
     bool     m_bspValid;
+    int      m_numViews = 1;
+    int      m_traceBenchmark = 0;
+    int      m_leafBenchmark  = 0;
+    int      m_entityBenchmark = 0;
     BspStats m_mapStats;
 };
 
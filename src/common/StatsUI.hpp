@@ -14,7 +14,6 @@ public:
     virtual ~StatsUI() {}
 
     virtual void OnRender()        = 0; // perform rendering
-    virtual void RebuildPipeline() = 0; // rebuild Vulkan pipeline from scratch
 protected:
     BspMap *m_map;
 };
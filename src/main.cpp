@@ -1,35 +1,96 @@
 #include "Application.hpp"
 #include "InputHandlers.hpp"
+#include "Metrics.hpp"
 #include "renderer/RenderContext.hpp"
 #include "renderer/CameraDirector.hpp"
 #include "ThreadProcessor.hpp"
 #include "Utils.hpp"
+#include <algorithm>
+#include <string.h>
 
 // for simplicity, let's use globals
 RenderContext   g_renderContext;
 Application     g_application;
 CameraDirector  g_cameraDirector;
 ThreadProcessor g_threadProcessor;
+Metrics         g_metrics;
 int g_fps = 1;
 
 int main(int argc, char **argv)
 {
-    // initialize SDL
-    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    // frame pacing and headless mode have to be known before the swapchain and per-frame resources are created
+    FramePacing pacing = PacingBalanced;
+    int framesInFlight = 0;
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAX_ENUM_KHR;
+    int headlessFrames = 0;
+    int width = 1024, height = 768;
+    const char *outputPrefix = "frame";
+    bool rawOutput = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-pacing") && i + 1 < argc)
+        {
+            ++i;
+            if (!strcmp(argv[i], "latency"))
+                pacing = PacingLatency;
+            else if (!strcmp(argv[i], "throughput"))
+                pacing = PacingThroughput;
+            else
+                pacing = PacingBalanced;
+        }
+
+        if (!strcmp(argv[i], "-present") && i + 1 < argc)
+        {
+            ++i;
+            if (!strcmp(argv[i], "fifo"))
+                presentMode = VK_PRESENT_MODE_FIFO_KHR;
+            else if (!strcmp(argv[i], "mailbox"))
+                presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+            else if (!strcmp(argv[i], "immediate"))
+                presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+        }
+
+        if (!strcmp(argv[i], "-frames") && i + 1 < argc)
+            framesInFlight = atoi(argv[++i]);
+
+        if (!strcmp(argv[i], "-headless") && i + 1 < argc)
+            headlessFrames = std::max(1, atoi(argv[++i]));
+
+        if (!strcmp(argv[i], "-output") && i + 1 < argc)
+            outputPrefix = argv[++i];
+
+        if (!strcmp(argv[i], "-raw"))
+            rawOutput = true;
+
+        if (!strcmp(argv[i], "-size") && i + 2 < argc)
+        {
+            width  = std::max(1, atoi(argv[++i]));
+            height = std::max(1, atoi(argv[++i]));
+        }
+    }
+
+    // initialize SDL - no video subsystem is needed if there's no window
+    if (SDL_Init(headlessFrames > 0 ? SDL_INIT_EVENTS : SDL_INIT_VIDEO) < 0)
     {
         LOG_MESSAGE_ASSERT(false, "Failed to initialize SDL.");
         return 1;
     }
 
-    if (!g_renderContext.Init("Quake BSP Viewer in Vulkan", 100, 100, 1024, 768))
+    g_renderContext.SetFramePacing(pacing, framesInFlight, presentMode);
+    if (headlessFrames > 0)
+        g_renderContext.SetHeadless(outputPrefix, rawOutput);
+
+    if (!g_renderContext.Init("Quake BSP Viewer in Vulkan", 100, 100, width, height))
     {
         LOG_MESSAGE_ASSERT(false, "Could not initialize render context!");
         SDL_Quit();
         return 1;
     }
 
-    SDL_ShowCursor(SDL_DISABLE);
+    if (headlessFrames == 0)
+        SDL_ShowCursor(SDL_DISABLE);
     g_application.OnStart(argc, argv);
+    int renderedFrames = 0;
 
     double now = 0, last = 0;
     int numFrames = 0;
@@ -61,11 +122,16 @@ int main(int argc, char **argv)
 
         // update debug info
         g_application.UpdateStats();
+        g_metrics.EndFrame(dt);
+
+        // offscreen rendering stops after requested number of frames
+        if (headlessFrames > 0 && ++renderedFrames >= headlessFrames)
+            g_application.Terminate();
     }
 
     g_application.OnTerminate();
     g_renderContext.Destroy();
     SDL_Quit();
 
-    return 0;
+    return g_application.ExitCode();
 }
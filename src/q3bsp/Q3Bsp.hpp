@@ -60,6 +60,23 @@ enum FaceTypes
 };
 
 
+// brush contents (Q3BspTextureLump::contents)
+enum ContentsFlags
+{
+    ContentsSolid       = 1,
+    ContentsLava        = 8,
+    ContentsSlime       = 16,
+    ContentsWater       = 32,
+    ContentsFog         = 64,
+    ContentsAreaPortal  = 0x8000,
+    ContentsPlayerClip  = 0x10000,
+    ContentsMonsterClip = 0x20000,
+    ContentsBody        = 0x2000000,
+    ContentsDetail      = 0x8000000,
+    ContentsTrigger     = 0x40000000
+};
+
+
 struct Q3BspDirEntry
 {
     int offset;
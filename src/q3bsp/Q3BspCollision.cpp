@@ -0,0 +1,669 @@
+#include "q3bsp/Q3BspCollision.hpp"
+#include "q3bsp/Q3BspMap.hpp"
+#include "ThreadProcessor.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define Q3COLLISION_SSE
+#include <emmintrin.h>
+#endif
+
+extern ThreadProcessor g_threadProcessor;
+
+static const float s_surfaceClipEpsilon = 0.125f; // keep traces this far off brush surfaces (same as Quake III)
+static const float s_paddingDist = 1e30f;         // padding planes have zero normals and are never crossed
+
+static inline void toFloat3(const Math::Vector3f &v, float *out)
+{
+    out[0] = v.m_x;
+    out[1] = v.m_y;
+    out[2] = v.m_z;
+}
+
+void Q3BspCollision::Init(const Q3BspMap &map)
+{
+    m_map = &map;
+    m_brushes.resize(map.brushes.size());
+
+    for (size_t i = 0; i < map.brushes.size(); ++i)
+    {
+        const Q3BspBrushLump &b = map.brushes[i];
+        Brush &brush = m_brushes[i];
+        brush.firstPlane = (int)m_planeDist.size();
+        brush.numGroups  = (b.n_brushSides + 3) / 4;
+        brush.contents   = (b.texture >= 0 && b.texture < (int)map.textures.size()) ? map.textures[b.texture].contents : 0;
+
+        for (int j = 0; j < brush.numGroups * 4; ++j)
+        {
+            if (j < b.n_brushSides)
+            {
+                const Q3BspBrushSideLump &side = map.brushSides[b.brushSide + j];
+                const Q3BspPlaneLump &plane = map.planes[side.plane];
+                m_planeNx.push_back(plane.normal.x);
+                m_planeNy.push_back(plane.normal.y);
+                m_planeNz.push_back(plane.normal.z);
+                m_planeDist.push_back(plane.dist);
+                m_planeIndex.push_back(side.plane);
+                m_planeSurfaceFlags.push_back((side.texture >= 0 && side.texture < (int)map.textures.size()) ? map.textures[side.texture].flags : 0);
+            }
+            else
+            {
+                m_planeNx.push_back(0.f);
+                m_planeNy.push_back(0.f);
+                m_planeNz.push_back(0.f);
+                m_planeDist.push_back(s_paddingDist);
+                m_planeIndex.push_back(-1);
+                m_planeSurfaceFlags.push_back(0);
+            }
+        }
+    }
+
+    // plane lookups are the main cost of tree walks - keep them next to node children
+    m_nodes.resize(map.nodes.size());
+    for (size_t i = 0; i < map.nodes.size(); ++i)
+    {
+        const Q3BspPlaneLump &plane = map.planes[map.nodes[i].plane];
+        PackedNode &node = m_nodes[i];
+        node.normal[0] = plane.normal.x;
+        node.normal[1] = plane.normal.y;
+        node.normal[2] = plane.normal.z;
+        node.dist = plane.dist;
+        node.children[0] = map.nodes[i].children.x;
+        node.children[1] = map.nodes[i].children.y;
+        node.padding = 0;
+
+        if (plane.normal.y == 0.f && plane.normal.z == 0.f)
+            node.axis = 0;
+        else if (plane.normal.x == 0.f && plane.normal.z == 0.f)
+            node.axis = 1;
+        else if (plane.normal.x == 0.f && plane.normal.y == 0.f)
+            node.axis = 2;
+        else
+            node.axis = 3;
+    }
+
+    unsigned int threadCnt = g_threadProcessor.NumThreads();
+    m_brushStampsPerThread.assign(threadCnt, std::vector<uint32_t>(m_brushes.size(), 0));
+    m_traceCountPerThread.assign(threadCnt, 0);
+}
+
+void Q3BspCollision::Trace(BspTrace &trace) const
+{
+    TraceInternal(trace, 0);
+}
+
+int Q3BspCollision::PointContents(const Math::Vector3f &point) const
+{
+    if (m_nodes.empty())
+        return 0;
+
+    float p[3];
+    toFloat3(point, p);
+
+    const Q3BspLeafLump &leaf = m_map->leaves[FindLeaf(p)];
+    int contents = 0;
+
+    for (int i = 0; i < leaf.n_leafBrushes; ++i)
+    {
+        const Brush &brush = m_brushes[m_map->leafBrushes[leaf.leafBrush + i].brush];
+        if ((contents & brush.contents) != brush.contents && PointInBrush(brush, p))
+            contents |= brush.contents;
+    }
+
+    return contents;
+}
+
+void Q3BspCollision::TraceBatch(std::vector<BspTrace> &traces) const
+{
+    unsigned int threadCnt = g_threadProcessor.NumThreads();
+    if (threadCnt > 1 && traces.size() > threadCnt)
+    {
+        // contiguous range of traces per worker
+        size_t tracesPerThread = (traces.size() + threadCnt - 1) / threadCnt;
+        for (unsigned int t = 0; t < threadCnt; ++t)
+        {
+            size_t first = t * tracesPerThread;
+            size_t last  = std::min(first + tracesPerThread, traces.size());
+            if (first >= last)
+                break;
+
+            g_threadProcessor.AddTask((uint8_t)t, [this, &traces, first, last, t] {
+                for (size_t i = first; i < last; ++i)
+                    TraceInternal(traces[i], (int)t);
+            });
+        }
+
+        g_threadProcessor.Wait();
+    }
+    else
+    {
+        for (auto &trace : traces)
+            TraceInternal(trace, 0);
+    }
+}
+
+void Q3BspCollision::FindLeaves(const Math::Vector3f *points, size_t count, int *leaves, int *clusters) const
+{
+    unsigned int threadCnt = g_threadProcessor.NumThreads();
+    if (threadCnt > 1 && count >= threadCnt * 64)
+    {
+        // ranges are multiples of 4 so that only the last one ends with a partial SIMD group
+        size_t pointsPerThread = ((count + threadCnt - 1) / threadCnt + 3) & ~(size_t)3;
+        for (unsigned int t = 0; t < threadCnt; ++t)
+        {
+            size_t first = t * pointsPerThread;
+            size_t last  = std::min(first + pointsPerThread, count);
+            if (first >= last)
+                break;
+
+            g_threadProcessor.AddTask((uint8_t)t, [=] { FindLeavesRange(points, first, last, leaves, clusters); });
+        }
+
+        g_threadProcessor.Wait();
+    }
+    else
+    {
+        FindLeavesRange(points, 0, count, leaves, clusters);
+    }
+}
+
+void Q3BspCollision::Benchmark(int numTraces, BspTraceStats &stats) const
+{
+    if (!m_map || m_map->models.empty() || numTraces <= 0)
+        return;
+
+    // fixed seed - results are comparable between runs
+    const Q3BspModelLump &world = m_map->models[0];
+    std::mt19937 rng(1337);
+    std::uniform_real_distribution<float> rx(world.mins.x, world.maxs.x);
+    std::uniform_real_distribution<float> ry(world.mins.y, world.maxs.y);
+    std::uniform_real_distribution<float> rz(world.mins.z, world.maxs.z);
+
+    // half rays, half player sized boxes
+    std::vector<BspTrace> traces(numTraces);
+    for (int i = 0; i < numTraces; ++i)
+    {
+        traces[i].start = Math::Vector3f(rx(rng), ry(rng), rz(rng));
+        traces[i].end   = Math::Vector3f(rx(rng), ry(rng), rz(rng));
+        if (i & 1)
+        {
+            traces[i].mins = Math::Vector3f(-15.f, -15.f, -24.f);
+            traces[i].maxs = Math::Vector3f( 15.f,  15.f,  32.f);
+        }
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto &trace : traces)
+        TraceInternal(trace, 0);
+    float singleTime = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    TraceBatch(traces);
+    float batchTime = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+
+    stats.numTraces = numTraces;
+    stats.hits = (int)std::count_if(traces.begin(), traces.end(), [](const BspTrace &t) { return t.fraction < 1.f; });
+    stats.tracesPerSec      = singleTime > 0.f ? numTraces / singleTime : 0.f;
+    stats.batchTracesPerSec = batchTime  > 0.f ? numTraces / batchTime  : 0.f;
+
+    LOG_MESSAGE("Trace benchmark: " << numTraces << " traces (" << stats.hits << " hits), " << stats.tracesPerSec << " traces/s, "
+                << stats.batchTracesPerSec << " traces/s batched on " << g_threadProcessor.NumThreads() << " thread(s)");
+}
+
+void Q3BspCollision::BenchmarkLeaves(int numPoints, BspLeafQueryStats &stats) const
+{
+    if (!m_map || m_map->models.empty() || m_nodes.empty() || numPoints <= 0)
+        return;
+
+    // fixed seed - results are comparable between runs
+    const Q3BspModelLump &world = m_map->models[0];
+    std::mt19937 rng(1337);
+    std::uniform_real_distribution<float> rx(world.mins.x, world.maxs.x);
+    std::uniform_real_distribution<float> ry(world.mins.y, world.maxs.y);
+    std::uniform_real_distribution<float> rz(world.mins.z, world.maxs.z);
+
+    std::vector<Math::Vector3f> points(numPoints);
+    for (auto &p : points)
+        p = Math::Vector3f(rx(rng), ry(rng), rz(rng));
+
+    std::vector<int> leaves(numPoints), clusters(numPoints), referenceLeaves(numPoints), referenceClusters(numPoints);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < numPoints; ++i)
+    {
+        referenceLeaves[i] = m_map->FindCameraLeaf(points[i]);
+        referenceClusters[i] = m_map->leaves[referenceLeaves[i]].cluster;
+    }
+    float scalarTime = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    FindLeaves(points.data(), points.size(), leaves.data(), clusters.data());
+    float batchTime = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+
+    stats.numPoints = numPoints;
+    stats.mismatches = 0;
+    for (int i = 0; i < numPoints; ++i)
+    {
+        if (leaves[i] != referenceLeaves[i] || clusters[i] != referenceClusters[i])
+            stats.mismatches++;
+    }
+
+    stats.pointsPerSec      = scalarTime > 0.f ? numPoints / scalarTime : 0.f;
+    stats.batchPointsPerSec = batchTime  > 0.f ? numPoints / batchTime  : 0.f;
+
+    LOG_MESSAGE_ASSERT(stats.mismatches == 0, "Batched leaf queries differ from FindCameraLeaf() for " << stats.mismatches << " points!");
+    LOG_MESSAGE("Leaf query benchmark: " << numPoints << " points, " << stats.pointsPerSec << " points/s, " << stats.batchPointsPerSec
+                << " points/s batched on " << g_threadProcessor.NumThreads() << " thread(s)");
+}
+
+void Q3BspCollision::TraceInternal(BspTrace &trace, int threadIndex) const
+{
+    trace.fraction = 1.f;
+    trace.normal = Math::Vector3f();
+    trace.contents = 0;
+    trace.surfaceFlags = 0;
+    trace.startSolid = false;
+    trace.allSolid = false;
+
+    if (!m_nodes.empty())
+    {
+        TraceWork tw;
+        tw.trace = &trace;
+        tw.threadIndex = threadIndex;
+
+        // move box center onto the trace line - extents become symmetric
+        float start[3], end[3], mins[3], maxs[3];
+        toFloat3(trace.start, start);
+        toFloat3(trace.end, end);
+        toFloat3(trace.mins, mins);
+        toFloat3(trace.maxs, maxs);
+
+        for (int i = 0; i < 3; ++i)
+        {
+            tw.offsets[i] = (mins[i] + maxs[i]) * 0.5f;
+            tw.extents[i] = maxs[i] - tw.offsets[i];
+            tw.start[i] = start[i] + tw.offsets[i];
+            tw.end[i]   = end[i] + tw.offsets[i];
+        }
+
+        tw.isPoint = tw.extents[0] == 0.f && tw.extents[1] == 0.f && tw.extents[2] == 0.f;
+
+        // new stamp for this trace - reset all stamps once the counter wraps around
+        if (++m_traceCountPerThread[threadIndex] == 0)
+        {
+            std::fill(m_brushStampsPerThread[threadIndex].begin(), m_brushStampsPerThread[threadIndex].end(), 0);
+            m_traceCountPerThread[threadIndex] = 1;
+        }
+
+        TraceThroughTree(tw, 0, 0.f, 1.f, tw.start, tw.end);
+    }
+
+    trace.endPos = trace.start + (trace.end - trace.start) * trace.fraction;
+}
+
+void Q3BspCollision::TraceThroughTree(TraceWork &tw, int nodeIdx, float startFrac, float endFrac, const float *p1, const float *p2) const
+{
+    // already hit something nearer
+    if (tw.trace->fraction <= startFrac)
+        return;
+
+    if (nodeIdx < 0)
+    {
+        TraceThroughLeaf(tw, ~nodeIdx);
+        return;
+    }
+
+    const PackedNode &node = m_nodes[nodeIdx];
+    float t1, t2, offset;
+
+    if (node.axis < 3)
+    {
+        t1 = node.normal[node.axis] * p1[node.axis] - node.dist;
+        t2 = node.normal[node.axis] * p2[node.axis] - node.dist;
+        offset = tw.extents[node.axis];
+    }
+    else
+    {
+        t1 = node.normal[0] * p1[0] + node.normal[1] * p1[1] + node.normal[2] * p1[2] - node.dist;
+        t2 = node.normal[0] * p2[0] + node.normal[1] * p2[1] + node.normal[2] * p2[2] - node.dist;
+        offset = tw.isPoint ? 0.f : fabsf(node.normal[0]) * tw.extents[0] + fabsf(node.normal[1]) * tw.extents[1] + fabsf(node.normal[2]) * tw.extents[2];
+    }
+
+    if (t1 >= offset + 1.f && t2 >= offset + 1.f)
+    {
+        TraceThroughTree(tw, node.children[0], startFrac, endFrac, p1, p2);
+        return;
+    }
+
+    if (t1 < -offset - 1.f && t2 < -offset - 1.f)
+    {
+        TraceThroughTree(tw, node.children[1], startFrac, endFrac, p1, p2);
+        return;
+    }
+
+    // trace crosses the plane - split it, near side first
+    int side;
+    float frac, frac2;
+    if (t1 < t2)
+    {
+        float invDist = 1.f / (t1 - t2);
+        side  = 1;
+        frac2 = (t1 + offset + s_surfaceClipEpsilon) * invDist;
+        frac  = (t1 - offset + s_surfaceClipEpsilon) * invDist;
+    }
+    else if (t1 > t2)
+    {
+        float invDist = 1.f / (t1 - t2);
+        side  = 0;
+        frac2 = (t1 - offset - s_surfaceClipEpsilon) * invDist;
+        frac  = (t1 + offset + s_surfaceClipEpsilon) * invDist;
+    }
+    else
+    {
+        side  = 0;
+        frac  = 1.f;
+        frac2 = 0.f;
+    }
+
+    frac  = std::max(0.f, std::min(1.f, frac));
+    frac2 = std::max(0.f, std::min(1.f, frac2));
+
+    float mid[3];
+    float midFrac = startFrac + (endFrac - startFrac) * frac;
+    for (int i = 0; i < 3; ++i)
+        mid[i] = p1[i] + frac * (p2[i] - p1[i]);
+
+    TraceThroughTree(tw, node.children[side], startFrac, midFrac, p1, mid);
+
+    midFrac = startFrac + (endFrac - startFrac) * frac2;
+    for (int i = 0; i < 3; ++i)
+        mid[i] = p1[i] + frac2 * (p2[i] - p1[i]);
+
+    TraceThroughTree(tw, node.children[side ^ 1], midFrac, endFrac, mid, p2);
+}
+
+void Q3BspCollision::TraceThroughLeaf(TraceWork &tw, int leafIdx) const
+{
+    const Q3BspLeafLump &leaf = m_map->leaves[leafIdx];
+    std::vector<uint32_t> &stamps = m_brushStampsPerThread[tw.threadIndex];
+    uint32_t traceCount = m_traceCountPerThread[tw.threadIndex];
+
+    for (int i = 0; i < leaf.n_leafBrushes; ++i)
+    {
+        int brushIdx = m_map->leafBrushes[leaf.leafBrush + i].brush;
+
+        // already checked in another leaf
+        if (stamps[brushIdx] == traceCount)
+            continue;
+        stamps[brushIdx] = traceCount;
+
+        const Brush &brush = m_brushes[brushIdx];
+        if (!(brush.contents & tw.trace->contentsMask))
+            continue;
+
+        TraceThroughBrush(tw, brush);
+
+        // can't get any closer than this
+        if (tw.trace->fraction == 0.f)
+            return;
+    }
+}
+
+void Q3BspCollision::TraceThroughBrush(TraceWork &tw, const Brush &brush) const
+{
+    if (brush.numGroups == 0)
+        return;
+
+    // the trace enters the brush at the latest entry and leaves it at the earliest exit over all brush planes
+    float enterFrac = -1.f;
+    float leaveFrac = 1.f;
+    int   enterPlane = -1;
+    bool  startOut = false;
+    bool  getOut   = false;
+
+#ifdef Q3COLLISION_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one  = _mm_set1_ps(1.f);
+    const __m128 eps  = _mm_set1_ps(s_surfaceClipEpsilon);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 s0 = _mm_set1_ps(tw.start[0]), s1 = _mm_set1_ps(tw.start[1]), s2 = _mm_set1_ps(tw.start[2]);
+    const __m128 e0 = _mm_set1_ps(tw.end[0]),   e1 = _mm_set1_ps(tw.end[1]),   e2 = _mm_set1_ps(tw.end[2]);
+    const __m128 x0 = _mm_set1_ps(tw.extents[0]), x1 = _mm_set1_ps(tw.extents[1]), x2 = _mm_set1_ps(tw.extents[2]);
+
+    __m128  enterVec = _mm_set1_ps(-1.f);
+    __m128  leaveVec = one;
+    __m128i enterIdx = _mm_set1_epi32(-1);
+    __m128  startOutVec = zero;
+    __m128  getOutVec   = zero;
+
+    for (int g = 0; g < brush.numGroups; ++g)
+    {
+        int p = brush.firstPlane + g * 4;
+        __m128 nx = _mm_loadu_ps(&m_planeNx[p]);
+        __m128 ny = _mm_loadu_ps(&m_planeNy[p]);
+        __m128 nz = _mm_loadu_ps(&m_planeNz[p]);
+
+        // push planes out by the box extents
+        __m128 dist = _mm_add_ps(_mm_loadu_ps(&m_planeDist[p]),
+                                 _mm_add_ps(_mm_mul_ps(_mm_and_ps(nx, absMask), x0),
+                                            _mm_add_ps(_mm_mul_ps(_mm_and_ps(ny, absMask), x1), _mm_mul_ps(_mm_and_ps(nz, absMask), x2))));
+
+        __m128 d1 = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(nx, s0), _mm_add_ps(_mm_mul_ps(ny, s1), _mm_mul_ps(nz, s2))), dist);
+        __m128 d2 = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(nx, e0), _mm_add_ps(_mm_mul_ps(ny, e1), _mm_mul_ps(nz, e2))), dist);
+
+        __m128 d1Front = _mm_cmpgt_ps(d1, zero);
+        __m128 d2Front = _mm_cmpgt_ps(d2, zero);
+        startOutVec = _mm_or_ps(startOutVec, d1Front);
+        getOutVec   = _mm_or_ps(getOutVec, d2Front);
+
+        // completely in front of any plane - the trace can't touch this brush
+        __m128 outside = _mm_and_ps(d1Front, _mm_or_ps(_mm_cmpge_ps(d2, eps), _mm_cmpge_ps(d2, d1)));
+        if (_mm_movemask_ps(outside))
+            return;
+
+        __m128 crossing = _mm_or_ps(d1Front, d2Front);
+        __m128 entering = _mm_cmpgt_ps(d1, d2);
+        __m128 invDenom = _mm_div_ps(one, _mm_sub_ps(d1, d2));
+
+        __m128 fEnter = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(d1, eps), invDenom), zero);
+        __m128 better = _mm_and_ps(_mm_and_ps(crossing, entering), _mm_cmpgt_ps(fEnter, enterVec));
+        enterVec = _mm_or_ps(_mm_and_ps(better, fEnter), _mm_andnot_ps(better, enterVec));
+        __m128i betterI = _mm_castps_si128(better);
+        __m128i planeIdx = _mm_add_epi32(_mm_set1_epi32(p), _mm_set_epi32(3, 2, 1, 0));
+        enterIdx = _mm_or_si128(_mm_and_si128(betterI, planeIdx), _mm_andnot_si128(betterI, enterIdx));
+
+        __m128 fLeave = _mm_min_ps(_mm_mul_ps(_mm_add_ps(d1, eps), invDenom), one);
+        __m128 leaving = _mm_andnot_ps(entering, crossing);
+        leaveVec = _mm_or_ps(_mm_and_ps(leaving, _mm_min_ps(fLeave, leaveVec)), _mm_andnot_ps(leaving, leaveVec));
+    }
+
+    startOut = _mm_movemask_ps(startOutVec) != 0;
+    getOut   = _mm_movemask_ps(getOutVec) != 0;
+
+    float enterLanes[4], leaveLanes[4];
+    int   enterIdxLanes[4];
+    _mm_storeu_ps(enterLanes, enterVec);
+    _mm_storeu_ps(leaveLanes, leaveVec);
+    _mm_storeu_si128((__m128i *)enterIdxLanes, enterIdx);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        if (enterLanes[i] > enterFrac)
+        {
+            enterFrac  = enterLanes[i];
+            enterPlane = enterIdxLanes[i];
+        }
+
+        leaveFrac = std::min(leaveFrac, leaveLanes[i]);
+    }
+#else
+    for (int p = brush.firstPlane; p < brush.firstPlane + brush.numGroups * 4; ++p)
+    {
+        float dist = m_planeDist[p] + fabsf(m_planeNx[p]) * tw.extents[0] + fabsf(m_planeNy[p]) * tw.extents[1] + fabsf(m_planeNz[p]) * tw.extents[2];
+        float d1 = m_planeNx[p] * tw.start[0] + m_planeNy[p] * tw.start[1] + m_planeNz[p] * tw.start[2] - dist;
+        float d2 = m_planeNx[p] * tw.end[0]   + m_planeNy[p] * tw.end[1]   + m_planeNz[p] * tw.end[2]   - dist;
+
+        if (d1 > 0.f) startOut = true;
+        if (d2 > 0.f) getOut = true;
+
+        // completely in front of the plane - the trace can't touch this brush
+        if (d1 > 0.f && (d2 >= s_surfaceClipEpsilon || d2 >= d1))
+            return;
+
+        if (d1 <= 0.f && d2 <= 0.f)
+            continue;
+
+        if (d1 > d2)
+        {
+            float f = std::max((d1 - s_surfaceClipEpsilon) / (d1 - d2), 0.f);
+            if (f > enterFrac)
+            {
+                enterFrac  = f;
+                enterPlane = p;
+            }
+        }
+        else
+        {
+            leaveFrac = std::min(leaveFrac, std::min((d1 + s_surfaceClipEpsilon) / (d1 - d2), 1.f));
+        }
+    }
+#endif
+
+    BspTrace &trace = *tw.trace;
+
+    if (!startOut)
+    {
+        // started inside the brush
+        trace.startSolid = true;
+        if (!getOut)
+        {
+            trace.allSolid = true;
+            trace.fraction = 0.f;
+        }
+
+        trace.contents = brush.contents;
+        return;
+    }
+
+    if (enterFrac < leaveFrac && enterFrac > -1.f && enterFrac < trace.fraction && enterPlane >= 0)
+    {
+        trace.fraction = std::max(enterFrac, 0.f);
+        trace.normal = Math::Vector3f(m_planeNx[enterPlane], m_planeNy[enterPlane], m_planeNz[enterPlane]);
+        trace.surfaceFlags = m_planeSurfaceFlags[enterPlane];
+        trace.contents = brush.contents;
+    }
+}
+
+bool Q3BspCollision::PointInBrush(const Brush &brush, const float *point) const
+{
+#ifdef Q3COLLISION_SSE
+    const __m128 px = _mm_set1_ps(point[0]), py = _mm_set1_ps(point[1]), pz = _mm_set1_ps(point[2]);
+
+    for (int g = 0; g < brush.numGroups; ++g)
+    {
+        int p = brush.firstPlane + g * 4;
+        __m128 d = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&m_planeNx[p]), px),
+                              _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&m_planeNy[p]), py), _mm_mul_ps(_mm_loadu_ps(&m_planeNz[p]), pz)));
+
+        if (_mm_movemask_ps(_mm_cmpgt_ps(d, _mm_loadu_ps(&m_planeDist[p]))))
+            return false;
+    }
+#else
+    for (int p = brush.firstPlane; p < brush.firstPlane + brush.numGroups * 4; ++p)
+    {
+        if (m_planeNx[p] * point[0] + m_planeNy[p] * point[1] + m_planeNz[p] * point[2] > m_planeDist[p])
+            return false;
+    }
+#endif
+
+    return brush.numGroups > 0;
+}
+
+int Q3BspCollision::FindLeaf(const float *point) const
+{
+    int nodeIdx = 0;
+
+    // plane test is the same as in Q3BspMap::FindCameraLeaf(), so both always agree on points lying on a plane
+    while (nodeIdx >= 0)
+    {
+        const PackedNode &node = m_nodes[nodeIdx];
+        float distance;
+        if (node.axis < 3)
+            distance = point[node.axis] * node.normal[node.axis] - node.dist;
+        else
+            distance = point[0] * node.normal[0] + point[1] * node.normal[1] + point[2] * node.normal[2] - node.dist;
+
+        nodeIdx = node.children[distance >= 0.f ? 0 : 1];
+    }
+
+    return ~nodeIdx;
+}
+
+void Q3BspCollision::FindLeavesRange(const Math::Vector3f *points, size_t first, size_t last, int *leaves, int *clusters) const
+{
+    if (m_nodes.empty())
+    {
+        std::fill(leaves + first, leaves + last, -1);
+        if (clusters)
+            std::fill(clusters + first, clusters + last, -1);
+        return;
+    }
+
+    size_t i = first;
+#ifdef Q3COLLISION_SSE
+    // 4 points walk down the tree together - each lane follows its own path until all of them reach a leaf
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= last; i += 4)
+    {
+        const Math::Vector3f *p = points + i;
+        const __m128 px = _mm_setr_ps(p[0].m_x, p[1].m_x, p[2].m_x, p[3].m_x);
+        const __m128 py = _mm_setr_ps(p[0].m_y, p[1].m_y, p[2].m_y, p[3].m_y);
+        const __m128 pz = _mm_setr_ps(p[0].m_z, p[1].m_z, p[2].m_z, p[3].m_z);
+        int nodeIdx[4] = { 0, 0, 0, 0 };
+
+        // loop until all lanes are negative (leaves)
+        while ((nodeIdx[0] & nodeIdx[1] & nodeIdx[2] & nodeIdx[3]) >= 0)
+        {
+            // lanes which are already done keep testing the root node - their result is ignored
+            const PackedNode &n0 = m_nodes[std::max(nodeIdx[0], 0)];
+            const PackedNode &n1 = m_nodes[std::max(nodeIdx[1], 0)];
+            const PackedNode &n2 = m_nodes[std::max(nodeIdx[2], 0)];
+            const PackedNode &n3 = m_nodes[std::max(nodeIdx[3], 0)];
+
+            __m128 nx = _mm_setr_ps(n0.normal[0], n1.normal[0], n2.normal[0], n3.normal[0]);
+            __m128 ny = _mm_setr_ps(n0.normal[1], n1.normal[1], n2.normal[1], n3.normal[1]);
+            __m128 nz = _mm_setr_ps(n0.normal[2], n1.normal[2], n2.normal[2], n3.normal[2]);
+            __m128 dist = _mm_setr_ps(n0.dist, n1.dist, n2.dist, n3.dist);
+
+            // same evaluation order as the scalar path
+            __m128 d = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, nx), _mm_mul_ps(py, ny)), _mm_mul_ps(pz, nz)), dist);
+            int front = _mm_movemask_ps(_mm_cmpge_ps(d, zero));
+
+            const PackedNode *lanes[4] = { &n0, &n1, &n2, &n3 };
+            for (int l = 0; l < 4; ++l)
+            {
+                if (nodeIdx[l] >= 0)
+                    nodeIdx[l] = lanes[l]->children[(front >> l) & 1 ? 0 : 1];
+            }
+        }
+
+        for (int l = 0; l < 4; ++l)
+        {
+            leaves[i + l] = ~nodeIdx[l];
+            if (clusters)
+                clusters[i + l] = m_map->leaves[~nodeIdx[l]].cluster;
+        }
+    }
+#endif
+
+    for (; i < last; ++i)
+    {
+        float p[3];
+        toFloat3(points[i], p);
+        leaves[i] = FindLeaf(p);
+        if (clusters)
+            clusters[i] = m_map->leaves[leaves[i]].cluster;
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef Q3BSPCOLLISION_INCLUDED
+#define Q3BSPCOLLISION_INCLUDED
+
+#include "Math.hpp"
+#include "common/BspMap.hpp"
+#include <stdint.h>
+#include <vector>
+
+class Q3BspMap;
+
+/*
+ *  Collision queries against Quake III map brushes: rays, swept boxes and point contents (all in bsp units).
+ *  Brush planes are flattened into SoA tables padded to groups of 4, so that each group is tested with a single
+ *  SIMD pass (SSE2 if available, scalar otherwise). Traces walk the node tree and only test brushes of touched leaves.
+ *  Points are located in the tree by walking a packed copy of bsp nodes with their planes inlined.
+ */
+
+class Q3BspCollision
+{
+public:
+    void Init(const Q3BspMap &map);
+
+    // single trace/query - main thread only
+    void Trace(BspTrace &trace) const;
+    int  PointContents(const Math::Vector3f &point) const;
+    // traces are spread across thread workers (if running)
+    void TraceBatch(std::vector<BspTrace> &traces) const;
+
+    // leaf and cluster index of each point (clusters can be null) - points are walked down the tree in groups of 4 SIMD lanes
+    // and spread across thread workers (if running)
+    void FindLeaves(const Math::Vector3f *points, size_t count, int *leaves, int *clusters) const;
+
+    // fire random rays and boxes within the map bounds and measure throughput (single and batched)
+    void Benchmark(int numTraces, BspTraceStats &stats) const;
+    // classify random points with FindLeaves() and with per-point Q3BspMap::FindCameraLeaf() and compare throughput
+    void BenchmarkLeaves(int numPoints, BspLeafQueryStats &stats) const;
+private:
+    // bsp node with its plane inlined (32 bytes - two nodes per cache line)
+    struct PackedNode
+    {
+        float normal[3];
+        float dist;
+        int   children[2]; // front, back (negative - ~leaf index)
+        int   axis;        // 0-2: plane is perpendicular to x, y or z axis (single multiply test); 3: any other plane
+        int   padding;
+    };
+
+    // precomputed brush: planes [firstPlane, firstPlane + numGroups * 4) in SoA tables
+    struct Brush
+    {
+        int firstPlane = 0;
+        int numGroups  = 0;
+        int contents   = 0;
+    };
+
+    // state of a single trace - box is centered around start/end, so the tree walk can use symmetric extents
+    struct TraceWork
+    {
+        BspTrace *trace;
+        float start[3];
+        float end[3];
+        float extents[3];
+        float offsets[3]; // box center relative to trace start/end
+        bool  isPoint;
+        int   threadIndex;
+    };
+
+    void TraceInternal(BspTrace &trace, int threadIndex) const;
+    void TraceThroughTree(TraceWork &tw, int nodeIdx, float startFrac, float endFrac, const float *p1, const float *p2) const;
+    void TraceThroughLeaf(TraceWork &tw, int leafIdx) const;
+    void TraceThroughBrush(TraceWork &tw, const Brush &brush) const;
+    bool PointInBrush(const Brush &brush, const float *point) const;
+    int  FindLeaf(const float *point) const;
+    void FindLeavesRange(const Math::Vector3f *points, size_t first, size_t last, int *leaves, int *clusters) const;
+
+    const Q3BspMap *m_map = nullptr;
+    std::vector<Brush> m_brushes;
+    std::vector<PackedNode> m_nodes;
+
+    // brush planes: normals, distances, bsp plane index (for reporting) and surface flags of respective brush sides
+    std::vector<float> m_planeNx;
+    std::vector<float> m_planeNy;
+    std::vector<float> m_planeNz;
+    std::vector<float> m_planeDist;
+    std::vector<int>   m_planeIndex;
+    std::vector<int>   m_planeSurfaceFlags;
+
+    // brushes shared by several leaves are tested once per trace - each thread stamps checked brushes with its trace counter
+    mutable std::vector<std::vector<uint32_t>> m_brushStampsPerThread;
+    mutable std::vector<uint32_t> m_traceCountPerThread;
+};
+
+#endif
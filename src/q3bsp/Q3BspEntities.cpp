@@ -0,0 +1,281 @@
+#include "q3bsp/Q3BspEntities.hpp"
+#include "common/BspMap.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+enum EntityToken
+{
+    TokenNone,   // end of text
+    TokenString, // quoted or bare word
+    TokenOpen,   // {
+    TokenClose   // }
+};
+
+static inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// next token in lump text - the lump is usually terminated with a null character, which also ends parsing
+static EntityToken nextToken(const char *&p, const char *end, Q3BspEntityString &token)
+{
+    while (p < end)
+    {
+        if (isSpace(*p))
+            ++p;
+        else if (*p == '/' && p + 1 < end && p[1] == '/')
+        {
+            while (p < end && *p != '\n')
+                ++p;
+        }
+        else
+            break;
+    }
+
+    if (p >= end || *p == '\0')
+        return TokenNone;
+
+    if (*p == '{' || *p == '}')
+        return *p++ == '{' ? TokenOpen : TokenClose;
+
+    if (*p == '"')
+    {
+        const char *start = ++p;
+        while (p < end && *p != '"' && *p != '\0')
+            ++p;
+
+        token.str = start;
+        token.length = p - start;
+        if (p < end && *p == '"')
+            ++p;
+
+        return TokenString;
+    }
+
+    const char *start = p;
+    while (p < end && !isSpace(*p) && *p != '\0' && *p != '"' && *p != '{' && *p != '}')
+        ++p;
+
+    token.str = start;
+    token.length = p - start;
+    return TokenString;
+}
+
+bool Q3BspEntityString::operator==(const char *other) const
+{
+    return strlen(other) == length && !memcmp(str, other, length);
+}
+
+bool Q3BspEntityString::operator<(const Q3BspEntityString &other) const
+{
+    int cmp = memcmp(str, other.str, std::min(length, other.length));
+    return cmp < 0 || (cmp == 0 && length < other.length);
+}
+
+bool Q3BspEntityString::StartsWith(const char *prefix) const
+{
+    size_t prefixLength = strlen(prefix);
+    return prefixLength <= length && !memcmp(str, prefix, prefixLength);
+}
+
+bool Q3BspEntities::Parse(const char *text, size_t size)
+{
+    m_entities.clear();
+    m_pairs.clear();
+    m_classnames.clear();
+
+    const char *p = text;
+    const char *end = text + size;
+    Q3BspEntityString key, value;
+
+    while (true)
+    {
+        EntityToken token = nextToken(p, end, key);
+        if (token == TokenNone)
+            return true;
+
+        if (token != TokenOpen)
+        {
+            LOG_MESSAGE("Malformed entity lump: expected '{' at offset " << (p - text));
+            return false;
+        }
+
+        Q3BspEntity entity;
+        entity.firstPair = (int)m_pairs.size();
+
+        while ((token = nextToken(p, end, key)) == TokenString)
+        {
+            if (nextToken(p, end, value) != TokenString)
+            {
+                LOG_MESSAGE("Malformed entity lump: key without value at offset " << (p - text));
+                return false;
+            }
+
+            if (key == "classname")
+                entity.classname = value;
+
+            m_pairs.push_back({ key, value });
+        }
+
+        if (token != TokenClose)
+        {
+            LOG_MESSAGE("Malformed entity lump: unterminated entity at offset " << (p - text));
+            return false;
+        }
+
+        entity.numPairs = (int)m_pairs.size() - entity.firstPair;
+        if (entity.classname.length > 0)
+            m_classnames[entity.classname].push_back((int)m_entities.size());
+
+        m_entities.push_back(entity);
+    }
+}
+
+bool Q3BspEntities::FindValue(int entity, const char *key, Q3BspEntityString &value) const
+{
+    const Q3BspEntity &e = m_entities[entity];
+    for (int i = e.firstPair; i < e.firstPair + e.numPairs; ++i)
+    {
+        if (m_pairs[i].key == key)
+        {
+            value = m_pairs[i].value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// values aren't null terminated - copy to a local buffer for scanning
+template<size_t N>
+static bool copyValue(const Q3BspEntityString &str, char (&buffer)[N])
+{
+    if (str.length >= N)
+        return false;
+
+    memcpy(buffer, str.str, str.length);
+    buffer[str.length] = '\0';
+    return true;
+}
+
+bool Q3BspEntities::FindFloat(int entity, const char *key, float &value) const
+{
+    Q3BspEntityString str;
+    char buffer[64];
+    if (!FindValue(entity, key, str) || !copyValue(str, buffer))
+        return false;
+
+    return sscanf(buffer, "%f", &value) == 1;
+}
+
+bool Q3BspEntities::FindVector(int entity, const char *key, Math::Vector3f &value) const
+{
+    Q3BspEntityString str;
+    char buffer[64];
+    if (!FindValue(entity, key, str) || !copyValue(str, buffer))
+        return false;
+
+    float x, y, z;
+    if (sscanf(buffer, "%f %f %f", &x, &y, &z) != 3)
+        return false;
+
+    value = Math::Vector3f(x, y, z);
+    return true;
+}
+
+const std::vector<int> &Q3BspEntities::FindByClassname(const char *classname) const
+{
+    static const std::vector<int> noEntities;
+
+    Q3BspEntityString name;
+    name.str = classname;
+    name.length = strlen(classname);
+
+    auto it = m_classnames.find(name);
+    return it != m_classnames.end() ? it->second : noEntities;
+}
+
+void Q3BspEntities::FindByClassnamePrefix(const char *prefix, std::vector<int> &result) const
+{
+    Q3BspEntityString name;
+    name.str = prefix;
+    name.length = strlen(prefix);
+
+    // classnames are sorted, so all matches follow the first name not less than the prefix
+    for (auto it = m_classnames.lower_bound(name); it != m_classnames.end() && it->first.StartsWith(prefix); ++it)
+        result.insert(result.end(), it->second.begin(), it->second.end());
+}
+
+int Q3BspEntities::Worldspawn() const
+{
+    return (!m_entities.empty() && m_entities[0].classname == "worldspawn") ? 0 : -1;
+}
+
+void Q3BspEntities::Benchmark(const char *text, size_t size, int numParses, BspEntityStats &stats) const
+{
+    if (!text || numParses <= 0)
+        return;
+
+    stats.numParses = numParses;
+    stats.numEntities = (int)m_entities.size();
+    stats.mismatches = 0;
+
+    Q3BspEntities table;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < numParses; ++i)
+        table.Parse(text, size);
+    float parseTime = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+
+    if (table.m_entities.size() != m_entities.size() || table.m_pairs.size() != m_pairs.size() || table.m_classnames.size() != m_classnames.size())
+        stats.mismatches++;
+
+    // every classname in the lump is looked up the same number of times as the lump is parsed
+    std::vector<std::string> names;
+    for (const auto &c : m_classnames)
+        names.push_back(c.first.ToString());
+
+    size_t numFound = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < numParses; ++i)
+    {
+        for (const auto &name : names)
+            numFound += FindByClassname(name.c_str()).size();
+    }
+    float lookupTime = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+
+    std::vector<std::vector<int>> scanned(names.size());
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < numParses; ++i)
+    {
+        for (size_t n = 0; n < names.size(); ++n)
+        {
+            scanned[n].clear();
+            for (int e = 0; e < (int)m_entities.size(); ++e)
+            {
+                if (m_entities[e].classname == names[n].c_str())
+                    scanned[n].push_back(e);
+            }
+        }
+    }
+    float scanTime = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+
+    for (size_t n = 0; n < names.size(); ++n)
+    {
+        if (scanned[n] != FindByClassname(names[n].c_str()))
+            stats.mismatches++;
+    }
+
+    float numLookups = (float)numParses * names.size();
+    stats.parseTime = parseTime * 1000.f / numParses;
+    stats.megabytesPerSec   = parseTime  > 0.f ? numParses * (size / (1024.f * 1024.f)) / parseTime : 0.f;
+    stats.lookupsPerSec     = lookupTime > 0.f ? numLookups / lookupTime : 0.f;
+    stats.scanLookupsPerSec = scanTime   > 0.f ? numLookups / scanTime : 0.f;
+
+    LOG_MESSAGE_ASSERT(stats.mismatches == 0, "Entity benchmark results differ from the loaded table for " << stats.mismatches << " parses/classnames!");
+    LOG_MESSAGE("Entity benchmark: " << numParses << " parses of " << m_entities.size() << " entities, " << stats.parseTime << "ms per parse ("
+                << stats.megabytesPerSec << "MB/s), " << stats.lookupsPerSec << " lookups/s indexed, " << stats.scanLookupsPerSec
+                << " lookups/s scanned (" << numFound / numParses << " entities found per pass)");
+}
@@ -0,0 +1,73 @@
+#ifndef Q3BSPENTITIES_INCLUDED
+#define Q3BSPENTITIES_INCLUDED
+
+#include "Math.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+struct BspEntityStats;
+
+/*
+ *  Quake III entity lump parsed in a single pass into a table of key/value pairs. Keys and values point directly
+ *  into lump text (nothing is copied), entities are indexed by classname so that lookups are proportional to
+ *  the number of matching entities rather than the size of the lump.
+ */
+
+// non-owning view of a string in entity lump text (not null terminated)
+struct Q3BspEntityString
+{
+    const char *str = nullptr;
+    size_t length   = 0;
+
+    bool operator==(const char *other) const;
+    bool operator<(const Q3BspEntityString &other) const;
+    bool StartsWith(const char *prefix) const;
+    std::string ToString() const { return std::string(str, length); }
+};
+
+struct Q3BspEntityPair
+{
+    Q3BspEntityString key;
+    Q3BspEntityString value;
+};
+
+struct Q3BspEntity
+{
+    int firstPair = 0;
+    int numPairs  = 0;
+    Q3BspEntityString classname;
+};
+
+class Q3BspEntities
+{
+public:
+    // text has to outlive the table - returns false (and keeps entities parsed so far) if the lump is malformed
+    bool Parse(const char *text, size_t size);
+
+    size_t NumEntities() const { return m_entities.size(); }
+    const Q3BspEntity &Entity(int index) const { return m_entities[index]; }
+    const Q3BspEntityPair *Pairs(int index) const { return &m_pairs[m_entities[index].firstPair]; }
+
+    // value of a key in given entity - false if the key is missing (or can't be converted)
+    bool FindValue(int entity, const char *key, Q3BspEntityString &value) const;
+    bool FindFloat(int entity, const char *key, float &value) const;
+    bool FindVector(int entity, const char *key, Math::Vector3f &value) const;
+
+    // indices of entities with given classname (in lump order)
+    const std::vector<int> &FindByClassname(const char *classname) const;
+    // indices of entities with classname beginning with prefix (e.g. "info_player_") - appended to result
+    void FindByClassnamePrefix(const char *prefix, std::vector<int> &result) const;
+    // first entity in the lump, -1 if it's not worldspawn
+    int Worldspawn() const;
+
+    // parse the lump text this table was built from numParses times and time classname lookups through the index
+    // against scanning all entities - both results are compared
+    void Benchmark(const char *text, size_t size, int numParses, BspEntityStats &stats) const;
+private:
+    std::vector<Q3BspEntity>     m_entities;
+    std::vector<Q3BspEntityPair> m_pairs;
+    std::map<Q3BspEntityString, std::vector<int>> m_classnames;
+};
+
+#endif
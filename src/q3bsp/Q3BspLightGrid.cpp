@@ -0,0 +1,352 @@
+#include "q3bsp/Q3BspLightGrid.hpp"
+#include "q3bsp/Q3BspMap.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <random>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define Q3LIGHTGRID_SSE
+#include <emmintrin.h>
+#endif
+
+const Math::Vector3f Q3BspLightGrid::s_defaultGridSize(64.f, 64.f, 128.f);
+
+static const float s_byteToColor = 1.f / 255.f;
+
+// weights of grid points don't sum up to 1 if some of them are in solid - rescale unless (almost) all of them are lit
+static const float s_fullWeight = 0.99f;
+
+// self-check: number of random points sampled both batched and per-point, and allowed difference of sample components
+static const int   s_checkPoints = 4096;
+static const float s_checkEpsilon = 1e-3f;
+
+static bool samplesMatch(const BspLightSample &a, const BspLightSample &b)
+{
+    const Math::Vector3f *va[3] = { &a.ambient, &a.directed, &a.direction };
+    const Math::Vector3f *vb[3] = { &b.ambient, &b.directed, &b.direction };
+    for (int i = 0; i < 3; ++i)
+    {
+        if (fabsf(va[i]->m_x - vb[i]->m_x) > s_checkEpsilon ||
+            fabsf(va[i]->m_y - vb[i]->m_y) > s_checkEpsilon ||
+            fabsf(va[i]->m_z - vb[i]->m_z) > s_checkEpsilon)
+            return false;
+    }
+    return true;
+}
+
+bool Q3BspLightGrid::Init(const Q3BspMap &map, const Math::Vector3f &gridSize)
+{
+    m_numPoints = 0;
+    if (map.models.empty() || map.lightVols.empty())
+        return false;
+
+    // grid spans world model bounds snapped inwards to grid size
+    const Q3BspModelLump &world = map.models[0];
+    const float worldMins[3] = { world.mins.x, world.mins.y, world.mins.z };
+    const float worldMaxs[3] = { world.maxs.x, world.maxs.y, world.maxs.z };
+    m_gridSize[0] = gridSize.m_x;
+    m_gridSize[1] = gridSize.m_y;
+    m_gridSize[2] = gridSize.m_z;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        m_invGridSize[i] = 1.f / m_gridSize[i];
+        m_origin[i] = m_gridSize[i] * ceilf(worldMins[i] * m_invGridSize[i]);
+        float maxs = m_gridSize[i] * floorf(worldMaxs[i] * m_invGridSize[i]);
+        m_bounds[i] = (int)((maxs - m_origin[i]) * m_invGridSize[i]) + 1;
+    }
+
+    int numPoints = m_bounds[0] * m_bounds[1] * m_bounds[2];
+    if (numPoints != (int)map.lightVols.size())
+    {
+        LOG_MESSAGE("Light grid size mismatch: expected " << numPoints << " points, lump has " << map.lightVols.size());
+        return false;
+    }
+
+    // directions are encoded as two angles quantized to a byte each
+    float sinTable[256], cosTable[256];
+    for (int i = 0; i < 256; ++i)
+    {
+        sinTable[i] = sinf(i * 2.f * (float)PI / 256.f);
+        cosTable[i] = cosf(i * 2.f * (float)PI / 256.f);
+    }
+
+    m_ambientR.resize(numPoints);  m_ambientG.resize(numPoints);  m_ambientB.resize(numPoints);
+    m_directedR.resize(numPoints); m_directedG.resize(numPoints); m_directedB.resize(numPoints);
+    m_dirX.resize(numPoints); m_dirY.resize(numPoints); m_dirZ.resize(numPoints);
+    m_weight.resize(numPoints);
+
+    for (int i = 0; i < numPoints; ++i)
+    {
+        const Q3BspLightVolLump &lv = map.lightVols[i];
+        m_ambientR[i]  = lv.ambient[0] * s_byteToColor;
+        m_ambientG[i]  = lv.ambient[1] * s_byteToColor;
+        m_ambientB[i]  = lv.ambient[2] * s_byteToColor;
+        m_directedR[i] = lv.directional[0] * s_byteToColor;
+        m_directedG[i] = lv.directional[1] * s_byteToColor;
+        m_directedB[i] = lv.directional[2] * s_byteToColor;
+
+        // dir[0] - longitude (angle from z axis), dir[1] - latitude (angle around z axis)
+        m_dirX[i] = cosTable[lv.dir[1]] * sinTable[lv.dir[0]];
+        m_dirY[i] = sinTable[lv.dir[1]] * sinTable[lv.dir[0]];
+        m_dirZ[i] = cosTable[lv.dir[0]];
+
+        // Quake III ignores points with no ambient light as being inside walls, whatever their directed light
+        bool lit = lv.ambient[0] || lv.ambient[1] || lv.ambient[2];
+        m_weight[i] = lit ? 1.f : 0.f;
+    }
+
+    m_numPoints = numPoints;
+    LOG_MESSAGE("Light grid: " << m_bounds[0] << "x" << m_bounds[1] << "x" << m_bounds[2] << " points");
+    return true;
+}
+
+void Q3BspLightGrid::Sample(const Math::Vector3f &position, BspLightSample &sample) const
+{
+    if (!Valid())
+    {
+        sample.ambient = sample.directed = Math::Vector3f();
+        sample.direction = Math::Vector3f(0.f, 0.f, 1.f);
+        return;
+    }
+
+    const float p[3] = { position.m_x, position.m_y, position.m_z };
+    int baseIdx, steps[3];
+    float frac[3];
+    Locate(p, baseIdx, steps, frac);
+
+    float total = 0.f;
+    float ambient[3]  = { 0.f, 0.f, 0.f };
+    float directed[3] = { 0.f, 0.f, 0.f };
+    float dir[3] = { 0.f, 0.f, 0.f };
+
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        int idx = baseIdx;
+        float factor = 1.f;
+        for (int j = 0; j < 3; ++j)
+        {
+            if (corner & (1 << j))
+            {
+                factor *= frac[j];
+                idx += steps[j];
+            }
+            else
+            {
+                factor *= 1.f - frac[j];
+            }
+        }
+
+        factor *= m_weight[idx];
+        total += factor;
+        ambient[0]  += factor * m_ambientR[idx];
+        ambient[1]  += factor * m_ambientG[idx];
+        ambient[2]  += factor * m_ambientB[idx];
+        directed[0] += factor * m_directedR[idx];
+        directed[1] += factor * m_directedG[idx];
+        directed[2] += factor * m_directedB[idx];
+        dir[0] += factor * m_dirX[idx];
+        dir[1] += factor * m_dirY[idx];
+        dir[2] += factor * m_dirZ[idx];
+    }
+
+    float scale = (total > 0.f && total < s_fullWeight) ? 1.f / total : 1.f;
+    float dirLength = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+    float dirScale = dirLength > 0.f ? 1.f / dirLength : 0.f;
+
+    sample.ambient   = Math::Vector3f(ambient[0] * scale, ambient[1] * scale, ambient[2] * scale);
+    sample.directed  = Math::Vector3f(directed[0] * scale, directed[1] * scale, directed[2] * scale);
+    sample.direction = Math::Vector3f(dir[0] * dirScale, dir[1] * dirScale, dir[2] * dirScale);
+}
+
+void Q3BspLightGrid::SampleBatch(const Math::Vector3f *positions, size_t count, BspLightSample *samples) const
+{
+    size_t i = 0;
+#ifdef Q3LIGHTGRID_SSE
+    if (!Valid())
+        count = 0;
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one  = _mm_set1_ps(1.f);
+    const __m128 fullWeight = _mm_set1_ps(s_fullWeight);
+    const __m128 origin[3]  = { _mm_set1_ps(m_origin[0]), _mm_set1_ps(m_origin[1]), _mm_set1_ps(m_origin[2]) };
+    const __m128 invSize[3] = { _mm_set1_ps(m_invGridSize[0]), _mm_set1_ps(m_invGridSize[1]), _mm_set1_ps(m_invGridSize[2]) };
+    const __m128 maxCell[3] = { _mm_set1_ps((float)(m_bounds[0] - 1)), _mm_set1_ps((float)(m_bounds[1] - 1)), _mm_set1_ps((float)(m_bounds[2] - 1)) };
+    const __m128 strideX = _mm_set1_ps(1.f);
+    const __m128 strideY = _mm_set1_ps((float)m_bounds[0]);
+    const __m128 strideZ = _mm_set1_ps((float)(m_bounds[0] * m_bounds[1]));
+    const float  strides[3] = { 1.f, (float)m_bounds[0], (float)(m_bounds[0] * m_bounds[1]) };
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const Math::Vector3f *p = positions + i;
+        __m128 pos[3] = { _mm_setr_ps(p[0].m_x, p[1].m_x, p[2].m_x, p[3].m_x),
+                          _mm_setr_ps(p[0].m_y, p[1].m_y, p[2].m_y, p[3].m_y),
+                          _mm_setr_ps(p[0].m_z, p[1].m_z, p[2].m_z, p[3].m_z) };
+
+        // grid cell of each lane - clamped positions are non-negative, so truncation is the same as floor
+        __m128 frac[3], step[3];
+        __m128 cellIdx = zero;
+        const __m128 cellStride[3] = { strideX, strideY, strideZ };
+        for (int j = 0; j < 3; ++j)
+        {
+            __m128 v = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(pos[j], origin[j]), invSize[j]), zero), maxCell[j]);
+            __m128 cell = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+            frac[j] = _mm_sub_ps(v, cell);
+            // no neighbour past the last grid point
+            step[j] = _mm_and_ps(_mm_cmplt_ps(cell, maxCell[j]), _mm_set1_ps(strides[j]));
+            cellIdx = _mm_add_ps(cellIdx, _mm_mul_ps(cell, cellStride[j]));
+        }
+
+        // grid indices fit in float mantissa, so they can be computed in float lanes
+        __m128 cornerIdx[8];
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            cornerIdx[corner] = cellIdx;
+            for (int j = 0; j < 3; ++j)
+            {
+                if (corner & (1 << j))
+                    cornerIdx[corner] = _mm_add_ps(cornerIdx[corner], step[j]);
+            }
+        }
+
+        __m128 total = zero;
+        __m128 ambient[3]  = { zero, zero, zero };
+        __m128 directed[3] = { zero, zero, zero };
+        __m128 dir[3] = { zero, zero, zero };
+
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            int idx[4];
+            _mm_storeu_si128((__m128i *)idx, _mm_cvttps_epi32(cornerIdx[corner]));
+
+            __m128 factor = one;
+            for (int j = 0; j < 3; ++j)
+                factor = _mm_mul_ps(factor, (corner & (1 << j)) ? frac[j] : _mm_sub_ps(one, frac[j]));
+
+#define GRID_LANES(array) _mm_setr_ps(array[idx[0]], array[idx[1]], array[idx[2]], array[idx[3]])
+            factor = _mm_mul_ps(factor, GRID_LANES(m_weight));
+            total = _mm_add_ps(total, factor);
+            ambient[0]  = _mm_add_ps(ambient[0],  _mm_mul_ps(factor, GRID_LANES(m_ambientR)));
+            ambient[1]  = _mm_add_ps(ambient[1],  _mm_mul_ps(factor, GRID_LANES(m_ambientG)));
+            ambient[2]  = _mm_add_ps(ambient[2],  _mm_mul_ps(factor, GRID_LANES(m_ambientB)));
+            directed[0] = _mm_add_ps(directed[0], _mm_mul_ps(factor, GRID_LANES(m_directedR)));
+            directed[1] = _mm_add_ps(directed[1], _mm_mul_ps(factor, GRID_LANES(m_directedG)));
+            directed[2] = _mm_add_ps(directed[2], _mm_mul_ps(factor, GRID_LANES(m_directedB)));
+            dir[0] = _mm_add_ps(dir[0], _mm_mul_ps(factor, GRID_LANES(m_dirX)));
+            dir[1] = _mm_add_ps(dir[1], _mm_mul_ps(factor, GRID_LANES(m_dirY)));
+            dir[2] = _mm_add_ps(dir[2], _mm_mul_ps(factor, GRID_LANES(m_dirZ)));
+#undef GRID_LANES
+        }
+
+        __m128 rescale = _mm_and_ps(_mm_cmpgt_ps(total, zero), _mm_cmplt_ps(total, fullWeight));
+        __m128 scale = _mm_or_ps(_mm_and_ps(rescale, _mm_div_ps(one, total)), _mm_andnot_ps(rescale, one));
+
+        __m128 dirLength = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dir[0], dir[0]), _mm_mul_ps(dir[1], dir[1])), _mm_mul_ps(dir[2], dir[2])));
+        __m128 dirScale = _mm_and_ps(_mm_cmpgt_ps(dirLength, zero), _mm_div_ps(one, dirLength));
+
+        float out[9][4];
+        for (int j = 0; j < 3; ++j)
+        {
+            _mm_storeu_ps(out[j],     _mm_mul_ps(ambient[j], scale));
+            _mm_storeu_ps(out[3 + j], _mm_mul_ps(directed[j], scale));
+            _mm_storeu_ps(out[6 + j], _mm_mul_ps(dir[j], dirScale));
+        }
+
+        for (int l = 0; l < 4; ++l)
+        {
+            samples[i + l].ambient   = Math::Vector3f(out[0][l], out[1][l], out[2][l]);
+            samples[i + l].directed  = Math::Vector3f(out[3][l], out[4][l], out[5][l]);
+            samples[i + l].direction = Math::Vector3f(out[6][l], out[7][l], out[8][l]);
+        }
+    }
+#endif
+
+    for (; i < count; ++i)
+        Sample(positions[i], samples[i]);
+}
+
+void Q3BspLightGrid::SelfCheck(const Q3BspMap &map, BspLightGridStats &stats) const
+{
+    if (!Valid())
+        return;
+
+    for (int i = 0; i < 3; ++i)
+        stats.bounds[i] = m_bounds[i];
+    stats.numChecked = 0;
+    stats.mismatches = 0;
+
+    // exactly at a grid point only that point contributes - unlit ones are skipped, since their lump values are never used
+    BspLightSample sample, reference;
+    for (int z = 0; z < m_bounds[2]; ++z)
+    {
+        for (int y = 0; y < m_bounds[1]; ++y)
+        {
+            for (int x = 0; x < m_bounds[0]; ++x)
+            {
+                int idx = GridPointIndex(x, y, z);
+                if (m_weight[idx] == 0.f)
+                    continue;
+
+                Sample(GridPointPosition(x, y, z), sample);
+                DecodeLightVol(map.lightVols[idx], reference);
+                stats.numChecked++;
+                if (!samplesMatch(sample, reference))
+                    stats.mismatches++;
+            }
+        }
+    }
+
+    // fixed seed - results are comparable between runs; points span slightly past the grid to cover clamping
+    const Q3BspModelLump &world = map.models[0];
+    std::mt19937 rng(1337);
+    std::uniform_real_distribution<float> rx(world.mins.x - m_gridSize[0], world.maxs.x + m_gridSize[0]);
+    std::uniform_real_distribution<float> ry(world.mins.y - m_gridSize[1], world.maxs.y + m_gridSize[1]);
+    std::uniform_real_distribution<float> rz(world.mins.z - m_gridSize[2], world.maxs.z + m_gridSize[2]);
+
+    std::vector<Math::Vector3f> points(s_checkPoints);
+    for (auto &p : points)
+        p = Math::Vector3f(rx(rng), ry(rng), rz(rng));
+
+    std::vector<BspLightSample> samples(points.size());
+    SampleBatch(points.data(), points.size(), samples.data());
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        Sample(points[i], reference);
+        stats.numChecked++;
+        if (!samplesMatch(samples[i], reference))
+            stats.mismatches++;
+    }
+
+    LOG_MESSAGE_ASSERT(stats.mismatches == 0, "Light grid samples differ from reference for " << stats.mismatches << " points!");
+    LOG_MESSAGE("Light grid self-check: " << stats.numChecked << " samples, " << stats.mismatches << " mismatches");
+}
+
+void Q3BspLightGrid::DecodeLightVol(const Q3BspLightVolLump &lightVol, BspLightSample &sample)
+{
+    float longitude = lightVol.dir[0] * 2.f * (float)PI / 256.f;
+    float latitude  = lightVol.dir[1] * 2.f * (float)PI / 256.f;
+
+    sample.ambient   = Math::Vector3f(lightVol.ambient[0], lightVol.ambient[1], lightVol.ambient[2]) * s_byteToColor;
+    sample.directed  = Math::Vector3f(lightVol.directional[0], lightVol.directional[1], lightVol.directional[2]) * s_byteToColor;
+    sample.direction = Math::Vector3f(cosf(latitude) * sinf(longitude), sinf(latitude) * sinf(longitude), cosf(longitude));
+}
+
+Math::Vector3f Q3BspLightGrid::GridPointPosition(int x, int y, int z) const
+{
+    return Math::Vector3f(m_origin[0] + x * m_gridSize[0], m_origin[1] + y * m_gridSize[1], m_origin[2] + z * m_gridSize[2]);
+}
+
+void Q3BspLightGrid::Locate(const float *position, int &baseIdx, int *steps, float *frac) const
+{
+    const int strides[3] = { 1, m_bounds[0], m_bounds[0] * m_bounds[1] };
+    baseIdx = 0;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        float v = std::min(std::max((position[i] - m_origin[i]) * m_invGridSize[i], 0.f), (float)(m_bounds[i] - 1));
+        int cell = (int)v;
+        frac[i]  = v - cell;
+        steps[i] = cell < m_bounds[i] - 1 ? strides[i] : 0;
+        baseIdx += cell * strides[i];
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef Q3BSPLIGHTGRID_INCLUDED
+#define Q3BSPLIGHTGRID_INCLUDED
+
+#include "Math.hpp"
+#include "common/BspMap.hpp"
+#include "q3bsp/Q3Bsp.hpp"
+#include <vector>
+
+class Q3BspMap;
+
+/*
+ *  Quake III light grid (light volumes): ambient and directed light stored at regular intervals across the world model
+ *  bounds. Lump bytes are decoded once into SoA float arrays (directions through a 256 entry sin/cos table), samples are
+ *  trilinearly interpolated between 8 surrounding grid points, skipping points inside solid geometry (same as Quake III).
+ */
+
+class Q3BspLightGrid
+{
+public:
+    static const Math::Vector3f s_defaultGridSize; // spacing of grid points (bsp units) unless overridden by worldspawn
+
+    // returns false if the lump doesn't match the grid expected from world bounds
+    bool Init(const Q3BspMap &map, const Math::Vector3f &gridSize = s_defaultGridSize);
+    bool Valid() const { return m_numPoints > 0; }
+
+    void Sample(const Math::Vector3f &position, BspLightSample &sample) const;
+    // positions are interpolated 4 at a time in SIMD lanes (SSE2 if available, scalar otherwise)
+    void SampleBatch(const Math::Vector3f *positions, size_t count, BspLightSample *samples) const;
+
+    // compares samples taken exactly at lit grid points against DecodeLightVol() and batched samples against Sample()
+    void SelfCheck(const Q3BspMap &map, BspLightGridStats &stats) const;
+
+    // reference decoding of a single lump entry - no interpolation or lookup tables
+    static void DecodeLightVol(const Q3BspLightVolLump &lightVol, BspLightSample &sample);
+    // grid point position (bsp units) and its index in the lump
+    Math::Vector3f GridPointPosition(int x, int y, int z) const;
+    int GridPointIndex(int x, int y, int z) const { return x + y * m_bounds[0] + z * m_bounds[0] * m_bounds[1]; }
+private:
+    // grid cell containing a position: base point index, step to the neighbouring points along each axis and interpolation factors
+    void Locate(const float *position, int &baseIdx, int *steps, float *frac) const;
+
+    float m_origin[3]  = { 0.f, 0.f, 0.f };
+    float m_gridSize[3] = { 0.f, 0.f, 0.f };
+    float m_invGridSize[3] = { 0.f, 0.f, 0.f };
+    int   m_bounds[3] = { 0, 0, 0 }; // number of grid points along each axis
+    int   m_numPoints = 0;
+
+    // decoded grid - colors in 0-1 range, weight is 0 for points inside walls (no light at all) and 1 otherwise
+    std::vector<float> m_ambientR, m_ambientG, m_ambientB;
+    std::vector<float> m_directedR, m_directedG, m_directedB;
+    std::vector<float> m_dirX, m_dirY, m_dirZ;
+    std::vector<float> m_weight;
+};
+
+#endif
@@ -1,4 +1,6 @@
 #include "q3bsp/Q3BspLoader.hpp"
+#include "Utils.hpp"
+#include <chrono>
 
 #ifdef __ANDROID__
 extern AAssetManager *g_androidAssetMgr;
@@ -69,6 +71,13 @@ void Q3BspLoader::LoadEntitiesLump(Q3BspMap *map, BSP_INPUT_FILE bsp)
 
     BSP_SEEK_SET(bsp, map->header.direntries[Entities].offset);
     BSP_READ(bsp, map->entities.ents, sizeof(char) * map->entities.size);
+
+    // entity table points into lump text, which stays around for the lifetime of the map
+    auto parseStart = std::chrono::high_resolution_clock::now();
+    map->entityTable.Parse(map->entities.ents, map->entities.size);
+    std::chrono::duration<float, std::milli> parseTime = std::chrono::high_resolution_clock::now() - parseStart;
+
+    LOG_MESSAGE("Entities: " << map->entityTable.NumEntities() << " parsed in " << parseTime.count() << "ms");
 }
 
 void Q3BspLoader::LoadVisDataLump(Q3BspMap *map, BSP_INPUT_FILE bsp)
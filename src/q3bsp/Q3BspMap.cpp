@@ -1,18 +1,36 @@
 #include "q3bsp/Q3BspMap.hpp"
 #include "q3bsp/Q3BspPatch.hpp"
+#include "renderer/MeshOptimizer.hpp"
 #include "renderer/TextureManager.hpp"
 #include "renderer/vulkan/CmdBuffer.hpp"
 #include "renderer/vulkan/Pipeline.hpp"
 #include "Math.hpp"
+#include "Metrics.hpp"
 #include "ThreadProcessor.hpp"
 #include "Utils.hpp"
 #include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <set>
 #include <sstream>
 
 extern RenderContext   g_renderContext;
 extern ThreadProcessor g_threadProcessor;
-const int   Q3BspMap::s_tesselationLevel = 10;   // level of curved surface tesselation
+extern Metrics         g_metrics;
+const int   Q3BspMap::s_tesselationLevels[] = { 2, 4, 8, 16 }; // levels of curved surface tesselation
+const float Q3BspMap::s_patchLodError      = 1.f;  // max screen space error of a tesselated patch (in pixels)
+const float Q3BspMap::s_patchLodHysteresis = 0.5f; // avoid popping when patch error oscillates around the threshold
 const float Q3BspMap::s_worldScale       = 64.f; // scale down factor for the map
+const float Q3BspMap::s_maxHalfTexcoordSpan = 8.f; // half float step is at most 1/256 of a repeat below 8
+
+// apply model transform to a point (column-major matrix with translation in the last column - same as in shaders)
+static Math::Vector3f transformPoint(const Math::Matrix4f &m, const Math::Vector3f &p)
+{
+    return Math::Vector3f(m[0] * p.m_x + m[4] * p.m_y + m[8]  * p.m_z + m[12],
+                          m[1] * p.m_x + m[5] * p.m_y + m[9]  * p.m_z + m[13],
+                          m[2] * p.m_x + m[6] * p.m_y + m[10] * p.m_z + m[14]);
+}
 
 Q3BspMap::~Q3BspMap()
 {
@@ -23,13 +41,12 @@ Q3BspMap::~Q3BspMap()
         delete it;
 
     // release all allocated Vulkan resources
-    vk::destroyPipeline(g_renderContext.Device(), m_facesPipeline);
-    vk::destroyPipeline(g_renderContext.Device(), m_patchPipeline);
+    m_facesPipelines.Destroy();
+    m_patchTessPipelines.Destroy();
 
-    vk::freeBuffer(g_renderContext.Device(), m_faceVertexBuffer);
-    vk::freeBuffer(g_renderContext.Device(), m_faceIndexBuffer);
-    vk::freeBuffer(g_renderContext.Device(), m_patchVertexBuffer);
-    vk::freeBuffer(g_renderContext.Device(), m_patchIndexBuffer);
+    vk::freeBuffer(g_renderContext.Device(), m_vertexBuffer);
+    vk::freeBuffer(g_renderContext.Device(), m_indexBuffer);
+    vk::freeBuffer(g_renderContext.Device(), m_controlPointBuffer);
 
     for (size_t i = 0; i < lightMaps.size(); ++i)
     {
@@ -38,51 +55,75 @@ Q3BspMap::~Q3BspMap()
     delete[] m_lightmapTextures;
 
     vk::freeBuffer(g_renderContext.Device(), m_renderBuffers.uniformBuffer);
+    vk::freeBuffer(g_renderContext.Device(), m_renderBuffers.indirectBuffer);
     vk::releaseTexture(g_renderContext.Device(), m_whiteTex);
     vkDestroyDescriptorPool(g_renderContext.Device().logical, m_descriptorPool, nullptr);
     vkDestroyDescriptorSetLayout(g_renderContext.Device().logical, m_dsLayout, nullptr);
 
     for (unsigned int i = 0; i < g_threadProcessor.NumThreads(); ++i)
     {
-        vkFreeCommandBuffers(g_renderContext.Device().logical, m_commandPools[i], 1, &m_commandBuffers[0][i]);
-        vkFreeCommandBuffers(g_renderContext.Device().logical, m_commandPools[i], 1, &m_commandBuffers[1][i]);
+        for (auto &frameBuffers : m_commandBuffers)
+            vkFreeCommandBuffers(g_renderContext.Device().logical, m_commandPools[i], 1, &frameBuffers[i]);
         vkDestroyCommandPool(g_renderContext.Device().logical, m_commandPools[i], nullptr);
     }
 }
 
 void Q3BspMap::Init()
 {
+    m_loadStart = std::chrono::high_resolution_clock::now();
+
     // setup render buffers - take multithreading into account (if enabled)
     unsigned int threadCnt = g_threadProcessor.NumThreads();
     m_facesPerThread = (int)leafFaces.size() / threadCnt;
 
-    m_visibleFacesPerThread.resize(threadCnt);
-    m_visiblePatchesPerThread.resize(threadCnt);
+    m_indirectDrawsPerThread.resize(threadCnt);
+    m_apiCallsPerThread.resize(threadCnt, 0);
+    m_drawCallsPerThread.resize(threadCnt, 0);
+    m_bindsPerThread.resize(threadCnt, 0);
+    m_patchTrianglesPerThread.resize(threadCnt, 0);
     m_commandPools.resize(threadCnt);
+    m_commandBuffers.resize(g_renderContext.FramesInFlight());
     for (unsigned int i = 0; i < threadCnt; ++i)
     {
         VK_VERIFY(vk::createCommandPool(g_renderContext.Device(), g_renderContext.Device().graphicsFamilyIndex, &m_commandPools[i]));
-        m_commandBuffers[0].push_back(vk::createCommandBuffer(g_renderContext.Device(), m_commandPools[i], VK_COMMAND_BUFFER_LEVEL_SECONDARY));
-        m_commandBuffers[1].push_back(vk::createCommandBuffer(g_renderContext.Device(), m_commandPools[i], VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+        for (auto &frameBuffers : m_commandBuffers)
+            frameBuffers.push_back(vk::createCommandBuffer(g_renderContext.Device(), m_commandPools[i], VK_COMMAND_BUFFER_LEVEL_SECONDARY));
     }
 
     // if there are no faces, this means a problem or a missing BSP - abort
     if (faces.empty())
         return;
 
-    // regular faces are simple triangle lists, patches are drawn as triangle strips, so we need extra pipeline
-    m_facesPipeline.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    m_patchPipeline.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
-    m_facesPipeline.cache = g_renderContext.PipelineCache();
-    m_patchPipeline.cache = g_renderContext.PipelineCache();
-    // use pipeline derivatives to create patch pipeline using faces pipeline as base
-    m_facesPipeline.flags = VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT;
-    m_patchPipeline.flags = VK_PIPELINE_CREATE_DERIVATIVE_BIT;
+    if (m_entityBenchmark > 0)
+        entityTable.Benchmark(entities.ents, entities.size, m_entityBenchmark, m_mapStats.entities);
+
+    // brush planes are flattened into SIMD friendly tables for collision queries
+    m_collision.Init(*this);
+    if (m_traceBenchmark > 0)
+        m_collision.Benchmark(m_traceBenchmark, m_mapStats.traces);
+    if (m_leafBenchmark > 0)
+        m_collision.BenchmarkLeaves(m_leafBenchmark, m_mapStats.leafQueries);
+
+    // grid spacing can be overridden by worldspawn
+    Math::Vector3f gridSize = Q3BspLightGrid::s_defaultGridSize;
+    int worldspawn = entityTable.Worldspawn();
+    if (worldspawn >= 0)
+        entityTable.FindVector(worldspawn, "gridsize", gridSize);
+
+    if (m_lightGrid.Init(*this, gridSize))
+        m_lightGrid.SelfCheck(*this, m_mapStats.lightGrid);
+    else
+        LOG_MESSAGE("Light grid not available - light samples will be black");
+
+    // patches can be optionally tesselated on the GPU - only control points are uploaded and tesselation level is picked per frame
+    const vk::Device &device = g_renderContext.Device();
+    m_tesselationSupported = device.features.tessellationShader && device.properties.limits.maxTessellationPatchSize >= 9;
+    m_tessPc.maxTessLevel = std::min(m_tessPc.maxTessLevel, (float)device.properties.limits.maxTessellationGenerationLevel);
 
     // stub missing texture used if original Quake assets are missing
     m_missingTex = TextureManager::GetInstance()->LoadTexture("res/missing.png");
 
-    // load textures
+    // start streaming textures - this doesn't block, faces use the missing texture stub until theirs is uploaded
     LoadTextures();
 
     // load lightmaps
@@ -114,36 +155,55 @@ void Q3BspMap::Init()
             m_renderLeaves.back().boundingBoxVertices[i].m_y /= Q3BspMap::s_worldScale;
             m_renderLeaves.back().boundingBoxVertices[i].m_z /= Q3BspMap::s_worldScale;
         }
+
+        m_allLeaves.push_back((int)m_allLeaves.size());
     }
 
     m_renderFaces.reserve(faces.size());
 
-    // create a common descriptor set layout and vertex buffer info
-    m_vbInfo.bindingDescriptions.push_back(vk::getBindingDescription(sizeof(Q3BspVertexLump)));
-    m_vbInfo.attributeDescriptions.push_back(vk::getAttributeDescription(inVertex, VK_FORMAT_R32G32B32_SFLOAT, 0));
-    m_vbInfo.attributeDescriptions.push_back(vk::getAttributeDescription(inTexCoord, VK_FORMAT_R32G32_SFLOAT, sizeof(vec3f)));
-    m_vbInfo.attributeDescriptions.push_back(vk::getAttributeDescription(inTexCoordLightmap, VK_FORMAT_R32G32_SFLOAT, sizeof(vec3f) + sizeof(vec2f)));
+    // quantization also decides if texture coordinates fit in half floats
+    CalculateVertexQuantization();
+
+    // create a common descriptor set layout and vertex buffer info - world geometry uses packed vertices which are decoded in vertex shader
+    if (m_wideTexcoords)
+    {
+        m_vbInfo.bindingDescriptions.push_back(vk::getBindingDescription(sizeof(Q3BspWideRenderVertex)));
+        m_vbInfo.attributeDescriptions.push_back(vk::getAttributeDescription(inVertex, VK_FORMAT_R16G16B16A16_UNORM, offsetof(Q3BspWideRenderVertex, position)));
+        m_vbInfo.attributeDescriptions.push_back(vk::getAttributeDescription(inTexCoord, VK_FORMAT_R32G32_SFLOAT, offsetof(Q3BspWideRenderVertex, texcoord)));
+        m_vbInfo.attributeDescriptions.push_back(vk::getAttributeDescription(inTexCoordLightmap, VK_FORMAT_R16G16_SFLOAT, offsetof(Q3BspWideRenderVertex, lmcoord)));
+    }
+    else
+    {
+        m_vbInfo.bindingDescriptions.push_back(vk::getBindingDescription(sizeof(Q3BspRenderVertex)));
+        m_vbInfo.attributeDescriptions.push_back(vk::getAttributeDescription(inVertex, VK_FORMAT_R16G16B16A16_UNORM, offsetof(Q3BspRenderVertex, position)));
+        m_vbInfo.attributeDescriptions.push_back(vk::getAttributeDescription(inTexCoord, VK_FORMAT_R16G16_SFLOAT, offsetof(Q3BspRenderVertex, texcoord)));
+        m_vbInfo.attributeDescriptions.push_back(vk::getAttributeDescription(inTexCoordLightmap, VK_FORMAT_R16G16_SFLOAT, offsetof(Q3BspRenderVertex, lmcoord)));
+    }
+
+    m_controlPointVbInfo.bindingDescriptions.push_back(vk::getBindingDescription(sizeof(Q3BspVertexLump)));
+    m_controlPointVbInfo.attributeDescriptions.push_back(vk::getAttributeDescription(inVertex, VK_FORMAT_R32G32B32_SFLOAT, 0));
+    m_controlPointVbInfo.attributeDescriptions.push_back(vk::getAttributeDescription(inTexCoord, VK_FORMAT_R32G32_SFLOAT, sizeof(vec3f)));
+    m_controlPointVbInfo.attributeDescriptions.push_back(vk::getAttributeDescription(inTexCoordLightmap, VK_FORMAT_R32G32_SFLOAT, sizeof(vec3f) + sizeof(vec2f)));
     CreateDescriptorSetLayout();
 
-    // create descriptor pool shared between all visible faces and patches (one descriptor per visible face)
-    CreateDescriptorPool((uint32_t)faces.size());
+    // create descriptor pool shared between all faces and patches (one descriptor per texture/lightmap combination)
+    // each material is replaced at most once per frame and old descriptors are kept until frames in flight are done with them
+    std::set<std::pair<int, int>> materialKeys;
+    for (const auto &f : faces)
+    {
+        if (f.type != FaceTypeBillboard)
+            materialKeys.insert(std::make_pair(f.texture, f.lm_index));
+    }
+
+    CreateDescriptorPool(std::max<uint32_t>(1, (uint32_t)materialKeys.size()) * (g_renderContext.FramesInFlight() + 1));
 
-    // single shared uniform buffer
-    VK_VERIFY(vk::createUniformBuffer(g_renderContext.Device(), sizeof(UniformBufferObject), &m_renderBuffers.uniformBuffer));
+    // each view gets its own UBO within the frame slot
+    m_renderBuffers.uniformsPerFrame = (uint32_t)m_numViews;
+    CreateUniformBuffer();
 
     int faceArrayIdx  = 0;
     int patchArrayIdx = 0;
 
-    int numFaceVerts = 0;
-    int numFaceIndexes = 0;
-    int numPatchVerts = 0;
-    int numPatchIndexes = 0;
-
-    // data agregators for vertex and index buffer creation
-    std::vector<Q3BspFaceLump*> faceData;
-    std::vector<Q3BspBiquadPatch*> patchData;
-    std::vector<int> patchIndexData;
-
     for (auto &f : faces)
     {
         m_renderFaces.push_back(Q3FaceRenderable());
@@ -153,36 +213,39 @@ void Q3BspMap::Init()
         {
             m_renderFaces.back().index = patchArrayIdx;
             CreatePatch(f);
-
-            // generate Vulkan descriptors for current patch
-            CreateDescriptorsForPatch(patchArrayIdx, numPatchVerts, numPatchIndexes, patchData, patchIndexData);
             ++patchArrayIdx;
         }
         else
         {
             m_renderFaces.back().index = faceArrayIdx;
-
-            // generate Vulkan descriptors for current face
-            CreateDescriptorsForFace(f, faceArrayIdx, numFaceVerts, numFaceIndexes);
-            faceData.push_back(&f);
-            numFaceVerts += f.n_vertexes;
-            numFaceIndexes += f.n_meshverts;
         }
 
         ++faceArrayIdx;
         m_renderFaces.back().type = f.type;
     }
 
-    // create single, large index and vertex buffers for faces and patches
-    // this is several magnitudes faster than separate buffers for each face/patch
-    CreatePatchBuffers(patchData, numPatchVerts, numPatchIndexes);
-    CreateFaceBuffers(faceData, numFaceVerts, numFaceIndexes);
+    // brush models reuse geometry of their faces, so they only need bounds and transforms
+    CreateModels();
+
+    // with tesselation shaders world patches are expanded on the GPU by default - their CPU tesselated levels
+    // would only take space in the vertex buffer, so they're built once the CPU path is toggled on
+    if (m_tesselationSupported)
+    {
+        m_renderFlags |= Q3RenderHWTesselation;
+        m_cpuPatches = false;
+    }
+
+    CreateGeometry();
+    CreateIndirectBuffer();
+
+    if (m_tesselationSupported)
+        CreateControlPointBuffer();
 
     m_mapStats.totalVertices = (int)vertices.size();
     m_mapStats.totalFaces    = (int)faces.size();
     m_mapStats.totalPatches  = patchArrayIdx;
 
-    RebuildPipeline();
+    CreatePipelines();
 
     // set the scale-down uniform
     m_pc.worldScaleFactor = 1.f / Q3BspMap::s_worldScale;
@@ -196,14 +259,36 @@ void Q3BspMap::OnRender()
 
     unsigned int threadCnt = g_threadProcessor.NumThreads();
 
-    // update uniform buffers
-    m_ubo.ModelViewProjectionMatrix = g_renderContext.ModelViewProjectionMatrix;
-    m_frustum.UpdatePlanes();
+    m_tessPc.base = m_pc;
+
+    // update uniform buffers and viewports of all views
+    const VkViewport &targetViewport = g_renderContext.Viewport();
+    for (size_t v = 0; v < m_views.size(); ++v)
+    {
+        Q3BspView &view = m_views[v];
+        view.viewport = targetViewport;
+        view.viewport.x      = targetViewport.x + view.view.x * targetViewport.width;
+        view.viewport.y      = targetViewport.y + view.view.y * targetViewport.height;
+        view.viewport.width  = view.view.width  * targetViewport.width;
+        view.viewport.height = view.view.height * targetViewport.height;
+        view.scissor.offset.x = (int32_t)view.viewport.x;
+        view.scissor.offset.y = (int32_t)view.viewport.y;
+        view.scissor.extent.width  = (uint32_t)view.viewport.width;
+        view.scissor.extent.height = (uint32_t)view.viewport.height;
+
+        // fill this frame's slot of the uniform ring - slots of frames still in flight are not touched
+        m_ubo.ModelViewProjectionMatrix = view.view.viewProjection;
+        view.uniformOffset = m_renderBuffers.UniformOffset(g_renderContext.ActiveFrame(), (int)v);
+        memcpy(m_renderBuffers.uniformData + view.uniformOffset, &m_ubo, sizeof(m_ubo));
+        // no-op on host coherent memory, required otherwise
+        vmaFlushAllocation(g_renderContext.Device().allocator, m_renderBuffers.uniformBuffer.allocation, view.uniformOffset, sizeof(m_ubo));
+    }
 
-    void *data;
-    vmaMapMemory(g_renderContext.Device().allocator, m_renderBuffers.uniformBuffer.allocation, &data);
-    memcpy(data, &m_ubo, sizeof(m_ubo));
-    vmaUnmapMemory(g_renderContext.Device().allocator, m_renderBuffers.uniformBuffer.allocation);
+    // pick pipelines matching current render pass and fill mode - all variants are precompiled, so it's just a lookup
+    VkPolygonMode polygonMode = HasRenderFlag(Q3RenderShowWireframe) ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
+    m_facesPipeline = &m_facesPipelines.Get(g_renderContext.ActiveRenderPass(), polygonMode, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    if (m_tesselationSupported)
+        m_patchTessPipeline = &m_patchTessPipelines.Get(g_renderContext.ActiveRenderPass(), polygonMode, VK_PRIMITIVE_TOPOLOGY_PATCH_LIST);
 
     VkCommandBufferInheritanceInfo inheritanceInfo = {};
     inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
@@ -212,6 +297,7 @@ void Q3BspMap::OnRender()
 
     // record new set of command buffers including only visible faces and patches
     std::vector<VkCommandBuffer> buffersToRender;
+    auto recordStart = std::chrono::high_resolution_clock::now();
     if (threadCnt > 1)
     {
         for (unsigned int i = 0; i < threadCnt; ++i)
@@ -227,10 +313,12 @@ void Q3BspMap::OnRender()
         Draw(0, inheritanceInfo);
     }
 
+    m_mapStats.recordTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - recordStart).count();
+
     // queue for rendering only non-empty command buffers
     for (unsigned int i = 0; i < threadCnt; ++i)
     {
-        if (!m_visibleFacesPerThread[i].empty() || !m_visiblePatchesPerThread[i].empty())
+        if (ThreadHasVisibleSurfaces(i))
         {
             buffersToRender.push_back(m_commandBuffers[g_renderContext.ActiveFrame()][i]);
         }
@@ -238,41 +326,131 @@ void Q3BspMap::OnRender()
 
     if (!buffersToRender.empty())
         vkCmdExecuteCommands(g_renderContext.ActiveCmdBuffer(), (uint32_t)buffersToRender.size(), buffersToRender.data());
+
+    if (m_frameCount == 0)
+        m_mapStats.firstFrameTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - m_loadStart).count();
+
+    // visibility is known by now, so streamed textures can be prioritized - swapped materials are used starting next frame
+    StreamTextures();
+    UpdateTextureResidency();
+    ++m_frameCount;
 }
 
-void Q3BspMap::OnUpdate(const Math::Vector3f &cameraPosition)
+void Q3BspMap::OnUpdate(const std::vector<BspView> &views)
 {
-    //calculate the camera leaf
-    int cameraLeaf = FindCameraLeaf(cameraPosition * Q3BspMap::s_worldScale);
+    LOG_MESSAGE_ASSERT(views.size() <= (size_t)m_numViews, "Too many views - increase view count before map initialization.");
+    unsigned int threadCnt = g_threadProcessor.NumThreads();
+    size_t numViews = std::min(views.size(), (size_t)m_numViews);
 
-    if (g_threadProcessor.NumThreads() > 1)
+    // new views start with the finest patch level - patches are coarsened once their projected error is known
+    if (m_views.size() != numViews)
     {
-        for (unsigned int i = 0; i < g_threadProcessor.NumThreads(); ++i)
+        m_views.resize(numViews);
+        for (auto &view : m_views)
+        {
+            view.visibleFacesPerThread.resize(threadCnt);
+            view.visiblePatchesPerThread.resize(threadCnt);
+            view.visibleModelsPerThread.resize(threadCnt);
+            view.apiCallsPerThread.resize(threadCnt, 0);
+            view.cullTimePerThread.resize(threadCnt, 0.f);
+            view.recordTimePerThread.resize(threadCnt, 0.f);
+            view.patchLods.resize(m_patches.size(), s_numPatchLods - 1);
+        }
+    }
+
+    // frustum planes and PVS are set up before the workers start, so that they can only read them
+    std::set<int> viewClusters;
+    for (size_t v = 0; v < numViews; ++v)
+    {
+        Q3BspView &view = m_views[v];
+        view.view = views[v];
+        view.frustum.UpdatePlanes(views[v].viewProjection);
+
+        //calculate the camera leaf
+        int cameraCluster = m_renderLeaves[FindCameraLeaf(views[v].position * Q3BspMap::s_worldScale)].visCluster;
+        view.cameraCluster = cameraCluster;
+        viewClusters.insert(cameraCluster);
+
+        if (HasRenderFlag(Q3RenderSkipPVS))
+        {
+            view.pvsLeaves = &m_allLeaves;
+            continue;
+        }
+
+        // PVS is expanded only once for views sitting in the same cluster (and kept as long as any view stays there)
+        auto pvs = m_pvsLeaves.find(cameraCluster);
+        if (pvs == m_pvsLeaves.end())
+        {
+            pvs = m_pvsLeaves.insert(std::make_pair(cameraCluster, std::vector<int>())).first;
+            for (size_t i = 0; i < m_renderLeaves.size(); ++i)
+            {
+                if (ClusterVisible(cameraCluster, m_renderLeaves[i].visCluster))
+                    pvs->second.push_back((int)i);
+            }
+        }
+
+        view.pvsLeaves = &pvs->second;
+    }
+
+    for (auto it = m_pvsLeaves.begin(); it != m_pvsLeaves.end();)
+    {
+        if (viewClusters.count(it->first))
+            ++it;
+        else
+            it = m_pvsLeaves.erase(it);
+    }
+
+    if (threadCnt > 1)
+    {
+        for (unsigned int i = 0; i < threadCnt; ++i)
         {
-            g_threadProcessor.AddTask(i, [=] { CalculateVisibleFaces(i, cameraLeaf); });
+            g_threadProcessor.AddTask(i, [=] { CalculateVisibleFaces(i); });
         }
     }
     else
     {
-        CalculateVisibleFaces(0, cameraLeaf);
+        CalculateVisibleFaces(0);
     }
 }
 
-void Q3BspMap::RebuildPipeline()
+void Q3BspMap::CreatePipelines()
 {
-    vk::destroyPipeline(g_renderContext.Device(), m_facesPipeline);
-    vk::destroyPipeline(g_renderContext.Device(), m_patchPipeline);
+    // both regular faces and tesselated patches are simple triangle lists, so a single pipeline is enough
+    vk::Pipeline facesPipeline;
+    facesPipeline.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    facesPipeline.cache = g_renderContext.PipelineCache();
+    facesPipeline.pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    facesPipeline.pushConstantRange.size = sizeof(BspPushConstants);
+    facesPipeline.pushConstantRangeCount = 1;
 
     const char *shaders[] = { "res/Basic_vert.spv", "res/Basic_frag.spv" };
-    m_facesPipeline.pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    m_facesPipeline.pushConstantRange.size = sizeof(BspPushConstants);
-    m_facesPipeline.pushConstantRangeCount = 1;
-    VK_VERIFY(vk::createPipeline(g_renderContext.Device(), g_renderContext.SwapChain(), g_renderContext.ActiveRenderPass(), m_dsLayout, &m_vbInfo, &m_facesPipeline, shaders));
-    m_patchPipeline.pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    m_patchPipeline.pushConstantRange.size = sizeof(BspPushConstants);
-    m_patchPipeline.basePipelineHandle = m_facesPipeline.pipeline;
-    m_patchPipeline.pushConstantRangeCount = 1;
-    VK_VERIFY(vk::createPipeline(g_renderContext.Device(), g_renderContext.SwapChain(), g_renderContext.ActiveRenderPass(), m_dsLayout, &m_vbInfo, &m_patchPipeline, shaders));
+    m_facesPipelines.Init(facesPipeline, m_dsLayout, &m_vbInfo, shaders);
+
+    vk::Pipeline patchTessPipeline;
+    patchTessPipeline.patchControlPoints = 9;
+    patchTessPipeline.cache = g_renderContext.PipelineCache();
+    patchTessPipeline.pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    patchTessPipeline.pushConstantRange.size = sizeof(BspTessPushConstants);
+    patchTessPipeline.pushConstantRangeCount = 1;
+
+    const char *tessShaders[] = { "res/Patch_vert.spv", "res/Patch_tesc.spv", "res/Patch_tese.spv", "res/Basic_frag.spv" };
+    m_patchTessPipelines.Init(patchTessPipeline, m_dsLayout, &m_controlPointVbInfo, tessShaders);
+
+    // every combination of MSAA and wireframe toggles is compiled upfront, so switching them never stalls rendering
+    const vk::RenderPass *renderPasses[] = { &g_renderContext.DefaultRenderPass(), &g_renderContext.MSAARenderPass() };
+    const VkPolygonMode polygonModes[] = { VK_POLYGON_MODE_FILL, VK_POLYGON_MODE_LINE };
+    for (const vk::RenderPass *rp : renderPasses)
+    {
+        for (VkPolygonMode mode : polygonModes)
+        {
+            m_facesPipelines.Add(*rp, mode, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+            if (m_tesselationSupported)
+                m_patchTessPipelines.Add(*rp, mode, VK_PRIMITIVE_TOPOLOGY_PATCH_LIST);
+        }
+    }
+
+    m_facesPipelines.Compile();
+    m_patchTessPipelines.Compile();
 }
 
 std::string Q3BspMap::ThreadAndBspStats()
@@ -281,12 +459,33 @@ std::string Q3BspMap::ThreadAndBspStats()
 
     m_mapStats.visibleFaces = 0;
     m_mapStats.visiblePatches = 0;
+    m_mapStats.apiCalls = 0;
+    m_mapStats.patchTriangles = 0;
+    m_mapStats.visibleModels = 0;
+    m_mapStats.views.assign(m_views.size(), BspViewStats());
     for (unsigned int i = 0; i < g_threadProcessor.NumThreads(); ++i)
     {
         // safe to perform a read from visibility sets without a mutex, since by this point thread processor had waited for all threads to finish, so no writes will occur
-        m_mapStats.visibleFaces += (int)m_visibleFacesPerThread[i].size();
-        m_mapStats.visiblePatches += (int)m_visiblePatchesPerThread[i].size();
-        threadStats += "[#" + std::to_string(i) + ": " + std::to_string(m_visibleFacesPerThread[i].size()) + ", " + std::to_string(m_visiblePatchesPerThread[i].size()) + "]";
+        size_t threadFaces = 0;
+        size_t threadPatches = 0;
+        for (size_t v = 0; v < m_views.size(); ++v)
+        {
+            BspViewStats &viewStats = m_mapStats.views[v];
+            viewStats.visibleFaces += (int)m_views[v].visibleFacesPerThread[i].size();
+            viewStats.visiblePatches += (int)m_views[v].visiblePatchesPerThread[i].size();
+            viewStats.apiCalls += m_views[v].apiCallsPerThread[i];
+            viewStats.cullTime += m_views[v].cullTimePerThread[i];
+            viewStats.recordTime += m_views[v].recordTimePerThread[i];
+            threadFaces += m_views[v].visibleFacesPerThread[i].size();
+            threadPatches += m_views[v].visiblePatchesPerThread[i].size();
+            m_mapStats.visibleModels += (int)m_views[v].visibleModelsPerThread[i].size();
+        }
+
+        m_mapStats.visibleFaces += (int)threadFaces;
+        m_mapStats.visiblePatches += (int)threadPatches;
+        m_mapStats.apiCalls += m_apiCallsPerThread[i];
+        m_mapStats.patchTriangles += m_patchTrianglesPerThread[i];
+        threadStats += "[#" + std::to_string(i) + ": " + std::to_string(threadFaces) + ", " + std::to_string(threadPatches) + "]";
     }
 
     return threadStats;
@@ -329,48 +528,119 @@ int Q3BspMap::FindCameraLeaf(const Math::Vector3f &cameraPosition) const
     return ~leafIndex;
 }
 
+void Q3BspMap::FindLeaves(const std::vector<Math::Vector3f> &points, std::vector<int> &leaves, std::vector<int> &clusters) const
+{
+    leaves.resize(points.size());
+    clusters.resize(points.size());
+
+    if (!points.empty())
+        m_collision.FindLeaves(points.data(), points.size(), leaves.data(), clusters.data());
+}
+
+void Q3BspMap::Trace(BspTrace &trace) const
+{
+    m_collision.Trace(trace);
+}
 
-//Calculate which faces to draw given a camera position & view frustum
-void Q3BspMap::CalculateVisibleFaces(int threadIndex, int cameraLeaf)
+void Q3BspMap::TraceBatch(std::vector<BspTrace> &traces) const
 {
-    m_visibleFacesPerThread[threadIndex].clear();
-    m_visiblePatchesPerThread[threadIndex].clear();
-    int cameraCluster = m_renderLeaves[cameraLeaf].visCluster;
+    m_collision.TraceBatch(traces);
+}
 
-    //loop through the leaves
-    for (const auto &rl : m_renderLeaves)
-    {
-        //if the leaf is not in the PVS - skip it
-        if (!HasRenderFlag(Q3RenderSkipPVS) && !ClusterVisible(cameraCluster, rl.visCluster))
-            continue;
+int Q3BspMap::PointContents(const Math::Vector3f &point) const
+{
+    return m_collision.PointContents(point);
+}
 
-        //if this leaf does not lie in the frustum - skip it
-        if (!HasRenderFlag(Q3RenderSkipFC) && !m_frustum.BoxInFrustum(rl.boundingBoxVertices))
-            continue;
+void Q3BspMap::SampleLight(const Math::Vector3f &position, BspLightSample &sample) const
+{
+    m_lightGrid.Sample(position, sample);
+}
 
-        //loop through faces in this leaf and them to visibility set
-        for (int j = 0; j < rl.numFaces; ++j)
+void Q3BspMap::SampleLightBatch(const std::vector<Math::Vector3f> &positions, std::vector<BspLightSample> &samples) const
+{
+    samples.resize(positions.size());
+
+    if (!positions.empty())
+        m_lightGrid.SampleBatch(positions.data(), positions.size(), samples.data());
+}
+
+
+//Calculate which faces to draw given camera positions & view frustums
+void Q3BspMap::CalculateVisibleFaces(int threadIndex)
+{
+    m_patchTrianglesPerThread[threadIndex] = 0;
+
+    for (auto &view : m_views)
+    {
+        auto cullStart = std::chrono::high_resolution_clock::now();
+        auto &visibleFaces = view.visibleFacesPerThread[threadIndex];
+        auto &visiblePatches = view.visiblePatchesPerThread[threadIndex];
+        visibleFaces.clear();
+        visiblePatches.clear();
+
+        //loop through the leaves in the PVS
+        for (int leafIdx : *view.pvsLeaves)
         {
-            int idx = leafFaces[rl.firstFace + j].face;
-            // determine if this face should be rendered by current thread - we do this to avoid "blinking" if same face ends up in different threads each frame
-            // this is also faster than forcing the threads to wait for each other with mutexes and keeping global visibility lists!
-            bool idxInRange = (idx >= threadIndex * m_facesPerThread) && (idx < (threadIndex + 1) * m_facesPerThread);
-            Q3FaceRenderable *face = &m_renderFaces[idx];
+            const Q3LeafRenderable &rl = m_renderLeaves[leafIdx];
 
-            if ((HasRenderFlag(Q3RenderSkipMissingTex) && !m_textures[faces[idx].texture]) || !idxInRange)
+            //if this leaf does not lie in the frustum - skip it
+            if (!HasRenderFlag(Q3RenderSkipFC) && !view.frustum.BoxInFrustum(rl.boundingBoxVertices))
                 continue;
 
-            if (face->type == FaceTypePolygon || face->type == FaceTypeMesh)
+            //loop through faces in this leaf and them to visibility set
+            for (int j = 0; j < rl.numFaces; ++j)
             {
-                m_visibleFacesPerThread[threadIndex].insert(face);
-            }
+                int idx = leafFaces[rl.firstFace + j].face;
+                // determine if this face should be rendered by current thread - we do this to avoid "blinking" if same face ends up in different threads each frame
+                // this is also faster than forcing the threads to wait for each other with mutexes and keeping global visibility lists!
+                bool idxInRange = (idx >= threadIndex * m_facesPerThread) && (idx < (threadIndex + 1) * m_facesPerThread);
+                Q3FaceRenderable *face = &m_renderFaces[idx];
 
-            if (face->type == FaceTypePatch)
-            {
-                m_visiblePatchesPerThread[threadIndex].insert(idx);
+                if ((HasRenderFlag(Q3RenderSkipMissingTex) && !m_textures[faces[idx].texture] && !m_texturePending[faces[idx].texture]) || !idxInRange)
+                    continue;
+
+                if (face->type == FaceTypePolygon || face->type == FaceTypeMesh)
+                {
+                    visibleFaces.insert(face);
+                }
+
+                // each patch is owned by a single thread, so its level of detail can be safely updated here
+                if (face->type == FaceTypePatch && visiblePatches.insert(face->index).second)
+                {
+                    UpdatePatchLod(face->index, view);
+                    m_patchTrianglesPerThread[threadIndex] += m_renderBuffers.m_patchBuffers[face->index][view.patchLods[face->index]].indexCount / 3;
+                }
             }
         }
+
+        // brush models are culled as a whole - each thread handles every n-th model
+        auto &visibleModels = view.visibleModelsPerThread[threadIndex];
+        visibleModels.clear();
+
+        for (size_t m = 1 + threadIndex; m < m_renderModels.size(); m += g_threadProcessor.NumThreads())
+        {
+            if (m_renderModels[m].numFaces > 0 && ModelVisible(m_renderModels[m], view))
+                visibleModels.push_back((int)m);
+        }
+
+        view.cullTimePerThread[threadIndex] = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - cullStart).count();
+
+        g_metrics.Add(Metrics::CullTime, threadIndex, (uint64_t)(view.cullTimePerThread[threadIndex] * 1000.f));
+        g_metrics.Add(Metrics::VisibleFaces, threadIndex, visibleFaces.size());
+        g_metrics.Add(Metrics::VisiblePatches, threadIndex, visiblePatches.size());
+    }
+}
+
+bool Q3BspMap::ThreadHasVisibleSurfaces(int threadIndex) const
+{
+    for (const auto &view : m_views)
+    {
+        if (!view.visibleFacesPerThread[threadIndex].empty() || !view.visiblePatchesPerThread[threadIndex].empty() || !view.visibleModelsPerThread[threadIndex].empty())
+            return true;
     }
+
+    return false;
 }
 
 void Q3BspMap::ToggleRenderFlag(int flag)
@@ -380,12 +650,6 @@ void Q3BspMap::ToggleRenderFlag(int flag)
 
     switch (flag)
     {
-    case Q3RenderShowWireframe:
-        m_facesPipeline.mode = set ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
-        m_patchPipeline.mode = set ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
-        vkDeviceWaitIdle(g_renderContext.Device().logical);
-        RebuildPipeline();
-        break;
     case Q3RenderShowLightmaps:
         m_pc.renderLightmaps = set ? 1 : 0;
         break;
@@ -395,44 +659,324 @@ void Q3BspMap::ToggleRenderFlag(int flag)
     case Q3RenderAlphaTest:
         m_pc.useAlphaTest = set ? 1 : 0;
         break;
+    case Q3RenderHWTesselation:
+        // stay on CPU tesselated patches if the device can't tesselate them
+        if (set && !m_tesselationSupported)
+        {
+            LOG_MESSAGE("Tesselation shaders not supported by the device - using CPU tesselated patches.");
+            m_renderFlags &= ~flag;
+        }
+        else if (!set && !m_cpuPatches)
+        {
+            // CPU tesselated patches are built on first use - geometry buffers can't be replaced while frames in flight use them
+            vkDeviceWaitIdle(g_renderContext.Device().logical);
+            vk::freeBuffer(g_renderContext.Device(), m_vertexBuffer);
+            vk::freeBuffer(g_renderContext.Device(), m_indexBuffer);
+
+            m_cpuPatches = true;
+            CreateGeometry();
+        }
+        break;
     default:
         break;
     }
 }
 
+void Q3BspMap::SetModelTransform(int model, const Math::Matrix4f &transform)
+{
+    // world geometry is never moved
+    if (model <= 0 || model >= (int)m_renderModels.size())
+        return;
+
+    m_renderModels[model].transform = transform;
+    UpdateModelBounds(m_renderModels[model]);
+}
+
+// brush models (other than the world) aren't referenced by any leaf - each one is culled as a whole and drawn with its own transform
+void Q3BspMap::CreateModels()
+{
+    m_renderModels.resize(models.size());
+
+    for (size_t i = 1; i < models.size(); ++i)
+    {
+        const Q3BspModelLump &m = models[i];
+        Q3ModelRenderable &model = m_renderModels[i];
+
+        if (m.face >= 0 && m.n_faces > 0 && m.face + m.n_faces <= (int)faces.size())
+        {
+            model.firstFace = m.face;
+            model.numFaces  = m.n_faces;
+        }
+
+        model.mins = Math::Vector3f(m.mins.x, m.mins.y, m.mins.z);
+        model.maxs = Math::Vector3f(m.maxs.x, m.maxs.y, m.maxs.z);
+    }
+
+    // models built with an origin brush are stored relative to the origin of their entity (Quake III places them at entity origin)
+    for (int e = 0; e < (int)entityTable.NumEntities(); ++e)
+    {
+        Q3BspEntityString modelName;
+        Math::Vector3f origin;
+        if (!entityTable.FindValue(e, "model", modelName) || !modelName.StartsWith("*") || !entityTable.FindVector(e, "origin", origin))
+            continue;
+
+        int modelIdx = atoi(modelName.ToString().c_str() + 1);
+        if (modelIdx > 0 && modelIdx < (int)m_renderModels.size())
+            Math::Translate(m_renderModels[modelIdx].transform, origin.m_x, origin.m_y, origin.m_z);
+    }
+
+    for (size_t i = 1; i < m_renderModels.size(); ++i)
+        UpdateModelBounds(m_renderModels[i]);
+
+    // patches of brush models are always drawn from CPU tesselated geometry
+    m_modelPatches.assign(m_patches.size(), false);
+    for (size_t i = 1; i < m_renderModels.size(); ++i)
+    {
+        for (int idx = m_renderModels[i].firstFace; idx < m_renderModels[i].firstFace + m_renderModels[i].numFaces; ++idx)
+        {
+            if (m_renderFaces[idx].type == FaceTypePatch)
+                m_modelPatches[m_renderFaces[idx].index] = true;
+        }
+    }
+
+    m_mapStats.totalModels = std::max(0, (int)models.size() - 1);
+}
+
+// transform model bounds to world space and find clusters they touch
+void Q3BspMap::UpdateModelBounds(Q3ModelRenderable &model)
+{
+    float mins[3] = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+    float maxs[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+    // same corner order as bounding boxes of leaves
+    for (int i = 0; i < 8; ++i)
+    {
+        Math::Vector3f corner((i & 4) ? model.maxs.m_x : model.mins.m_x,
+                              (i & 2) ? model.maxs.m_y : model.mins.m_y,
+                              (i & 1) ? model.maxs.m_z : model.mins.m_z);
+        Math::Vector3f p = transformPoint(model.transform, corner);
+        model.boundingBoxVertices[i] = p / Q3BspMap::s_worldScale;
+
+        mins[0] = std::min(mins[0], p.m_x); maxs[0] = std::max(maxs[0], p.m_x);
+        mins[1] = std::min(mins[1], p.m_y); maxs[1] = std::max(maxs[1], p.m_y);
+        mins[2] = std::min(mins[2], p.m_z); maxs[2] = std::max(maxs[2], p.m_z);
+    }
+
+    model.clusters.clear();
+    if (!nodes.empty())
+        FindBoxClusters(0, mins, maxs, model.clusters);
+}
+
+// collect clusters of all leaves touched by a box (bsp units)
+void Q3BspMap::FindBoxClusters(int nodeIdx, const float *mins, const float *maxs, std::vector<int> &clusters) const
+{
+    while (nodeIdx >= 0)
+    {
+        const Q3BspNodeLump &node = nodes[nodeIdx];
+        const Q3BspPlaneLump &plane = planes[node.plane];
+        const float normal[3] = { plane.normal.x, plane.normal.y, plane.normal.z };
+
+        // signed distances of box corners nearest to and farthest along plane normal
+        float nearDist = -plane.dist;
+        float farDist  = -plane.dist;
+        for (int i = 0; i < 3; ++i)
+        {
+            nearDist += normal[i] * (normal[i] > 0.f ? mins[i] : maxs[i]);
+            farDist  += normal[i] * (normal[i] > 0.f ? maxs[i] : mins[i]);
+        }
+
+        // children.x - front node; children.y - back node
+        if (nearDist >= 0.f)
+        {
+            nodeIdx = node.children.x;
+        }
+        else if (farDist < 0.f)
+        {
+            nodeIdx = node.children.y;
+        }
+        else
+        {
+            FindBoxClusters(node.children.x, mins, maxs, clusters);
+            nodeIdx = node.children.y;
+        }
+    }
+
+    int cluster = leaves[~nodeIdx].cluster;
+    if (cluster >= 0 && std::find(clusters.begin(), clusters.end(), cluster) == clusters.end())
+        clusters.push_back(cluster);
+}
+
+bool Q3BspMap::ModelVisible(const Q3ModelRenderable &model, const Q3BspView &view) const
+{
+    if (!HasRenderFlag(Q3RenderSkipFC) && !view.frustum.BoxInFrustum(model.boundingBoxVertices))
+        return false;
+
+    // models which don't touch any cluster (e.g. moved outside of the map) are not PVS culled
+    if (HasRenderFlag(Q3RenderSkipPVS) || model.clusters.empty())
+        return true;
+
+    for (int cluster : model.clusters)
+    {
+        if (ClusterVisible(view.cameraCluster, cluster))
+            return true;
+    }
+
+    return false;
+}
+
 void Q3BspMap::LoadTextures()
 {
     int numTextures = header.direntries[Textures].length / sizeof(Q3BspTextureLump);
 
     m_textures.resize(numTextures);
+    m_texturePending.resize(numTextures, false);
+    m_textureGenerations.resize(numTextures, 0);
 
-    // load the textures from file (determine wheter it's a jpg or tga)
+    // queue textures for loading (bsp doesn't specify wheter it's a jpg or tga, so try both)
     for (const auto &f : faces)
     {
-        if (m_textures[f.texture])
+        if (m_texturePending[f.texture])
             continue;
 
-        std::string nameJPG = textures[f.texture].name;
+        std::string name = textures[f.texture].name;
 
-        nameJPG.append(".jpg");
+        m_texturePending[f.texture] = true;
+        m_textureStreamer.Request(f.texture, { name + ".jpg", name + ".tga" });
+    }
+}
 
-        m_textures[f.texture] = TextureManager::GetInstance()->LoadTexture(nameJPG.c_str());
+// prioritize textures of nearest visible surfaces and swap in the ones which finished loading
+void Q3BspMap::StreamTextures()
+{
+    if (!m_textureStreamer.Pending())
+    {
+        // measured once all textures are resident (right away if there's nothing to load)
+        if (m_mapStats.textureLoadTime == 0.f)
+        {
+            m_mapStats.textureLoadTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - m_loadStart).count();
+            LOG_MESSAGE("All textures loaded in " << m_mapStats.textureLoadTime << "ms");
+        }
+        return;
+    }
 
-        if (m_textures[f.texture] == nullptr)
+    // safe to read visibility sets without a mutex, thread processor had waited for all threads to finish recording
+    // surfaces seen in several views get the priority of the nearest one
+    m_texturePriorities.clear();
+    for (const auto &view : m_views)
+    {
+        const Math::Vector3f &cameraPosition = view.view.position;
+
+        for (unsigned int i = 0; i < g_threadProcessor.NumThreads(); ++i)
         {
-            std::string nameTGA = textures[f.texture].name;
-            nameTGA.append(".tga");
+            for (const auto *f : view.visibleFacesPerThread[i])
+            {
+                const Q3BspFaceLump &face = faces[f - m_renderFaces.data()];
+                if (!m_texturePending[face.texture])
+                    continue;
+
+                const vec3f &p = vertices[face.vertex].position;
+                float distance = (Math::Vector3f(p.x, p.y, p.z) / Q3BspMap::s_worldScale - cameraPosition).Length();
+                m_texturePriorities.push_back(std::make_pair(face.texture, distance));
+            }
 
-            m_textures[f.texture] = TextureManager::GetInstance()->LoadTexture(nameTGA.c_str());
+            for (int pi : view.visiblePatchesPerThread[i])
+            {
+                const Q3BspPatch *patch = m_patches[pi];
+                if (m_texturePending[patch->textureIdx])
+                    m_texturePriorities.push_back(std::make_pair(patch->textureIdx, (patch->center - cameraPosition).Length() - patch->radius));
+            }
 
-            if (m_textures[f.texture] == nullptr)
+            for (int m : view.visibleModelsPerThread[i])
             {
-                std::stringstream sstream;
-                sstream << "Missing texture: " << nameTGA.c_str() << "\n";
-                LOG_MESSAGE(sstream.str().c_str());
+                const Q3ModelRenderable &model = m_renderModels[m];
+                Math::Vector3f center = (model.boundingBoxVertices[0] + model.boundingBoxVertices[7]) * 0.5f;
+                float distance = (center - cameraPosition).Length();
+
+                for (int idx = model.firstFace; idx < model.firstFace + model.numFaces; ++idx)
+                {
+                    if (m_texturePending[faces[idx].texture])
+                        m_texturePriorities.push_back(std::make_pair(faces[idx].texture, distance));
+                }
             }
         }
     }
+
+    m_textureStreamer.Prioritize(m_texturePriorities);
+
+    std::vector<TextureStreamer::Result> results;
+    m_textureStreamer.Update(s_textureUploadsPerFrame, results);
+
+    for (const auto &r : results)
+    {
+        m_textures[r.id] = r.texture;
+        m_texturePending[r.id] = false;
+
+        if (!r.texture)
+        {
+            std::stringstream sstream;
+            sstream << "Missing texture: " << textures[r.id].name << "\n";
+            LOG_MESSAGE(sstream.str().c_str());
+            continue;
+        }
+
+        m_textureGenerations[r.id] = r.texture->Generation();
+        ReplaceMaterials(r.id);
+    }
+}
+
+// report textures used by visible surfaces and pick up images which were replaced by mip eviction or reload
+void Q3BspMap::UpdateTextureResidency()
+{
+    TextureManager *textureManager = TextureManager::GetInstance();
+
+    for (const auto &view : m_views)
+    {
+        for (unsigned int i = 0; i < g_threadProcessor.NumThreads(); ++i)
+        {
+            for (const auto *f : view.visibleFacesPerThread[i])
+            {
+                GameTexture *texture = m_textures[faces[f - m_renderFaces.data()].texture];
+                if (texture)
+                    textureManager->MarkUsed(texture);
+            }
+
+            for (int pi : view.visiblePatchesPerThread[i])
+            {
+                GameTexture *texture = m_textures[m_patches[pi]->textureIdx];
+                if (texture)
+                    textureManager->MarkUsed(texture);
+            }
+
+            for (int m : view.visibleModelsPerThread[i])
+            {
+                const Q3ModelRenderable &model = m_renderModels[m];
+                for (int idx = model.firstFace; idx < model.firstFace + model.numFaces; ++idx)
+                {
+                    GameTexture *texture = m_textures[faces[idx].texture];
+                    if (texture)
+                        textureManager->MarkUsed(texture);
+                }
+            }
+        }
+    }
+
+    textureManager->UpdateResidency();
+
+    for (size_t i = 0; i < m_textures.size(); ++i)
+    {
+        if (m_textures[i] && m_textures[i]->Generation() != m_textureGenerations[i])
+        {
+            m_textureGenerations[i] = m_textures[i]->Generation();
+            ReplaceMaterials((int)i);
+        }
+    }
+
+    // free descriptors which are no longer used by any frame in flight
+    auto it = m_retiredDescriptors.begin();
+    for (; it != m_retiredDescriptors.end() && it->first + g_renderContext.FramesInFlight() <= m_frameCount; ++it)
+        vkFreeDescriptorSets(g_renderContext.Device().logical, m_descriptorPool, 1, &it->second);
+
+    m_retiredDescriptors.erase(m_retiredDescriptors.begin(), it);
 }
 
 void Q3BspMap::LoadLightmaps()
@@ -527,22 +1071,78 @@ void Q3BspMap::CreatePatch(const Q3BspFaceLump &f)
                                                                                          row * newPatch->width + col];
                 }
             }
+        }
+    }
+
+    // bounding sphere and curvature of the surface - control points form a convex hull of the patch, so they're enough to compute both
+    Math::Vector3f mins( FLT_MAX,  FLT_MAX,  FLT_MAX);
+    Math::Vector3f maxs(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (const auto &bp : newPatch->quadraticPatches)
+    {
+        for (int i = 0; i < 9; ++i)
+        {
+            mins.m_x = std::min(mins.m_x, bp.controlPoints[i].position.x); maxs.m_x = std::max(maxs.m_x, bp.controlPoints[i].position.x);
+            mins.m_y = std::min(mins.m_y, bp.controlPoints[i].position.y); maxs.m_y = std::max(maxs.m_y, bp.controlPoints[i].position.y);
+            mins.m_z = std::min(mins.m_z, bp.controlPoints[i].position.z); maxs.m_z = std::max(maxs.m_z, bp.controlPoints[i].position.z);
+        }
 
-            newPatch->quadraticPatches[y * numPatchesWidth + x].Tesselate(Q3BspMap::s_tesselationLevel);
+        for (int i = 0; i < 3; ++i)
+        {
+            const vec3f *row[] = { &bp.controlPoints[i * 3].position, &bp.controlPoints[i * 3 + 1].position, &bp.controlPoints[i * 3 + 2].position };
+            const vec3f *col[] = { &bp.controlPoints[i].position, &bp.controlPoints[i + 3].position, &bp.controlPoints[i + 6].position };
+            Math::Vector3f rowCurvature(row[0]->x - 2.f * row[1]->x + row[2]->x, row[0]->y - 2.f * row[1]->y + row[2]->y, row[0]->z - 2.f * row[1]->z + row[2]->z);
+            Math::Vector3f colCurvature(col[0]->x - 2.f * col[1]->x + col[2]->x, col[0]->y - 2.f * col[1]->y + col[2]->y, col[0]->z - 2.f * col[1]->z + col[2]->z);
+            newPatch->curvature = std::max(newPatch->curvature, std::max(rowCurvature.Length(), colCurvature.Length()));
         }
     }
 
+    Math::Vector3f extents = (maxs - mins) * 0.5f;
+    newPatch->center    = (mins + extents) / Q3BspMap::s_worldScale;
+    newPatch->radius    = extents.Length() / Q3BspMap::s_worldScale;
+    newPatch->curvature /= Q3BspMap::s_worldScale;
+
     m_patches.push_back(newPatch);
 }
 
+// pick tesselation level of a patch so that its projected error in given view stays below s_patchLodError
+void Q3BspMap::UpdatePatchLod(int patchIdx, Q3BspView &view)
+{
+    const Q3BspPatch *patch = m_patches[patchIdx];
+    int &lod = view.patchLods[patchIdx];
+
+    // distance from camera to the bounding sphere - use the finest level if camera is inside it
+    Math::Vector3f toPatch = patch->center - view.view.position;
+    float distance = toPatch.Length() - patch->radius;
+    if (distance <= g_renderContext.nearPlane)
+    {
+        lod = s_numPatchLods - 1;
+        return;
+    }
+
+    // max deviation of a quadratic Bezier from its n-segment approximation is |P0 - 2*P1 + P2| / (4 * n^2)
+    float pixelsPerUnit = view.view.height * g_renderContext.halfHeight / (tanf(0.5f * g_renderContext.fov) * distance);
+    auto screenError = [&](int level) { return patch->curvature / (4.f * s_tesselationLevels[level] * s_tesselationLevels[level]) * pixelsPerUnit; };
+
+    while (lod < s_numPatchLods - 1 && screenError(lod) > s_patchLodError)
+        ++lod;
+
+    while (lod > 0 && screenError(lod - 1) < s_patchLodError * s_patchLodHysteresis)
+        --lod;
+}
+
 void Q3BspMap::Draw(int threadIndex, VkCommandBufferInheritanceInfo inheritanceInfo)
 {
-    // no visible patches nor faces for this thread - bail out
-    if (m_visibleFacesPerThread[threadIndex].empty() && m_visiblePatchesPerThread[threadIndex].empty())
+    m_apiCallsPerThread[threadIndex] = 0;
+    m_drawCallsPerThread[threadIndex] = 0;
+    m_bindsPerThread[threadIndex] = 0;
+
+    // no visible patches nor faces for this thread in any view - bail out
+    if (!ThreadHasVisibleSurfaces(threadIndex))
         return;
 
-    VkBuffer vertexBuffers[] = { m_faceVertexBuffer.buffer, m_patchVertexBuffer.buffer };
     VkDeviceSize offsets[] = { 0 };
+    bool useIndirect = HasRenderFlag(Q3RenderUseMDI);
+    bool tesselatePatches = HasRenderFlag(Q3RenderHWTesselation);
 
     VkCommandBufferBeginInfo beginInfo = {};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -550,41 +1150,297 @@ void Q3BspMap::Draw(int threadIndex, VkCommandBufferInheritanceInfo inheritanceI
     beginInfo.pInheritanceInfo = &inheritanceInfo;
 
     int frameIdx = g_renderContext.ActiveFrame();
-    VK_VERIFY(vkBeginCommandBuffer(m_commandBuffers[frameIdx][threadIndex], &beginInfo));
-    vkCmdSetViewport(m_commandBuffers[frameIdx][threadIndex], 0, 1, &g_renderContext.Viewport());
-    vkCmdSetScissor(m_commandBuffers[frameIdx][threadIndex], 0, 1, &g_renderContext.Scissor());
+    const VkCommandBuffer &cmdBuffer = m_commandBuffers[frameIdx][threadIndex];
+    VK_VERIFY(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+
+    // faces and patches share the pipeline and buffers - views only differ in viewport and uniform data
+    auto bindFacesPipeline = [&] {
+        vkCmdPushConstants(cmdBuffer, m_facesPipeline->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(BspPushConstants), &m_pc);
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_facesPipeline->pipeline);
+        vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &m_vertexBuffer.buffer, offsets);
+        // quake 3 bsp requires uint32 for index type - 16 is too small
+        vkCmdBindIndexBuffer(cmdBuffer, m_indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+        m_apiCallsPerThread[threadIndex] += 4;
+        m_bindsPerThread[threadIndex] += 3;
+    };
+
+    bindFacesPipeline();
+
+    for (size_t v = 0; v < m_views.size(); ++v)
+    {
+        Q3BspView &view = m_views[v];
+        const auto &visibleFaces = view.visibleFacesPerThread[threadIndex];
+        const auto &visiblePatches = view.visiblePatchesPerThread[threadIndex];
+        view.apiCallsPerThread[threadIndex] = 0;
+        view.recordTimePerThread[threadIndex] = 0.f;
+
+        if (visibleFaces.empty() && visiblePatches.empty() && view.visibleModelsPerThread[threadIndex].empty())
+            continue;
 
-    // draw regular faces
-    vkCmdPushConstants(m_commandBuffers[frameIdx][threadIndex], m_facesPipeline.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(BspPushConstants), &m_pc);
-    vkCmdBindPipeline(m_commandBuffers[frameIdx][threadIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, m_facesPipeline.pipeline);
-    vkCmdBindVertexBuffers(m_commandBuffers[frameIdx][threadIndex], 0, 1, vertexBuffers, offsets);
-    // quake 3 bsp requires uint32 for index type - 16 is too small
-    vkCmdBindIndexBuffer(m_commandBuffers[frameIdx][threadIndex], m_faceIndexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+        auto recordStart = std::chrono::high_resolution_clock::now();
+        int apiCallsStart = m_apiCallsPerThread[threadIndex];
+
+        vkCmdSetViewport(cmdBuffer, 0, 1, &view.viewport);
+        vkCmdSetScissor(cmdBuffer, 0, 1, &view.scissor);
+        m_apiCallsPerThread[threadIndex] += 2;
+
+        uint32_t numIndirectCommands = 0;
+        if (useIndirect)
+        {
+            auto &draws = m_indirectDrawsPerThread[threadIndex];
+            draws.clear();
+            for (auto &f : visibleFaces)
+                draws.push_back(&m_renderBuffers.m_faceBuffers[f->index]);
+            if (!tesselatePatches)
+            {
+                for (auto &pi : visiblePatches)
+                    draws.push_back(&m_renderBuffers.m_patchBuffers[pi][view.patchLods[pi]]);
+            }
+
+            numIndirectCommands = DrawIndirect(threadIndex, (int)v, *m_facesPipeline, 0);
+        }
+        else
+        {
+            // draw regular faces
+            for (auto &f : visibleFaces)
+            {
+                FaceBuffers &fb = m_renderBuffers.m_faceBuffers[f->index];
+                vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_facesPipeline->layout, 0, 1, &m_materials[fb.material].set, 1, &view.uniformOffset);
+                vkCmdDrawIndexed(cmdBuffer, fb.indexCount, 1, fb.indexOffset, fb.vertexOffset, 0);
+            }
+
+            m_apiCallsPerThread[threadIndex] += 2 * (int)visibleFaces.size();
+            m_drawCallsPerThread[threadIndex] += (int)visibleFaces.size();
+            m_bindsPerThread[threadIndex] += (int)visibleFaces.size();
+
+            // draw patches
+            if (!tesselatePatches)
+            {
+                for (auto &pi : visiblePatches)
+                {
+                    FaceBuffers &pb = m_renderBuffers.m_patchBuffers[pi][view.patchLods[pi]];
+                    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_facesPipeline->layout, 0, 1, &m_materials[pb.material].set, 1, &view.uniformOffset);
+                    vkCmdDrawIndexed(cmdBuffer, pb.indexCount, 1, pb.indexOffset, pb.vertexOffset, 0);
+                }
+
+                m_apiCallsPerThread[threadIndex] += 2 * (int)visiblePatches.size();
+                m_drawCallsPerThread[threadIndex] += (int)visiblePatches.size();
+                m_bindsPerThread[threadIndex] += (int)visiblePatches.size();
+            }
+        }
+
+        // brush models follow world surfaces - their indirect commands are placed right after the ones of world surfaces
+        numIndirectCommands = DrawModels(threadIndex, (int)v, useIndirect, numIndirectCommands);
+
+        if (useIndirect)
+        {
+            // no-op on host coherent memory, required otherwise
+            VkDeviceSize cmdSize = sizeof(VkDrawIndexedIndirectCommand);
+            vmaFlushAllocation(g_renderContext.Device().allocator, m_renderBuffers.indirectBuffer.allocation,
+                               ((frameIdx * m_numViews + v) * m_indirectSlotSize + m_indirectOffsets[threadIndex]) * cmdSize, numIndirectCommands * cmdSize);
+        }
+
+        // tesselation pipeline replaces faces pipeline state, so it has to be restored for the next view
+        if (tesselatePatches && !visiblePatches.empty())
+        {
+            DrawTesselatedPatches(threadIndex, view);
+            if (v + 1 < m_views.size())
+                bindFacesPipeline();
+        }
+
+        view.apiCallsPerThread[threadIndex] = m_apiCallsPerThread[threadIndex] - apiCallsStart;
+        view.recordTimePerThread[threadIndex] = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - recordStart).count();
+    }
+
+    VK_VERIFY(vkEndCommandBuffer(cmdBuffer));
+
+    g_metrics.Add(Metrics::DrawCalls, threadIndex, m_drawCallsPerThread[threadIndex]);
+    g_metrics.Add(Metrics::Binds, threadIndex, m_bindsPerThread[threadIndex]);
+}
+
+// write indirect commands for surfaces gathered in m_indirectDrawsPerThread and record one draw per material bucket
+uint32_t Q3BspMap::DrawIndirect(int threadIndex, int viewIndex, const vk::Pipeline &pipeline, uint32_t firstCommand)
+{
+    auto &draws = m_indirectDrawsPerThread[threadIndex];
+    if (draws.empty())
+        return firstCommand;
+
+    std::sort(draws.begin(), draws.end(), [](const FaceBuffers *a, const FaceBuffers *b) { return a->material < b->material; });
+
+    int frameIdx = g_renderContext.ActiveFrame();
+    const VkCommandBuffer &cmdBuffer = m_commandBuffers[frameIdx][threadIndex];
+    const VkDeviceSize cmdSize = sizeof(VkDrawIndexedIndirectCommand);
+    uint32_t slotStart = (frameIdx * m_numViews + viewIndex) * m_indirectSlotSize + m_indirectOffsets[threadIndex];
+    VkDrawIndexedIndirectCommand *commands = m_renderBuffers.indirectCommands + slotStart;
+    uint32_t cmdIdx = firstCommand;
 
-    for (auto &f : m_visibleFacesPerThread[threadIndex])
+    for (size_t i = 0; i < draws.size();)
     {
-        FaceBuffers &fb = m_renderBuffers.m_faceBuffers[f->index];
-        vkCmdBindDescriptorSets(m_commandBuffers[frameIdx][threadIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, m_facesPipeline.layout, 0, 1, &fb.descriptor.set, 0, nullptr);
-        vkCmdDrawIndexed(m_commandBuffers[frameIdx][threadIndex], fb.indexCount, 1, fb.indexOffset, fb.vertexOffset, 0);
+        uint32_t bucketStart = cmdIdx;
+        int material = draws[i]->material;
+
+        for (; i < draws.size() && draws[i]->material == material; ++i, ++cmdIdx)
+        {
+            commands[cmdIdx].indexCount    = draws[i]->indexCount;
+            commands[cmdIdx].instanceCount = 1;
+            commands[cmdIdx].firstIndex    = draws[i]->indexOffset;
+            commands[cmdIdx].vertexOffset  = draws[i]->vertexOffset;
+            commands[cmdIdx].firstInstance = 0;
+        }
+
+        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout, 0, 1, &m_materials[material].set, 1, &m_views[viewIndex].uniformOffset);
+        ++m_apiCallsPerThread[threadIndex];
+        ++m_bindsPerThread[threadIndex];
+
+        VkDeviceSize offset = (slotStart + bucketStart) * cmdSize;
+        uint32_t drawCount = cmdIdx - bucketStart;
+
+        // without multiDrawIndirect support drawCount has to be 0 or 1
+        if (g_renderContext.Device().features.multiDrawIndirect)
+        {
+            vkCmdDrawIndexedIndirect(cmdBuffer, m_renderBuffers.indirectBuffer.buffer, offset, drawCount, (uint32_t)cmdSize);
+            ++m_apiCallsPerThread[threadIndex];
+            ++m_drawCallsPerThread[threadIndex];
+        }
+        else
+        {
+            for (uint32_t j = 0; j < drawCount; ++j)
+                vkCmdDrawIndexedIndirect(cmdBuffer, m_renderBuffers.indirectBuffer.buffer, offset + j * cmdSize, 1, (uint32_t)cmdSize);
+            m_apiCallsPerThread[threadIndex] += drawCount;
+            m_drawCallsPerThread[threadIndex] += drawCount;
+        }
     }
 
-    // draw patches
-    vkCmdPushConstants(m_commandBuffers[frameIdx][threadIndex], m_patchPipeline.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(BspPushConstants), &m_pc);
-    vkCmdBindPipeline(m_commandBuffers[frameIdx][threadIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, m_patchPipeline.pipeline);
-    vkCmdBindVertexBuffers(m_commandBuffers[frameIdx][threadIndex], 0, 1, &vertexBuffers[1], offsets);
-    // quake 3 bsp requires uint32 for index type - 16 is too small
-    vkCmdBindIndexBuffer(m_commandBuffers[frameIdx][threadIndex], m_patchIndexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+    return cmdIdx;
+}
+
+// draw visible brush models of a view - faces are batched the same way as world faces, only model transform is pushed before each model
+uint32_t Q3BspMap::DrawModels(int threadIndex, int viewIndex, bool useIndirect, uint32_t firstCommand)
+{
+    const Q3BspView &view = m_views[viewIndex];
+    const auto &visibleModels = view.visibleModelsPerThread[threadIndex];
+    if (visibleModels.empty())
+        return firstCommand;
+
+    const VkCommandBuffer &cmdBuffer = m_commandBuffers[g_renderContext.ActiveFrame()][threadIndex];
+    bool skipMissingTex = HasRenderFlag(Q3RenderSkipMissingTex);
+    auto &draws = m_indirectDrawsPerThread[threadIndex];
+    uint32_t cmdIdx = firstCommand;
 
-    for (auto &pi : m_visiblePatchesPerThread[threadIndex])
+    for (int m : visibleModels)
     {
-        vkCmdBindDescriptorSets(m_commandBuffers[frameIdx][threadIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, m_patchPipeline.layout, 0, 1, &m_renderBuffers.m_patchBuffers[pi][0].descriptor.set, 0, nullptr);
-        for (auto &p : m_renderBuffers.m_patchBuffers[pi])
+        const Q3ModelRenderable &model = m_renderModels[m];
+        draws.clear();
+
+        // patches of brush models are always drawn with the finest CPU tesselated level
+        for (int idx = model.firstFace; idx < model.firstFace + model.numFaces; ++idx)
         {
-            vkCmdDrawIndexed(m_commandBuffers[frameIdx][threadIndex], p.indexCount, 1, p.indexOffset, p.vertexOffset, 0);
+            const Q3FaceRenderable &face = m_renderFaces[idx];
+            if (skipMissingTex && !m_textures[faces[idx].texture] && !m_texturePending[faces[idx].texture])
+                continue;
+
+            if (face.type == FaceTypePolygon || face.type == FaceTypeMesh)
+                draws.push_back(&m_renderBuffers.m_faceBuffers[face.index]);
+            else if (face.type == FaceTypePatch)
+                draws.push_back(&m_renderBuffers.m_patchBuffers[face.index][s_numPatchLods - 1]);
         }
+
+        if (draws.empty())
+            continue;
+
+        vkCmdPushConstants(cmdBuffer, m_facesPipeline->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Math::Matrix4f), &model.transform);
+        ++m_apiCallsPerThread[threadIndex];
+
+        if (useIndirect)
+        {
+            cmdIdx = DrawIndirect(threadIndex, viewIndex, *m_facesPipeline, cmdIdx);
+            continue;
+        }
+
+        for (const FaceBuffers *fb : draws)
+        {
+            vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_facesPipeline->layout, 0, 1, &m_materials[fb->material].set, 1, &view.uniformOffset);
+            vkCmdDrawIndexed(cmdBuffer, fb->indexCount, 1, fb->indexOffset, fb->vertexOffset, 0);
+        }
+
+        m_apiCallsPerThread[threadIndex] += 2 * (int)draws.size();
+        m_drawCallsPerThread[threadIndex] += (int)draws.size();
+        m_bindsPerThread[threadIndex] += (int)draws.size();
     }
 
-    VK_VERIFY(vkEndCommandBuffer(m_commandBuffers[frameIdx][threadIndex]));
+    // world surfaces of the next view expect identity transform
+    vkCmdPushConstants(cmdBuffer, m_facesPipeline->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Math::Matrix4f), &m_pc.modelMatrix);
+    ++m_apiCallsPerThread[threadIndex];
+
+    return cmdIdx;
+}
+
+// draw visible patches using hardware tesselation - control points are expanded on the GPU with screen space level of detail
+void Q3BspMap::DrawTesselatedPatches(int threadIndex, const Q3BspView &view)
+{
+    const auto &visiblePatches = view.visiblePatchesPerThread[threadIndex];
+    if (visiblePatches.empty())
+        return;
+
+    // tesselation level depends on the size of view's viewport
+    BspTessPushConstants tessPc = m_tessPc;
+    tessPc.viewportWidth  = view.viewport.width;
+    tessPc.viewportHeight = view.viewport.height;
+
+    VkDeviceSize offsets[] = { 0 };
+    int frameIdx = g_renderContext.ActiveFrame();
+    const VkCommandBuffer &cmdBuffer = m_commandBuffers[frameIdx][threadIndex];
+
+    // pipeline layout differs from the faces pipeline, so push constants and descriptor sets have to be set again
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_patchTessPipeline->pipeline);
+    vkCmdPushConstants(cmdBuffer, m_patchTessPipeline->layout, m_patchTessPipeline->pushConstantRange.stageFlags, 0, sizeof(BspTessPushConstants), &tessPc);
+    vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &m_controlPointBuffer.buffer, offsets);
+    m_apiCallsPerThread[threadIndex] += 3;
+    m_bindsPerThread[threadIndex] += 2;
+
+    for (auto &pi : visiblePatches)
+    {
+        FaceBuffers &pb = m_renderBuffers.m_patchControlPointBuffers[pi];
+        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_patchTessPipeline->layout, 0, 1, &m_materials[pb.material].set, 1, &view.uniformOffset);
+        vkCmdDraw(cmdBuffer, pb.vertexCount, 1, pb.vertexOffset, 0);
+    }
+
+    m_apiCallsPerThread[threadIndex] += 2 * (int)visiblePatches.size();
+    m_drawCallsPerThread[threadIndex] += (int)visiblePatches.size();
+    m_bindsPerThread[threadIndex] += (int)visiblePatches.size();
+}
+
+// create single, large index and vertex buffers shared by faces and patches
+// this is several magnitudes faster than separate buffers for each face/patch
+void Q3BspMap::CreateGeometry()
+{
+    int numVerts = 0;
+    int numIndexes = 0;
+
+    // data agregator for vertex and index buffer creation
+    std::vector<Q3BspFaceLump*> faceData;
+    m_renderBuffers.m_faceBuffers.resize(faces.size());
+
+    for (size_t i = 0; i < faces.size(); ++i)
+    {
+        if (faces[i].type == FaceTypePatch)
+            continue;
+
+        // generate Vulkan descriptors for current face
+        CreateDescriptorsForFace(faces[i], (int)i, numVerts, numIndexes);
+        faceData.push_back(&faces[i]);
+        numVerts += faces[i].n_vertexes;
+        numIndexes += faces[i].n_meshverts;
+    }
+
+    // generate Vulkan descriptors for patches - their geometry is stored right after all regular faces
+    m_renderBuffers.m_patchBuffers.resize(m_patches.size());
+    for (int i = 0; i < (int)m_patches.size(); ++i)
+    {
+        CreateDescriptorsForPatch(i, numVerts, numIndexes);
+    }
+
+    CreateBuffers(faceData, numVerts, numIndexes);
 }
 
 void Q3BspMap::CreateDescriptorsForFace(const Q3BspFaceLump &face, int idx, int vertexOffset, int indexOffset)
@@ -593,140 +1449,292 @@ void Q3BspMap::CreateDescriptorsForFace(const Q3BspFaceLump &face, int idx, int
         return;
 
     auto &faceBuffer = m_renderBuffers.m_faceBuffers[idx];
-    faceBuffer.descriptor.setLayout = m_dsLayout;
-    faceBuffer.descriptor.pool = m_descriptorPool;
+    faceBuffer.material = GetMaterial(face.texture, face.lm_index);
     faceBuffer.vertexCount = face.n_vertexes;
     faceBuffer.indexCount  = face.n_meshverts;
     faceBuffer.vertexOffset = vertexOffset;
     faceBuffer.indexOffset = indexOffset;
+}
 
-    // check if both the texture and lightmap exist and if not - replace them with missing/white texture stubs
-    const vk::Texture *colorTex = m_textures[faces[idx].texture] ? *m_textures[faces[idx].texture] : *m_missingTex;
-    const vk::Texture &lmap = faces[idx].lm_index >= 0 ? m_lightmapTextures[faces[idx].lm_index] : m_whiteTex;
+void Q3BspMap::CreateDescriptorsForPatch(int idx, int &vertexOffset, int &indexOffset)
+{
+    auto *patch = m_patches[idx];
+    auto &patchBuffers = m_renderBuffers.m_patchBuffers[idx];
+    int numBiquads = (int)patch->quadraticPatches.size();
+    int material = GetMaterial(patch->textureIdx, patch->lightmapIdx);
+
+    // vertices are stored once at the finest level - coarser levels only index every n-th vertex of its grid
+    // all biquadratic patches of a single level are drawn with one call
+    // patches drawn only with tesselation shaders don't need any CPU tesselated geometry
+    bool hasGeometry = m_cpuPatches || m_modelPatches[idx];
+    int finestLevel = s_tesselationLevels[s_numPatchLods - 1];
+    int vertexCount = hasGeometry ? numBiquads * (finestLevel + 1) * (finestLevel + 1) : 0;
+
+    patchBuffers.resize(s_numPatchLods);
+    for (int i = 0; i < s_numPatchLods; ++i)
+    {
+        int level = s_tesselationLevels[i];
+        patchBuffers[i].material = material;
+        patchBuffers[i].vertexOffset = vertexOffset;
+        patchBuffers[i].indexOffset  = indexOffset;
+        patchBuffers[i].vertexCount  = vertexCount;
+        patchBuffers[i].indexCount   = hasGeometry ? numBiquads * level * level * 6 : 0;
+
+        indexOffset += patchBuffers[i].indexCount;
+    }
 
-    const vk::Texture *textureSet[2] = { colorTex, &lmap };
-    CreateDescriptor(textureSet, &faceBuffer.descriptor);
+    vertexOffset += vertexCount;
 }
 
-void Q3BspMap::CreateDescriptorsForPatch(int idx, int &vertexOffset, int &indexOffset, std::vector<Q3BspBiquadPatch*> &vertexData, std::vector<int> &indexData)
+void Q3BspMap::CreateBuffers(const std::vector<Q3BspFaceLump*> &faceData, int vertexCount, int indexCount)
 {
-    auto *patch = m_patches[idx];
-    int numPatches = (int)patch->quadraticPatches.size();
+    // vertex and index data is staged by the upload queue, so it's only assembled in system memory here
+    size_t vertexStride = m_wideTexcoords ? sizeof(Q3BspWideRenderVertex) : sizeof(Q3BspRenderVertex);
+    std::vector<unsigned char> vertexData(vertexCount * vertexStride);
+    std::vector<Q3BspMeshVertLump> indexData(indexCount);
+    unsigned char *dstVertex = vertexData.data();
+    Q3BspMeshVertLump *dstIndex  = indexData.data();
+
+    // texture coordinates are shifted by a whole number of texture repeats to keep them small enough for half float precision
+    auto texcoordOffset = [](const Q3BspVertexLump *v, int count) {
+        vec2f offset = { FLT_MAX, FLT_MAX };
+        for (int i = 0; i < count; ++i)
+        {
+            offset.x = std::min(offset.x, v[i].texcoord[0].x);
+            offset.y = std::min(offset.y, v[i].texcoord[0].y);
+        }
+        offset.x = floorf(offset.x);
+        offset.y = floorf(offset.y);
+        return offset;
+    };
+
+    // meshes and patches are reordered for post-transform vertex cache and vertex fetch locality - track cache misses before and after
+    std::vector<unsigned int> indices, originalIndices, remap;
+    std::vector<Q3BspVertexLump> patchVertices;
+    float missesBefore = 0.f, missesAfter = 0.f;
+    size_t optimizedTriangles = 0;
+    int changedMeshes = 0;
+
+    auto optimizeMesh = [&](size_t vertexCount, bool optimizeFetch) {
+        size_t triangleCount = indices.size() / 3;
+        originalIndices = indices;
+        missesBefore += MeshOptimizer::CalculateACMR(indices.data(), indices.size()) * triangleCount;
+        MeshOptimizer::OptimizeVertexCache(indices.data(), indices.size(), vertexCount);
+        if (optimizeFetch)
+        {
+            MeshOptimizer::OptimizeVertexFetch(indices.data(), indices.size(), vertexCount, remap);
+            for (auto &i : originalIndices)
+                i = remap[i];
+        }
+        missesAfter += MeshOptimizer::CalculateACMR(indices.data(), indices.size()) * triangleCount;
+        optimizedTriangles += triangleCount;
 
-    // check if both the texture and lightmap exist and if not - replace them with missing/white texture stubs
-    const vk::Texture *colorTex = m_textures[patch->textureIdx] ? *m_textures[patch->textureIdx] : *m_missingTex;
-    const vk::Texture &lmap = patch->lightmapIdx >= 0 ? m_lightmapTextures[patch->lightmapIdx] : m_whiteTex;
-    const vk::Texture *textureSet[] = { colorTex, &lmap };
+        // reordering must not drop, duplicate or flip any triangle
+        if (!MeshOptimizer::SameTriangles(originalIndices.data(), indices.data(), indices.size()))
+            ++changedMeshes;
+    };
+
+    for (auto &f : faceData)
+    {
+        vec2f offset = texcoordOffset(&vertices[f->vertex], f->n_vertexes);
+        const unsigned int *meshIndices = (const unsigned int *)&meshVertices[f->meshvert];
+        indices.assign(meshIndices, meshIndices + f->n_meshverts);
+
+        bool validIndices = std::all_of(indices.begin(), indices.end(), [&](unsigned int i) { return i < (unsigned int)f->n_vertexes; });
+        if (f->type == FaceTypeMesh && validIndices)
+        {
+            optimizeMesh(f->n_vertexes, true);
+            for (int i = 0; i < f->n_vertexes; ++i)
+                PackVertex(vertices[f->vertex + i], offset, dstVertex + remap[i] * vertexStride);
+        }
+        else
+        {
+            for (int i = 0; i < f->n_vertexes; ++i)
+                PackVertex(vertices[f->vertex + i], offset, dstVertex + i * vertexStride);
+        }
+
+        dstVertex += f->n_vertexes * vertexStride;
+        memcpy(dstIndex, indices.data(), sizeof(Q3BspMeshVertLump) * f->n_meshverts);
+        dstIndex += f->n_meshverts;
+    }
 
-    // create Vulkan descriptor
-    vk::Descriptor patchDescriptor;
-    patchDescriptor.setLayout = m_dsLayout;
-    patchDescriptor.pool = m_descriptorPool;
-    CreateDescriptor(textureSet, &patchDescriptor);
+    // patches follow regular faces - vertices are tesselated at the finest level and shared by all levels,
+    // indices of each biquadratic patch are rebased so they're relative to the start of entire surface
+    int finestLevel = s_tesselationLevels[s_numPatchLods - 1];
+    unsigned int biquadVertexCount = (finestLevel + 1) * (finestLevel + 1);
+    std::vector<unsigned int> biquadIndices;
 
-    for (int i = 0; i < numPatches; i++)
+    for (size_t p = 0; p < m_patches.size(); ++p)
     {
-        // shorthand references so the code is easier to read
-        auto &biquadPatch = patch->quadraticPatches[i];
-        auto &patchBuffer = m_renderBuffers.m_patchBuffers[idx];
-        int numVerts  = (int)biquadPatch.m_vertices.size();
-        int tessLevel = biquadPatch.m_tesselationLevel;
-        vertexData.push_back(&biquadPatch);
+        auto &quadraticPatches = m_patches[p]->quadraticPatches;
+        const auto &patchBuffers = m_renderBuffers.m_patchBuffers[p];
+        if (patchBuffers[0].vertexCount == 0)
+            continue;
 
-        for (int row = 0; row < tessLevel; ++row)
+        // control points bound the tesselated surface, so they're enough to compute texture coordinate offset
+        vec2f offset = { FLT_MAX, FLT_MAX };
+        for (auto &bp : quadraticPatches)
         {
-            FaceBuffers pb;
-            pb.descriptor = patchDescriptor;
-            pb.vertexCount = numVerts;
-            pb.indexCount  = 2 * (tessLevel + 1);
-            pb.vertexOffset = vertexOffset;
-            pb.indexOffset  = indexOffset;
-            indexOffset += pb.indexCount;
-            indexData.push_back(row * pb.indexCount);
+            vec2f bpOffset = texcoordOffset(bp.controlPoints, 9);
+            offset.x = std::min(offset.x, bpOffset.x);
+            offset.y = std::min(offset.y, bpOffset.y);
+        }
 
-            patchBuffer.emplace_back(pb);
+        patchVertices.clear();
+        for (auto &bp : quadraticPatches)
+        {
+            bp.Tesselate(finestLevel);
+            patchVertices.insert(patchVertices.end(), bp.m_vertices.begin(), bp.m_vertices.end());
         }
 
-        vertexOffset += numVerts;
-    }
-}
+        // finest level goes first: vertex order is optimized for it and coarser levels are remapped to match
+        for (int lod = s_numPatchLods - 1; lod >= 0; --lod)
+        {
+            indices.clear();
+            for (size_t b = 0; b < quadraticPatches.size(); ++b)
+            {
+                quadraticPatches[b].GridIndices(s_tesselationLevels[lod], biquadIndices);
+                for (auto i : biquadIndices)
+                    indices.push_back(i + (unsigned int)b * biquadVertexCount);
+            }
 
-void Q3BspMap::CreateFaceBuffers(const std::vector<Q3BspFaceLump*> &faceData, int vertexCount, int indexCount)
-{
-    vk::Buffer vertexStaging, indexStaging;
-    size_t vertexOffset = 0, indexOffset  = 0;
+            // entire surface is optimized at once, so that vertex cache is utilized across biquadratic patch borders
+            bool finest = lod == s_numPatchLods - 1;
+            if (!finest)
+            {
+                for (auto &i : indices)
+                    i = remap[i];
+            }
 
-    // staging buffer for vertex data
-    vk::createStagingBuffer(g_renderContext.Device(), sizeof(Q3BspVertexLump) * vertexCount, &vertexStaging);
-    // staging buffer for index data
-    vk::createStagingBuffer(g_renderContext.Device(), sizeof(Q3BspMeshVertLump) * indexCount, &indexStaging);
+            optimizeMesh(patchVertices.size(), finest);
+            memcpy(indexData.data() + patchBuffers[lod].indexOffset, indices.data(), sizeof(Q3BspMeshVertLump) * indices.size());
+        }
 
-    void *dstV, *dstI;
-    vmaMapMemory(g_renderContext.Device().allocator, vertexStaging.allocation, &dstV);
-    vmaMapMemory(g_renderContext.Device().allocator, indexStaging.allocation, &dstI);
-    for (auto &f : faceData)
-    {
-        memcpy((char*)dstV + vertexOffset, &(vertices[f->vertex].position), sizeof(Q3BspVertexLump) * f->n_vertexes);
-        memcpy((char*)dstI + indexOffset, &meshVertices[f->meshvert], sizeof(Q3BspMeshVertLump) * f->n_meshverts);
+        unsigned char *patchDst = vertexData.data() + patchBuffers[0].vertexOffset * vertexStride;
+        for (size_t i = 0; i < patchVertices.size(); ++i)
+            PackVertex(patchVertices[i], offset, patchDst + remap[i] * vertexStride);
 
-        vertexOffset += sizeof(Q3BspVertexLump) * f->n_vertexes;
-        indexOffset  += sizeof(Q3BspMeshVertLump) * f->n_meshverts;
+        // tesselated data lives in GPU buffers now
+        for (auto &bp : quadraticPatches)
+        {
+            std::vector<Q3BspVertexLump>().swap(bp.m_vertices);
+            std::vector<unsigned int>().swap(bp.m_indices);
+        }
     }
-    vmaUnmapMemory(g_renderContext.Device().allocator, vertexStaging.allocation);
-    vmaUnmapMemory(g_renderContext.Device().allocator, indexStaging.allocation);
 
     // create rendering buffers
-    vk::createVertexBufferStaged(g_renderContext.Device(), sizeof(Q3BspVertexLump) * vertexCount, vertexStaging, &m_faceVertexBuffer);
-     vk::createIndexBufferStaged(g_renderContext.Device(), sizeof(Q3BspMeshVertLump) * indexCount, indexStaging, &m_faceIndexBuffer);
+    vk::createVertexBuffer(g_renderContext.Device(), vertexData.data(), vertexData.size(), &m_vertexBuffer);
+    vk::createIndexBuffer(g_renderContext.Device(), indexData.data(), sizeof(Q3BspMeshVertLump) * indexCount, &m_indexBuffer);
 
-    freeBuffer(g_renderContext.Device(), vertexStaging);
-    freeBuffer(g_renderContext.Device(), indexStaging);
+    m_mapStats.vertexBufferSize = (int)vertexData.size();
+    if (optimizedTriangles > 0)
+    {
+        m_mapStats.acmrBefore = missesBefore / optimizedTriangles;
+        m_mapStats.acmrAfter  = missesAfter / optimizedTriangles;
+    }
+    m_mapStats.optimizerMismatches = changedMeshes;
+
+    std::stringstream sstream;
+    sstream << "World vertex buffer: " << m_mapStats.vertexBufferSize / 1024 << "KB (unpacked: " << sizeof(Q3BspVertexLump) * vertexCount / 1024 << "KB)\n";
+    if (optimizedTriangles > 0)
+        sstream << "Vertex cache ACMR (meshes and patches, " << MeshOptimizer::VertexCacheSize << " entry LRU): " << m_mapStats.acmrBefore << " -> " << m_mapStats.acmrAfter
+                << " (" << optimizedTriangles << " triangles, " << changedMeshes << " meshes with altered triangles)\n";
+    LOG_MESSAGE(sstream.str().c_str());
+    LOG_MESSAGE_ASSERT(changedMeshes == 0, "Vertex cache optimization altered triangles of " << changedMeshes << " meshes");
 }
 
-void Q3BspMap::CreatePatchBuffers(const std::vector<Q3BspBiquadPatch*> &patchData, int vertexCount, int indexCount)
+// vertex positions are quantized to 16 bits relative to the bounds of all bsp vertices (this includes patch control points)
+void Q3BspMap::CalculateVertexQuantization()
 {
-    vk::Buffer vertexStaging, indexStaging;
-    size_t vertexOffset = 0, indexOffset = 0;
+    vec3f mins = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+    vec3f maxs = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
 
-    // staging buffer for vertex data
-    vk::createStagingBuffer(g_renderContext.Device(), sizeof(Q3BspVertexLump) * vertexCount, &vertexStaging);
-    // staging buffer for index data
-    vk::createStagingBuffer(g_renderContext.Device(), sizeof(Q3BspMeshVertLump) * indexCount, &indexStaging);
+    for (const auto &v : vertices)
+    {
+        mins.x = std::min(mins.x, v.position.x); maxs.x = std::max(maxs.x, v.position.x);
+        mins.y = std::min(mins.y, v.position.y); maxs.y = std::max(maxs.y, v.position.y);
+        mins.z = std::min(mins.z, v.position.z); maxs.z = std::max(maxs.z, v.position.z);
+    }
 
-    void *dstV, *dstI;
-    vmaMapMemory(g_renderContext.Device().allocator, vertexStaging.allocation, &dstV);
-    vmaMapMemory(g_renderContext.Device().allocator, indexStaging.allocation, &dstI);
-    for (auto &p : patchData)
+    // rounding error is at most half of the quantization step
+    const float *min = &mins.x, *max = &maxs.x;
+    float maxPositionError = 0.f;
+    for (int i = 0; i < 3; ++i)
     {
-        memcpy((char*)dstV + vertexOffset, &p->m_vertices[0].position, sizeof(Q3BspVertexLump) * p->m_vertices.size());
-        vertexOffset += sizeof(Q3BspVertexLump) * p->m_vertices.size();
+        m_ubo.PositionBias[i]  = min[i];
+        m_ubo.PositionScale[i] = max[i] > min[i] ? max[i] - min[i] : 1.f;
+        maxPositionError = std::max(maxPositionError, 0.5f * m_ubo.PositionScale[i] / 65535.f);
+    }
 
-        int tessLevel = p->m_tesselationLevel;
-        int indexCount = 2 * (tessLevel + 1);
-        for (int row = 0; row < tessLevel; ++row)
+    // texture coordinates are rebased per surface by whole repeats - a single surface spanning too many repeats
+    // would lose several texels of precision in half floats, so the entire map falls back to full precision instead
+    // (patch control points bound their tesselated surface, so vertices of each face are enough for patches as well)
+    float maxTexcoordSpan = 0.f;
+    for (const auto &f : faces)
+    {
+        if (f.vertex < 0 || f.n_vertexes <= 0 || f.vertex + f.n_vertexes > (int)vertices.size())
+            continue;
+
+        vec2f tcMin = {  FLT_MAX,  FLT_MAX };
+        vec2f tcMax = { -FLT_MAX, -FLT_MAX };
+        for (int i = f.vertex; i < f.vertex + f.n_vertexes; ++i)
         {
-            memcpy((char*)dstI + indexOffset, &p->m_indices[row * indexCount], sizeof(Q3BspMeshVertLump) * indexCount);
-            indexOffset += sizeof(Q3BspMeshVertLump) * indexCount;
+            tcMin.x = std::min(tcMin.x, vertices[i].texcoord[0].x); tcMax.x = std::max(tcMax.x, vertices[i].texcoord[0].x);
+            tcMin.y = std::min(tcMin.y, vertices[i].texcoord[0].y); tcMax.y = std::max(tcMax.y, vertices[i].texcoord[0].y);
         }
+
+        maxTexcoordSpan = std::max(maxTexcoordSpan, std::max(tcMax.x - floorf(tcMin.x), tcMax.y - floorf(tcMin.y)));
     }
-    vmaUnmapMemory(g_renderContext.Device().allocator, vertexStaging.allocation);
-    vmaUnmapMemory(g_renderContext.Device().allocator, indexStaging.allocation);
 
-    // create rendering buffers
-    vk::createVertexBufferStaged(g_renderContext.Device(), sizeof(Q3BspVertexLump) * vertexCount, vertexStaging, &m_patchVertexBuffer);
-     vk::createIndexBufferStaged(g_renderContext.Device(), sizeof(Q3BspMeshVertLump) * indexCount, indexStaging, &m_patchIndexBuffer);
+    m_wideTexcoords = maxTexcoordSpan > s_maxHalfTexcoordSpan;
 
-    freeBuffer(g_renderContext.Device(), vertexStaging);
-    freeBuffer(g_renderContext.Device(), indexStaging);
+    std::stringstream sstream;
+    sstream << "Vertex quantization: max position error " << maxPositionError << " units, max texture coordinate span " << maxTexcoordSpan
+            << " repeats" << (m_wideTexcoords ? " - using 32 bit texture coordinates" : "") << "\n";
+    LOG_MESSAGE(sstream.str().c_str());
+}
+
+void Q3BspMap::PackVertex(const Q3BspVertexLump &vertex, const vec2f &texcoordOffset, unsigned char *dst) const
+{
+    Q3BspRenderVertex packed;
+    const float *position = &vertex.position.x;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        float normalized = (position[i] - m_ubo.PositionBias[i]) / m_ubo.PositionScale[i];
+        packed.position[i] = (uint16_t)(std::min(std::max(normalized, 0.f), 1.f) * 65535.f + 0.5f);
+    }
+
+    packed.position[3] = 0;
+    packed.texcoord[0] = Math::FloatToHalf(vertex.texcoord[0].x - texcoordOffset.x);
+    packed.texcoord[1] = Math::FloatToHalf(vertex.texcoord[0].y - texcoordOffset.y);
+    packed.lmcoord[0]  = Math::FloatToHalf(vertex.texcoord[1].x);
+    packed.lmcoord[1]  = Math::FloatToHalf(vertex.texcoord[1].y);
+
+    if (!m_wideTexcoords)
+    {
+        memcpy(dst, &packed, sizeof(packed));
+        return;
+    }
+
+    Q3BspWideRenderVertex wide;
+    memcpy(wide.position, packed.position, sizeof(wide.position));
+    memcpy(wide.lmcoord, packed.lmcoord, sizeof(wide.lmcoord));
+    wide.texcoord[0] = vertex.texcoord[0].x - texcoordOffset.x;
+    wide.texcoord[1] = vertex.texcoord[0].y - texcoordOffset.y;
+    memcpy(dst, &wide, sizeof(wide));
 }
 
 void Q3BspMap::CreateDescriptorSetLayout()
 {
     VkDescriptorSetLayoutBinding uboLayoutBinding = {};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uboLayoutBinding.descriptorCount = 1;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    // tesselation shaders need the MVP matrix to pick level of detail and to place generated vertices
+    if (m_tesselationSupported)
+        uboLayoutBinding.stageFlags |= VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
     uboLayoutBinding.pImmutableSamplers = nullptr;
 
     VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
@@ -755,7 +1763,7 @@ void Q3BspMap::CreateDescriptorSetLayout()
 void Q3BspMap::CreateDescriptorPool(uint32_t numDescriptors)
 {
     VkDescriptorPoolSize poolSizes[3];
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     poolSizes[0].descriptorCount = numDescriptors;
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     poolSizes[1].descriptorCount = numDescriptors;
@@ -767,14 +1775,17 @@ void Q3BspMap::CreateDescriptorPool(uint32_t numDescriptors)
     poolInfo.poolSizeCount = 3;
     poolInfo.pPoolSizes = poolSizes;
     poolInfo.maxSets = numDescriptors;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
 
     VK_VERIFY(vkCreateDescriptorPool(g_renderContext.Device().logical, &poolInfo, nullptr, &m_descriptorPool));
 }
 
-void Q3BspMap::CreateDescriptor(const vk::Texture **textures, vk::Descriptor *descriptor)
+void Q3BspMap::CreateDescriptor(const vk::Texture **textures, vk::Descriptor *descriptor, bool allocate)
 {
-    // create descriptor set
-    VK_VERIFY(vk::createDescriptorSet(g_renderContext.Device(), descriptor));
+    // create descriptor set (or just rewrite existing one)
+    if (allocate)
+        VK_VERIFY(vk::createDescriptorSet(g_renderContext.Device(), descriptor));
+    // dynamic uniform buffer: actual slot of the ring is selected with a dynamic offset when binding
     VkDescriptorBufferInfo bufferInfo = {};
     bufferInfo.offset = 0;
     bufferInfo.buffer = m_renderBuffers.uniformBuffer.buffer;
@@ -795,7 +1806,7 @@ void Q3BspMap::CreateDescriptor(const vk::Texture **textures, vk::Descriptor *de
     descriptorWrites[0].dstSet = descriptor->set;
     descriptorWrites[0].dstBinding = 0;
     descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     descriptorWrites[0].descriptorCount = 1;
     descriptorWrites[0].pBufferInfo = &bufferInfo;
     descriptorWrites[0].pImageInfo = nullptr;
@@ -824,3 +1835,132 @@ void Q3BspMap::CreateDescriptor(const vk::Texture **textures, vk::Descriptor *de
 
     vkUpdateDescriptorSets(g_renderContext.Device().logical, 3, descriptorWrites, 0, nullptr);
 }
+
+void Q3BspMap::CreateMaterialDescriptor(int textureIdx, int lightmapIdx, vk::Descriptor *descriptor, bool allocate)
+{
+    // check if both the texture and lightmap exist and if not - replace them with missing/white texture stubs
+    const vk::Texture *colorTex = m_textures[textureIdx] ? *m_textures[textureIdx] : *m_missingTex;
+    const vk::Texture &lmap = lightmapIdx >= 0 ? m_lightmapTextures[lightmapIdx] : m_whiteTex;
+    const vk::Texture *textureSet[] = { colorTex, &lmap };
+
+    descriptor->setLayout = m_dsLayout;
+    descriptor->pool = m_descriptorPool;
+    CreateDescriptor(textureSet, descriptor, allocate);
+}
+
+// point all materials using given texture to its current image
+void Q3BspMap::ReplaceMaterials(int textureIdx)
+{
+    // descriptors can't be updated while frames in flight use them - replace them with new ones instead
+    for (auto it = m_materialIds.lower_bound(std::make_pair(textureIdx, INT_MIN)); it != m_materialIds.end() && it->first.first == textureIdx; ++it)
+    {
+        // replaced again within the same frame - the new descriptor isn't used by any frame yet, so it can be rewritten
+        // (this keeps at most FramesInFlight retired descriptors per material, which is what the pool is sized for)
+        if (m_materialFrames[it->second] == m_frameCount)
+        {
+            CreateMaterialDescriptor(it->first.first, it->first.second, &m_materials[it->second], false);
+            continue;
+        }
+
+        m_retiredDescriptors.push_back(std::make_pair(m_frameCount, m_materials[it->second].set));
+        CreateMaterialDescriptor(it->first.first, it->first.second, &m_materials[it->second]);
+        m_materialFrames[it->second] = m_frameCount;
+    }
+}
+
+// fetch descriptor index for given texture/lightmap combination, create a new one if it doesn't exist yet
+int Q3BspMap::GetMaterial(int textureIdx, int lightmapIdx)
+{
+    auto key = std::make_pair(textureIdx, lightmapIdx);
+    auto it = m_materialIds.find(key);
+
+    if (it != m_materialIds.end())
+        return it->second;
+
+    vk::Descriptor descriptor;
+    CreateMaterialDescriptor(textureIdx, lightmapIdx, &descriptor);
+
+    m_materials.push_back(descriptor);
+    m_materialFrames.push_back(UINT64_MAX);
+    m_materialIds[key] = (int)m_materials.size() - 1;
+
+    return m_materialIds[key];
+}
+
+void Q3BspMap::CreateUniformBuffer()
+{
+    // slots have to respect offset alignment required for dynamic uniform buffers
+    VkDeviceSize alignment = std::max((VkDeviceSize)1, g_renderContext.Device().properties.limits.minUniformBufferOffsetAlignment);
+    m_renderBuffers.uniformStride = (uint32_t)((sizeof(UniformBufferObject) + alignment - 1) / alignment * alignment);
+
+    VkDeviceSize size = (VkDeviceSize)m_renderBuffers.UniformOffset(g_renderContext.FramesInFlight());
+    VK_VERIFY(vk::createUniformBuffer(g_renderContext.Device(), size, &m_renderBuffers.uniformBuffer));
+
+    VmaAllocationInfo allocInfo;
+    vmaGetAllocationInfo(g_renderContext.Device().allocator, m_renderBuffers.uniformBuffer.allocation, &allocInfo);
+    m_renderBuffers.uniformData = static_cast<unsigned char *>(allocInfo.pMappedData);
+}
+
+void Q3BspMap::CreateIndirectBuffer()
+{
+    unsigned int threadCnt = g_threadProcessor.NumThreads();
+    m_indirectOffsets.resize(threadCnt);
+    m_indirectSlotSize = 0;
+
+    // reserve space for the worst case: every face and patch handled by a thread is visible
+    for (unsigned int i = 0; i < threadCnt; ++i)
+    {
+        m_indirectOffsets[i] = m_indirectSlotSize;
+
+        for (int idx = i * m_facesPerThread; idx < (int)faces.size() && idx < (int)(i + 1) * m_facesPerThread; ++idx)
+        {
+            // each polygon, mesh and patch is a single draw (billboards aren't drawn)
+            if (faces[idx].type != FaceTypeBillboard)
+                ++m_indirectSlotSize;
+        }
+
+        // brush models handled by this thread
+        for (size_t m = 1 + i; m < m_renderModels.size(); m += threadCnt)
+        {
+            for (int idx = m_renderModels[m].firstFace; idx < m_renderModels[m].firstFace + m_renderModels[m].numFaces; ++idx)
+            {
+                if (faces[idx].type != FaceTypeBillboard)
+                    ++m_indirectSlotSize;
+            }
+        }
+    }
+
+    // one slot per view per frame in flight
+    VkDeviceSize size = std::max(1u, m_indirectSlotSize) * m_numViews * g_renderContext.FramesInFlight() * sizeof(VkDrawIndexedIndirectCommand);
+    VK_VERIFY(vk::createIndirectBuffer(g_renderContext.Device(), size, &m_renderBuffers.indirectBuffer));
+
+    VmaAllocationInfo allocInfo;
+    vmaGetAllocationInfo(g_renderContext.Device().allocator, m_renderBuffers.indirectBuffer.allocation, &allocInfo);
+    m_renderBuffers.indirectCommands = static_cast<VkDrawIndexedIndirectCommand *>(allocInfo.pMappedData);
+}
+
+// upload raw control points of all patches (9 per biquadratic patch) for hardware tesselation
+void Q3BspMap::CreateControlPointBuffer()
+{
+    std::vector<Q3BspVertexLump> controlPoints;
+    int vertexOffset = 0;
+
+    m_renderBuffers.m_patchControlPointBuffers.resize(m_patches.size());
+    for (size_t i = 0; i < m_patches.size(); ++i)
+    {
+        auto &cpBuffer = m_renderBuffers.m_patchControlPointBuffers[i];
+        cpBuffer.material = m_renderBuffers.m_patchBuffers[i][0].material;
+        cpBuffer.vertexOffset = vertexOffset;
+        cpBuffer.vertexCount = 9 * (int)m_patches[i]->quadraticPatches.size();
+
+        for (const auto &biquadPatch : m_patches[i]->quadraticPatches)
+            controlPoints.insert(controlPoints.end(), biquadPatch.controlPoints, biquadPatch.controlPoints + 9);
+
+        vertexOffset += cpBuffer.vertexCount;
+    }
+
+    if (controlPoints.empty())
+        return;
+
+    vk::createVertexBuffer(g_renderContext.Device(), controlPoints.data(), sizeof(Q3BspVertexLump) * controlPoints.size(), &m_controlPointBuffer);
+}
@@ -4,8 +4,14 @@
 #include "Frustum.hpp"
 #include "common/BspMap.hpp"
 #include "q3bsp/Q3Bsp.hpp"
+#include "q3bsp/Q3BspCollision.hpp"
+#include "q3bsp/Q3BspEntities.hpp"
+#include "q3bsp/Q3BspLightGrid.hpp"
+#include "renderer/PipelineVariants.hpp"
 #include "renderer/RenderContext.hpp"
+#include "renderer/TextureStreamer.hpp"
 #include "renderer/Ubo.hpp"
+#include <chrono>
 #include <map>
 #include <set>
 #include <vector>
@@ -21,26 +27,39 @@ struct Q3BspPatch;
 class Q3BspMap : public BspMap
 {
 public:
-    static const int   s_tesselationLevel; // level of curved surface tesselation
+    static const int   s_numPatchLods = 4;
+    static const int   s_tesselationLevels[s_numPatchLods]; // available levels of curved surface tesselation (coarsest first, each divides the finest one)
+    static const float s_patchLodError;      // max allowed screen space error (in pixels) of a tesselated patch
+    static const float s_patchLodHysteresis; // switch to a coarser level only if its error is below this fraction of max error
     static const float s_worldScale;       // scale down factor for the map
+    static const float s_maxHalfTexcoordSpan; // max texture repeats over a single surface which still fit in half float texture coordinates
 
     Q3BspMap(bool bspValid) : BspMap(bspValid) {}
     ~Q3BspMap();
 
     void Init();
     void OnRender();
-    void OnUpdate(const Math::Vector3f &cameraPosition);
-    void RebuildPipeline();
+    void OnUpdate(const std::vector<BspView> &views);
     std::string ThreadAndBspStats();
 
     bool ClusterVisible(int cameraCluster, int testCluster)   const;
     int  FindCameraLeaf(const Math::Vector3f &cameraPosition) const;
-    void CalculateVisibleFaces(int threadIndex, int cameraLeaf);
+    void FindLeaves(const std::vector<Math::Vector3f> &points, std::vector<int> &leaves, std::vector<int> &clusters) const;
+    void CalculateVisibleFaces(int threadIndex);
     void ToggleRenderFlag(int flag);
+    void SetModelTransform(int model, const Math::Matrix4f &transform);
+
+    void Trace(BspTrace &trace) const;
+    void TraceBatch(std::vector<BspTrace> &traces) const;
+    int  PointContents(const Math::Vector3f &point) const;
+
+    void SampleLight(const Math::Vector3f &position, BspLightSample &sample) const;
+    void SampleLightBatch(const std::vector<Math::Vector3f> &positions, std::vector<BspLightSample> &samples) const;
 
     // bsp data
     Q3BspHeader     header;
     Q3BspEntityLump entities;
+    Q3BspEntities   entityTable; // parsed entities lump
     std::vector<Q3BspTextureLump>   textures;
     std::vector<Q3BspPlaneLump>     planes;
     std::vector<Q3BspNodeLump>      nodes;
@@ -58,34 +77,80 @@ public:
     std::vector<Q3BspLightVolLump>  lightVols;
     Q3BspVisDataLump                visData;
 private:
+    // visibility and rendering state of a single view - sets are filled by each thread for faces it owns
+    struct Q3BspView
+    {
+        BspView    view;
+        Frustum    frustum;
+        VkViewport viewport = {};
+        VkRect2D   scissor  = {};
+        uint32_t   uniformOffset = 0;         // dynamic offset of view's UBO in the uniform ring
+        int        cameraCluster = -1;
+        const std::vector<int> *pvsLeaves = nullptr; // potentially visible leaves - shared by views in the same cluster
+        std::vector<std::set<Q3FaceRenderable *>> visibleFacesPerThread;
+        std::vector<std::set<int>> visiblePatchesPerThread;
+        std::vector<std::vector<int>> visibleModelsPerThread; // brush models are spread across threads by index
+        std::vector<int>   patchLods;           // current tesselation level of each patch (index to s_tesselationLevels)
+        std::vector<int>   apiCallsPerThread;
+        std::vector<float> cullTimePerThread;   // ms
+        std::vector<float> recordTimePerThread; // ms
+    };
+
+    void CreatePipelines();
     void LoadTextures();
+    void StreamTextures();
+    void UpdateTextureResidency();
     void LoadLightmaps();
     void SetLightmapGamma(float gamma);
     void CreatePatch(const Q3BspFaceLump &f);
+    void UpdatePatchLod(int patchIdx, Q3BspView &view);
+    bool ThreadHasVisibleSurfaces(int threadIndex) const;
+
+    // brush models
+    void CreateModels();
+    void UpdateModelBounds(Q3ModelRenderable &model);
+    void FindBoxClusters(int nodeIdx, const float *mins, const float *maxs, std::vector<int> &clusters) const;
+    bool ModelVisible(const Q3ModelRenderable &model, const Q3BspView &view) const;
 
     // queue data for drawing
     void Draw(int threadIndex, VkCommandBufferInheritanceInfo inheritanceInfo);
+    uint32_t DrawIndirect(int threadIndex, int viewIndex, const vk::Pipeline &pipeline, uint32_t firstCommand);
+    void DrawTesselatedPatches(int threadIndex, const Q3BspView &view);
+    uint32_t DrawModels(int threadIndex, int viewIndex, bool useIndirect, uint32_t firstCommand);
 
     // Vulkan buffer creation
+    void CreateGeometry();
     void CreateDescriptorsForFace(const Q3BspFaceLump &face, int idx, int vertexOffset, int indexOffset);
-    void CreateDescriptorsForPatch(int idx, int &vertexOffset, int &indexOffset, std::vector<Q3BspBiquadPatch*> &vdata, std::vector<int> &idata);
-    void CreateFaceBuffers(const std::vector<Q3BspFaceLump*> &faceData, int vertexCount, int indexCount);
-    void CreatePatchBuffers(const std::vector<Q3BspBiquadPatch*> &patchData, int vertexCount, int indexCount);
+    void CreateDescriptorsForPatch(int idx, int &vertexOffset, int &indexOffset);
+    void CreateBuffers(const std::vector<Q3BspFaceLump*> &faceData, int vertexCount, int indexCount);
+    void CalculateVertexQuantization();
+    void PackVertex(const Q3BspVertexLump &vertex, const vec2f &texcoordOffset, unsigned char *dst) const;
     void CreateDescriptorSetLayout();
     void CreateDescriptorPool(uint32_t numDescriptors);
-    void CreateDescriptor(const vk::Texture **textures, vk::Descriptor *descriptor);
+    void CreateDescriptor(const vk::Texture **textures, vk::Descriptor *descriptor, bool allocate = true);
+    void CreateMaterialDescriptor(int textureIdx, int lightmapIdx, vk::Descriptor *descriptor, bool allocate = true);
+    int  GetMaterial(int textureIdx, int lightmapIdx);
+    void ReplaceMaterials(int textureIdx);
+    void CreateUniformBuffer();
+    void CreateIndirectBuffer();
+    void CreateControlPointBuffer();
 
     // render data
     std::vector<Q3LeafRenderable>   m_renderLeaves;   // bsp leaves in "renderable format"
     std::vector<Q3FaceRenderable>   m_renderFaces;    // bsp faces in "renderable format"
     std::vector<Q3BspPatch *>       m_patches;        // curved surfaces
+    std::vector<Q3ModelRenderable>  m_renderModels;   // brush models (first entry is the world - unused)
     std::vector<GameTexture *>      m_textures;       // loaded in-game textures
-    std::vector<std::set<Q3FaceRenderable *>> m_visibleFacesPerThread;   // list of visible surfaces to render (per thread)
-    std::vector<std::set<int>>                m_visiblePatchesPerThread; // list of visible patches to render (per thread)
+    std::vector<bool>               m_texturePending; // texture is still being streamed in (rendered with m_missingTex until then)
+    std::vector<uint32_t>           m_textureGenerations; // image generation of each texture referenced by materials
+    std::vector<Q3BspView>          m_views;          // views rendered this frame
+    std::map<int, std::vector<int>> m_pvsLeaves;      // leaves potentially visible from each cluster occupied by a view
+    std::vector<int>                m_allLeaves;      // used instead of PVS if it's disabled
+    std::vector<int>                m_patchTrianglesPerThread; // triangles in visible patches (per thread, all views)
+    Q3BspCollision                  m_collision;      // trace and point contents queries against map brushes
+    Q3BspLightGrid                  m_lightGrid;      // light volumes for lighting dynamic objects
     vk::Texture *m_lightmapTextures = nullptr;        // bsp lightmaps
 
-    Frustum  m_frustum; // view frustum
-
     // helper textures
     GameTexture *m_missingTex = nullptr; // rendered if an in-game texture is missing
     vk::Texture  m_whiteTex;             // used if no lightmap specified for a face
@@ -94,24 +159,54 @@ private:
     RenderBuffers m_renderBuffers;
     UniformBufferObject m_ubo;
     BspPushConstants m_pc;
-    vk::Pipeline   m_facesPipeline; // used for rendering standard faces
-    vk::Pipeline   m_patchPipeline; // used for rendering curves/patches
+    PipelineVariants m_facesPipelines; // used for rendering both standard faces and curves/patches
+    PipelineVariants m_patchTessPipelines; // curves/patches tesselated on the GPU (if supported by the device)
+    const vk::Pipeline *m_facesPipeline = nullptr;     // variants matching current render state - picked once per frame
+    const vk::Pipeline *m_patchTessPipeline = nullptr;
+    BspTessPushConstants m_tessPc;
+    bool m_tesselationSupported = false;
+    bool m_wideTexcoords = false;     // world vertices use full precision texture coordinates (Q3BspWideRenderVertex)
+    bool m_cpuPatches = true;         // world patches have CPU tesselated geometry in shared buffers
+    std::vector<bool> m_modelPatches; // patches of brush models (always drawn from CPU tesselated geometry)
 
     // all faces and patches use shared vertex buffer info and descriptor set layout
     vk::VertexBufferInfo  m_vbInfo;
+    vk::VertexBufferInfo  m_controlPointVbInfo; // patch control points are kept in raw bsp format
     VkDescriptorSetLayout m_dsLayout;
     VkDescriptorPool      m_descriptorPool;
 
-    // store faces and patches in separate buffers
-    vk::Buffer m_faceVertexBuffer;
-    vk::Buffer m_faceIndexBuffer;
-    vk::Buffer m_patchVertexBuffer;
-    vk::Buffer m_patchIndexBuffer;
+    // faces sharing the same texture and lightmap share a single descriptor ("material")
+    std::map<std::pair<int, int>, int> m_materialIds;
+    std::vector<vk::Descriptor>        m_materials;
+    std::vector<uint64_t>              m_materialFrames; // frame in which each material was last replaced
 
-    // secondary command buffers (double buffered) and respective command pools used for rendering - one per thread
+    // textures are decoded in the background and swapped into materials once uploaded
+    TextureStreamer m_textureStreamer;
+    std::vector<std::pair<int, float>> m_texturePriorities; // (texture, distance to nearest visible surface) scratch list
+    std::chrono::high_resolution_clock::time_point m_loadStart; // start of Init() - load times are measured from here
+    static const int s_textureUploadsPerFrame = 4;
+
+    // replaced material descriptors, freed once frames in flight no longer use them
+    std::vector<std::pair<uint64_t, VkDescriptorSet>> m_retiredDescriptors;
+    uint64_t m_frameCount = 0;
+
+    // store faces and patches in shared buffers (patches are placed after all regular faces)
+    vk::Buffer m_vertexBuffer;
+    vk::Buffer m_indexBuffer;
+    vk::Buffer m_controlPointBuffer; // patch control points used by hardware tesselation
+
+    // secondary command buffers (one set per frame in flight) and respective command pools used for rendering - one per thread
     std::vector<VkCommandPool> m_commandPools;
-    std::vector<VkCommandBuffer> m_commandBuffers[2];
+    std::vector<std::vector<VkCommandBuffer>> m_commandBuffers; // [frame in flight][thread]
     int m_facesPerThread;
+
+    // indirect draw ring: each thread owns a fixed range of commands within a view slot (one slot per view per frame)
+    std::vector<uint32_t> m_indirectOffsets;
+    uint32_t m_indirectSlotSize = 0;
+    std::vector<std::vector<const FaceBuffers *>> m_indirectDrawsPerThread; // per-thread scratch list sorted by material
+    std::vector<int> m_apiCallsPerThread;
+    std::vector<int> m_drawCallsPerThread; // subsets of API calls reported to metrics
+    std::vector<int> m_bindsPerThread;
 };
 
 #endif
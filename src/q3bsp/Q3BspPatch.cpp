@@ -41,23 +41,32 @@ void Q3BspBiquadPatch::Tesselate(int tessLevel)
         }
     }
 
-    m_indices.resize(m_tesselationLevel * (m_tesselationLevel + 1) * 2);
+    GridIndices(m_tesselationLevel, m_indices);
+}
 
-    for (int row = 0; row < m_tesselationLevel; ++row)
-    {
-        for (int col = 0; col <= m_tesselationLevel; ++col)
-        {
-            m_indices[(row * (m_tesselationLevel + 1) + col) * 2 + 1] = row       * (m_tesselationLevel + 1) + col;
-            m_indices[(row * (m_tesselationLevel + 1) + col) * 2]     = (row + 1) * (m_tesselationLevel + 1) + col;
-        }
-    }
+void Q3BspBiquadPatch::GridIndices(int tessLevel, std::vector<unsigned int> &indices) const
+{
+    // coarser grid is made of every n-th row and column of the current one, since both are evaluated at uniform steps
+    int step   = m_tesselationLevel / tessLevel;
+    int stride = m_tesselationLevel + 1;
 
-    m_trianglesPerRow  = new int[m_tesselationLevel];
-    m_rowIndexPointers = new unsigned int *[m_tesselationLevel];
+    // emit a plain triangle list, so that patches can be drawn in a single call just like regular faces
+    indices.resize(tessLevel * tessLevel * 6);
 
-    for (int row = 0; row < m_tesselationLevel; ++row)
+    for (int row = 0, i = 0; row < tessLevel; ++row)
     {
-        m_trianglesPerRow[row] = 2 * (m_tesselationLevel + 1);
-        m_rowIndexPointers[row] = &m_indices[row * 2 * (m_tesselationLevel + 1)];
+        for (int col = 0; col < tessLevel; ++col)
+        {
+            unsigned int topLeft     = row       * step * stride + col * step;
+            unsigned int bottomLeft  = (row + 1) * step * stride + col * step;
+
+            // keep the winding order of the original triangle strip
+            indices[i++] = bottomLeft;
+            indices[i++] = topLeft;
+            indices[i++] = bottomLeft + step;
+            indices[i++] = bottomLeft + step;
+            indices[i++] = topLeft;
+            indices[i++] = topLeft + step;
+        }
     }
-}
+}
\ No newline at end of file
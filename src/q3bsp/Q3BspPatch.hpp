@@ -8,21 +8,14 @@
 class Q3BspBiquadPatch
 {
 public:
-    ~Q3BspBiquadPatch()
-    {
-        delete[] m_trianglesPerRow;
-        delete[] m_rowIndexPointers;
-    }
-
     void Tesselate(int tessLevel); // perform tesselation 
+    // triangle list of a coarser level over vertices of current tesselation (tessLevel has to divide current level)
+    void GridIndices(int tessLevel, std::vector<unsigned int> &indices) const;
 
     Q3BspVertexLump              controlPoints[9];
     std::vector<Q3BspVertexLump> m_vertices;
     int                          m_tesselationLevel = 0;
-    std::vector<unsigned int>    m_indices;
-private:
-    int*            m_trianglesPerRow  = nullptr;
-    unsigned int**  m_rowIndexPointers = nullptr;
+    std::vector<unsigned int>    m_indices; // triangle list, same layout as regular bsp faces
 };
 
 
@@ -34,6 +27,11 @@ struct Q3BspPatch
     int width  = 0;
     int height = 0;
 
+    // bounding sphere and curvature (in scaled world units) used to pick tesselation level each frame
+    Math::Vector3f center;
+    float radius    = 0.f;
+    float curvature = 0.f; // max length of (P0 - 2*P1 + P2) over control point rows and columns
+
     std::vector<Q3BspBiquadPatch> quadraticPatches;
 };
 
@@ -4,7 +4,6 @@
 #include "renderer/vulkan/Base.hpp"
 #include "renderer/vulkan/Buffers.hpp"
 #include <vector>
-#include <map>
 
 /*
  * Helper structs for Q3BspMap rendering
@@ -19,7 +18,9 @@ enum Q3BspRenderFlags
     Q3RenderSkipMissingTex = 1 << 4,
     Q3RenderSkipPVS        = 1 << 5,
     Q3RenderSkipFC         = 1 << 6,
-    Q3Multisampling        = 1 << 7
+    Q3Multisampling        = 1 << 7,
+    Q3RenderUseMDI         = 1 << 8,
+    Q3RenderHWTesselation  = 1 << 9
 };
 
 
@@ -33,6 +34,19 @@ struct Q3LeafRenderable
 };
 
 
+// brush model (door, platform, mover) rendered as a whole with its own transform - the world (model 0) is rendered through leaves
+struct Q3ModelRenderable
+{
+    int firstFace = 0;
+    int numFaces  = 0;
+    Math::Vector3f mins;             // model space bounds (bsp units)
+    Math::Vector3f maxs;
+    Math::Matrix4f transform;        // model to world transform (bsp units)
+    Math::Vector3f boundingBoxVertices[8]; // transformed bounds used for frustum culling
+    std::vector<int> clusters;       // clusters touched by transformed bounds, used for PVS culling
+};
+
+
 // face structure used for rendering
 struct Q3FaceRenderable
 {
@@ -41,25 +55,102 @@ struct Q3FaceRenderable
 };
 
 
-// Vulkan buffers and descriptor for a single face in the BSP
+// packed vertex used for rendering world geometry (16 bytes instead of 44 bytes of Q3BspVertexLump)
+struct Q3BspRenderVertex
+{
+    uint16_t position[4]; // unsigned normalized, relative to world bounds (4th component is padding)
+    uint16_t texcoord[2]; // half float, rebased per surface
+    uint16_t lmcoord[2];  // half float
+};
+
+// same as above with full precision texture coordinates - used if a surface repeats its texture too many times for half float precision
+struct Q3BspWideRenderVertex
+{
+    uint16_t position[4];
+    float    texcoord[2];
+    uint16_t lmcoord[2];
+};
+
+
+// Vulkan buffers for a single face in the BSP
 struct FaceBuffers
 {
-    vk::Descriptor descriptor;
     int vertexCount = 0;
     int indexCount  = 0;
     int vertexOffset = 0;
     int indexOffset  = 0;
+    int material     = 0; // texture + lightmap combination (index to descriptor set), also used for bucketing indirect draws
 };
 
 
 struct RenderBuffers
 {
+    // persistently mapped ring of uniform data: one slot per frame in flight, each with room for uniformsPerFrame UBOs
     vk::Buffer uniformBuffer;
+    unsigned char *uniformData = nullptr;
+    uint32_t uniformStride = 0;    // UBO size rounded up to minUniformBufferOffsetAlignment
+    uint32_t uniformsPerFrame = 1; // i.e. one per rendered view
+    uint32_t UniformOffset(int frame, int view = 0) const { return (frame * uniformsPerFrame + view) * uniformStride; }
+
+    // persistently mapped ring of indirect draw commands (one slot per frame in flight)
+    vk::Buffer indirectBuffer;
+    VkDrawIndexedIndirectCommand *indirectCommands = nullptr;
+
+    // sized once on load and only read afterwards, so worker threads can index them without locking
+    std::vector<FaceBuffers> m_faceBuffers;                // indexed by face
+    std::vector<std::vector<FaceBuffers>> m_patchBuffers;  // indexed by patch, one entry per tesselation level
+    std::vector<FaceBuffers> m_patchControlPointBuffers;   // indexed by patch - hardware tesselation input: 9 control points per biquadratic patch
+};
 
-    std::map<int, FaceBuffers> m_faceBuffers;
-    std::map<int, std::vector<FaceBuffers> > m_patchBuffers;
+
+// per-view statistics (CPU times are summed over all threads)
+struct BspViewStats
+{
+    int   visibleFaces   = 0;
+    int   visiblePatches = 0;
+    int   apiCalls       = 0;
+    float cullTime       = 0.f; // time spent on frustum culling of the view (ms)
+    float recordTime     = 0.f; // time spent recording draws of the view (ms)
+};
+
+
+// collision benchmark results
+struct BspTraceStats
+{
+    int   numTraces = 0;
+    int   hits      = 0;           // traces which hit a brush
+    float tracesPerSec      = 0.f; // single thread
+    float batchTracesPerSec = 0.f; // spread across thread workers
+};
+
+// point to leaf classification benchmark results
+struct BspLeafQueryStats
+{
+    int   numPoints  = 0;
+    int   mismatches = 0;          // points classified differently by the batch and per-point path (should be 0)
+    float pointsPerSec      = 0.f; // per-point node walk
+    float batchPointsPerSec = 0.f; // SIMD lanes spread across thread workers
 };
 
+// light grid load-time self-check results
+struct BspLightGridStats
+{
+    int bounds[3]  = { 0, 0, 0 }; // number of grid points along each axis
+    int numChecked = 0;           // lit grid points sampled exactly + random points sampled both batched and per-point
+    int mismatches = 0;           // samples which differ from the reference (should be 0)
+};
+
+// entity lump parse benchmark results
+struct BspEntityStats
+{
+    int   numParses   = 0;
+    int   numEntities = 0;
+    int   mismatches  = 0;       // re-parsed tables and classname lookups which differ from the loaded table/linear scan (should be 0)
+    float parseTime   = 0.f;     // average time of a single parse (ms)
+    float megabytesPerSec   = 0.f; // lump text parsed per second
+    float lookupsPerSec     = 0.f; // classname lookups through the sorted index
+    float scanLookupsPerSec = 0.f; // classname lookups scanning all entities
+};
 
 // map statistics
 struct BspStats
@@ -69,6 +160,22 @@ struct BspStats
     int visibleFaces    = 0;
     int totalPatches    = 0;
     int visiblePatches  = 0;
+    int patchTriangles  = 0;   // number of triangles in rendered (CPU tesselated) patches
+    int totalModels     = 0;   // brush models excluding the world
+    int visibleModels   = 0;
+    int vertexBufferSize = 0;  // size of world geometry vertex buffer (bytes)
+    float acmrBefore    = 0.f; // vertex cache ACMR of meshes and patches before load-time optimization (0 - nothing optimized)
+    float acmrAfter     = 0.f;
+    int optimizerMismatches = 0; // meshes whose triangles were altered by the optimizer (should be 0)
+    int apiCalls        = 0;   // number of vkCmd* calls recorded in the last frame
+    float recordTime    = 0.f; // time spent recording secondary command buffers (ms)
+    float firstFrameTime  = 0.f; // time from start of map initialization until first frame was recorded (ms)
+    float textureLoadTime = 0.f; // time from start of map initialization until all textures were streamed in (0 - still loading)
+    std::vector<BspViewStats> views;
+    BspTraceStats traces;
+    BspLeafQueryStats leafQueries;
+    BspLightGridStats lightGrid;
+    BspEntityStats entities;
 };
 
 #endif
\ No newline at end of file
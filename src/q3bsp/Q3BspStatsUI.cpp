@@ -1,13 +1,121 @@
 #include "Application.hpp"
 #include "q3bsp/Q3BspMap.hpp"
 #include "q3bsp/Q3BspStatsUI.hpp"
+#include "renderer/PipelineVariants.hpp"
 #include "renderer/RenderContext.hpp"
-#include <sstream>
+#include "renderer/TextureManager.hpp"
+#include <type_traits>
 
 extern RenderContext g_renderContext;
 extern Application   g_application;
 extern int g_fps;
 
+static const float statsX   = -0.99f;
+static const float keysX    =  0.34f;
+static const float statsY   =  0.70f;
+static const float keysY    = -0.25f;
+static const float ySpacing =  0.05f;
+
+const int StatsLine::MAX_LENGTH;
+const int Q3StatsUI::s_timingsInterval = 250;
+
+// float printed with fixed number of decimals
+struct Fixed
+{
+    Fixed(float v, int d) : value(v), decimals(d) {}
+
+    float value;
+    int   decimals;
+};
+
+// allocation-free formatting into a stats line - text is truncated if it doesn't fit
+class LineWriter
+{
+public:
+    LineWriter(StatsLine &line, float y) : m_line(line)
+    {
+        m_line.length = 0;
+        m_line.text[0] = '\0';
+        m_line.y = y;
+    }
+
+    LineWriter &operator<<(const char *str)
+    {
+        while (*str)
+            Put(*str++);
+
+        return *this;
+    }
+
+    template<typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
+    LineWriter &operator<<(T value)
+    {
+        long long v = (long long)value;
+        char digits[24];
+        int numDigits = 0;
+
+        if (v < 0)
+        {
+            Put('-');
+            v = -v;
+        }
+
+        do
+        {
+            digits[numDigits++] = '0' + (char)(v % 10);
+            v /= 10;
+        } while (v > 0);
+
+        while (numDigits > 0)
+            Put(digits[--numDigits]);
+
+        return *this;
+    }
+
+    LineWriter &operator<<(const Fixed &f)
+    {
+        float v = f.value;
+        if (v < 0.f)
+        {
+            Put('-');
+            v = -v;
+        }
+
+        long long scale = 1;
+        for (int i = 0; i < f.decimals; ++i)
+            scale *= 10;
+
+        long long scaled = (long long)(v * scale + 0.5f);
+        *this << scaled / scale;
+
+        if (f.decimals > 0)
+        {
+            Put('.');
+            long long frac = scaled % scale;
+            for (long long d = scale / 10; d > 0; d /= 10)
+                Put('0' + (char)(frac / d % 10));
+        }
+
+        return *this;
+    }
+private:
+    void Put(char c)
+    {
+        if (m_line.length < StatsLine::MAX_LENGTH - 1)
+        {
+            m_line.text[m_line.length++] = c;
+            m_line.text[m_line.length] = '\0';
+        }
+    }
+
+    StatsLine &m_line;
+};
+
+bool StatsLine::operator==(const StatsLine &other) const
+{
+    return length == other.length && y == other.y && !memcmp(text, other.text, length);
+}
+
 Q3StatsUI::Q3StatsUI(BspMap *map) : StatsUI(map)
 {
     m_font = new Font("res/font.png");
@@ -17,98 +125,186 @@ Q3StatsUI::Q3StatsUI(BspMap *map) : StatsUI(map)
 void Q3StatsUI::OnRender()
 {
     m_font->RenderStart();
+    UpdateStaticText();
+
+    if (m_map->Valid())
+        UpdateDynamicText();
+
+    m_font->RenderFinish();
+}
+
+void Q3StatsUI::UpdateStaticText()
+{
+    // everything else in static text is fixed once the map is loaded
+    int  renderFlags = m_map->RenderFlags();
+    bool cameraCollision = g_application.CameraCollision();
+    int  compiledVariants = PipelineVariants::CompiledVariants();
+
+    if (m_staticValid && renderFlags == m_renderFlags && cameraCollision == m_cameraCollision && compiledVariants == m_compiledVariants)
+        return;
+
+    m_staticValid = true;
+    m_renderFlags = renderFlags;
+    m_cameraCollision = cameraCollision;
+    m_compiledVariants = compiledVariants;
+
+    m_font->ClearLayer(Font::LayerStatic);
+    m_font->SetLayer(Font::LayerStatic);
 
     // no map loaded or no cmdline parameter specified - display error message
     if (!m_map->Valid())
     {
         m_font->SetColor(Math::Vector3f(1.f, 0.f, 0.f));
         m_font->RenderText("Error loading BSP - missing/corrupted file or no file specified!", -0.7f, 0.0f, 0.f);
-        m_font->RenderFinish();
         return;
     }
 
-    static const float statsX   = -0.99f;
-    static const float keysX    =  0.34f;
-    static const float statsY   =  0.70f;
-    static const float keysY    = -0.25f;
-    static const float ySpacing =  0.05f;
-
     const BspStats &stats = m_map->GetMapStats();
+    StatsLine line;
+
+    m_font->SetColor(Math::Vector3f(1.f, 1.f, 1.f));
+    LineWriter(line, statsY) << "Total vertices: " << stats.totalVertices;
+    m_font->RenderText(line.text, statsX, line.y, 0.f);
 
-    std::stringstream statsStream;
-    statsStream.precision(5);
-    statsStream << "FPS: " << g_fps << " (" << (g_fps > 0 ? (1000.f / g_fps) : 0) << "ms)";
-    m_font->RenderText(statsStream.str(), statsX, statsY + 6 * ySpacing, 0.f);
+    LineWriter(line, statsY - ySpacing) << "Total faces: " << stats.totalFaces;
+    m_font->RenderText(line.text, statsX, line.y, 0.f);
 
-    statsStream.str("");
-    statsStream << "Total vertices: " << stats.totalVertices;
-    m_font->RenderText(statsStream.str(), statsX, statsY, 0.f);
+    LineWriter(line, statsY - ySpacing * 2.f) << "Total patches: " << stats.totalPatches;
+    m_font->RenderText(line.text, statsX, line.y, 0.f);
 
-    statsStream.str("");
-    statsStream << "Total faces: " << stats.totalFaces;
-    m_font->RenderText(statsStream.str(), statsX, statsY - ySpacing, 0.f);
+    LineWriter vertexBuffer(line, statsY - ySpacing * 8.f);
+    vertexBuffer << "Vertex buffer: " << stats.vertexBufferSize / 1024 << "KB";
+    if (stats.acmrAfter > 0.f)
+        vertexBuffer << ", vertex cache ACMR " << Fixed(stats.acmrBefore, 2) << " -> " << Fixed(stats.acmrAfter, 2);
+    if (stats.optimizerMismatches > 0)
+        vertexBuffer << " (" << stats.optimizerMismatches << " meshes altered!)";
+    m_font->RenderText(line.text, statsX, line.y, 0.f);
 
-    statsStream.str("");
-    statsStream << "Total patches: " << stats.totalPatches;
-    m_font->RenderText(statsStream.str(), statsX, statsY - ySpacing * 2.f, 0.f);
+    static const char *cacheStatus[] = { "no cache", "cache loaded", "cache incompatible", "cache rejected by driver" };
+    LineWriter(line, statsY - ySpacing * 10.f) << "Pipelines: " << PipelineVariants::CompiledVariants() << " variants ("
+                                               << Fixed(PipelineVariants::CompileTime(), 2) << "ms, " << cacheStatus[g_renderContext.PipelineCacheStatus()] << ")";
+    m_font->RenderText(line.text, statsX, line.y, 0.f);
 
-    statsStream.str("");
-    statsStream << "Rendered faces: " << stats.visibleFaces;
-    m_font->RenderText(statsStream.str(), statsX, statsY - ySpacing * 3.f, 0.f);
+    float nextLine = 12.f;
+    if (stats.traces.numTraces > 0)
+    {
+        LineWriter(line, statsY - ySpacing * nextLine) << "Traces: " << (int)stats.traces.tracesPerSec << "/s, " << (int)stats.traces.batchTracesPerSec
+                                                       << "/s batched (" << stats.traces.numTraces << " traces, " << stats.traces.hits << " hits)";
+        m_font->RenderText(line.text, statsX, line.y, 0.f);
+        nextLine += 1.f;
+    }
 
-    statsStream.str("");
-    statsStream << "Rendered patches: " << stats.visiblePatches;
-    m_font->RenderText(statsStream.str(), statsX, statsY - ySpacing * 4.f, 0.);
+    if (stats.leafQueries.numPoints > 0)
+    {
+        LineWriter(line, statsY - ySpacing * nextLine) << "Leaf queries: " << (int)stats.leafQueries.pointsPerSec << "/s, " << (int)stats.leafQueries.batchPointsPerSec
+                                                       << "/s batched (" << stats.leafQueries.numPoints << " points, " << stats.leafQueries.mismatches << " mismatches)";
+        m_font->RenderText(line.text, statsX, line.y, 0.f);
+        nextLine += 1.f;
+    }
+
+    if (stats.entities.numParses > 0)
+    {
+        LineWriter(line, statsY - ySpacing * nextLine) << "Entities: " << Fixed(stats.entities.parseTime, 3) << "ms/parse (" << Fixed(stats.entities.megabytesPerSec, 1)
+                                                       << "MB/s), lookups " << (int)stats.entities.lookupsPerSec << "/s indexed, " << (int)stats.entities.scanLookupsPerSec
+                                                       << "/s scanned (" << stats.entities.mismatches << " mismatches)";
+        m_font->RenderText(line.text, statsX, line.y, 0.f);
+        nextLine += 1.f;
+    }
+
+    if (stats.lightGrid.numChecked > 0)
+    {
+        LineWriter(line, statsY - ySpacing * nextLine) << "Light grid: " << stats.lightGrid.bounds[0] << "x" << stats.lightGrid.bounds[1] << "x" << stats.lightGrid.bounds[2]
+                                                       << " points (" << stats.lightGrid.numChecked << " samples checked, " << stats.lightGrid.mismatches << " mismatches)";
+        m_font->RenderText(line.text, statsX, line.y, 0.f);
+    }
+
+    // key help - enabled options are green
+    const Math::Vector3f white(1.f, 1.f, 1.f), green(0.f, 1.f, 0.f);
+    auto keyHelp = [&](const char *text, float line, bool enabled)
+    {
+        m_font->SetColor(enabled ? green : white);
+        m_font->RenderText(text, keysX, keysY - ySpacing * line, 0.f);
+    };
 
     m_font->SetColor(Math::Vector3f(1.f, 0.f, 0.f));
     m_font->RenderText(" ~ - toggle stats view", keysX, keysY, 0.f);
 
-    if (m_map->HasRenderFlag(Q3RenderShowWireframe))
-        m_font->SetColor(Math::Vector3f(0.f, 1.f, 0.f));
-    else
-        m_font->SetColor(Math::Vector3f(1.f, 1.f, 1.f));
-    m_font->RenderText("F1 - show wireframe", keysX, keysY - ySpacing, 0.f);
-    m_font->SetColor(Math::Vector3f(1.f, 1.f, 1.f));
+    keyHelp("F1 - show wireframe", 1.f, m_map->HasRenderFlag(Q3RenderShowWireframe));
+    keyHelp("F2 - show lightmaps", 2.f, m_map->HasRenderFlag(Q3RenderShowLightmaps));
+    keyHelp("F3 - use lightmaps", 3.f, m_map->HasRenderFlag(Q3RenderUseLightmaps));
+    keyHelp("F4 - use alpha test", 4.f, m_map->HasRenderFlag(Q3RenderAlphaTest));
+    keyHelp("F5 - show missing textures", 5.f, !m_map->HasRenderFlag(Q3RenderSkipMissingTex));
+    keyHelp("F6 - use PVS culling", 6.f, !m_map->HasRenderFlag(Q3RenderSkipPVS));
+    keyHelp("F7 - use frustum culling", 7.f, !m_map->HasRenderFlag(Q3RenderSkipFC));
 
-    if (m_map->HasRenderFlag(Q3RenderShowLightmaps))
-        m_font->SetColor(Math::Vector3f(0.f, 1.f, 0.f));
-    m_font->RenderText("F2 - show lightmaps", keysX, keysY - ySpacing * 2.f, 0.f);
-    m_font->SetColor(Math::Vector3f(1.f, 1.f, 1.f));
+    LineWriter(line, keysY - ySpacing * 8.f) << "F8 - multisampling (MSAAx" << g_renderContext.MSAASamples() << ")";
+    keyHelp(line.text, 8.f, m_map->HasRenderFlag(Q3Multisampling));
 
-    if (m_map->HasRenderFlag(Q3RenderUseLightmaps))
-        m_font->SetColor(Math::Vector3f(0.f, 1.f, 0.f));
-    m_font->RenderText("F3 - use lightmaps", keysX, keysY - ySpacing * 3.f, 0.f);
-    m_font->SetColor(Math::Vector3f(1.f, 1.f, 1.f));
+    keyHelp("F10 - multi-draw indirect", 9.f, m_map->HasRenderFlag(Q3RenderUseMDI));
+    keyHelp("F11 - hardware tesselation", 10.f, m_map->HasRenderFlag(Q3RenderHWTesselation));
+    keyHelp(" N - camera collision", 11.f, m_cameraCollision);
 
-    if (m_map->HasRenderFlag(Q3RenderAlphaTest))
-        m_font->SetColor(Math::Vector3f(0.f, 1.f, 0.f));
-    m_font->RenderText("F4 - use alpha test", keysX, keysY - ySpacing * 4.f, 0.f);
-    m_font->SetColor(Math::Vector3f(1.f, 1.f, 1.f));
+    m_font->SetColor(white);
+}
 
-    if (!m_map->HasRenderFlag(Q3RenderSkipMissingTex))
-        m_font->SetColor(Math::Vector3f(0.f, 1.f, 0.f));
-    m_font->RenderText("F5 - show missing textures", keysX, keysY - ySpacing * 5.f, 0.f);
-    m_font->SetColor(Math::Vector3f(1.f, 1.f, 1.f));
+void Q3StatsUI::UpdateDynamicText()
+{
+    const BspStats &stats = m_map->GetMapStats();
+    const TextureManager *textureManager = TextureManager::GetInstance();
 
-    if (!m_map->HasRenderFlag(Q3RenderSkipPVS))
-        m_font->SetColor(Math::Vector3f(0.f, 1.f, 0.f));
-    m_font->RenderText("F6 - use PVS culling", keysX, keysY - ySpacing * 6.f, 0.f);
-    m_font->SetColor(Math::Vector3f(1.f, 1.f, 1.f));
+    // benchmark results take lines between fixed counters and per view stats
+    float viewLine = 12.f + (stats.traces.numTraces > 0 ? 1.f : 0.f) + (stats.leafQueries.numPoints > 0 ? 1.f : 0.f) +
+                     (stats.entities.numParses > 0 ? 1.f : 0.f) + (stats.lightGrid.numChecked > 0 ? 1.f : 0.f);
+    m_newLines.resize(8 + stats.views.size());
 
-    if (!m_map->HasRenderFlag(Q3RenderSkipFC))
-        m_font->SetColor(Math::Vector3f(0.f, 1.f, 0.f));
-    m_font->RenderText("F7 - use frustum culling", keysX, keysY - ySpacing * 7.f, 0.f);
-    m_font->SetColor(Math::Vector3f(1.f, 1.f, 1.f));
+    // refresh timings on a fixed interval only - counters below still update as soon as they change
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_timingsTime >= std::chrono::milliseconds(s_timingsInterval) || m_viewTimings.size() != stats.views.size())
+    {
+        m_timingsTime  = now;
+        m_fps          = g_fps;
+        m_recordTime   = stats.recordTime;
+        m_frameLatency = g_renderContext.FrameLatency();
 
-    if (m_map->HasRenderFlag(Q3Multisampling))
-        m_font->SetColor(Math::Vector3f(0.f, 1.f, 0.f));
-    m_font->RenderText("F8 - multisampling (MSAAx" + std::to_string(g_renderContext.MSAASamples()) + ")", keysX, keysY - ySpacing * 8.f, 0.f);
-    m_font->SetColor(Math::Vector3f(1.f, 1.f, 1.f));
+        m_viewTimings.resize(stats.views.size());
+        for (size_t i = 0; i < stats.views.size(); ++i)
+        {
+            m_viewTimings[i].cullTime   = stats.views[i].cullTime;
+            m_viewTimings[i].recordTime = stats.views[i].recordTime;
+        }
+    }
 
-    m_font->RenderFinish();
-}
+    LineWriter(m_newLines[0], statsY + 6 * ySpacing) << "FPS: " << m_fps << " (" << Fixed(m_fps > 0 ? (1000.f / m_fps) : 0.f, 2) << "ms)";
+    LineWriter(m_newLines[1], statsY - ySpacing * 3.f) << "Rendered faces: " << stats.visibleFaces << " (brush models: " << stats.visibleModels << "/" << stats.totalModels << ")";
+    LineWriter(m_newLines[2], statsY - ySpacing * 4.f) << "Rendered patches: " << stats.visiblePatches;
+    LineWriter(m_newLines[3], statsY - ySpacing * 5.f) << "API calls: " << stats.apiCalls;
+    LineWriter(m_newLines[4], statsY - ySpacing * 6.f) << "Record time: " << Fixed(m_recordTime, 3) << "ms";
+    LineWriter(m_newLines[5], statsY - ySpacing * 7.f) << "Patch triangles: " << stats.patchTriangles;
+    LineWriter textures(m_newLines[6], statsY - ySpacing * 9.f);
+    textures << "Textures: " << textureManager->TextureMemory() / (1024 * 1024) << "/" << textureManager->TextureBudget() / (1024 * 1024)
+             << "MB (" << textureManager->EvictedTextures() << " evicted), first frame " << (int)stats.firstFrameTime << "ms";
+    if (stats.textureLoadTime > 0.f)
+        textures << ", all loaded " << (int)stats.textureLoadTime << "ms";
+    else
+        textures << ", loading";
+    LineWriter(m_newLines[7], statsY - ySpacing * 11.f) << "Frame latency: " << Fixed(m_frameLatency, 3) << "ms (" << g_renderContext.FramesInFlight() << " in flight)";
 
-void Q3StatsUI::RebuildPipeline()
-{
-    m_font->RebuildPipeline();
+    // CPU cost of each rendered view
+    for (size_t i = 0; i < stats.views.size(); ++i)
+    {
+        const BspViewStats &view = stats.views[i];
+        LineWriter(m_newLines[8 + i], statsY - ySpacing * (viewLine + i)) << "View " << i << ": " << view.visibleFaces << " faces, " << view.visiblePatches
+                                                                          << " patches, cull " << Fixed(m_viewTimings[i].cullTime, 3) << "ms, record " << Fixed(m_viewTimings[i].recordTime, 3) << "ms";
+    }
+
+    if (m_newLines == m_dynamicLines)
+        return;
+
+    m_dynamicLines.swap(m_newLines);
+    m_font->ClearLayer(Font::LayerDynamic);
+    m_font->SetLayer(Font::LayerDynamic);
+    m_font->SetColor(Math::Vector3f(1.f, 1.f, 1.f));
+
+    for (const StatsLine &line : m_dynamicLines)
+        m_font->RenderText(line.text, statsX, line.y, 0.f);
 }
@@ -3,11 +3,27 @@
 
 #include "common/StatsUI.hpp"
 #include "renderer/Font.hpp"
+#include <chrono>
+#include <vector>
 
 /*
- *  Quake III BSP stats display
+ *  Quake III BSP stats display. Totals and key help are kept in static font layer and rebuilt only when state they
+ *  show changes, counters are formatted in place every frame and passed to the font only if their text changed.
+ *  Timings change every frame, so they are sampled on a fixed interval to keep the text stable in between.
  */
 
+// single line of stats text formatted without allocations
+struct StatsLine
+{
+    static const int MAX_LENGTH = 128;
+
+    char  text[MAX_LENGTH] = {};
+    int   length = 0;
+    float y = 0.f;
+
+    bool operator==(const StatsLine &other) const;
+};
+
 class Q3StatsUI : public StatsUI
 {
 public:
@@ -19,9 +35,35 @@ public:
     }
 
     void OnRender();
-    void RebuildPipeline();
 private:
+    void UpdateStaticText();
+    void UpdateDynamicText();
+
     Font *m_font = nullptr;
+
+    // state shown by static text when it was last built
+    bool m_staticValid = false;
+    int  m_renderFlags = 0;
+    bool m_cameraCollision = false;
+    int  m_compiledVariants = 0;
+
+    // timings sampled on last refresh
+    struct ViewTimings
+    {
+        float cullTime = 0.f;
+        float recordTime = 0.f;
+    };
+
+    static const int s_timingsInterval; // ms
+
+    std::chrono::steady_clock::time_point m_timingsTime;
+    int   m_fps = 0;
+    float m_recordTime = 0.f;
+    float m_frameLatency = 0.f;
+    std::vector<ViewTimings> m_viewTimings;
+
+    std::vector<StatsLine> m_dynamicLines; // counters shown by dynamic layer
+    std::vector<StatsLine> m_newLines;     // counters of current frame
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -194,23 +194,25 @@ void Camera::OnMouseMove(int x, int y)
 
 void Camera::UpdateProjection()
 {
+    float aspectRatio = m_aspectRatio > 0.f ? m_aspectRatio : g_renderContext.scrRatio;
+
     switch (m_mode)
     {
     case CAM_DOF6:
     case CAM_FPS:
-        if (g_renderContext.width > g_renderContext.height)
+        if (aspectRatio > 1.f)
         {
             Math::MakePerspective(m_projectionMatrix,
                                   g_renderContext.fov,
-                                  g_renderContext.scrRatio,
+                                  aspectRatio,
                                   g_renderContext.nearPlane,
                                   g_renderContext.farPlane);
         }
         else
         {
             Math::MakePerspective(m_projectionMatrix,
-                                  g_renderContext.fov / g_renderContext.scrRatio,
-                                  g_renderContext.scrRatio,
+                                  g_renderContext.fov / aspectRatio,
+                                  aspectRatio,
                                   g_renderContext.nearPlane,
                                   g_renderContext.farPlane);
         }
@@ -231,3 +233,12 @@ void Camera::UpdateProjection()
 
     m_projectionMatrix = m_projectionMatrix * vulkanCorrection;
 }
+
+void Camera::SetAspectRatio(float ratio)
+{
+    if (m_aspectRatio != ratio)
+    {
+        m_aspectRatio = ratio;
+        UpdateProjection();
+    }
+}
@@ -35,6 +35,7 @@ public:
     void SetMode(CameraMode cm);
     inline CameraMode GetMode() { return m_mode; }
     const Math::Vector3f &Position() const { return m_position; }
+    void SetPosition(const Math::Vector3f &position) { m_position = position; }
 
     // rotate in Euler-space - used mainly for some debugging
     void rotateX(float angle);
@@ -44,6 +45,7 @@ public:
     void OnMouseMove(int x, int y);
 
     void UpdateProjection();
+    void SetAspectRatio(float ratio); // aspect ratio of the viewport (0 - use aspect ratio of the window)
     const Math::Matrix4f &ProjectionMatrix() const { return m_projectionMatrix; }
     const Math::Matrix4f &ViewMatrix() const { return m_viewMatrix; }
 
@@ -72,6 +74,7 @@ private:
     CameraMode     m_mode;
     Math::Vector3f m_position;
     float          m_yLimit;
+    float          m_aspectRatio = 0.f;
     Math::Matrix4f m_viewMatrix;
     Math::Matrix4f m_projectionMatrix;
 
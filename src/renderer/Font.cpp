@@ -1,186 +1,330 @@
 #include "renderer/Font.hpp"
 #include "renderer/RenderContext.hpp"
-#include "renderer/CameraDirector.hpp"
 #include "renderer/GameTexture.hpp"
 #include "renderer/TextureManager.hpp"
 #include "renderer/Ubo.hpp"
 #include "renderer/vulkan/CmdBuffer.hpp"
 #include "Utils.hpp"
+#include <algorithm>
 
 extern RenderContext  g_renderContext;
-extern CameraDirector g_cameraDirector;
 
 static const int CHAR_WIDTH  = 8;
 static const int CHAR_HEIGHT = 9;
 static const float CHAR_SPACING = 1.5f;
+static const int INITIAL_CAPACITY = 2048; // glyphs per frame - the ring grows if more text is queued
 
 
-Font::Font(const char *tex) : m_scale(1.f, 1.f), m_position(0.0f, 0.0f, 0.0f), m_color(1.f, 1.f, 1.f)
+Font::Font(const char *tex) : m_scale(1.f, 1.f), m_position(0.0f, 0.0f, 0.0f), m_color(1.f, 1.f, 1.f), m_camera(0.f, 0.f, 0.f)
 {
-    // characters are rendered as alpha blended triangle strips with no culling
-    m_pipeline.cullMode  = VK_CULL_MODE_NONE;
-    m_pipeline.topology  = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
-    m_pipeline.blendMode = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    m_pipeline.cache     = g_renderContext.PipelineCache();
-    m_pipeline.depthTestEnable = VK_FALSE;
+    // characters are rendered as alpha blended indexed quads with no culling
+    vk::Pipeline pipeline;
+    pipeline.cullMode  = VK_CULL_MODE_NONE;
+    pipeline.topology  = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    pipeline.blendMode = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    pipeline.cache     = g_renderContext.PipelineCache();
+    pipeline.depthTestEnable = VK_FALSE;
 
     // load font texture
     m_texture = TextureManager::GetInstance()->LoadTexture(tex, false);
     LOG_MESSAGE_ASSERT(m_texture, "Could not load font texture: " << tex);
 
+    // texture holds 16 characters per row, each followed by a 1 pixel gap in vertical direction
+    for (int i = 0; i < NUM_GLYPHS; ++i)
+    {
+        float uo = (float)(i % 16 * CHAR_WIDTH);
+        float vo = (float)(i / 16 * (CHAR_HEIGHT + 1));
+
+        m_glyphUVs[i][0] = uo / m_texture->Width();
+        m_glyphUVs[i][1] = vo / m_texture->Height();
+        m_glyphUVs[i][2] = (uo + CHAR_WIDTH) / m_texture->Width();
+        m_glyphUVs[i][3] = (vo + CHAR_HEIGHT) / m_texture->Height();
+    }
+
+    m_camera.SetMode(Camera::CAM_ORTHO);
+
     // setup vertex attributes
     m_vbInfo.bindingDescriptions.push_back(vk::getBindingDescription(sizeof(GlyphVertex)));
     m_vbInfo.attributeDescriptions.push_back(vk::getAttributeDescription(inVertex, VK_FORMAT_R32G32B32_SFLOAT, 0));
     m_vbInfo.attributeDescriptions.push_back(vk::getAttributeDescription(inTexCoord, VK_FORMAT_R32G32_SFLOAT, sizeof(float) * 3));
     m_vbInfo.attributeDescriptions.push_back(vk::getAttributeDescription(inColor, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 5));
 
-    // create vertex buffer and Vulkan descriptor
-    vk::createVertexBuffer(g_renderContext.Device(), &m_charBuffer, sizeof(Glyph) * MAX_CHARS, &m_vertexBuffer);
+    // create glyph ring and Vulkan descriptor
+    m_slots.resize(g_renderContext.FramesInFlight());
+    Reserve(INITIAL_CAPACITY);
     CreateDescriptor(*m_texture, &m_descriptor);
 
-    RebuildPipeline();
+    // todo: pipeline derivatives https://github.com/SaschaWillems/Vulkan/blob/master/examples/pipelines/pipelines.cpp
+    const char *shaders[] = { "res/Font_vert.spv", "res/Font_frag.spv" };
+    m_pipelines.Init(pipeline, m_descriptor.setLayout, &m_vbInfo, shaders);
+    m_pipelines.Add(g_renderContext.DefaultRenderPass(), VK_POLYGON_MODE_FILL, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    m_pipelines.Add(g_renderContext.MSAARenderPass(), VK_POLYGON_MODE_FILL, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    m_pipelines.Compile();
 
     VK_VERIFY(vk::createCommandPool(g_renderContext.Device(), g_renderContext.Device().graphicsFamilyIndex, &m_commandPool));
-    m_commandBuffers[0] = vk::createCommandBuffer(g_renderContext.Device(), m_commandPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
-    m_commandBuffers[1] = vk::createCommandBuffer(g_renderContext.Device(), m_commandPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+    for (int i = 0; i < g_renderContext.FramesInFlight(); ++i)
+        m_commandBuffers.push_back(vk::createCommandBuffer(g_renderContext.Device(), m_commandPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY));
 }
 
 Font::~Font()
 {
-    vk::destroyPipeline(g_renderContext.Device(), m_pipeline);
+    m_pipelines.Destroy();
 
     vkDestroyDescriptorSetLayout(g_renderContext.Device().logical, m_descriptor.setLayout, nullptr);
     vkDestroyDescriptorPool(g_renderContext.Device().logical, m_descriptor.pool, nullptr);
     vk::freeBuffer(g_renderContext.Device(), m_vertexBuffer);
+    vk::freeBuffer(g_renderContext.Device(), m_indexBuffer);
 
-    vkFreeCommandBuffers(g_renderContext.Device().logical, m_commandPool, 2, m_commandBuffers);
+    vkFreeCommandBuffers(g_renderContext.Device().logical, m_commandPool, (uint32_t)m_commandBuffers.size(), m_commandBuffers.data());
     vkDestroyCommandPool(g_renderContext.Device().logical, m_commandPool, nullptr);
 }
 
 void Font::RenderText(const std::string &text, float x, float y, float z, float r, float g, float b)
 {
-    RenderText(text, Math::Vector3f(x, y, z), Math::Vector3f(r, g, b));
+    RenderText(text.c_str(), Math::Vector3f(x, y, z), Math::Vector3f(r, g, b));
 }
 
 void Font::RenderText(const std::string &text, float x, float y, float z)
 {
-    RenderText(text, Math::Vector3f(x, y, z), m_color);
+    RenderText(text.c_str(), Math::Vector3f(x, y, z), m_color);
 }
 
 void Font::RenderText(const std::string &text)
 {
-    RenderText(text, m_position, m_color);
+    RenderText(text.c_str(), m_position, m_color);
 }
 
 void Font::RenderText(const std::string &text, const Math::Vector3f &position, const Math::Vector3f &color)
 {
-    Camera::CameraMode camMode = g_cameraDirector.GetActiveCamera()->GetMode();
-    g_cameraDirector.GetActiveCamera()->SetMode(Camera::CAM_ORTHO);
+    RenderText(text.c_str(), position, color);
+}
 
-    Math::Vector3f pos = position;
+void Font::RenderText(const char *text, float x, float y, float z)
+{
+    RenderText(text, Math::Vector3f(x, y, z), m_color);
+}
 
-    LOG_MESSAGE_ASSERT(m_charCount + text.length() < MAX_CHARS, "Too many chars");
-    m_charCount += (int)text.length();
+void Font::RenderText(const char *text, const Math::Vector3f &position, const Math::Vector3f &color)
+{
+    Layer &layer = m_layers[m_layer];
+    TextRun run;
+    run.position = position;
+    run.color  = color;
+    run.first  = layer.text.size();
+    run.length = strlen(text);
+
+    layer.text.insert(layer.text.end(), text, text + run.length);
+    layer.runs.push_back(run);
+    layer.dirty = true;
+}
 
-    for (int i = 0; i < text.length(); i++)
+void Font::ClearLayer(TextLayer layer)
+{
+    m_layers[layer].text.clear();
+    m_layers[layer].runs.clear();
+    m_layers[layer].dirty = true;
+}
+
+void Font::BuildGlyphs(Layer &layer) const
+{
+    layer.glyphs.clear();
+
+    for (const TextRun &run : layer.runs)
     {
-        int cu = text[i] - 32;
+        Math::Vector3f pos(run.position.m_x, -run.position.m_y, run.position.m_z);
 
-        if (cu >= 0 && cu < 32 * 3)
+        for (size_t i = run.first; i < run.first + run.length; i++)
         {
-            DrawChar(pos, CHAR_WIDTH, CHAR_HEIGHT, cu % 16 * CHAR_WIDTH, cu / 16 * (CHAR_HEIGHT + 1), i, color);
+            int cu = layer.text[i] - 32;
+
+            // spaces and characters missing in font texture only advance the pen
+            if (cu > 0 && cu < NUM_GLYPHS)
+            {
+                layer.glyphs.emplace_back();
+                Glyph &glyph = layer.glyphs.back();
+                const float *uv = m_glyphUVs[cu];
+
+                for (int j = 0; j < 4; j++)
+                {
+                    GlyphVertex &v = glyph.verts[j];
+                    v.pos[0] = m_quadCorners[j].m_x + pos.m_x;
+                    v.pos[1] = m_quadCorners[j].m_y + pos.m_y;
+                    v.pos[2] = m_quadCorners[j].m_z + pos.m_z;
+                    // corners go top-left, bottom-left, top-right, bottom-right
+                    v.uv[0] = uv[(j & 2)];
+                    v.uv[1] = uv[(j & 1) ? 3 : 1];
+                    v.color[0] = run.color.m_x;
+                    v.color[1] = run.color.m_y;
+                    v.color[2] = run.color.m_z;
+                }
+            }
+
+            pos.m_x += m_advance;
         }
-
-        pos.m_x += m_scale.m_x * (CHAR_SPACING / g_renderContext.scrRatio) * CHAR_WIDTH / g_renderContext.height;
-        m_mappedData++;
     }
-
-    g_cameraDirector.GetActiveCamera()->SetMode(camMode);
 }
 
 void Font::RenderStart()
 {
-    // reset character counter and start mapping vertex buffer memory
-    m_charCount = 0;
-    vmaMapMemory(g_renderContext.Device().allocator, m_vertexBuffer.allocation, (void**)&m_mappedData);
+    m_frame = g_renderContext.ActiveFrame();
+
+    // every glyph shares the same transform, so quad corners are projected once and only offset by pen position
+    Math::Matrix4f mvMatrix;
+    Math::Scale(mvMatrix, 2.f * CHAR_WIDTH / g_renderContext.height, 2.f * CHAR_HEIGHT / g_renderContext.height);
+    Math::Scale(mvMatrix, m_scale.m_x, m_scale.m_y);
+
+    Math::Vector3f quad[]{ { 0.f, 0.f, -1.f },{ 0.f, -1.f, -1.f },
+                           { 1.f, 0.f, -1.f },{ 1.f, -1.f, -1.f } };
+    Math::Vector3f corners[4];
+
+    // window may have been resized since last frame
+    m_camera.UpdateProjection();
+    Math::TransformPoints(m_camera.ProjectionMatrix() * mvMatrix, quad, 4, corners);
+    float advance = m_scale.m_x * (CHAR_SPACING / g_renderContext.scrRatio) * CHAR_WIDTH / g_renderContext.height;
+
+    // glyphs of all layers have to be moved if the transform changed
+    if (memcmp(corners, m_quadCorners, sizeof(corners)) || advance != m_advance)
+    {
+        for (int i = 0; i < 4; i++)
+            m_quadCorners[i] = corners[i];
+
+        m_advance = advance;
+
+        for (Layer &layer : m_layers)
+            layer.dirty = true;
+    }
 }
 
 void Font::RenderFinish()
 {
-    vmaUnmapMemory(g_renderContext.Device().allocator, m_vertexBuffer.allocation);
+    int numGlyphs = 0;
+    for (Layer &layer : m_layers)
+    {
+        if (layer.dirty)
+        {
+            BuildGlyphs(layer);
+            layer.version = ++m_version;
+            layer.dirty = false;
+        }
 
-    // update command buffers with new characters
-    Draw();
-    vkCmdExecuteCommands(g_renderContext.ActiveCmdBuffer(), 1, &m_commandBuffers[g_renderContext.ActiveFrame()]);
-}
+        numGlyphs += (int)layer.glyphs.size();
+    }
 
-void Font::RebuildPipeline()
-{
-    vk::destroyPipeline(g_renderContext.Device(), m_pipeline);
+    if (numGlyphs > m_capacity)
+        Reserve(std::max(numGlyphs, m_capacity * 2));
 
-    // todo: pipeline derivatives https://github.com/SaschaWillems/Vulkan/blob/master/examples/pipelines/pipelines.cpp
-    const char *shaders[] = { "res/Font_vert.spv", "res/Font_frag.spv" };
-    VK_VERIFY(vk::createPipeline(g_renderContext.Device(), g_renderContext.SwapChain(), g_renderContext.ActiveRenderPass(), m_descriptor.setLayout, &m_vbInfo, &m_pipeline, shaders));
-}
+    // copy changed layers into ring slot of current frame - following layers are shifted, so they're copied as well
+    FrameSlot &slot = m_slots[m_frame];
+    Glyph *slotData = m_glyphData + m_frame * m_capacity;
+    bool changed = !slot.valid;
+    int offset = 0;
 
-void Font::DrawChar(const Math::Vector3f &pos, int w, int h, int uo, int vo, int offset, const Math::Vector3f &color)
-{
-    Math::Matrix4f texMatrix, mvMatrix;
+    for (int i = 0; i < NumLayers; ++i)
+    {
+        const Layer &layer = m_layers[i];
+        changed |= slot.versions[i] != layer.version;
 
-    Math::Scale(mvMatrix, 2.f * w / g_renderContext.height, 2.f * h / g_renderContext.height);
-    Math::Scale(mvMatrix, m_scale.m_x, m_scale.m_y);
+        if (changed && !layer.glyphs.empty())
+        {
+            memcpy(slotData + offset, layer.glyphs.data(), layer.glyphs.size() * sizeof(Glyph));
+            // no-op on host coherent memory, required otherwise
+            vmaFlushAllocation(g_renderContext.Device().allocator, m_vertexBuffer.allocation, (m_frame * m_capacity + offset) * sizeof(Glyph), layer.glyphs.size() * sizeof(Glyph));
+        }
+
+        slot.versions[i] = layer.version;
+        offset += (int)layer.glyphs.size();
+    }
 
-    Math::Scale(texMatrix, 1.f / m_texture->Width(), -1.f / m_texture->Height());
-    Math::Translate(texMatrix, (float)uo, (float)-vo);
-    Math::Scale(texMatrix, (float)w, (float)h);
+    // command buffer of the slot is still valid if glyphs and render target didn't change
+    const VkRenderPass &renderPass = g_renderContext.ActiveRenderPass().renderPass;
+    if (changed || slot.renderPass != renderPass || memcmp(&slot.viewport, &g_renderContext.Viewport(), sizeof(VkViewport))
+                || memcmp(&slot.scissor, &g_renderContext.Scissor(), sizeof(VkRect2D)))
+    {
+        Draw(numGlyphs);
+        slot.renderPass = renderPass;
+        slot.viewport = g_renderContext.Viewport();
+        slot.scissor  = g_renderContext.Scissor();
+        slot.valid = true;
+    }
+
+    vkCmdExecuteCommands(g_renderContext.ActiveCmdBuffer(), 1, &m_commandBuffers[m_frame]);
+}
 
-    Math::Vector3f verts[]{ { 0.f, 0.f, -1.f },{ 0.f, -1.f, -1.f },
-                            { 1.f, 0.f, -1.f },{ 1.f, -1.f, -1.f } };
-    Math::Vector3f uv[4];
-    Math::Vector3f p(pos.m_x, -pos.m_y, pos.m_z);
-    Math::Vector3f uvo(texMatrix[12], texMatrix[13], 0.f);
-    GlyphVertex g;
+void Font::Reserve(int capacity)
+{
+    const vk::Device &device = g_renderContext.Device();
 
-    for (int i = 0; i < 4; i++)
+    // growing is rare (capacity at least doubles each time), so just wait until previous frames no longer read the ring
+    if (m_vertexBuffer.buffer != VK_NULL_HANDLE)
     {
-        uv[i] = texMatrix * verts[i] + uvo;
-        verts[i] = g_cameraDirector.GetActiveCamera()->ProjectionMatrix() * mvMatrix * verts[i] + p;
+        vkDeviceWaitIdle(device.logical);
+        vk::freeBuffer(device, m_vertexBuffer);
+        vk::freeBuffer(device, m_indexBuffer);
+    }
 
-        memcpy(g.pos, &verts[i], sizeof(g.pos));
-        memcpy(g.uv, &uv[i], sizeof(g.uv));
-        memcpy(g.color, &m_color, sizeof(g.color));
-        memcpy(&m_mappedData->verts[i], &g, sizeof(GlyphVertex));
+    vk::BufferOptions bOpts;
+    bOpts.memFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    bOpts.vmaFlags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    bOpts.vmaUsage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+
+    bOpts.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    VK_VERIFY(vk::createBuffer(device, sizeof(Glyph) * capacity * g_renderContext.FramesInFlight(), &m_vertexBuffer, bOpts));
+    bOpts.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    VK_VERIFY(vk::createBuffer(device, sizeof(uint32_t) * 6 * capacity, &m_indexBuffer, bOpts));
+
+    VmaAllocationInfo allocInfo;
+    vmaGetAllocationInfo(device.allocator, m_vertexBuffer.allocation, &allocInfo);
+    m_glyphData = static_cast<Glyph *>(allocInfo.pMappedData);
+    m_capacity  = capacity;
+
+    // slots have to be filled and recorded again
+    for (FrameSlot &slot : m_slots)
+        slot.valid = false;
+
+    // two triangles per glyph quad - indices are the same for every ring slot, since slots are bound at an offset
+    vmaGetAllocationInfo(device.allocator, m_indexBuffer.allocation, &allocInfo);
+    uint32_t *indices = static_cast<uint32_t *>(allocInfo.pMappedData);
+    for (uint32_t i = 0; i < (uint32_t)capacity; ++i)
+    {
+        uint32_t quadIndices[] = { 4 * i, 4 * i + 1, 4 * i + 2, 4 * i + 2, 4 * i + 1, 4 * i + 3 };
+        memcpy(&indices[6 * i], quadIndices, sizeof(quadIndices));
     }
+
+    vmaFlushAllocation(device.allocator, m_indexBuffer.allocation, 0, VK_WHOLE_SIZE);
 }
 
-void Font::Draw()
+void Font::Draw(int numGlyphs)
 {
+    // framebuffer is left unspecified, so that the command buffer can be reused with any swapchain image
     VkCommandBufferInheritanceInfo inheritanceInfo = {};
     inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
     inheritanceInfo.renderPass = g_renderContext.ActiveRenderPass().renderPass;
-    inheritanceInfo.framebuffer = g_renderContext.ActiveFramebuffer();
+    inheritanceInfo.framebuffer = VK_NULL_HANDLE;
 
     VkCommandBufferBeginInfo beginInfo = {};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
     beginInfo.pInheritanceInfo = &inheritanceInfo;
 
-    int frameIdx = g_renderContext.ActiveFrame();
-    VK_VERIFY(vkBeginCommandBuffer(m_commandBuffers[frameIdx], &beginInfo));
-    vkCmdSetViewport(m_commandBuffers[frameIdx], 0, 1, &g_renderContext.Viewport());
-    vkCmdSetScissor(m_commandBuffers[frameIdx], 0, 1, &g_renderContext.Scissor());
+    VkCommandBuffer cmdBuffer = m_commandBuffers[m_frame];
+    VK_VERIFY(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+    vkCmdSetViewport(cmdBuffer, 0, 1, &g_renderContext.Viewport());
+    vkCmdSetScissor(cmdBuffer, 0, 1, &g_renderContext.Scissor());
 
-    vkCmdBindPipeline(m_commandBuffers[frameIdx], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline.pipeline);
+    const vk::Pipeline &pipeline = m_pipelines.Get(g_renderContext.ActiveRenderPass(), VK_POLYGON_MODE_FILL, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
 
-    // queue all pending characters
-    VkDeviceSize offsets[] = { 0 };
-    vkCmdBindVertexBuffers(m_commandBuffers[frameIdx], 0, 1, &m_vertexBuffer.buffer, offsets);
-    vkCmdBindDescriptorSets(m_commandBuffers[frameIdx], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline.layout, 0, 1, &m_descriptor.set, 0, nullptr);
-
-    for (int j = 0; j < m_charCount; j++)
-        vkCmdDraw(m_commandBuffers[frameIdx], 4, 1, j * 4, 0);
+    // draw all glyphs at once from ring slot of current frame
+    if (numGlyphs > 0)
+    {
+        VkDeviceSize offsets[] = { sizeof(Glyph) * m_frame * m_capacity };
+        vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &m_vertexBuffer.buffer, offsets);
+        vkCmdBindIndexBuffer(cmdBuffer, m_indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout, 0, 1, &m_descriptor.set, 0, nullptr);
+        vkCmdDrawIndexed(cmdBuffer, 6 * numGlyphs, 1, 0, 0, 0);
+    }
 
-    VK_VERIFY(vkEndCommandBuffer(m_commandBuffers[frameIdx]));
+    VK_VERIFY(vkEndCommandBuffer(cmdBuffer));
 }
 
 void Font::CreateDescriptor(const vk::Texture *texture, vk::Descriptor *descriptor)
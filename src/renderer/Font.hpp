@@ -1,33 +1,48 @@
 #ifndef FONT_HPP
 #define FONT_HPP
 
+#include "renderer/Camera.hpp"
+#include "renderer/PipelineVariants.hpp"
 #include "renderer/RenderContext.hpp"
 #include <string>
 
 class GameTexture;
 
 /*
- * Basic bitmap font
+ * Basic bitmap font with retained text: text is kept in layers between frames and glyphs of a layer are only rebuilt
+ * after it's cleared or the window is resized. Glyphs are copied into a persistently mapped vertex ring (one slot per
+ * frame in flight) and drawn with a single indexed draw - command buffer of a slot is reused while nothing changed.
  */
 
 class Font
 {
 public:
+    enum TextLayer
+    {
+        LayerStatic,  // rarely changing text (labels, help)
+        LayerDynamic, // frequently updated text (counters) - drawn on top of static text
+        NumLayers
+    };
+
     Font(const char *texture);
     ~Font();
 
     void SetColor(const Math::Vector3f &color) { m_color = color; }
     void SetPosition(const Math::Vector3f &position) { m_position = position; }
-    void SetScale(const Math::Vector2f &scale) { m_scale = scale; }
+    void SetScale(const Math::Vector2f &scale) { m_scale = scale; } // applied from next RenderStart()
+    void SetLayer(TextLayer layer) { m_layer = layer; }            // layer RenderText() appends to
+    void ClearLayer(TextLayer layer);
+    // append text to current layer - it stays there until the layer is cleared
+    void RenderText(const char *text, const Math::Vector3f &position, const Math::Vector3f &color);
+    void RenderText(const char *text, float x, float y, float z = -1.0f);
     void RenderText(const std::string &text);
     void RenderText(const std::string &text, float x, float y, float z, float r, float g, float b);
     void RenderText(const std::string &text, const Math::Vector3f &position, const Math::Vector3f &color);
     void RenderText(const std::string &text, float x, float y, float z = -1.0f);
     void RenderStart();
     void RenderFinish();
-    void RebuildPipeline();
 private:
-    static const int MAX_CHARS = 350;
+    static const int NUM_GLYPHS = 96; // printable ASCII characters in font texture
 
     // vertex data for character
     struct GlyphVertex
@@ -43,10 +58,39 @@ private:
         GlyphVertex verts[4];
     };
 
-    void Draw();
+    // text passed to a single RenderText() call
+    struct TextRun
+    {
+        Math::Vector3f position;
+        Math::Vector3f color;
+        size_t first  = 0; // first character in layer text
+        size_t length = 0;
+    };
+
+    struct Layer
+    {
+        std::vector<char>    text;
+        std::vector<TextRun> runs;
+        std::vector<Glyph>   glyphs;  // built from runs in RenderFinish()
+        uint32_t version = 0;         // changes whenever glyphs are rebuilt
+        bool dirty = false;
+    };
+
+    // contents of a ring slot - the slot is reused as is if none of these changed since it was filled
+    struct FrameSlot
+    {
+        uint32_t     versions[NumLayers] = {};
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        VkViewport   viewport = {};
+        VkRect2D     scissor = {};
+        bool         valid = false;
+    };
+
+    void Draw(int numGlyphs);
     void CreateDescriptor(const vk::Texture *texture, vk::Descriptor *descriptor);
-    // single character draw
-    void DrawChar(const Math::Vector3f &pos, int w, int h, int uo, int vo, int offset, const Math::Vector3f &color);
+    // (re)create glyph ring and index buffer with room for given number of glyphs per frame
+    void Reserve(int capacity);
+    void BuildGlyphs(Layer &layer) const;
 
     // handle to font texture
     GameTexture*    m_texture = nullptr;
@@ -54,20 +98,32 @@ private:
     Math::Vector3f  m_position;
     Math::Vector3f  m_color;
 
+    // text is projected with its own orthographic camera, so the active one is never touched
+    Camera          m_camera;
+    float           m_glyphUVs[NUM_GLYPHS][4]; // u0, v0, u1, v1 of each character
+    Math::Vector3f  m_quadCorners[4];          // projected glyph quad relative to pen position (updated in RenderStart())
+    float           m_advance = 0.f;           // pen advance per character
+
+    Layer     m_layers[NumLayers];
+    TextLayer m_layer = LayerDynamic;
+    uint32_t  m_version = 0; // last assigned layer version
+
     // Vulkan buffers
-    vk::Pipeline   m_pipeline;
+    PipelineVariants m_pipelines; // one variant per render pass (MSAA on/off)
     vk::VertexBufferInfo m_vbInfo;
 
     vk::Buffer     m_vertexBuffer;
+    vk::Buffer     m_indexBuffer; // 6 indices per glyph, shared by all ring slots
     vk::Descriptor m_descriptor;
 
-    int    m_charCount = 0;         // number of characters currently queued for drawing
-    Glyph  m_charBuffer[MAX_CHARS]; // character data for vertex buffer
-    Glyph *m_mappedData = nullptr;  // pointer to currently mapped Vulkan data
+    Glyph *m_glyphData = nullptr; // persistently mapped ring: m_capacity glyphs per frame in flight
+    int    m_capacity  = 0;
+    int    m_frame     = 0;       // ring slot used in current frame
+    std::vector<FrameSlot> m_slots;
 
-    // secondary command buffers (double buffered) and pool to render into
+    // secondary command buffers (one per frame in flight) and pool to render into
     VkCommandPool m_commandPool;
-    VkCommandBuffer m_commandBuffers[2];
+    std::vector<VkCommandBuffer> m_commandBuffers;
 };
 
 #endif
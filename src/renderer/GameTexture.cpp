@@ -1,5 +1,6 @@
 #include "renderer/RenderContext.hpp"
 #include "renderer/GameTexture.hpp"
+#include "renderer/TextureManager.hpp"
 #include "stb_image/stb_image.h"
 #include <algorithm>
 #include <cmath>
@@ -11,8 +12,18 @@ extern AAssetManager *g_androidAssetMgr;
 
 extern RenderContext  g_renderContext;
 
+// baked textures live next to source images, with .qtx extension
+static std::string containerName(const char *filename)
+{
+    std::string name(filename);
+    return name.substr(0, name.find_last_of('.')) + ".qtx";
+}
+
 GameTexture::GameTexture(const char *filename) : m_textureData(nullptr)
 {
+    if (LoadContainer(containerName(filename)))
+        return;
+
     VkFormatProperties fp = {};
     vkGetPhysicalDeviceFormatProperties(g_renderContext.Device().physical, VK_FORMAT_R8G8B8_UNORM, &fp);
 
@@ -48,6 +59,9 @@ GameTexture::GameTexture(const char *filename) : m_textureData(nullptr)
         m_textureData = stbi_load(filename, &m_width, &m_height, &m_components, STBI_rgb_alpha);
         m_components = 4;
     }
+
+    if (m_textureData && TextureManager::GetInstance()->BakeTextures())
+        BakeContainer(containerName(filename));
 #endif
 }
 
@@ -62,15 +76,29 @@ GameTexture::~GameTexture()
 bool GameTexture::Load(bool filtering)
 {
     // texture already loaded or doesn't exist
-    if (!m_textureData)
+    if (!m_textureData && !m_encoding)
         return false;
 
+    m_filtering = filtering;
     if (!filtering)
     {
         m_vkTexture.minFilter = VK_FILTER_NEAREST;
         m_vkTexture.magFilter = VK_FILTER_NEAREST;
     }
 
+    // baked texture: all mips are uploaded as they are, no blits needed
+    if (m_encoding)
+    {
+        m_vkTexture.format = m_encoding->format;
+        m_vkTexture.mipLevels = m_container.mipLevels;
+
+        vk::createTextureFromMips(g_renderContext.Device(), &m_vkTexture, m_encoding->data.data(), m_width, m_height);
+
+        m_encoding = nullptr;
+        m_container = TextureContainer();
+        return true;
+    }
+
     m_vkTexture.format = m_components == 3 ? VK_FORMAT_R8G8B8_UNORM : VK_FORMAT_R8G8B8A8_UNORM;
     // calculate number of mipmaps to generate for given texture dimensions
     m_vkTexture.mipLevels = (uint32_t)std::floor(std::log2(std::max(m_width, m_height))) + 1;
@@ -82,3 +110,110 @@ bool GameTexture::Load(bool filtering)
 
     return true;
 }
+
+bool GameTexture::LoadContainer(const std::string &filename)
+{
+#ifdef __ANDROID__
+    AAsset *asset = AAssetManager_open(g_androidAssetMgr, filename.c_str(), AASSET_MODE_BUFFER);
+
+    if (!asset)
+        return false;
+
+    bool loaded = m_container.Load((const unsigned char*)AAsset_getBuffer(asset), (size_t)AAsset_getLength64(asset));
+    AAsset_close(asset);
+#else
+    bool loaded = m_container.Load(filename.c_str());
+#endif
+
+    if (!loaded)
+        return false;
+
+    m_encoding = m_container.SelectEncoding([](VkFormat format) { return vk::isFormatSampleable(g_renderContext.Device(), format); });
+
+    // none of the baked formats can be used - fall back to source image
+    if (!m_encoding)
+    {
+        m_container = TextureContainer();
+        return false;
+    }
+
+    m_width  = (int)m_container.width;
+    m_height = (int)m_container.height;
+    m_components = 4;
+    return true;
+}
+
+void GameTexture::BakeContainer(const std::string &filename)
+{
+    // compressor expects RGBA input - expand grayscale and RGB source images
+    std::vector<unsigned char> rgba(m_width * m_height * 4, 255);
+    for (int i = 0; i < m_width * m_height; ++i)
+    {
+        const unsigned char *src = m_textureData + i * m_components;
+        if (m_components < 3)
+        {
+            memset(&rgba[i * 4], src[0], 3);
+            if (m_components == 2)
+                rgba[i * 4 + 3] = src[1];
+        }
+        else
+        {
+            memcpy(&rgba[i * 4], src, m_components);
+        }
+    }
+
+    m_container.Build(rgba.data(), m_width, m_height);
+
+    if (m_container.Save(filename.c_str()))
+    {
+        LOG_MESSAGE("[GameTexture] Baked texture: " << filename);
+    }
+    else
+    {
+        LOG_MESSAGE("[GameTexture] Could not write baked texture: " << filename);
+    }
+
+    // use the baked data right away, so that results are identical to subsequent runs
+    m_encoding = m_container.SelectEncoding([](VkFormat format) { return vk::isFormatSampleable(g_renderContext.Device(), format); });
+    if (m_encoding)
+    {
+        stbi_image_free(m_textureData);
+        m_textureData = nullptr;
+    }
+    else
+    {
+        m_container = TextureContainer();
+    }
+}
+
+VkDeviceSize GameTexture::MemorySize() const
+{
+    if (m_vkTexture.allocation == VK_NULL_HANDLE)
+        return 0;
+
+    VmaAllocationInfo allocInfo;
+    vmaGetAllocationInfo(g_renderContext.Device().allocator, m_vkTexture.allocation, &allocInfo);
+    return allocInfo.size;
+}
+
+void GameTexture::EvictTopMip(vk::Texture *retired)
+{
+    vk::Texture lowRes;
+    uint32_t width  = std::max(1, m_width >> m_residentMip);
+    uint32_t height = std::max(1, m_height >> m_residentMip);
+    vk::createTextureFromMipRange(g_renderContext.Device(), m_vkTexture, 1, width, height, &lowRes);
+
+    *retired = m_vkTexture;
+    m_vkTexture = lowRes;
+    m_residentMip++;
+    m_generation++;
+}
+
+void GameTexture::ReplaceImage(GameTexture *source, vk::Texture *retired)
+{
+    *retired = m_vkTexture;
+    m_vkTexture = source->m_vkTexture;
+    source->m_vkTexture = vk::Texture();
+    m_residentMip = 0;
+    m_generation++;
+}
@@ -1,7 +1,9 @@
 #ifndef GAMETEXTURE_INCLUDED
 #define GAMETEXTURE_INCLUDED
 
+#include "renderer/TextureContainer.hpp"
 #include "renderer/vulkan/Image.hpp"
+#include <string>
 
 /*
  *  Generic texture with Vulkan image buffer
@@ -11,9 +13,12 @@ class GameTexture
 {
 public:
     friend class TextureManager;
+    friend class TextureStreamer;
 
     const int Width()  const { return m_width; }
     const int Height() const { return m_height; }
+    // changes whenever the Vulkan image is replaced (due to mip eviction or reload) - descriptors using it have to be updated
+    const uint32_t Generation() const { return m_generation; }
 
     // implicit conversion to vk::Texture* for fast reference to Vulkan image
     operator const vk::Texture*() const { return &m_vkTexture; }
@@ -22,12 +27,33 @@ private:
     ~GameTexture();
 
     bool Load(bool filtering);
+    // true if image data was read from file and is waiting for upload
+    bool Decoded() const { return m_textureData || m_encoding; }
+    // try to use baked texture with precomputed mips - true if it's available in a format supported by the device
+    bool LoadContainer(const std::string &filename);
+    void BakeContainer(const std::string &filename);
+
+    // residency management (see TextureManager::UpdateResidency)
+    VkDeviceSize MemorySize() const;
+    // replace the image with a copy lacking the top mip - old image is returned for deferred release
+    void EvictTopMip(vk::Texture *retired);
+    // take over the full resolution image of a freshly loaded copy of this texture
+    void ReplaceImage(GameTexture *source, vk::Texture *retired);
 
     int m_width;
     int m_height;
     int m_components;
     vk::Texture m_vkTexture;
     unsigned char *m_textureData;
+    TextureContainer m_container;
+    const TextureContainer::Encoding *m_encoding = nullptr;
+
+    std::string m_name;            // name the texture is registered with in TextureManager
+    bool     m_filtering = true;
+    uint32_t m_residentMip = 0;    // mip of the full chain which is currently the top level of the image
+    uint64_t m_lastUsedFrame = 0;  // 0 if never used for rendering - such textures are always kept resident
+    uint32_t m_generation = 0;
+    bool     m_reloading = false;
 };
 
 #endif
\ No newline at end of file
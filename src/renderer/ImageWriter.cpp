@@ -0,0 +1,125 @@
+#include "renderer/ImageWriter.hpp"
+#include <algorithm>
+#include <fstream>
+#include <stdint.h>
+#include <vector>
+
+static uint32_t crc32(const unsigned char *data, size_t size, uint32_t crc = 0)
+{
+    static uint32_t table[256] = { 0 };
+    if (!table[1])
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+static void appendU32(std::vector<unsigned char> &dst, uint32_t value)
+{
+    dst.push_back((unsigned char)(value >> 24));
+    dst.push_back((unsigned char)(value >> 16));
+    dst.push_back((unsigned char)(value >> 8));
+    dst.push_back((unsigned char)value);
+}
+
+// chunk length, type, data and CRC of type + data
+static void writeChunk(std::ofstream &file, const char *type, const std::vector<unsigned char> &data)
+{
+    std::vector<unsigned char> chunk;
+    chunk.reserve(data.size() + 12);
+    appendU32(chunk, (uint32_t)data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    appendU32(chunk, crc32(chunk.data() + 4, data.size() + 4));
+
+    file.write((const char *)chunk.data(), chunk.size());
+}
+
+bool ImageWriter::WritePNG(const char *filename, const unsigned char *rgba, int width, int height)
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    static const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    file.write((const char *)signature, sizeof(signature));
+
+    // 8 bits per channel, truecolor, default compression and filtering, no interlacing
+    std::vector<unsigned char> header;
+    appendU32(header, (uint32_t)width);
+    appendU32(header, (uint32_t)height);
+    header.insert(header.end(), { 8, 2, 0, 0, 0 });
+    writeChunk(file, "IHDR", header);
+
+    // scanlines prefixed with filter type (none)
+    size_t rowSize = 1 + (size_t)width * 3;
+    std::vector<unsigned char> scanlines(rowSize * height);
+    for (int y = 0; y < height; ++y)
+    {
+        unsigned char *row = &scanlines[y * rowSize];
+        const unsigned char *src = rgba + (size_t)y * width * 4;
+        row[0] = 0;
+        for (int x = 0; x < width; ++x)
+        {
+            row[1 + x * 3 + 0] = src[x * 4 + 0];
+            row[1 + x * 3 + 1] = src[x * 4 + 1];
+            row[1 + x * 3 + 2] = src[x * 4 + 2];
+        }
+    }
+
+    // zlib stream made of stored (uncompressed) deflate blocks
+    std::vector<unsigned char> zlib;
+    zlib.reserve(scanlines.size() + scanlines.size() / 65535 * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+
+    uint32_t adlerA = 1, adlerB = 0;
+    size_t offset = 0;
+    do
+    {
+        uint16_t blockSize = (uint16_t)std::min(scanlines.size() - offset, (size_t)65535);
+        uint16_t blockSizeComplement = (uint16_t)~blockSize;
+        bool lastBlock = offset + blockSize == scanlines.size();
+        zlib.push_back(lastBlock ? 1 : 0);
+        zlib.push_back((unsigned char)blockSize);
+        zlib.push_back((unsigned char)(blockSize >> 8));
+        zlib.push_back((unsigned char)blockSizeComplement);
+        zlib.push_back((unsigned char)(blockSizeComplement >> 8));
+        zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + blockSize);
+
+        for (size_t i = offset; i < offset + blockSize; ++i)
+        {
+            adlerA = (adlerA + scanlines[i]) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+        }
+
+        offset += blockSize;
+    } while (offset < scanlines.size());
+
+    appendU32(zlib, (adlerB << 16) | adlerA);
+    writeChunk(file, "IDAT", zlib);
+    writeChunk(file, "IEND", std::vector<unsigned char>());
+
+    return file.good();
+}
+
+bool ImageWriter::WriteRaw(const char *filename, const unsigned char *rgba, int width, int height)
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    file.write((const char *)rgba, (size_t)width * height * 4);
+    return file.good();
+}
@@ -0,0 +1,16 @@
+#ifndef IMAGEWRITER_INCLUDED
+#define IMAGEWRITER_INCLUDED
+
+/*
+ * Saving of rendered RGBA8 frames (used by headless rendering)
+ */
+
+namespace ImageWriter
+{
+    // 8-bit RGB PNG (alpha is dropped) - image data is stored without compression, since frames are written at render rate
+    bool WritePNG(const char *filename, const unsigned char *rgba, int width, int height);
+    // tightly packed RGBA8 rows, top row first, no header
+    bool WriteRaw(const char *filename, const unsigned char *rgba, int width, int height);
+}
+
+#endif
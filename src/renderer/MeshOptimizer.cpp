@@ -0,0 +1,247 @@
+#include "renderer/MeshOptimizer.hpp"
+#include <algorithm>
+#include <array>
+#include <math.h>
+
+namespace MeshOptimizer
+{
+    // Forsyth's scoring parameters, tuned for an LRU cache of VertexCacheSize entries
+    static const int   s_cacheSize         = VertexCacheSize;
+    static const float s_cacheDecayPower   = 1.5f;
+    static const float s_lastTriScore      = 0.75f;
+    static const float s_valenceBoostScale = 2.0f;
+    static const float s_valenceBoostPower = 0.5f;
+
+    struct VertexData
+    {
+        int cachePosition = -1;
+        int remainingTriangles = 0;
+        int firstTriangle = 0; // offset into vertex-triangle adjacency list
+        float score = 0.f;
+    };
+
+    static float VertexScore(const VertexData &vertex)
+    {
+        // no triangles left to draw - vertex is useless
+        if (vertex.remainingTriangles == 0)
+            return -1.f;
+
+        float score = 0.f;
+
+        if (vertex.cachePosition >= 0)
+        {
+            // vertices used by the last triangle get a fixed score, so that the triangle itself isn't favored again
+            if (vertex.cachePosition < 3)
+            {
+                score = s_lastTriScore;
+            }
+            else
+            {
+                float scaler = 1.f / (s_cacheSize - 3);
+                score = powf(1.f - (vertex.cachePosition - 3) * scaler, s_cacheDecayPower);
+            }
+        }
+
+        // boost vertices with few triangles left, so that lone triangles aren't left behind
+        score += s_valenceBoostScale * powf((float)vertex.remainingTriangles, -s_valenceBoostPower);
+
+        return score;
+    }
+
+    void OptimizeVertexCache(unsigned int *indices, size_t indexCount, size_t vertexCount)
+    {
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount < 2)
+            return;
+
+        std::vector<VertexData> vertexData(vertexCount);
+        std::vector<int> adjacency(indexCount);
+        std::vector<int> adjacencyFill(vertexCount, 0);
+        std::vector<float> triangleScore(triangleCount, 0.f);
+        std::vector<bool> triangleEmitted(triangleCount, false);
+        std::vector<unsigned int> output;
+        output.reserve(indexCount);
+
+        // build vertex-triangle adjacency
+        for (size_t i = 0; i < indexCount; ++i)
+            vertexData[indices[i]].remainingTriangles++;
+
+        for (size_t i = 0, offset = 0; i < vertexCount; ++i)
+        {
+            vertexData[i].firstTriangle = (int)offset;
+            offset += vertexData[i].remainingTriangles;
+            vertexData[i].score = VertexScore(vertexData[i]);
+        }
+
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            VertexData &v = vertexData[indices[i]];
+            adjacency[v.firstTriangle + adjacencyFill[indices[i]]++] = (int)(i / 3);
+        }
+
+        for (size_t i = 0; i < triangleCount; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+                triangleScore[i] += vertexData[indices[i * 3 + j]].score;
+        }
+
+        int cache[s_cacheSize + 3];
+        int cacheCount = 0;
+        int bestTriangle = -1;
+        size_t scanPosition = 0;
+
+        for (size_t emitted = 0; emitted < triangleCount; ++emitted)
+        {
+            // no candidate among cached vertices - fall back to the first not yet emitted triangle in input order
+            // (the cursor only moves forward, so disconnected meshes don't degrade to a quadratic scan)
+            if (bestTriangle < 0)
+            {
+                for (; triangleEmitted[scanPosition]; ++scanPosition);
+                bestTriangle = (int)scanPosition;
+            }
+
+            // emit the triangle and remove it from adjacency of its vertices
+            triangleEmitted[bestTriangle] = true;
+            int newCache[s_cacheSize + 3];
+            int newCacheCount = 0;
+
+            for (int j = 0; j < 3; ++j)
+            {
+                unsigned int idx = indices[bestTriangle * 3 + j];
+                output.push_back(idx);
+                newCache[newCacheCount++] = (int)idx;
+
+                VertexData &v = vertexData[idx];
+                int *triangles = &adjacency[v.firstTriangle];
+                for (int k = 0; k < v.remainingTriangles; ++k)
+                {
+                    if (triangles[k] == bestTriangle)
+                    {
+                        triangles[k] = triangles[v.remainingTriangles - 1];
+                        break;
+                    }
+                }
+                v.remainingTriangles--;
+            }
+
+            // move emitted vertices to the front of the LRU cache
+            for (int i = 0; i < cacheCount; ++i)
+            {
+                int idx = cache[i];
+                if (idx != newCache[0] && idx != newCache[1] && idx != newCache[2])
+                    newCache[newCacheCount++] = idx;
+            }
+
+            // vertices pushed out of the cache lose their cache score
+            for (int i = s_cacheSize; i < newCacheCount; ++i)
+                vertexData[newCache[i]].cachePosition = -1;
+
+            cacheCount = newCacheCount < s_cacheSize ? newCacheCount : s_cacheSize;
+            for (int i = 0; i < cacheCount; ++i)
+                cache[i] = newCache[i];
+
+            // update scores of cached vertices and their triangles, pick the best candidate for the next iteration
+            float bestScore = -1.f;
+            bestTriangle = -1;
+
+            for (int i = 0; i < newCacheCount; ++i)
+            {
+                VertexData &v = vertexData[newCache[i]];
+                v.cachePosition = i < s_cacheSize ? i : -1;
+
+                float newScore = VertexScore(v);
+                float delta = newScore - v.score;
+                v.score = newScore;
+
+                for (int k = 0; k < v.remainingTriangles; ++k)
+                {
+                    int tri = adjacency[v.firstTriangle + k];
+                    triangleScore[tri] += delta;
+
+                    if (i < s_cacheSize && triangleScore[tri] > bestScore)
+                    {
+                        bestScore = triangleScore[tri];
+                        bestTriangle = tri;
+                    }
+                }
+            }
+        }
+
+        for (size_t i = 0; i < indexCount; ++i)
+            indices[i] = output[i];
+    }
+
+    void OptimizeVertexFetch(unsigned int *indices, size_t indexCount, size_t vertexCount, std::vector<unsigned int> &remap)
+    {
+        const unsigned int unused = ~0u;
+        unsigned int nextVertex = 0;
+        remap.assign(vertexCount, unused);
+
+        // vertices are laid out in the order they're first referenced
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            unsigned int &newIndex = remap[indices[i]];
+            if (newIndex == unused)
+                newIndex = nextVertex++;
+
+            indices[i] = newIndex;
+        }
+
+        for (size_t i = 0; i < vertexCount; ++i)
+        {
+            if (remap[i] == unused)
+                remap[i] = nextVertex++;
+        }
+    }
+
+    float CalculateACMR(const unsigned int *indices, size_t indexCount, unsigned int cacheSize)
+    {
+        if (indexCount < 3 || cacheSize == 0)
+            return 0.f;
+
+        // same LRU model the optimizer is tuned for: most recently used vertex first, misses push out the last one
+        std::vector<unsigned int> cache;
+        cache.reserve(cacheSize);
+        unsigned int misses = 0;
+
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            unsigned int idx = indices[i];
+            size_t pos = 0;
+            for (; pos < cache.size() && cache[pos] != idx; ++pos);
+
+            if (pos == cache.size())
+            {
+                ++misses;
+                if (cache.size() < cacheSize)
+                    cache.push_back(idx);
+                pos = cache.size() - 1;
+            }
+
+            for (; pos > 0; --pos)
+                cache[pos] = cache[pos - 1];
+            cache[0] = idx;
+        }
+
+        return (float)misses / (indexCount / 3);
+    }
+
+    bool SameTriangles(const unsigned int *a, const unsigned int *b, size_t indexCount)
+    {
+        // rotate each triangle so that its smallest index goes first (keeps winding), then compare sorted lists
+        auto normalize = [indexCount](const unsigned int *indices) {
+            std::vector<std::array<unsigned int, 3>> triangles(indexCount / 3);
+            for (size_t i = 0; i < triangles.size(); ++i)
+            {
+                const unsigned int *t = &indices[i * 3];
+                int first = t[0] <= t[1] && t[0] <= t[2] ? 0 : (t[1] <= t[2] ? 1 : 2);
+                triangles[i] = { t[first], t[(first + 1) % 3], t[(first + 2) % 3] };
+            }
+
+            std::sort(triangles.begin(), triangles.end());
+            return triangles;
+        };
+
+        return normalize(a) == normalize(b);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef MESHOPTIMIZER_INCLUDED
+#define MESHOPTIMIZER_INCLUDED
+
+#include <vector>
+#include <stddef.h>
+
+/*
+ * Load-time optimization of indexed triangle lists for post-transform vertex cache and vertex fetch
+ */
+
+namespace MeshOptimizer
+{
+    // LRU post-transform cache modelled by both the optimizer and ACMR calculation
+    const unsigned int VertexCacheSize = 32;
+
+    // reorder triangles to improve post-transform vertex cache hit ratio (Tom Forsyth's linear-speed algorithm)
+    void OptimizeVertexCache(unsigned int *indices, size_t indexCount, size_t vertexCount);
+
+    // compute vertex order matching first use in the index buffer and remap indices accordingly
+    // remap[oldIndex] = newIndex; vertices not referenced by any triangle are moved to the end
+    void OptimizeVertexFetch(unsigned int *indices, size_t indexCount, size_t vertexCount, std::vector<unsigned int> &remap);
+
+    // average cache miss ratio (transformed vertices per triangle) simulated on an LRU cache
+    float CalculateACMR(const unsigned int *indices, size_t indexCount, unsigned int cacheSize = VertexCacheSize);
+
+    // check that both index lists contain the same triangles with the same winding (in any order)
+    bool SameTriangles(const unsigned int *a, const unsigned int *b, size_t indexCount);
+}
+
+#endif
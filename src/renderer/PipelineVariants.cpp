@@ -0,0 +1,125 @@
+#include "renderer/PipelineVariants.hpp"
+#include "renderer/RenderContext.hpp"
+#include "ThreadProcessor.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <tuple>
+
+extern RenderContext   g_renderContext;
+extern ThreadProcessor g_threadProcessor;
+
+int   PipelineVariants::s_compiledVariants = 0;
+float PipelineVariants::s_compileTime = 0.f;
+
+bool PipelineVariants::Key::operator<(const Key &other) const
+{
+    return std::tie(renderPass, samples, mode, topology) < std::tie(other.renderPass, other.samples, other.mode, other.topology);
+}
+
+void PipelineVariants::Init(const vk::Pipeline &base, const VkDescriptorSetLayout &dsLayout, const vk::VertexBufferInfo *vbInfo, const char **shaders)
+{
+    // tesselation pipelines expect shaders in order: vertex, tess control, tess evaluation, fragment
+    int numShaders = base.patchControlPoints > 0 ? 4 : 2;
+
+    m_base = base;
+    m_dsLayout = dsLayout;
+    m_vbInfo = vbInfo;
+    m_shaders.assign(shaders, shaders + numShaders);
+}
+
+void PipelineVariants::Destroy()
+{
+    for (auto &v : m_variants)
+        vk::destroyPipeline(g_renderContext.Device(), v.second.pipeline);
+
+    m_variants.clear();
+    m_queued.clear();
+}
+
+void PipelineVariants::Add(const vk::RenderPass &renderPass, VkPolygonMode mode, VkPrimitiveTopology topology)
+{
+    Variant &variant = FindOrCreate(renderPass, mode, topology);
+
+    if (!variant.compiled && std::find(m_queued.begin(), m_queued.end(), &variant) == m_queued.end())
+        m_queued.push_back(&variant);
+}
+
+void PipelineVariants::Compile()
+{
+    if (m_queued.empty())
+        return;
+
+    auto compileStart = std::chrono::high_resolution_clock::now();
+
+    // pipeline creation (and the pipeline cache) is thread safe, as long as each thread writes to a different pipeline
+    unsigned int threadCnt = g_threadProcessor.NumThreads();
+    if (threadCnt > 1)
+    {
+        for (size_t i = 0; i < m_queued.size(); ++i)
+        {
+            Variant *variant = m_queued[i];
+            g_threadProcessor.AddTask((uint8_t)(i % threadCnt), [=] { Build(*variant); });
+        }
+
+        g_threadProcessor.Wait();
+    }
+    else
+    {
+        for (auto *variant : m_queued)
+            Build(*variant);
+    }
+
+    float compileTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - compileStart).count();
+    LOG_MESSAGE("Compiled " << m_queued.size() << " pipeline variants in " << compileTime << "ms");
+
+    for (auto *variant : m_queued)
+        variant->compiled = true;
+
+    s_compiledVariants += (int)m_queued.size();
+    s_compileTime += compileTime;
+    m_queued.clear();
+}
+
+const vk::Pipeline &PipelineVariants::Get(const vk::RenderPass &renderPass, VkPolygonMode mode, VkPrimitiveTopology topology)
+{
+    Variant &variant = FindOrCreate(renderPass, mode, topology);
+
+    // variants not set up in advance cause a hitch, but rendering can still continue
+    if (!variant.compiled)
+    {
+        LOG_MESSAGE("Pipeline variant was not precompiled - compiling now.");
+        Add(renderPass, mode, topology);
+        Compile();
+    }
+
+    return variant.pipeline;
+}
+
+PipelineVariants::Variant &PipelineVariants::FindOrCreate(const vk::RenderPass &renderPass, VkPolygonMode mode, VkPrimitiveTopology topology)
+{
+    Key key;
+    key.renderPass = renderPass.renderPass;
+    key.samples = renderPass.sampleCount;
+    key.mode = mode;
+    key.topology = topology;
+
+    Variant &variant = m_variants[key];
+    variant.renderPass = renderPass;
+    variant.mode = mode;
+    variant.topology = topology;
+    return variant;
+}
+
+void PipelineVariants::Build(Variant &variant) const
+{
+    std::vector<const char *> shaders;
+    for (const auto &s : m_shaders)
+        shaders.push_back(s.c_str());
+
+    variant.pipeline = m_base;
+    variant.pipeline.mode = variant.mode;
+    variant.pipeline.topology = variant.topology;
+
+    VK_VERIFY(vk::createPipeline(g_renderContext.Device(), g_renderContext.SwapChain(), variant.renderPass, m_dsLayout, m_vbInfo, &variant.pipeline, shaders.data()));
+}
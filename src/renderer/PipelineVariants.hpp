@@ -0,0 +1,67 @@
+#ifndef PIPELINEVARIANTS_HPP
+#define PIPELINEVARIANTS_HPP
+
+#include "renderer/vulkan/Pipeline.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Set of pipelines sharing shaders, layout and vertex format, which differ only in state toggled at runtime
+ * (render pass/sample count, polygon mode and topology). All variants are compiled upfront (in parallel if
+ * thread workers are running), so switching render modes is just a handle lookup with no device stall.
+ */
+
+class PipelineVariants
+{
+public:
+    // common setup of all variants - polygon mode and topology of the base pipeline are overridden by variant keys
+    void Init(const vk::Pipeline &base, const VkDescriptorSetLayout &dsLayout, const vk::VertexBufferInfo *vbInfo, const char **shaders);
+    void Destroy();
+
+    // queue a variant for compilation - no-op if it's already compiled or queued
+    void Add(const vk::RenderPass &renderPass, VkPolygonMode mode, VkPrimitiveTopology topology);
+    // compile all queued variants
+    void Compile();
+    // main thread only: variant matching given state - compiled on the spot if it was never queued
+    const vk::Pipeline &Get(const vk::RenderPass &renderPass, VkPolygonMode mode, VkPrimitiveTopology topology);
+
+    // totals across all variant sets
+    static int   CompiledVariants() { return s_compiledVariants; }
+    static float CompileTime() { return s_compileTime; }
+private:
+    struct Key
+    {
+        VkRenderPass renderPass;
+        VkSampleCountFlagBits samples;
+        VkPolygonMode mode;
+        VkPrimitiveTopology topology;
+
+        bool operator<(const Key &other) const;
+    };
+
+    struct Variant
+    {
+        vk::RenderPass renderPass;
+        VkPolygonMode  mode;
+        VkPrimitiveTopology topology;
+        vk::Pipeline   pipeline;
+        bool compiled = false;
+    };
+
+    Variant &FindOrCreate(const vk::RenderPass &renderPass, VkPolygonMode mode, VkPrimitiveTopology topology);
+    void Build(Variant &variant) const;
+
+    vk::Pipeline m_base;
+    VkDescriptorSetLayout m_dsLayout = VK_NULL_HANDLE;
+    const vk::VertexBufferInfo *m_vbInfo = nullptr; // owned by the caller
+    std::vector<std::string> m_shaders;
+
+    std::map<Key, Variant> m_variants; // map keeps addresses stable, so workers can fill variants in place
+    std::vector<Variant *> m_queued;
+
+    static int   s_compiledVariants;
+    static float s_compileTime; // ms
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "renderer/RenderContext.hpp"
+#include "renderer/ImageWriter.hpp"
 #include "renderer/vulkan/CmdBuffer.hpp"
 #include "renderer/vulkan/Pipeline.hpp"
 #include "renderer/vulkan/Validation.hpp"
@@ -9,6 +10,8 @@
 #include "Utils.hpp"
 #include <algorithm>
 
+const size_t RenderContext::s_maxPendingFrames = 8;
+
 // not using pipeline dynamic state?
 //#define INLINE_COMMANDS
 
@@ -25,17 +28,63 @@ static VkSampleCountFlagBits getMaxUsableSampleCount(const VkPhysicalDevicePrope
     return VK_SAMPLE_COUNT_1_BIT;
 }
 
+void RenderContext::SetFramePacing(FramePacing pacing, int framesInFlight, VkPresentModeKHR presentMode)
+{
+    static const int defaultFramesInFlight[] = { 1, 2, 3 };
+
+    m_pacing = pacing;
+    m_framesInFlight = framesInFlight > 0 ? std::min(framesInFlight, MAX_FRAMES_IN_FLIGHT) : defaultFramesInFlight[pacing];
+    m_swapChain.preferredImageCount = 0;
+
+    switch (pacing)
+    {
+    case PacingLatency:
+        // newest frame replaces the queued one - no tearing and no waiting for vblank with queued up frames
+        m_swapChain.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+        break;
+    case PacingThroughput:
+        // never wait for the display and keep enough images around for the CPU not to stall on image acquisition
+        m_swapChain.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+        m_swapChain.preferredImageCount = m_framesInFlight + 1;
+        break;
+    default:
+        m_swapChain.presentMode = VK_PRESENT_MODE_MAX_ENUM_KHR;
+        break;
+    }
+
+    // explicitly requested mode (e.g. FIFO for vsync) - automatic selection is used if it's not supported
+    if (presentMode != VK_PRESENT_MODE_MAX_ENUM_KHR)
+        m_swapChain.presentMode = presentMode;
+}
+
+void RenderContext::SetHeadless(const char *outputPrefix, bool rawOutput)
+{
+    m_headless = true;
+    m_rawOutput = rawOutput;
+    m_outputPrefix = outputPrefix;
+}
+
 // initialize Vulkan render context
 bool RenderContext::Init(const char *title, int x, int y, int w, int h)
 {
-    uint32_t windowFlags = SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE | SDL_WINDOW_SHOWN | SDL_WINDOW_ALLOW_HIGHDPI;
-    // SDL overrides status bar visibility on iOS in Info.plist unless SDL_WINDOW_FULLSCREEN is explicitly passed as a flag. This also makes the SDL_Vulkan_GetDrawableSize() function return correct results!
+    m_windowTitle = title;
+
+    if (m_headless)
+    {
+        // no window - render target size is fixed
+        width  = w;
+        height = h;
+    }
+    else
+    {
+        uint32_t windowFlags = SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE | SDL_WINDOW_SHOWN | SDL_WINDOW_ALLOW_HIGHDPI;
+        // SDL overrides status bar visibility on iOS in Info.plist unless SDL_WINDOW_FULLSCREEN is explicitly passed as a flag. This also makes the SDL_Vulkan_GetDrawableSize() function return correct results!
 #if TARGET_OS_IPHONE
-    windowFlags |= SDL_WINDOW_FULLSCREEN;
+        windowFlags |= SDL_WINDOW_FULLSCREEN;
 #endif
-    window = SDL_CreateWindow(title, x, y, w, h, windowFlags);
-    m_windowTitle = title;
-    SDL_Vulkan_GetDrawableSize(window, &width, &height);
+        window = SDL_CreateWindow(title, x, y, w, h, windowFlags);
+        SDL_Vulkan_GetDrawableSize(window, &width, &height);
+    }
 
     halfWidth  = width  >> 1;
     halfHeight = height >> 1;
@@ -57,10 +106,19 @@ bool RenderContext::Init(const char *title, int x, int y, int w, int h)
 
 void RenderContext::Destroy()
 {
-    if (window)
+    if (m_instance != VK_NULL_HANDLE)
     {
         vkDeviceWaitIdle(m_device.logical);
 
+        // frames still waiting in readback buffers are complete by now
+        if (m_headless)
+        {
+            for (int i = 0; i < m_framesInFlight; ++i)
+                WriteFrame((m_currentCmdBuffer + i) % m_framesInFlight);
+        }
+
+        vk::destroyUploadQueue(m_device, m_uploadQueue);
+        m_device.uploadQueue = nullptr;
         vk::destroyRenderPass(m_device, m_renderPass);
         vk::destroyRenderPass(m_device, m_msaaRenderPass);
         vk::freeCommandBuffers(m_device, m_device.commandPool, m_commandBuffers);
@@ -73,9 +131,12 @@ void RenderContext::Destroy()
 
         TextureManager::GetInstance()->ReleaseTextures();
 
-        vkDestroySwapchainKHR(m_device.logical, m_swapChain.sc, nullptr);
+        if (m_headless)
+            DestroyOffscreenTargets();
+        else
+            vkDestroySwapchainKHR(m_device.logical, m_swapChain.sc, nullptr);
 
-        for (int i = 0; i < NUM_CMDBUFFERS; ++i)
+        for (int i = 0; i < m_framesInFlight; ++i)
         {
             vkDestroySemaphore(m_device.logical, m_imageAvailableSemaphores[i], nullptr);
             vkDestroySemaphore(m_device.logical, m_renderFinishedSemaphores[i], nullptr);
@@ -83,21 +144,42 @@ void RenderContext::Destroy()
         }
 
         vk::destroyAllocator(m_device.allocator);
+        SavePipelineCache();
         vkDestroyPipelineCache(m_device.logical, m_pipelineCache, nullptr);
         vkDestroyDevice(m_device.logical, nullptr);
-        vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+        if (m_surface != VK_NULL_HANDLE)
+            vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
 #ifdef VALIDATION_LAYERS_ON
         vk::destroyValidationLayers(m_instance);
 #endif
         vkDestroyInstance(m_instance, nullptr);
-        SDL_DestroyWindow(window);
-        window = nullptr;
+        m_instance = VK_NULL_HANDLE;
+
+        if (window)
+        {
+            SDL_DestroyWindow(window);
+            window = nullptr;
+        }
     }
 }
 
 VkResult RenderContext::RenderStart()
 {
-    VkResult result = vkAcquireNextImageKHR(m_device.logical, m_swapChain.sc, UINT64_MAX, m_imageAvailableSemaphores[m_currentCmdBuffer], VK_NULL_HANDLE, &m_imageIndex);
+    auto frameStart = std::chrono::high_resolution_clock::now();
+    VkResult result = VK_SUCCESS;
+
+    UpdateFrameLatency();
+
+    // command buffer and image available semaphore of this frame slot can be reused only after its previous frame completed
+    VK_VERIFY(vkWaitForFences(m_device.logical, 1, &m_fences[m_currentCmdBuffer], VK_TRUE, UINT64_MAX));
+    UpdateFrameLatency();
+
+    // offscreen targets are tied to frames in flight - there's nothing to acquire
+    if (m_headless)
+        m_imageIndex = m_currentCmdBuffer;
+    else
+        result = vkAcquireNextImageKHR(m_device.logical, m_swapChain.sc, UINT64_MAX, m_imageAvailableSemaphores[m_currentCmdBuffer], VK_NULL_HANDLE, &m_imageIndex);
+
     m_activeCmdBuffer = m_commandBuffers[m_currentCmdBuffer];
     m_activeFramebuffer = (m_activeRenderPass.sampleCount == VK_SAMPLE_COUNT_1_BIT) ? m_frameBuffers[m_imageIndex] : m_msaaFrameBuffers[m_imageIndex];
 
@@ -109,9 +191,15 @@ VkResult RenderContext::RenderStart()
         return result;
     }
 
-    VK_VERIFY(vkWaitForFences(m_device.logical, 1, &m_fences[m_currentCmdBuffer], VK_TRUE, UINT64_MAX));
+    // fence is reset only once the frame is going to be submitted, so that it's still signaled if swapchain had to be recreated
     vkResetFences(m_device.logical, 1, &m_fences[m_currentCmdBuffer]);
 
+    m_frameStart[m_currentCmdBuffer] = frameStart;
+
+    // frame previously rendered by this command buffer has been copied to the CPU - save it before the readback buffer is reused
+    if (m_headless)
+        WriteFrame(m_currentCmdBuffer);
+
     LOG_MESSAGE_ASSERT(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR, "Could not acquire swapchain image: " << result);
 
     // setup command buffers and render pass for drawing
@@ -146,27 +234,57 @@ VkResult RenderContext::RenderStart()
     return VK_SUCCESS;
 }
 
+// stamp frames in flight whose fences signaled since the last check - fences are polled once per frame (and after
+// waiting for one), so measured latency is accurate to a frame regardless of how many frames are in flight
+void RenderContext::UpdateFrameLatency()
+{
+    auto now = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < m_framesInFlight; ++i)
+    {
+        if (m_frameStart[i].time_since_epoch().count() == 0 || vkGetFenceStatus(m_device.logical, m_fences[i]) != VK_SUCCESS)
+            continue;
+
+        float latency = std::chrono::duration<float, std::milli>(now - m_frameStart[i]).count();
+        m_frameLatency = m_frameLatency > 0.f ? m_frameLatency * 0.95f + latency * 0.05f : latency;
+        m_frameStart[i] = std::chrono::high_resolution_clock::time_point();
+    }
+}
+
 VkResult RenderContext::Submit()
 {
     vkCmdEndRenderPass(m_commandBuffers[m_currentCmdBuffer]);
+
+    if (m_headless)
+        RecordReadback();
+
     VK_VERIFY(vkEndCommandBuffer(m_commandBuffers[m_currentCmdBuffer]));
 
+    // no image acquisition nor presentation to synchronize with when rendering offscreen
     VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.waitSemaphoreCount = m_headless ? 0 : 1;
     submitInfo.pWaitSemaphores = &m_imageAvailableSemaphores[m_currentCmdBuffer];
-    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.signalSemaphoreCount = m_headless ? 0 : 1;
     submitInfo.pSignalSemaphores = &m_renderFinishedSemaphores[m_currentCmdBuffer];
     submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &m_commandBuffers[m_currentCmdBuffer];
 
+    // uploads recorded since last frame have to be submitted ahead of rendering commands that use them
+    vk::flushUploads(m_device, m_uploadQueue);
+
     return vkQueueSubmit(m_device.graphicsQueue, 1, &submitInfo, m_fences[m_currentCmdBuffer]);
 }
 
 VkResult RenderContext::Present()
 {
+    if (m_headless)
+    {
+        m_currentCmdBuffer = (m_currentCmdBuffer + 1) % m_framesInFlight;
+        return VK_SUCCESS;
+    }
+
     VkSwapchainKHR swapChains[] = { m_swapChain.sc };
     VkPresentInfoKHR presentInfo = {};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -186,13 +304,16 @@ VkResult RenderContext::Present()
         RecreateSwapChain();
     }
 
-    m_currentCmdBuffer = (m_currentCmdBuffer + 1) % NUM_CMDBUFFERS;
+    m_currentCmdBuffer = (m_currentCmdBuffer + 1) % m_framesInFlight;
 
     return renderResult;
 }
 
 Math::Vector2f RenderContext::WindowSize()
 {
+    if (m_headless)
+        return Math::Vector2f((float)width, (float)height);
+
     VkSurfaceCapabilitiesKHR surfaceCaps;
     vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_device.physical, m_surface, &surfaceCaps);
     LOG_MESSAGE_ASSERT(surfaceCaps.currentExtent.width != std::numeric_limits<uint32_t>::max(), "WM sets extent width and height to max uint32!");
@@ -212,8 +333,7 @@ Math::Vector2f RenderContext::WindowSize()
 
 VkSampleCountFlagBits RenderContext::ToggleMSAA()
 {
-    // "flip" render passes on MSAA toggle
-    vkDeviceWaitIdle(m_device.logical);
+    // "flip" render passes on MSAA toggle - frames in flight keep using the previous one, so there's no need to wait for the device
     m_activeRenderPass = (m_activeRenderPass.renderPass == m_msaaRenderPass.renderPass) ? m_renderPass : m_msaaRenderPass;
 
     return m_activeRenderPass.sampleCount;
@@ -221,6 +341,10 @@ VkSampleCountFlagBits RenderContext::ToggleMSAA()
 
 bool RenderContext::RecreateSwapChain()
 {
+    // offscreen targets never become out of date
+    if (m_headless)
+        return true;
+
     vkDeviceWaitIdle(m_device.logical);
     DestroyFramebuffers();
     DestroyImageViews();
@@ -273,20 +397,29 @@ bool RenderContext::InitVulkan(const char *appTitle)
     VK_VERIFY(vk::createInstance(window, &m_instance, appTitle));
     // "oldschool" way of creating a Vulkan surface in SDL prior to 2.0.6
     //VK_VERIFY(vk::createSurface(window, m_instance, &m_surface));
-    SDL_Vulkan_CreateSurface(window, m_instance, &m_surface);
+    if (!m_headless)
+        SDL_Vulkan_CreateSurface(window, m_instance, &m_surface);
 
     m_device = vk::createDevice(m_instance, m_surface);
     VK_VERIFY(vk::createAllocator(m_device, &m_device.allocator));
     // set initial swap chain extent to current window size - in case WM can't determine it by itself
     m_swapChain.extent = { (uint32_t)width, (uint32_t)height };
-    // desired present mode
+
+    if (m_headless)
+    {
+        CreateOffscreenTargets();
+        LOG_MESSAGE("Rendering offscreen: " << m_framesInFlight << " frame(s) in flight, " << width << "x" << height << " " << (m_rawOutput ? "raw" : "PNG") << " output to " << m_outputPrefix);
+    }
+    else
+    {
+        // present mode is picked by frame pacing policy - Android only reliably supports FIFO
 #ifdef __ANDROID__
-    m_swapChain.presentMode = VK_PRESENT_MODE_FIFO_KHR;
-#else
-    m_swapChain.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+        m_swapChain.presentMode = VK_PRESENT_MODE_FIFO_KHR;
 #endif
 
-    VK_VERIFY(vk::createSwapChain(m_device, m_surface, &m_swapChain, VK_NULL_HANDLE));
+        VK_VERIFY(vk::createSwapChain(m_device, m_surface, &m_swapChain, VK_NULL_HANDLE));
+        LOG_MESSAGE("Frame pacing: " << m_framesInFlight << " frame(s) in flight, present mode " << m_swapChain.presentMode << ", " << m_swapChain.images.size() << " swapchain images");
+    }
 
     m_viewport.x = 0.f;
     m_viewport.y = 0.f;
@@ -309,14 +442,18 @@ bool RenderContext::InitVulkan(const char *appTitle)
     VK_VERIFY(vk::createRenderPass(m_device, m_swapChain, &m_msaaRenderPass));
     VK_VERIFY(vk::createCommandPool(m_device, m_device.graphicsFamilyIndex, &m_device.commandPool));
     VK_VERIFY(vk::createCommandPool(m_device, m_device.transferFamilyIndex, &m_device.transferCommandPool));
+
+    vk::createUploadQueue(m_device, 32 * 1024 * 1024, &m_uploadQueue);
+    m_device.uploadQueue = &m_uploadQueue;
+
     CreateDrawBuffers();
     if (!CreateImageViews()) return false;
     m_frameBuffers = CreateFramebuffers(m_renderPass);
     m_msaaFrameBuffers = CreateFramebuffers(m_msaaRenderPass);
     m_activeRenderPass = m_renderPass;
 
-    // allocate NUM_CMDBUFFERS command buffers (used to be m_frameBuffers.size())
-    VK_VERIFY(vk::createCommandBuffers(m_device, m_device.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_commandBuffers, NUM_CMDBUFFERS));
+    // allocate one command buffer per frame in flight (used to be m_frameBuffers.size())
+    VK_VERIFY(vk::createCommandBuffers(m_device, m_device.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_commandBuffers, m_framesInFlight));
 
     return true;
 }
@@ -421,7 +558,7 @@ void RenderContext::CreateFences()
     fCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     fCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    for (int i = 0; i < NUM_CMDBUFFERS; ++i)
+    for (int i = 0; i < m_framesInFlight; ++i)
     {
         VK_VERIFY(vkCreateFence(m_device.logical, &fCreateInfo, nullptr, &m_fences[i]));
     }
@@ -432,7 +569,7 @@ void RenderContext::CreateSemaphores()
     VkSemaphoreCreateInfo sCreateInfo = {};
     sCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    for (int i = 0; i < NUM_CMDBUFFERS; ++i)
+    for (int i = 0; i < m_framesInFlight; ++i)
     {
         VK_VERIFY(vkCreateSemaphore(m_device.logical, &sCreateInfo, nullptr, &m_imageAvailableSemaphores[i]));
         VK_VERIFY(vkCreateSemaphore(m_device.logical, &sCreateInfo, nullptr, &m_renderFinishedSemaphores[i]));
@@ -441,8 +578,142 @@ void RenderContext::CreateSemaphores()
 
 void RenderContext::CreatePipelineCache()
 {
-    VkPipelineCacheCreateInfo pcInfo = {};
-    pcInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    // user writable location on all platforms (application bundle and Android assets are read-only)
+    char *prefPath = SDL_GetPrefPath("", "QuakeBspViewer");
+    if (prefPath)
+    {
+        m_pipelineCacheFile = std::string(prefPath) + "pipeline.cache";
+        SDL_free(prefPath);
+    }
+    else
+    {
+        m_pipelineCacheFile = "pipeline.cache";
+    }
+
+    VK_VERIFY(vk::createPipelineCache(m_device, m_pipelineCacheFile.c_str(), &m_pipelineCache, &m_pipelineCacheStatus));
+}
+
+void RenderContext::SavePipelineCache()
+{
+    bool saved = vk::savePipelineCache(m_device, m_pipelineCache, m_pipelineCacheFile.c_str());
+    LOG_MESSAGE((saved ? "Saved pipeline cache: " : "Failed to save pipeline cache: ") << m_pipelineCacheFile);
+}
+
+void RenderContext::CreateOffscreenTargets()
+{
+    // finished frames stay in transfer source layout, ready to be copied to readback buffers
+    m_swapChain.format = VK_FORMAT_R8G8B8A8_UNORM;
+    m_swapChain.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    m_swapChain.images.clear();
+
+    for (int i = 0; i < m_framesInFlight; ++i)
+    {
+        m_offscreenTargets[i] = vk::createRenderTarget(m_device, m_swapChain);
+        m_swapChain.images.push_back(m_offscreenTargets[i].image);
+        VK_VERIFY(vk::createReadbackBuffer(m_device, (VkDeviceSize)width * height * 4, &m_readbackBuffers[i]));
+        m_readbackFrames[i] = -1;
+    }
+}
+
+void RenderContext::DestroyOffscreenTargets()
+{
+    if (m_writerThread.joinable())
+    {
+        m_writerMutex.lock();
+        m_writerFinish = true;
+        m_writerCv.notify_all();
+        m_writerMutex.unlock();
+        m_writerThread.join();
+    }
+
+    for (int i = 0; i < m_framesInFlight; ++i)
+    {
+        vk::releaseTexture(m_device, m_offscreenTargets[i]);
+        vk::freeBuffer(m_device, m_readbackBuffers[i]);
+    }
+
+    m_swapChain.images.clear();
+}
+
+void RenderContext::RecordReadback()
+{
+    VkCommandBuffer cmdBuffer = m_commandBuffers[m_currentCmdBuffer];
+
+    // render pass already left the image in transfer source layout - only wait for color writes to finish
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = m_swapChain.images[m_imageIndex];
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = { m_swapChain.extent.width, m_swapChain.extent.height, 1 };
+
+    vkCmdCopyImageToBuffer(cmdBuffer, m_swapChain.images[m_imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_readbackBuffers[m_currentCmdBuffer].buffer, 1, &region);
+    m_readbackFrames[m_currentCmdBuffer] = m_frameNumber++;
+}
+
+void RenderContext::WriteFrame(int frameIdx)
+{
+    if (m_readbackFrames[frameIdx] < 0)
+        return;
+
+    // readback memory is host cached, so it may not be coherent
+    const vk::Buffer &readback = m_readbackBuffers[frameIdx];
+    vmaInvalidateAllocation(m_device.allocator, readback.allocation, 0, VK_WHOLE_SIZE);
 
-    VK_VERIFY(vkCreatePipelineCache(m_device.logical, &pcInfo, nullptr, &m_pipelineCache));
+    VmaAllocationInfo allocInfo;
+    vmaGetAllocationInfo(m_device.allocator, readback.allocation, &allocInfo);
+    const unsigned char *pixels = (const unsigned char *)allocInfo.pMappedData;
+
+    std::string frameNumber = std::to_string(m_readbackFrames[frameIdx]);
+    if (frameNumber.size() < 5)
+        frameNumber.insert(0, 5 - frameNumber.size(), '0');
+
+    PendingFrame frame;
+    frame.fileName = m_outputPrefix + "_" + frameNumber + (m_rawOutput ? ".raw" : ".png");
+    frame.pixels.assign(pixels, pixels + (size_t)width * height * 4);
+    m_readbackFrames[frameIdx] = -1;
+
+    if (!m_writerThread.joinable())
+        m_writerThread = std::thread(&RenderContext::WriteFrames, this);
+
+    std::unique_lock<std::mutex> lock(m_writerMutex);
+    m_writerCv.wait(lock, [this]() { return m_pendingFrames.size() < s_maxPendingFrames; });
+    m_pendingFrames.push_back(std::move(frame));
+    m_writerCv.notify_all();
+}
+
+// writer thread: encode and save queued frames until told to finish (remaining frames are written first)
+void RenderContext::WriteFrames()
+{
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(m_writerMutex);
+        m_writerCv.wait(lock, [this]() { return m_writerFinish || !m_pendingFrames.empty(); });
+        if (m_pendingFrames.empty())
+            break;
+
+        PendingFrame frame = std::move(m_pendingFrames.front());
+        m_pendingFrames.pop_front();
+        m_writerCv.notify_all();
+        lock.unlock();
+
+        bool written = m_rawOutput ? ImageWriter::WriteRaw(frame.fileName.c_str(), frame.pixels.data(), width, height)
+                                   : ImageWriter::WritePNG(frame.fileName.c_str(), frame.pixels.data(), width, height);
+        // reported in release builds too - a missing frame is a failed render job
+        if (!written)
+            LogError(("Could not write frame: " + frame.fileName + "\n").c_str());
+    }
 }
@@ -7,19 +7,40 @@
 #include "renderer/vulkan/Device.hpp"
 #include "renderer/vulkan/Image.hpp"
 #include "renderer/vulkan/Pipeline.hpp"
+#include "renderer/vulkan/Upload.hpp"
 #include <SDL.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
 #ifdef __ANDROID__
 #include "android/vulkan_wrapper.h"
 #endif
 #include <SDL_vulkan.h>
 
+// frame pacing policy - trades input latency for throughput
+enum FramePacing
+{
+    PacingLatency,   // single frame in flight, mailbox presentation
+    PacingBalanced,  // 2 frames in flight, best available present mode
+    PacingThroughput // 3 frames in flight, immediate presentation with extra swapchain images
+};
+
 // SDL-based Vulkan setup container ("render context")
 class RenderContext
 {
 public:
+    // has to be called before Init() - framesInFlight (1-4) and presentMode override the policy defaults if > 0 or not MAX_ENUM
+    void SetFramePacing(FramePacing pacing, int framesInFlight = 0, VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAX_ENUM_KHR);
+    // has to be called before Init() - render into offscreen images with no window or swapchain, each finished frame is read back
+    // asynchronously and written to <outputPrefix>_<frame number>.png (or .raw with RGBA8 pixels)
+    void SetHeadless(const char *outputPrefix, bool rawOutput = false);
     bool Init(const char *title, int x, int y, int w, int h);
     void Destroy();
     const char *WindowTitle() const { return m_windowTitle; }
+    bool Headless() const { return m_headless; }
 
     // start rendering frame and setup all necessary structs
     VkResult RenderStart();
@@ -57,16 +78,27 @@ public:
     const vk::Device &Device()   const { return m_device; }
     const vk::SwapChain &SwapChain() const { return m_swapChain; }
     const VkPipelineCache &PipelineCache() const { return m_pipelineCache; }
+    // whether pipeline cache saved by previous run was used
+    const vk::PipelineCacheStatus PipelineCacheStatus() const { return m_pipelineCacheStatus; }
     const VkViewport &Viewport() const { return m_viewport; }
     const VkRect2D &Scissor()    const { return m_scissor; }
     const vk::RenderPass &ActiveRenderPass() const { return m_activeRenderPass; }
+    const vk::RenderPass &DefaultRenderPass() const { return m_renderPass; }
+    const vk::RenderPass &MSAARenderPass() const { return m_msaaRenderPass; }
     const VkFramebuffer &ActiveFramebuffer() const { return m_activeFramebuffer; }
     const VkCommandBuffer &ActiveCmdBuffer() const { return m_activeCmdBuffer; }
     const int &ActiveFrame() const { return m_currentCmdBuffer; }
     const int MSAASamples() const { return (int)m_msaaRenderPass.sampleCount; }
+    const int FramesInFlight() const { return m_framesInFlight; }
+    const FramePacing Pacing() const { return m_pacing; }
+    // time from start of a frame until its fence was first seen signaled (ms, smoothed) - polled once per frame
+    const float FrameLatency() const { return m_frameLatency; }
+    // device local memory available to the application and currently used by it
+    void MemoryBudget(VkDeviceSize *budget, VkDeviceSize *usage) const { vk::getMemoryBudget(m_instance, m_device, budget, usage); }
 private:
     bool InitVulkan(const char *appTitle);
     void CreateDrawBuffers();
+    void UpdateFrameLatency();
     void DestroyDrawBuffers();
     bool CreateImageViews();
     void DestroyImageViews();
@@ -75,6 +107,12 @@ private:
     void CreateFences();
     void CreateSemaphores();
     void CreatePipelineCache();
+    void SavePipelineCache();
+    void CreateOffscreenTargets();
+    void DestroyOffscreenTargets();
+    void RecordReadback();
+    void WriteFrame(int frameIdx);
+    void WriteFrames();
 
     const char *m_windowTitle;
 
@@ -86,6 +124,11 @@ private:
     vk::Device m_device;
     vk::SwapChain m_swapChain;
     VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+    std::string m_pipelineCacheFile; // pipeline cache persists between runs
+    vk::PipelineCacheStatus m_pipelineCacheStatus = vk::PipelineCacheEmpty;
+
+    // load-time transfers are batched and submitted asynchronously
+    vk::UploadQueue m_uploadQueue;
 
     // using dynamic states for pipelines, so we need to update viewport and scissor manually
     VkViewport m_viewport = {};
@@ -106,17 +149,23 @@ private:
     // Vulkan image views
     std::vector<VkImageView> m_imageViews;
 
-    // use 2 synchronized command buffers for rendering (double buffering)
-    static const int NUM_CMDBUFFERS = 2;
+    // number of synchronized command buffers used for rendering is set by frame pacing policy (2 - double buffering)
+    static const int MAX_FRAMES_IN_FLIGHT = 4;
+    FramePacing m_pacing = PacingBalanced;
+    int m_framesInFlight = 2;
 
     // command buffers
     std::vector<VkCommandBuffer> m_commandBuffers;
-    // command buffer double buffering fences
-    VkFence m_fences[NUM_CMDBUFFERS];
+    // command buffer fences (one per frame in flight)
+    VkFence m_fences[MAX_FRAMES_IN_FLIGHT];
     // semaphore: signal when next image is available for rendering
-    VkSemaphore m_imageAvailableSemaphores[NUM_CMDBUFFERS];
+    VkSemaphore m_imageAvailableSemaphores[MAX_FRAMES_IN_FLIGHT];
     // semaphore: signal when rendering to current command buffer is complete
-    VkSemaphore m_renderFinishedSemaphores[NUM_CMDBUFFERS];
+    VkSemaphore m_renderFinishedSemaphores[MAX_FRAMES_IN_FLIGHT];
+
+    // frame latency measurement: start time of the frame recorded into each command buffer (cleared once it's measured)
+    std::chrono::high_resolution_clock::time_point m_frameStart[MAX_FRAMES_IN_FLIGHT];
+    float m_frameLatency = 0.f;
 
     // depth buffer
     vk::Texture m_depthBuffer;
@@ -125,6 +174,31 @@ private:
     vk::Texture m_msaaColor;
     vk::Texture m_msaaDepthBuffer;
 
+    // headless rendering: one offscreen target and host visible readback buffer per frame in flight - a frame is written to disk
+    // once its command buffer is reused, so the CPU never waits for the copy to finish
+    bool m_headless  = false;
+    bool m_rawOutput = false;
+    std::string m_outputPrefix;
+    vk::Texture m_offscreenTargets[MAX_FRAMES_IN_FLIGHT];
+    vk::Buffer  m_readbackBuffers[MAX_FRAMES_IN_FLIGHT];
+    int64_t     m_readbackFrames[MAX_FRAMES_IN_FLIGHT]; // number of the frame copied to each readback buffer (-1 - none)
+    int64_t     m_frameNumber = 0;
+
+    // read back frames are copied out of readback buffers and encoded/written on a dedicated thread, so that disk speed
+    // doesn't limit the frame rate (thread processor workers are waited for every frame, so they're no good for this)
+    struct PendingFrame
+    {
+        std::string fileName;
+        std::vector<unsigned char> pixels;
+    };
+
+    static const size_t s_maxPendingFrames; // render thread waits once this many frames are queued (bounds memory)
+    std::deque<PendingFrame> m_pendingFrames;
+    std::mutex  m_writerMutex;
+    std::condition_variable m_writerCv;
+    std::thread m_writerThread;
+    bool        m_writerFinish = false;
+
     // handle submission from multiple render passes
     uint32_t m_imageIndex;
     // index of the command buffer that's currently in use
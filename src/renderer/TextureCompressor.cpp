@@ -0,0 +1,746 @@
+#include "renderer/TextureCompressor.hpp"
+#include <algorithm>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace TextureCompressor
+{
+    // ETC1/ETC2 intensity modifier tables
+    static const int s_etcModifiers[8][4] = {
+        {  2,   8,  -2,   -8 }, {  5,  17,  -5,  -17 }, {  9,  29,  -9,  -29 }, { 13,  42, -13,  -42 },
+        { 18,  60, -18,  -60 }, { 24,  80, -24,  -80 }, { 33, 106, -33, -106 }, { 47, 183, -47, -183 }
+    };
+
+    // EAC alpha modifier tables
+    static const int s_eacModifiers[16][8] = {
+        { -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 }, { -2, -5, -8, -13, 1, 4, 7, 12 }, { -2, -4, -6, -13, 1, 3, 5, 12 },
+        { -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 }, { -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 },
+        { -2, -6, -8, -10, 1, 5, 7,  9 }, { -2, -5, -8, -10, 1, 4, 7,  9 }, { -2, -4, -8, -10, 1, 3, 7,  9 }, { -2, -5, -7, -10, 1, 4, 6,  9 },
+        { -3, -4, -7, -10, 2, 3, 6,  9 }, { -1, -2, -3, -10, 0, 1, 2,  9 }, { -4, -6, -8,  -9, 3, 5, 7,  8 }, { -3, -5, -7,  -9, 2, 4, 6,  8 }
+    };
+
+    // BC7 4-bit index interpolation weights
+    static const int s_bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    static inline int Clamp255(int v) { return v < 0 ? 0 : (v > 255 ? 255 : v); }
+
+    static inline int ColorError(const unsigned char *a, const unsigned char *b, int channels)
+    {
+        int err = 0;
+        for (int i = 0; i < channels; ++i)
+            err += (a[i] - b[i]) * (a[i] - b[i]);
+        return err;
+    }
+
+    // fetch 4x4 texels starting at (x, y) in row-major order, clamping to image edges
+    static void FetchBlock(const Image &image, int x, int y, unsigned char block[16][4])
+    {
+        for (int by = 0; by < 4; ++by)
+        {
+            for (int bx = 0; bx < 4; ++bx)
+            {
+                int sx = std::min(x + bx, image.width - 1);
+                int sy = std::min(y + by, image.height - 1);
+                memcpy(block[by * 4 + bx], &image.rgba[(sy * image.width + sx) * 4], 4);
+            }
+        }
+    }
+
+    template<typename BlockEncoder>
+    static void CompressBlocks(const Image &image, std::vector<unsigned char> &dst, size_t blockSize, BlockEncoder encode)
+    {
+        unsigned char block[16][4];
+
+        for (int y = 0; y < image.height; y += 4)
+        {
+            for (int x = 0; x < image.width; x += 4)
+            {
+                FetchBlock(image, x, y, block);
+                dst.resize(dst.size() + blockSize);
+                encode(block, &dst[dst.size() - blockSize]);
+            }
+        }
+    }
+
+    static inline unsigned short To565(const unsigned char *c)
+    {
+        return (unsigned short)(((c[0] * 31 + 127) / 255) << 11 | ((c[1] * 63 + 127) / 255) << 5 | ((c[2] * 31 + 127) / 255));
+    }
+
+    static inline void From565(unsigned short v, unsigned char *c)
+    {
+        int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+        c[0] = (unsigned char)((r << 3) | (r >> 2));
+        c[1] = (unsigned char)((g << 2) | (g >> 4));
+        c[2] = (unsigned char)((b << 3) | (b >> 2));
+    }
+
+    // BC1 color block in 4 color mode - endpoints are the inset bounding box of block colors
+    static void EncodeBC1Color(const unsigned char block[16][4], unsigned char *dst)
+    {
+        unsigned char minColor[3] = { 255, 255, 255 }, maxColor[3] = { 0, 0, 0 };
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                minColor[c] = std::min(minColor[c], block[i][c]);
+                maxColor[c] = std::max(maxColor[c], block[i][c]);
+            }
+        }
+
+        // inset bounding box by 1/16 of its size to reduce error introduced by extreme endpoints
+        for (int c = 0; c < 3; ++c)
+        {
+            int inset = (maxColor[c] - minColor[c]) >> 4;
+            minColor[c] = (unsigned char)(minColor[c] + inset);
+            maxColor[c] = (unsigned char)(maxColor[c] - inset);
+        }
+
+        unsigned short c0 = To565(maxColor);
+        unsigned short c1 = To565(minColor);
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        unsigned int indices = 0;
+        if (c0 != c1)
+        {
+            unsigned char palette[4][3];
+            From565(c0, palette[0]);
+            From565(c1, palette[1]);
+            for (int c = 0; c < 3; ++c)
+            {
+                palette[2][c] = (unsigned char)((2 * palette[0][c] + palette[1][c] + 1) / 3);
+                palette[3][c] = (unsigned char)((palette[0][c] + 2 * palette[1][c] + 1) / 3);
+            }
+
+            for (int i = 0; i < 16; ++i)
+            {
+                int bestIdx = 0, bestErr = INT_MAX;
+                for (int p = 0; p < 4; ++p)
+                {
+                    int err = ColorError(block[i], palette[p], 3);
+                    if (err < bestErr)
+                    {
+                        bestErr = err;
+                        bestIdx = p;
+                    }
+                }
+                indices |= bestIdx << (i * 2);
+            }
+        }
+
+        dst[0] = (unsigned char)(c0 & 0xFF);
+        dst[1] = (unsigned char)(c0 >> 8);
+        dst[2] = (unsigned char)(c1 & 0xFF);
+        dst[3] = (unsigned char)(c1 >> 8);
+        for (int i = 0; i < 4; ++i)
+            dst[4 + i] = (unsigned char)(indices >> (i * 8));
+    }
+
+    // BC3 alpha block in 8 value mode
+    static void EncodeBC3Alpha(const unsigned char block[16][4], unsigned char *dst)
+    {
+        int a0 = 0, a1 = 255;
+        for (int i = 0; i < 16; ++i)
+        {
+            a0 = std::max(a0, (int)block[i][3]);
+            a1 = std::min(a1, (int)block[i][3]);
+        }
+
+        int palette[8] = { a0, a1 };
+        for (int i = 1; i < 7; ++i)
+            palette[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+
+        unsigned long long indices = 0;
+        for (int i = 0; i < 16 && a0 != a1; ++i)
+        {
+            int bestIdx = 0, bestErr = INT_MAX;
+            for (int p = 0; p < 8; ++p)
+            {
+                int err = abs(block[i][3] - palette[p]);
+                if (err < bestErr)
+                {
+                    bestErr = err;
+                    bestIdx = p;
+                }
+            }
+            indices |= (unsigned long long)bestIdx << (i * 3);
+        }
+
+        dst[0] = (unsigned char)a0;
+        dst[1] = (unsigned char)a1;
+        for (int i = 0; i < 6; ++i)
+            dst[2 + i] = (unsigned char)(indices >> (i * 8));
+    }
+
+    // BC7 block bits are written LSB first
+    struct BC7Writer
+    {
+        unsigned long long lo = 0, hi = 0;
+        int bit = 0;
+
+        void Write(unsigned long long value, int numBits)
+        {
+            for (int i = 0; i < numBits; ++i, ++bit)
+            {
+                unsigned long long b = (value >> i) & 1;
+                if (bit < 64) lo |= b << bit;
+                else          hi |= b << (bit - 64);
+            }
+        }
+
+        void Store(unsigned char *dst) const
+        {
+            for (int i = 0; i < 8; ++i)
+            {
+                dst[i] = (unsigned char)(lo >> (i * 8));
+                dst[8 + i] = (unsigned char)(hi >> (i * 8));
+            }
+        }
+    };
+
+    // endpoints are the extremes of block texels projected on the axis of largest variance (given range of channels)
+    static void FitPrincipalAxis(const unsigned char block[16][4], int channel, int numChannels, float endpoints[2][4])
+    {
+        float mean[4] = {};
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int c = 0; c < numChannels; ++c)
+                mean[c] += block[i][channel + c] / 16.f;
+        }
+
+        float cov[4][4] = {};
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int a = 0; a < numChannels; ++a)
+            {
+                for (int b = 0; b < numChannels; ++b)
+                    cov[a][b] += (block[i][channel + a] - mean[a]) * (block[i][channel + b] - mean[b]);
+            }
+        }
+
+        // power iteration, starting from the channel with largest variance
+        int start = 0;
+        for (int c = 1; c < numChannels; ++c)
+        {
+            if (cov[c][c] > cov[start][start])
+                start = c;
+        }
+
+        float axis[4] = {};
+        for (int c = 0; c < numChannels; ++c)
+            axis[c] = cov[start][c];
+
+        for (int iter = 0; iter < 8; ++iter)
+        {
+            float next[4] = {}, length = 0.f;
+            for (int a = 0; a < numChannels; ++a)
+            {
+                for (int b = 0; b < numChannels; ++b)
+                    next[a] += cov[a][b] * axis[b];
+                length += next[a] * next[a];
+            }
+
+            // flat block - both endpoints collapse to the mean
+            if (length < 1e-6f)
+            {
+                memset(axis, 0, sizeof(axis));
+                break;
+            }
+
+            length = 1.f / sqrtf(length);
+            for (int c = 0; c < numChannels; ++c)
+                axis[c] = next[c] * length;
+        }
+
+        float tMin = 0.f, tMax = 0.f;
+        for (int i = 0; i < 16; ++i)
+        {
+            float t = 0.f;
+            for (int c = 0; c < numChannels; ++c)
+                t += (block[i][channel + c] - mean[c]) * axis[c];
+            tMin = std::min(tMin, t);
+            tMax = std::max(tMax, t);
+        }
+
+        for (int c = 0; c < numChannels; ++c)
+        {
+            endpoints[0][c] = std::min(255.f, std::max(0.f, mean[c] + tMin * axis[c]));
+            endpoints[1][c] = std::min(255.f, std::max(0.f, mean[c] + tMax * axis[c]));
+        }
+    }
+
+    // least squares endpoints for fixed indices - minimizes sum of |(1 - w) * e0 + w * e1 - texel|^2
+    static bool RefineEndpoints(const unsigned char block[16][4], int channel, int numChannels, const int *indices, const int *weights, float endpoints[2][4])
+    {
+        float aa = 0.f, ab = 0.f, bb = 0.f;
+        float ax[4] = {}, bx[4] = {};
+        for (int i = 0; i < 16; ++i)
+        {
+            float w = weights[indices[i]] / 64.f;
+            float a = 1.f - w;
+            aa += a * a;
+            ab += a * w;
+            bb += w * w;
+            for (int c = 0; c < numChannels; ++c)
+            {
+                ax[c] += a * block[i][channel + c];
+                bx[c] += w * block[i][channel + c];
+            }
+        }
+
+        // all texels use the same weight - system is singular, keep current endpoints
+        float det = aa * bb - ab * ab;
+        if (fabsf(det) < 1e-4f)
+            return false;
+
+        for (int c = 0; c < numChannels; ++c)
+        {
+            endpoints[0][c] = std::min(255.f, std::max(0.f, (ax[c] * bb - bx[c] * ab) / det));
+            endpoints[1][c] = std::min(255.f, std::max(0.f, (bx[c] * aa - ax[c] * ab) / det));
+        }
+
+        return true;
+    }
+
+    // pick nearest interpolated value for each texel (endpoints are already expanded to 8 bits), returns total squared error
+    static int AssignIndices(const unsigned char block[16][4], int channel, int numChannels, const int endpoints[2][4], const int *weights, int numWeights, int *indices)
+    {
+        unsigned char palette[16][4];
+        for (int w = 0; w < numWeights; ++w)
+        {
+            for (int c = 0; c < numChannels; ++c)
+                palette[w][c] = (unsigned char)(((64 - weights[w]) * endpoints[0][c] + weights[w] * endpoints[1][c] + 32) >> 6);
+        }
+
+        int totalErr = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            int bestErr = INT_MAX;
+            for (int w = 0; w < numWeights; ++w)
+            {
+                int err = ColorError(&block[i][channel], palette[w], numChannels);
+                if (err < bestErr)
+                {
+                    bestErr = err;
+                    indices[i] = w;
+                }
+            }
+            totalErr += bestErr;
+        }
+
+        return totalErr;
+    }
+
+    // BC7 mode 6: single subset, RGBA endpoints with 7 bits per channel and unique p-bit, 4 bit indices shared by color and alpha
+    static int EncodeBC7Mode6(const unsigned char block[16][4], unsigned char *dst)
+    {
+        float fitted[2][4];
+        FitPrincipalAxis(block, 0, 4, fitted);
+
+        int bestErr = INT_MAX;
+        int endpoints[2][4], pbits[2], indices[16];
+
+        // alternate between index assignment and least squares endpoints as long as the error drops
+        for (int iter = 0; iter < 3; ++iter)
+        {
+            // quantize endpoints to 7 bits + p-bit, picking the p-bit that yields lower error
+            int q[2][4], p[2], expanded[2][4], idx[16];
+            for (int e = 0; e < 2; ++e)
+            {
+                int bestEndpointErr = INT_MAX;
+                for (int pbit = 0; pbit < 2; ++pbit)
+                {
+                    int candidate[4], err = 0;
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        int src = (int)(fitted[e][c] + 0.5f);
+                        candidate[c] = std::min(127, std::max(0, (src - pbit + 1) >> 1));
+                        int v = (candidate[c] << 1) | pbit;
+                        err += (v - src) * (v - src);
+                    }
+
+                    if (err < bestEndpointErr)
+                    {
+                        bestEndpointErr = err;
+                        p[e] = pbit;
+                        memcpy(q[e], candidate, sizeof(candidate));
+                    }
+                }
+
+                for (int c = 0; c < 4; ++c)
+                    expanded[e][c] = (q[e][c] << 1) | p[e];
+            }
+
+            int err = AssignIndices(block, 0, 4, expanded, s_bc7Weights, 16, idx);
+            if (err >= bestErr)
+                break;
+
+            bestErr = err;
+            memcpy(endpoints, q, sizeof(q));
+            memcpy(pbits, p, sizeof(p));
+            memcpy(indices, idx, sizeof(idx));
+
+            if (err == 0 || !RefineEndpoints(block, 0, 4, indices, s_bc7Weights, fitted))
+                break;
+        }
+
+        // anchor index (first texel) must have its highest bit cleared - swap endpoints if needed (weights are symmetric)
+        if (indices[0] & 8)
+        {
+            std::swap(endpoints[0], endpoints[1]);
+            std::swap(pbits[0], pbits[1]);
+            for (int i = 0; i < 16; ++i)
+                indices[i] = 15 - indices[i];
+        }
+
+        BC7Writer writer;
+        writer.Write(1 << 6, 7);
+        for (int c = 0; c < 4; ++c)
+        {
+            writer.Write(endpoints[0][c], 7);
+            writer.Write(endpoints[1][c], 7);
+        }
+        writer.Write(pbits[0], 1);
+        writer.Write(pbits[1], 1);
+        writer.Write(indices[0], 3);
+        for (int i = 1; i < 16; ++i)
+            writer.Write(indices[i], 4);
+
+        writer.Store(dst);
+        return bestErr;
+    }
+
+    // fit one endpoint pair of BC7 mode 5 (color or alpha) with 2 bit indices, endpoints are quantized to given number of bits
+    static int FitBC7Mode5Endpoints(const unsigned char block[16][4], int channel, int numChannels, int bits, int endpoints[2][4], int indices[16])
+    {
+        static const int weights[4] = { 0, 21, 43, 64 };
+        int maxValue = (1 << bits) - 1;
+
+        float fitted[2][4];
+        FitPrincipalAxis(block, channel, numChannels, fitted);
+
+        int bestErr = INT_MAX;
+        for (int iter = 0; iter < 3; ++iter)
+        {
+            int q[2][4], expanded[2][4], idx[16];
+            for (int e = 0; e < 2; ++e)
+            {
+                for (int c = 0; c < numChannels; ++c)
+                {
+                    q[e][c] = std::min(maxValue, std::max(0, (int)(fitted[e][c] * maxValue / 255.f + 0.5f)));
+                    expanded[e][c] = bits == 8 ? q[e][c] : (q[e][c] << (8 - bits)) | (q[e][c] >> (2 * bits - 8));
+                }
+            }
+
+            int err = AssignIndices(block, channel, numChannels, expanded, weights, 4, idx);
+            if (err >= bestErr)
+                break;
+
+            bestErr = err;
+            memcpy(endpoints, q, sizeof(q));
+            memcpy(indices, idx, sizeof(idx));
+
+            if (err == 0 || !RefineEndpoints(block, channel, numChannels, indices, weights, fitted))
+                break;
+        }
+
+        // anchor index must have its highest bit cleared
+        if (indices[0] & 2)
+        {
+            std::swap(endpoints[0], endpoints[1]);
+            for (int i = 0; i < 16; ++i)
+                indices[i] = 3 - indices[i];
+        }
+
+        return bestErr;
+    }
+
+    // BC7 mode 5: single subset, 7 bit RGB and 8 bit alpha endpoints with separate 2 bit index sets, so alpha which
+    // doesn't follow color doesn't take index precision away from it. Rotation (1-3) swaps alpha with R, G or B before
+    // encoding - on opaque blocks this gives one of the color channels its own indices (e.g. 2D gradients)
+    static int EncodeBC7Mode5(const unsigned char srcBlock[16][4], int rotation, unsigned char *dst)
+    {
+        unsigned char block[16][4];
+        memcpy(block, srcBlock, sizeof(block));
+        if (rotation > 0)
+        {
+            for (int i = 0; i < 16; ++i)
+                std::swap(block[i][rotation - 1], block[i][3]);
+        }
+
+        int colorEndpoints[2][4], alphaEndpoints[2][4];
+        int colorIndices[16], alphaIndices[16];
+
+        int err = FitBC7Mode5Endpoints(block, 0, 3, 7, colorEndpoints, colorIndices);
+        err += FitBC7Mode5Endpoints(block, 3, 1, 8, alphaEndpoints, alphaIndices);
+
+        BC7Writer writer;
+        writer.Write(1 << 5, 6);
+        writer.Write(rotation, 2);
+        for (int c = 0; c < 3; ++c)
+        {
+            writer.Write(colorEndpoints[0][c], 7);
+            writer.Write(colorEndpoints[1][c], 7);
+        }
+        writer.Write(alphaEndpoints[0][0], 8);
+        writer.Write(alphaEndpoints[1][0], 8);
+        writer.Write(colorIndices[0], 1);
+        for (int i = 1; i < 16; ++i)
+            writer.Write(colorIndices[i], 2);
+        writer.Write(alphaIndices[0], 1);
+        for (int i = 1; i < 16; ++i)
+            writer.Write(alphaIndices[i], 2);
+
+        writer.Store(dst);
+        return err;
+    }
+
+    // BC7 block: mode 6 or mode 5 with any rotation, whichever is closest to the source
+    static void EncodeBC7(const unsigned char block[16][4], unsigned char *dst)
+    {
+        unsigned char mode5[16];
+        int bestErr = EncodeBC7Mode6(block, dst);
+        for (int rotation = 0; rotation < 4 && bestErr > 0; ++rotation)
+        {
+            int err = EncodeBC7Mode5(block, rotation, mode5);
+            if (err < bestErr)
+            {
+                bestErr = err;
+                memcpy(dst, mode5, sizeof(mode5));
+            }
+        }
+    }
+
+    // ETC2 RGB block using individual mode (also a valid ETC1 block) - both subblock orientations are tried
+    static void EncodeETC2Color(const unsigned char block[16][4], unsigned char *dst)
+    {
+        unsigned long long bestBlock = 0;
+        int bestBlockErr = INT_MAX;
+
+        for (int flip = 0; flip < 2; ++flip)
+        {
+            unsigned long long bits = (unsigned long long)flip << 32;
+            int blockErr = 0;
+
+            for (int sub = 0; sub < 2; ++sub)
+            {
+                // texels belonging to the subblock: 2x4 columns if not flipped, 4x2 rows otherwise
+                int texels[8], count = 0;
+                for (int y = 0; y < 4; ++y)
+                {
+                    for (int x = 0; x < 4; ++x)
+                    {
+                        if ((flip ? y >> 1 : x >> 1) == sub)
+                            texels[count++] = y * 4 + x;
+                    }
+                }
+
+                int avg[3] = { 0, 0, 0 };
+                for (int i = 0; i < 8; ++i)
+                {
+                    for (int c = 0; c < 3; ++c)
+                        avg[c] += block[texels[i]][c];
+                }
+
+                unsigned char base[3];
+                int base4[3];
+                for (int c = 0; c < 3; ++c)
+                {
+                    base4[c] = (avg[c] / 8 * 15 + 127) / 255;
+                    base[c] = (unsigned char)((base4[c] << 4) | base4[c]);
+                }
+
+                int bestTable = 0, bestErr = INT_MAX;
+                int bestIndices[8] = {};
+                for (int t = 0; t < 8; ++t)
+                {
+                    int err = 0, tableIndices[8];
+                    for (int i = 0; i < 8; ++i)
+                    {
+                        int bestTexelErr = INT_MAX;
+                        for (int m = 0; m < 4; ++m)
+                        {
+                            unsigned char c[3];
+                            for (int k = 0; k < 3; ++k)
+                                c[k] = (unsigned char)Clamp255(base[k] + s_etcModifiers[t][m]);
+
+                            int texelErr = ColorError(block[texels[i]], c, 3);
+                            if (texelErr < bestTexelErr)
+                            {
+                                bestTexelErr = texelErr;
+                                tableIndices[i] = m;
+                            }
+                        }
+                        err += bestTexelErr;
+                    }
+
+                    if (err < bestErr)
+                    {
+                        bestErr = err;
+                        bestTable = t;
+                        memcpy(bestIndices, tableIndices, sizeof(tableIndices));
+                    }
+                }
+
+                blockErr += bestErr;
+                for (int c = 0; c < 3; ++c)
+                    bits |= (unsigned long long)base4[c] << (60 - c * 8 - sub * 4);
+                bits |= (unsigned long long)bestTable << (37 - sub * 3);
+
+                // pixel indices are stored column-major, MSBs in upper 16 bits and LSBs in lower 16 bits
+                for (int i = 0; i < 8; ++i)
+                {
+                    int x = texels[i] & 3, y = texels[i] >> 2;
+                    int pixel = x * 4 + y;
+                    bits |= (unsigned long long)(bestIndices[i] >> 1) << (16 + pixel);
+                    bits |= (unsigned long long)(bestIndices[i] & 1) << pixel;
+                }
+            }
+
+            if (blockErr < bestBlockErr)
+            {
+                bestBlockErr = blockErr;
+                bestBlock = bits;
+            }
+        }
+
+        // ETC blocks are stored big endian
+        for (int i = 0; i < 8; ++i)
+            dst[i] = (unsigned char)(bestBlock >> (56 - i * 8));
+    }
+
+    // EAC alpha block: base value, multiplier and modifier table are searched around the block's alpha range
+    static void EncodeEACAlpha(const unsigned char block[16][4], unsigned char *dst)
+    {
+        int minAlpha = 255, maxAlpha = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            minAlpha = std::min(minAlpha, (int)block[i][3]);
+            maxAlpha = std::max(maxAlpha, (int)block[i][3]);
+        }
+
+        unsigned long long bestBlock = 0;
+        int bestErr = INT_MAX;
+        int base = (minAlpha + maxAlpha + 1) / 2;
+
+        for (int t = 0; t < 16 && bestErr > 0; ++t)
+        {
+            int range = s_eacModifiers[t][7] - s_eacModifiers[t][3];
+            int multiplier = std::max(1, (maxAlpha - minAlpha + range - 1) / range);
+
+            for (int m = std::max(1, multiplier - 1); m <= std::min(15, multiplier + 1); ++m)
+            {
+                unsigned long long bits = (unsigned long long)base << 56 | (unsigned long long)m << 52 | (unsigned long long)t << 48;
+                int err = 0;
+
+                for (int i = 0; i < 16; ++i)
+                {
+                    int bestIdx = 0, bestTexelErr = INT_MAX;
+                    for (int k = 0; k < 8; ++k)
+                    {
+                        int texelErr = abs(Clamp255(base + s_eacModifiers[t][k] * m) - block[i][3]);
+                        if (texelErr < bestTexelErr)
+                        {
+                            bestTexelErr = texelErr;
+                            bestIdx = k;
+                        }
+                    }
+
+                    err += bestTexelErr * bestTexelErr;
+                    int x = i & 3, y = i >> 2;
+                    bits |= (unsigned long long)bestIdx << (45 - (x * 4 + y) * 3);
+                }
+
+                if (err < bestErr)
+                {
+                    bestErr = err;
+                    bestBlock = bits;
+                }
+            }
+        }
+
+        for (int i = 0; i < 8; ++i)
+            dst[i] = (unsigned char)(bestBlock >> (56 - i * 8));
+    }
+
+    std::vector<Image> GenerateMips(const unsigned char *rgba, int width, int height)
+    {
+        std::vector<Image> mips(1);
+        mips[0].width  = width;
+        mips[0].height = height;
+        mips[0].rgba.assign(rgba, rgba + width * height * 4);
+
+        while (mips.back().width > 1 || mips.back().height > 1)
+        {
+            const Image &src = mips.back();
+            Image dst;
+            dst.width  = std::max(1, src.width >> 1);
+            dst.height = std::max(1, src.height >> 1);
+            dst.rgba.resize(dst.width * dst.height * 4);
+
+            for (int y = 0; y < dst.height; ++y)
+            {
+                int y0 = std::min(y * 2, src.height - 1), y1 = std::min(y * 2 + 1, src.height - 1);
+                for (int x = 0; x < dst.width; ++x)
+                {
+                    int x0 = std::min(x * 2, src.width - 1), x1 = std::min(x * 2 + 1, src.width - 1);
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        int sum = src.rgba[(y0 * src.width + x0) * 4 + c] + src.rgba[(y0 * src.width + x1) * 4 + c] +
+                                  src.rgba[(y1 * src.width + x0) * 4 + c] + src.rgba[(y1 * src.width + x1) * 4 + c];
+                        dst.rgba[(y * dst.width + x) * 4 + c] = (unsigned char)((sum + 2) >> 2);
+                    }
+                }
+            }
+
+            mips.push_back(std::move(dst));
+        }
+
+        return mips;
+    }
+
+    void CompressBC1(const Image &image, std::vector<unsigned char> &dst)
+    {
+        CompressBlocks(image, dst, 8, EncodeBC1Color);
+    }
+
+    void CompressBC3(const Image &image, std::vector<unsigned char> &dst)
+    {
+        CompressBlocks(image, dst, 16, [](const unsigned char block[16][4], unsigned char *out) {
+            EncodeBC3Alpha(block, out);
+            EncodeBC1Color(block, out + 8);
+        });
+    }
+
+    void CompressBC7(const Image &image, std::vector<unsigned char> &dst)
+    {
+        CompressBlocks(image, dst, 16, EncodeBC7);
+    }
+
+    void CompressETC2(const Image &image, std::vector<unsigned char> &dst)
+    {
+        CompressBlocks(image, dst, 8, EncodeETC2Color);
+    }
+
+    void CompressETC2A(const Image &image, std::vector<unsigned char> &dst)
+    {
+        CompressBlocks(image, dst, 16, [](const unsigned char block[16][4], unsigned char *out) {
+            EncodeEACAlpha(block, out);
+            EncodeETC2Color(block, out + 8);
+        });
+    }
+
+    bool HasAlpha(const Image &image)
+    {
+        for (size_t i = 3; i < image.rgba.size(); i += 4)
+        {
+            if (image.rgba[i] != 255)
+                return true;
+        }
+
+        return false;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef TEXTURECOMPRESSOR_INCLUDED
+#define TEXTURECOMPRESSOR_INCLUDED
+
+#include <vector>
+#include <stddef.h>
+
+/*
+ * Offline mipmap generation and block compression of RGBA8 images (used when baking texture containers)
+ */
+
+namespace TextureCompressor
+{
+    struct Image
+    {
+        int width  = 0;
+        int height = 0;
+        std::vector<unsigned char> rgba;
+    };
+
+    // full mip chain down to 1x1, mip 0 is a copy of source image (box filtered, edge texels clamped for odd sizes)
+    std::vector<Image> GenerateMips(const unsigned char *rgba, int width, int height);
+
+    // encode image into 4x4 blocks - output is appended to dst, partial blocks at image edges are padded with clamped texels
+    void CompressBC1(const Image &image, std::vector<unsigned char> &dst);  // 8 bytes per block, opaque
+    void CompressBC3(const Image &image, std::vector<unsigned char> &dst);  // 16 bytes per block
+    void CompressBC7(const Image &image, std::vector<unsigned char> &dst);  // 16 bytes per block, best of mode 6 and mode 5
+    void CompressETC2(const Image &image, std::vector<unsigned char> &dst); // 8 bytes per block, opaque (ETC1 compatible individual mode)
+    void CompressETC2A(const Image &image, std::vector<unsigned char> &dst);// 16 bytes per block, EAC alpha + ETC2 color
+
+    // true if any texel of the image is not fully opaque
+    bool HasAlpha(const Image &image);
+}
+
+#endif
@@ -0,0 +1,173 @@
+#include "renderer/TextureContainer.hpp"
+#include "renderer/TextureCompressor.hpp"
+#include "renderer/vulkan/Image.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string.h>
+
+static const char     s_magic[4] = { 'Q', 'T', 'E', 'X' };
+static const uint32_t s_version  = 1;
+
+// encodings in order of preference: best quality per bit first, uncompressed last
+static const VkFormat s_formatPreference[] = {
+    VK_FORMAT_BC7_UNORM_BLOCK,
+    VK_FORMAT_ASTC_4x4_UNORM_BLOCK,
+    VK_FORMAT_BC3_UNORM_BLOCK,
+    VK_FORMAT_BC1_RGB_UNORM_BLOCK,
+    VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK,
+    VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK,
+    VK_FORMAT_R8G8B8A8_UNORM
+};
+
+struct TextureContainerHeader
+{
+    char     magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+    uint32_t numEncodings;
+};
+
+struct TextureContainerEntry
+{
+    uint32_t format;
+    uint32_t offset;
+    uint32_t size;
+};
+
+bool TextureContainer::Load(const char *filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    std::vector<unsigned char> fileData((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return Load(fileData.data(), fileData.size());
+}
+
+bool TextureContainer::Load(const unsigned char *data, size_t size)
+{
+    TextureContainerHeader header;
+    if (size < sizeof(header))
+        return false;
+
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, s_magic, sizeof(s_magic)) || header.version != s_version)
+        return false;
+
+    // full mip chain ends at 1x1 - anything longer (or empty) comes from a corrupted file
+    uint32_t maxMipLevels = 1;
+    while ((std::max(header.width, header.height) >> maxMipLevels) > 0)
+        ++maxMipLevels;
+
+    if (header.width == 0 || header.height == 0 || header.mipLevels == 0 || header.mipLevels > maxMipLevels)
+        return false;
+
+    uint64_t dataStart = sizeof(header) + (uint64_t)header.numEncodings * sizeof(TextureContainerEntry);
+    if (size < dataStart)
+        return false;
+
+    width = header.width;
+    height = header.height;
+    mipLevels = header.mipLevels;
+    encodings.resize(header.numEncodings);
+
+    const TextureContainerEntry *entries = (const TextureContainerEntry *)(data + sizeof(header));
+    for (uint32_t i = 0; i < header.numEncodings; ++i)
+    {
+        // reject truncated files and data overlapping the header
+        if (entries[i].offset < dataStart || (uint64_t)entries[i].offset + entries[i].size > size)
+        {
+            encodings.clear();
+            return false;
+        }
+
+        encodings[i].format = (VkFormat)entries[i].format;
+        encodings[i].data.assign(data + entries[i].offset, data + entries[i].offset + entries[i].size);
+    }
+
+    return true;
+}
+
+bool TextureContainer::Save(const char *filename) const
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    TextureContainerHeader header;
+    memcpy(header.magic, s_magic, sizeof(s_magic));
+    header.version = s_version;
+    header.width = width;
+    header.height = height;
+    header.mipLevels = mipLevels;
+    header.numEncodings = (uint32_t)encodings.size();
+    file.write((const char *)&header, sizeof(header));
+
+    uint32_t offset = (uint32_t)(sizeof(header) + encodings.size() * sizeof(TextureContainerEntry));
+    for (const auto &e : encodings)
+    {
+        TextureContainerEntry entry = { (uint32_t)e.format, offset, (uint32_t)e.data.size() };
+        file.write((const char *)&entry, sizeof(entry));
+        offset += entry.size;
+    }
+
+    for (const auto &e : encodings)
+        file.write((const char *)e.data.data(), e.data.size());
+
+    return file.good();
+}
+
+void TextureContainer::Build(const unsigned char *rgba, int w, int h)
+{
+    std::vector<TextureCompressor::Image> mips = TextureCompressor::GenerateMips(rgba, w, h);
+    bool alpha = TextureCompressor::HasAlpha(mips[0]);
+
+    width = w;
+    height = h;
+    mipLevels = (uint32_t)mips.size();
+    encodings.resize(3);
+    encodings[0].format = VK_FORMAT_BC7_UNORM_BLOCK;
+    encodings[1].format = alpha ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    encodings[2].format = alpha ? VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK : VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK;
+
+    for (const auto &mip : mips)
+    {
+        TextureCompressor::CompressBC7(mip, encodings[0].data);
+
+        if (alpha)
+        {
+            TextureCompressor::CompressBC3(mip, encodings[1].data);
+            TextureCompressor::CompressETC2A(mip, encodings[2].data);
+        }
+        else
+        {
+            TextureCompressor::CompressBC1(mip, encodings[1].data);
+            TextureCompressor::CompressETC2(mip, encodings[2].data);
+        }
+    }
+}
+
+const TextureContainer::Encoding *TextureContainer::SelectEncoding(const std::function<bool(VkFormat)> &isSupported) const
+{
+    for (VkFormat format : s_formatPreference)
+    {
+        for (const auto &e : encodings)
+        {
+            if (e.format != format || !isSupported(format))
+                continue;
+
+            // skip encodings with data not matching the mip chain
+            VkDeviceSize expectedSize = 0;
+            for (uint32_t i = 0; i < mipLevels; ++i)
+                expectedSize += vk::getMipLevelSize(e.format, std::max(1u, width >> i), std::max(1u, height >> i));
+
+            if (e.data.size() == expectedSize)
+                return &e;
+        }
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,39 @@
+#ifndef TEXTURECONTAINER_INCLUDED
+#define TEXTURECONTAINER_INCLUDED
+
+#include "renderer/vulkan/Base.hpp"
+#include <functional>
+#include <vector>
+
+/*
+ * Baked texture file (.qtx) with a full pre-filtered mip chain stored in several block compressed formats,
+ * so that the runtime can upload the best encoding supported by the device without any conversion.
+ *
+ * Layout: header, encoding table (format, offset, size) and tightly packed mip data of each encoding (mip 0 first).
+ */
+
+struct TextureContainer
+{
+    struct Encoding
+    {
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        std::vector<unsigned char> data;
+    };
+
+    bool Load(const char *filename);
+    bool Load(const unsigned char *data, size_t size);
+    bool Save(const char *filename) const;
+
+    // generate mips and encode them in all formats the compressor supports (BC7, BC1/BC3, ETC2)
+    void Build(const unsigned char *rgba, int width, int height);
+
+    // most preferred encoding for which isSupported returns true - nullptr if there's none
+    const Encoding *SelectEncoding(const std::function<bool(VkFormat)> &isSupported) const;
+
+    uint32_t width     = 0;
+    uint32_t height    = 0;
+    uint32_t mipLevels = 0;
+    std::vector<Encoding> encodings;
+};
+
+#endif
@@ -1,9 +1,19 @@
+#include "renderer/RenderContext.hpp"
 #include "renderer/TextureManager.hpp"
 #include "Utils.hpp"
+#include <algorithm>
 #ifdef __APPLE__
 #include "apple/AppleUtils.hpp"
 #endif
 
+extern RenderContext g_renderContext;
+
+const uint64_t TextureManager::s_evictionDelay       = 300;
+const uint64_t TextureManager::s_budgetQueryInterval = 60;
+const int      TextureManager::s_maxEvictionsPerFrame = 4;
+const int      TextureManager::s_maxReloads           = 4;
+const int      TextureManager::s_minResidentSize      = 32;
+
 TextureManager* TextureManager::GetInstance()
 {
     static TextureManager instance;
@@ -24,6 +34,8 @@ void TextureManager::ReleaseTextures()
     }
 
     m_textures.clear();
+    m_reloads.clear();
+    ReleaseRetiredImages(true);
 }
 
 GameTexture *TextureManager::LoadTexture(const char *textureName, bool filtering)
@@ -43,8 +55,149 @@ GameTexture *TextureManager::LoadTexture(const char *textureName, bool filtering
             return nullptr;
         }
 
+        newTex->m_name = textureName;
         m_textures[textureName] = newTex;
     }
 
     return m_textures[textureName];
 }
+
+GameTexture *TextureManager::FindTexture(const char *textureName) const
+{
+    auto it = m_textures.find(textureName);
+
+    return it != m_textures.end() ? it->second : nullptr;
+}
+
+GameTexture *TextureManager::AddTexture(const char *textureName, GameTexture *texture)
+{
+    GameTexture *existing = FindTexture(textureName);
+
+    if (existing)
+    {
+        delete texture;
+        return existing;
+    }
+
+    texture->m_name = textureName;
+    m_textures[textureName] = texture;
+    return texture;
+}
+
+void TextureManager::UpdateResidency()
+{
+    // finished reloads - unknown ids belong to textures released in the meantime
+    std::vector<TextureStreamer::Result> reloaded;
+    m_reloader.Update(s_maxReloads, reloaded);
+    for (const auto &r : reloaded)
+    {
+        auto it = m_reloads.find(r.id);
+        if (it != m_reloads.end())
+        {
+            GameTexture *target = it->second;
+            target->m_reloading = false;
+            m_reloads.erase(it);
+
+            if (r.texture)
+            {
+                vk::Texture retired;
+                target->ReplaceImage(r.texture, &retired);
+                RetireImage(retired);
+            }
+        }
+
+        delete r.texture;
+    }
+
+    // device budget is shared with everything else allocated by the application
+    if (m_frame % s_budgetQueryInterval == 1)
+    {
+        VkDeviceSize usage;
+        g_renderContext.MemoryBudget(&m_deviceBudget, &usage);
+        m_otherMemory = usage > m_textureMemory ? usage - m_textureMemory : 0;
+    }
+
+    m_textureBudget = m_budgetOverride ? m_budgetOverride : (m_deviceBudget > m_otherMemory ? m_deviceBudget - m_otherMemory : 0);
+    m_textureMemory = 0;
+    m_numEvicted = 0;
+
+    std::vector<GameTexture *> evictable;
+    for (const auto &t : m_textures)
+    {
+        GameTexture *tex = t.second;
+        m_textureMemory += tex->MemorySize();
+        m_numEvicted += tex->m_residentMip > 0 ? 1 : 0;
+
+        if (!tex->m_lastUsedFrame || tex->m_reloading)
+            continue;
+
+        int residentSize = std::min(tex->m_width, tex->m_height) >> tex->m_residentMip;
+        if (tex->m_lastUsedFrame + s_evictionDelay < m_frame && tex->m_vkTexture.mipLevels > 1 && residentSize / 2 >= s_minResidentSize)
+            evictable.push_back(tex);
+    }
+
+    for (const auto &r : m_retiredImages)
+    {
+        VmaAllocationInfo allocInfo;
+        vmaGetAllocationInfo(g_renderContext.Device().allocator, r.second.allocation, &allocInfo);
+        m_textureMemory += allocInfo.size;
+    }
+
+    if (m_textureMemory > m_textureBudget)
+    {
+        // over budget: least recently used textures go first, a few per frame to avoid hitches
+        std::sort(evictable.begin(), evictable.end(), [](const GameTexture *a, const GameTexture *b) { return a->m_lastUsedFrame < b->m_lastUsedFrame; });
+
+        for (size_t i = 0; i < evictable.size() && i < (size_t)s_maxEvictionsPerFrame && m_textureMemory > m_textureBudget; ++i)
+        {
+            vk::Texture retired;
+            evictable[i]->EvictTopMip(&retired);
+            RetireImage(retired);
+
+            // old image is still accounted for until it's released
+            m_textureMemory += evictable[i]->MemorySize();
+            m_numEvicted += evictable[i]->m_residentMip == 1 ? 1 : 0;
+        }
+    }
+    else
+    {
+        // reload textures which are visible again, as long as their full size fits into the budget
+        for (const auto &t : m_textures)
+        {
+            GameTexture *tex = t.second;
+            if (m_reloads.size() >= (size_t)s_maxReloads)
+                break;
+
+            if (tex->m_residentMip == 0 || tex->m_reloading || tex->m_lastUsedFrame != m_frame)
+                continue;
+
+            // each mip level is roughly 4 times larger than the next one
+            VkDeviceSize fullSize = tex->MemorySize() << (2 * tex->m_residentMip);
+            if (m_textureMemory + fullSize > m_textureBudget)
+                continue;
+
+            m_textureMemory += fullSize;
+            tex->m_reloading = true;
+            m_reloads[m_nextReloadId] = tex;
+            m_reloader.Request(m_nextReloadId++, { tex->m_name }, tex->m_filtering, false);
+        }
+    }
+
+    ReleaseRetiredImages(false);
+    ++m_frame;
+}
+
+void TextureManager::RetireImage(const vk::Texture &texture)
+{
+    m_retiredImages.push_back(std::make_pair(m_frame, texture));
+}
+
+void TextureManager::ReleaseRetiredImages(bool all)
+{
+    // image replaced in this frame can still be used by frames in flight (recorded with old descriptors)
+    auto it = m_retiredImages.begin();
+    for (; it != m_retiredImages.end() && (all || it->first + g_renderContext.FramesInFlight() <= m_frame); ++it)
+        vk::releaseTexture(g_renderContext.Device(), it->second);
+
+    m_retiredImages.erase(m_retiredImages.begin(), it);
+}
@@ -2,7 +2,9 @@
 #define TEXTUREMANAGER_HPP
 
 #include "renderer/GameTexture.hpp"
+#include "renderer/TextureStreamer.hpp"
 #include <map>
+#include <vector>
 
 /*
  * Container class for loading/releasing textures
@@ -15,11 +17,50 @@ public:
 
     void ReleaseTextures();
     GameTexture *LoadTexture(const char *textureName, bool filtering = true);
+    GameTexture *FindTexture(const char *textureName) const;
+    // take ownership of a texture loaded elsewhere (i.e. streamed) - returns the previously registered one if name is taken
+    GameTexture *AddTexture(const char *textureName, GameTexture *texture);
+
+    // write compressed .qtx containers for all loaded source images
+    void SetBakeTextures(bool bake) { m_bakeTextures = bake; }
+    bool BakeTextures() const { return m_bakeTextures; }
+
+    // residency: textures used for rendering are tracked per frame - if they don't fit into the budget, top mips of
+    // the least recently used ones are evicted and they get reloaded at full resolution once they're used again
+    void SetBudget(VkDeviceSize budget) { m_budgetOverride = budget; } // 0 - use device memory budget
+    void MarkUsed(GameTexture *texture) { texture->m_lastUsedFrame = m_frame; }
+    void UpdateResidency(); // call once per frame, after all used textures have been marked
+    VkDeviceSize TextureMemory() const { return m_textureMemory; }
+    VkDeviceSize TextureBudget() const { return m_textureBudget; }
+    int EvictedTextures() const { return m_numEvicted; }
 private:
     TextureManager() {}
     ~TextureManager();
 
+    void RetireImage(const vk::Texture &texture);
+    void ReleaseRetiredImages(bool all);
+
+    static const uint64_t s_evictionDelay;         // frames a texture has to stay unused before its mips get evicted
+    static const uint64_t s_budgetQueryInterval;   // frames between memory budget queries
+    static const int      s_maxEvictionsPerFrame;
+    static const int      s_maxReloads;            // textures reloaded at the same time
+    static const int      s_minResidentSize;       // textures are not reduced below this size (texels)
+
     std::map<std::string, GameTexture *> m_textures;
+    bool m_bakeTextures = false;
+
+    uint64_t     m_frame = 1;
+    VkDeviceSize m_budgetOverride = 0;
+    VkDeviceSize m_deviceBudget   = 0; // last queried device local memory budget and non-texture usage
+    VkDeviceSize m_otherMemory    = 0;
+    VkDeviceSize m_textureMemory  = 0;
+    VkDeviceSize m_textureBudget  = 0;
+    int m_numEvicted = 0;
+
+    TextureStreamer m_reloader;                // full resolution reloads of evicted textures
+    std::map<int, GameTexture *> m_reloads;
+    int m_nextReloadId = 0;
+    std::vector<std::pair<uint64_t, vk::Texture>> m_retiredImages; // released once no frame in flight can use them
 };
 
 #endif
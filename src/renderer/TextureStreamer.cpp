@@ -0,0 +1,149 @@
+#include "renderer/TextureStreamer.hpp"
+#include "renderer/TextureManager.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#ifdef __APPLE__
+#include "apple/AppleUtils.hpp"
+#endif
+
+const size_t TextureStreamer::s_maxDecoded = 8;
+
+TextureStreamer::~TextureStreamer()
+{
+    if (m_thread.joinable())
+    {
+        m_mutex.lock();
+        m_finish = true;
+        m_cv.notify_all();
+        m_mutex.unlock();
+        m_thread.join();
+    }
+
+    // textures which never made it to the GPU are not owned by TextureManager
+    for (auto &d : m_decoded)
+        delete d.texture;
+}
+
+void TextureStreamer::Request(int id, const std::vector<std::string> &fileNames, bool filtering, bool registerTexture)
+{
+    ++m_numPending;
+
+    // texture shared with something loaded earlier - no need to touch the disk
+    for (size_t i = 0; registerTexture && i < fileNames.size(); ++i)
+    {
+        GameTexture *texture = TextureManager::GetInstance()->FindTexture(fileNames[i].c_str());
+        if (texture)
+        {
+            Result result;
+            result.id = id;
+            result.texture = texture;
+            m_cached.push_back(result);
+            return;
+        }
+    }
+
+    // worker thread is started with the first request, so that maps which never stream don't pay for it
+    if (!m_thread.joinable())
+        m_thread = std::thread(&TextureStreamer::Work, this);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    LoadRequest &request = m_requests[id];
+    request.id = id;
+    request.fileNames = fileNames;
+    request.filtering = filtering;
+    request.registerTexture = registerTexture;
+    m_cv.notify_all();
+}
+
+void TextureStreamer::Prioritize(const std::vector<std::pair<int, float>> &priorities)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (auto &r : m_requests)
+        r.second.priority = FLT_MAX;
+
+    for (const auto &p : priorities)
+    {
+        auto it = m_requests.find(p.first);
+        if (it != m_requests.end())
+            it->second.priority = std::min(it->second.priority, p.second);
+    }
+}
+
+void TextureStreamer::Update(int maxUploads, std::vector<Result> &results)
+{
+    results.insert(results.end(), m_cached.begin(), m_cached.end());
+    m_numPending -= m_cached.size();
+    m_cached.clear();
+
+    std::vector<LoadRequest> decoded;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        size_t count = std::min(m_decoded.size(), (size_t)maxUploads);
+        decoded.assign(m_decoded.begin(), m_decoded.begin() + count);
+        m_decoded.erase(m_decoded.begin(), m_decoded.begin() + count);
+
+        // make room for more decoded textures
+        if (count > 0)
+            m_cv.notify_all();
+    }
+
+    // uploads are recorded to the upload queue, which is not thread safe - hence done here and not on the worker
+    for (auto &d : decoded)
+    {
+        Result result;
+        result.id = d.id;
+
+        if (d.texture && d.texture->Load(d.filtering))
+        {
+            LOG_MESSAGE("[TextureStreamer] Loaded texture: " << d.loadedName);
+            result.texture = d.registerTexture ? TextureManager::GetInstance()->AddTexture(d.loadedName.c_str(), d.texture) : d.texture;
+        }
+        else
+        {
+            delete d.texture;
+        }
+
+        results.push_back(result);
+        --m_numPending;
+    }
+}
+
+void TextureStreamer::Work()
+{
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_finish || (!m_requests.empty() && m_decoded.size() < s_maxDecoded); });
+        if (m_finish)
+            break;
+
+        // most important request first - ties are resolved in order of ids
+        auto next = std::min_element(m_requests.begin(), m_requests.end(),
+                                     [](const std::pair<const int, LoadRequest> &a, const std::pair<const int, LoadRequest> &b) { return a.second.priority < b.second.priority; });
+        LoadRequest request = next->second;
+        m_requests.erase(next);
+
+        // decode without holding the lock, so that new requests and priorities can arrive meanwhile
+        lock.unlock();
+        for (const auto &name : request.fileNames)
+        {
+#if TARGET_OS_IPHONE
+            GameTexture *texture = new GameTexture((getResourcePath() + name).c_str());
+#else
+            GameTexture *texture = new GameTexture(name.c_str());
+#endif
+            if (texture->Decoded())
+            {
+                request.texture = texture;
+                request.loadedName = name;
+                break;
+            }
+
+            delete texture;
+        }
+
+        lock.lock();
+        m_decoded.push_back(request);
+    }
+}
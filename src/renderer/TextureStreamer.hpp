@@ -0,0 +1,67 @@
+#ifndef TEXTURESTREAMER_INCLUDED
+#define TEXTURESTREAMER_INCLUDED
+
+#include <cfloat>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class GameTexture;
+
+/*
+ * Asynchronous texture loading: image files are decoded on a background thread (most important requests first)
+ * and uploaded to the GPU on the main thread, a few per frame. Finished textures are registered in TextureManager.
+ */
+
+class TextureStreamer
+{
+public:
+    struct Result
+    {
+        int id = -1;
+        GameTexture *texture = nullptr; // nullptr if none of the requested files could be loaded
+    };
+
+    ~TextureStreamer();
+
+    // queue a texture for loading - first existing file in the list is used
+    // unregistered textures are not shared through TextureManager and have to be deleted by the caller
+    void Request(int id, const std::vector<std::string> &fileNames, bool filtering = true, bool registerTexture = true);
+    // set priorities of queued requests (id, priority) - lower values are loaded first, unlisted requests are loaded last
+    void Prioritize(const std::vector<std::pair<int, float>> &priorities);
+    // main thread only: upload up to maxUploads decoded textures and append finished requests to results
+    void Update(int maxUploads, std::vector<Result> &results);
+    // number of requests which are not finished yet
+    size_t Pending() const { return m_numPending; }
+private:
+    struct LoadRequest
+    {
+        int id = -1;
+        std::vector<std::string> fileNames;
+        bool  filtering = true;
+        bool  registerTexture = true;
+        float priority  = FLT_MAX;
+        std::string  loadedName;         // file which was successfully decoded
+        GameTexture *texture = nullptr;
+    };
+
+    void Work();
+
+    static const size_t s_maxDecoded; // limit of decoded textures waiting for upload (bounds memory and keeps priorities fresh)
+
+    std::map<int, LoadRequest> m_requests; // waiting for decode
+    std::vector<LoadRequest>   m_decoded;  // waiting for upload
+    std::vector<Result>    m_cached;   // already loaded by TextureManager, reported on next update
+    size_t m_numPending = 0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+    bool m_finish = false;
+};
+
+#endif
@@ -8,17 +8,30 @@
 struct UniformBufferObject
 {
     Math::Matrix4f ModelViewProjectionMatrix;
+    float PositionScale[4] = { 1.f, 1.f, 1.f, 0.f }; // dequantization of packed vertex positions: position = bias + scale * packed
+    float PositionBias[4]  = { 0.f, 0.f, 0.f, 0.f };
 };
 
 // push constants used by the main shader
 struct BspPushConstants
 {
+    Math::Matrix4f modelMatrix; // brush model transform (bsp units) - identity for world geometry, replaced per draw for submodels
     float worldScaleFactor = 1.f;
     int renderLightmaps = 0;
     int useLightmaps = 1;
     int useAlphaTest = 0;
 };
 
+// push constants used by the patch tesselation shaders (extends BspPushConstants)
+struct BspTessPushConstants
+{
+    BspPushConstants base;
+    float viewportWidth  = 0.f;
+    float viewportHeight = 0.f;
+    float pixelsPerEdge  = 16.f; // target screen space length of a single tesselated edge
+    float maxTessLevel   = 64.f;
+};
+
 // shader attribute IDs for both the main and font shaders
 enum Attributes : uint32_t
 {
@@ -41,12 +41,14 @@ namespace vk
         appInfo.apiVersion = instanceVersion;
 
         unsigned int extCount = 0;
-        // get count of required extensions
-        SDL_Vulkan_GetInstanceExtensions(window, &extCount, nullptr);
+        // get count of required extensions - none if there's no window to present to (headless rendering)
+        if (window)
+            SDL_Vulkan_GetInstanceExtensions(window, &extCount, nullptr);
 
         std::vector<const char*> enabledExtensions(extCount);
         // get names of required extensions
-        SDL_Vulkan_GetInstanceExtensions(window, &extCount, enabledExtensions.data());
+        if (window)
+            SDL_Vulkan_GetInstanceExtensions(window, &extCount, enabledExtensions.data());
 
 #ifdef VALIDATION_LAYERS_ON
         // add validation layer extension to the list
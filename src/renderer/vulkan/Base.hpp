@@ -33,6 +33,8 @@
 
 namespace vk
 {
+    struct UploadQueue;
+
     // Vulkan device
     struct Device
     {
@@ -50,6 +52,8 @@ namespace vk
         int graphicsFamilyIndex = -1; // physical device queue family index
         int presentFamilyIndex  = -1; // physical device presentation family index
         int transferFamilyIndex = -1;
+        UploadQueue *uploadQueue = nullptr; // batched asynchronous uploads - if not set, each transfer is submitted and waited for immediately
+        bool memoryBudgetSupported = false; // VK_EXT_memory_budget is enabled
     };
 
     // Vulkan descriptor
@@ -61,6 +65,7 @@ namespace vk
     };
 
 
+    // window can be null if rendering is done offscreen only
     VkResult createInstance(SDL_Window *window, VkInstance *instance, const char *title);
     VkResult createDescriptorSet(const Device &device, Descriptor *descriptor);
     // this application uses VMA for memory management
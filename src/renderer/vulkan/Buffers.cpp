@@ -1,11 +1,13 @@
 #include "renderer/vulkan/Buffers.hpp"
 #include "renderer/vulkan/CmdBuffer.hpp"
+#include "renderer/vulkan/Upload.hpp"
 #include "Utils.hpp"
 #include "renderer/vulkan/vk_mem_alloc.h"
 
 namespace vk
 {
     static void copyBuffer(const Device &device, const VkBuffer &src, VkBuffer &dst, VkDeviceSize size);
+    static void uploadData(const Device &device, const void *data, VkDeviceSize size, Buffer &dstBuffer);
 
     VkVertexInputBindingDescription getBindingDescription(uint32_t stride)
     {
@@ -70,74 +72,51 @@ namespace vk
 
     void createVertexBuffer(const Device &device, const void *data, VkDeviceSize size, Buffer *dstBuffer)
     {
-        Buffer stagingBuffer;
-        VK_VERIFY(createStagingBuffer(device, size, &stagingBuffer));
-
-        void *dst;
-        vmaMapMemory(device.allocator, stagingBuffer.allocation, &dst);
-        memcpy(dst, data, (size_t)size);
-        vmaUnmapMemory(device.allocator, stagingBuffer.allocation);
-
         BufferOptions dstOpts;
         dstOpts.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
         dstOpts.memFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
         dstOpts.vmaUsage = VMA_MEMORY_USAGE_GPU_ONLY;
 
         VK_VERIFY(createBuffer(device, size, dstBuffer, dstOpts));
-
-        copyBuffer(device, stagingBuffer.buffer, dstBuffer->buffer, size);
-        freeBuffer(device, stagingBuffer);
+        uploadData(device, data, size, *dstBuffer);
     }
 
-    void createVertexBufferStaged(const Device &device, VkDeviceSize size, const Buffer &stagingBuffer, Buffer *dstBuffer)
+    void createIndexBuffer(const Device &device, const void *data, VkDeviceSize size, Buffer *dstBuffer)
     {
         BufferOptions dstOpts;
-        dstOpts.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        dstOpts.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
         dstOpts.memFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
         dstOpts.vmaUsage = VMA_MEMORY_USAGE_GPU_ONLY;
 
         VK_VERIFY(createBuffer(device, size, dstBuffer, dstOpts));
-
-        copyBuffer(device, stagingBuffer.buffer, dstBuffer->buffer, size);
+        uploadData(device, data, size, *dstBuffer);
     }
 
-    void createIndexBuffer(const Device &device, const void *data, VkDeviceSize size, Buffer *dstBuffer)
+    VkResult createUniformBuffer(const Device &device, VkDeviceSize size, Buffer *dstBuffer)
     {
-        Buffer stagingBuffer;
-        VK_VERIFY(createStagingBuffer(device, size, &stagingBuffer));
-
-        void *dst;
-        vmaMapMemory(device.allocator, stagingBuffer.allocation, &dst);
-        memcpy(dst, data, (size_t)size);
-        vmaUnmapMemory(device.allocator, stagingBuffer.allocation);
-
         BufferOptions dstOpts;
-        dstOpts.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-        dstOpts.memFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-        dstOpts.vmaUsage = VMA_MEMORY_USAGE_GPU_ONLY;
-
-        VK_VERIFY(createBuffer(device, size, dstBuffer, dstOpts));
-
-        copyBuffer(device, stagingBuffer.buffer, dstBuffer->buffer, size);
-        freeBuffer(device, stagingBuffer);
+        dstOpts.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        dstOpts.memFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        dstOpts.vmaFlags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        dstOpts.vmaUsage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+        return createBuffer(device, size, dstBuffer, dstOpts);
     }
 
-    void createIndexBufferStaged(const Device &device, VkDeviceSize size, const Buffer &stagingBuffer, Buffer *dstBuffer)
+    VkResult createReadbackBuffer(const Device &device, VkDeviceSize size, Buffer *dstBuffer)
     {
+        // cached memory is much faster to read on the CPU - has to be invalidated before reading if it's not coherent
         BufferOptions dstOpts;
-        dstOpts.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-        dstOpts.memFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-        dstOpts.vmaUsage = VMA_MEMORY_USAGE_GPU_ONLY;
-
-        VK_VERIFY(createBuffer(device, size, dstBuffer, dstOpts));
-
-        copyBuffer(device, stagingBuffer.buffer, dstBuffer->buffer, size);
+        dstOpts.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        dstOpts.memFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        dstOpts.vmaFlags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        dstOpts.vmaUsage = VMA_MEMORY_USAGE_GPU_TO_CPU;
+        return createBuffer(device, size, dstBuffer, dstOpts);
     }
 
-    VkResult createUniformBuffer(const Device &device, VkDeviceSize size, Buffer *dstBuffer)
+    VkResult createIndirectBuffer(const Device &device, VkDeviceSize size, Buffer *dstBuffer)
     {
         BufferOptions dstOpts;
-        dstOpts.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        dstOpts.usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
         dstOpts.memFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
         dstOpts.vmaFlags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
         dstOpts.vmaUsage = VMA_MEMORY_USAGE_CPU_TO_GPU;
@@ -159,4 +138,26 @@ namespace vk
         submitCommand(device, commandBuffer, device.transferQueue);
         vkFreeCommandBuffers(device.logical, device.transferCommandPool, 1, &commandBuffer);
     }
+
+    // internal helper
+    void uploadData(const Device &device, const void *data, VkDeviceSize size, Buffer &dstBuffer)
+    {
+        // batched upload - copy is submitted along with other transfers and not waited for
+        if (device.uploadQueue)
+        {
+            uploadBuffer(device, *device.uploadQueue, data, size, dstBuffer, 0);
+            return;
+        }
+
+        Buffer stagingBuffer;
+        VK_VERIFY(createStagingBuffer(device, size, &stagingBuffer));
+
+        void *dst;
+        vmaMapMemory(device.allocator, stagingBuffer.allocation, &dst);
+        memcpy(dst, data, (size_t)size);
+        vmaUnmapMemory(device.allocator, stagingBuffer.allocation);
+
+        copyBuffer(device, stagingBuffer.buffer, dstBuffer.buffer, size);
+        freeBuffer(device, stagingBuffer);
+    }
 }
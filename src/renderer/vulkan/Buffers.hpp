@@ -41,8 +41,8 @@ namespace vk
     void     freeBuffer(const Device &device, Buffer &buffer);
     VkResult createStagingBuffer(const Device &device, VkDeviceSize size, Buffer *dstBuffer);
     void     createVertexBuffer(const Device &device, const void *data, VkDeviceSize size, Buffer *dstBuffer);
-    void     createVertexBufferStaged(const Device &device, VkDeviceSize size, const Buffer &stagingBuffer, Buffer *dstBuffer);
     void     createIndexBuffer(const Device &device, const void *data, VkDeviceSize size, Buffer *dstBuffer);
-    void     createIndexBufferStaged(const Device &device, VkDeviceSize size, const Buffer &stagingBuffer, Buffer *dstBuffer);
     VkResult createUniformBuffer(const Device &device, VkDeviceSize size, Buffer *dstBuffer);
+    VkResult createIndirectBuffer(const Device &device, VkDeviceSize size, Buffer *dstBuffer);
+    VkResult createReadbackBuffer(const Device &device, VkDeviceSize size, Buffer *dstBuffer);
 }
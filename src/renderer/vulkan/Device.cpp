@@ -26,7 +26,7 @@ namespace vk
 
     // internal helper functions for device and swapchain creation
     static VkResult selectPhysicalDevice(const VkInstance &instance, const VkSurfaceKHR &surface, Device *device);
-    static VkResult createLogicalDevice(Device *device);
+    static VkResult createLogicalDevice(Device *device, bool presentationEnabled);
     static void getBestPhysicalDevice(const VkPhysicalDevice *devices, size_t count, const VkSurfaceKHR &surface, Device *device);
     static bool deviceExtensionsSupported(const VkPhysicalDevice &device, const char **requested, size_t count);
     static void getSwapChainInfo(const VkPhysicalDevice devices, const VkSurfaceKHR &surface, SwapChainInfo *scInfo);
@@ -39,7 +39,7 @@ namespace vk
     {
         Device device;
         VK_VERIFY(selectPhysicalDevice(instance, surface, &device));
-        VK_VERIFY(createLogicalDevice(&device));
+        VK_VERIFY(createLogicalDevice(&device, surface != VK_NULL_HANDLE));
 
         vkGetDeviceQueue(device.logical, device.graphicsFamilyIndex, 0, &device.graphicsQueue);
         vkGetDeviceQueue(device.logical, device.presentFamilyIndex, 0, &device.presentQueue);
@@ -66,6 +66,8 @@ namespace vk
         if (swapChain->presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
             imageCount = std::max(3, (int)scInfo.surfaceCaps.minImageCount);
 
+        imageCount = std::max(imageCount, swapChain->preferredImageCount);
+
         if (scInfo.surfaceCaps.maxImageCount > 0)
             imageCount = std::min(imageCount, scInfo.surfaceCaps.maxImageCount);
 
@@ -136,7 +138,7 @@ namespace vk
         return VK_SUCCESS;
     }
 
-    VkResult createLogicalDevice(Device *device)
+    VkResult createLogicalDevice(Device *device, bool presentationEnabled)
     {
         LOG_MESSAGE_ASSERT(device->physical != VK_NULL_HANDLE, "Invalid physical device!");
         // at least one queue (graphics and present combined) has to be present
@@ -158,6 +160,11 @@ namespace vk
         wantedDeviceFeatures.samplerAnisotropy = device->features.samplerAnisotropy;
         wantedDeviceFeatures.fillModeNonSolid  = device->features.fillModeNonSolid;  // for wireframe rendering
         wantedDeviceFeatures.sampleRateShading = device->features.sampleRateShading; // for sample shading
+        wantedDeviceFeatures.multiDrawIndirect = device->features.multiDrawIndirect; // for batched indirect draws
+        wantedDeviceFeatures.tessellationShader = device->features.tessellationShader; // for hardware tesselated patches
+        wantedDeviceFeatures.textureCompressionBC = device->features.textureCompressionBC;     // for baked texture containers
+        wantedDeviceFeatures.textureCompressionETC2 = device->features.textureCompressionETC2;
+        wantedDeviceFeatures.textureCompressionASTC_LDR = device->features.textureCompressionASTC_LDR;
 
         // a graphics and present queue are different - two queues have to be created
         if (device->graphicsFamilyIndex != device->presentFamilyIndex)
@@ -174,8 +181,19 @@ namespace vk
         VkDeviceCreateInfo deviceCreateInfo = {};
         deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
         deviceCreateInfo.pEnabledFeatures = &wantedDeviceFeatures;
-        deviceCreateInfo.ppEnabledExtensionNames = devExtensions.data();
-        deviceCreateInfo.enabledExtensionCount = (uint32_t)devExtensions.size();
+        // optional extensions
+        std::vector<const char *> enabledExtensions;
+        if (presentationEnabled)
+            enabledExtensions = devExtensions;
+        const char *memoryBudgetExt = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+        if (device->properties.apiVersion >= VK_API_VERSION_1_1 && deviceExtensionsSupported(device->physical, &memoryBudgetExt, 1))
+        {
+            enabledExtensions.push_back(memoryBudgetExt);
+            device->memoryBudgetSupported = true;
+        }
+
+        deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
+        deviceCreateInfo.enabledExtensionCount = (uint32_t)enabledExtensions.size();
         deviceCreateInfo.queueCreateInfoCount = numQueues;
         deviceCreateInfo.pQueueCreateInfos = queueCreateInfo;
 
@@ -207,7 +225,8 @@ namespace vk
 
                 // check if requested device extensions are present
 #ifndef __ANDROID__
-                bool extSupported = deviceExtensionsSupported(devices[i], devExtensions.data(), devExtensions.size());
+                // swapchain is not needed when rendering offscreen
+                bool extSupported = surface == VK_NULL_HANDLE || deviceExtensionsSupported(devices[i], devExtensions.data(), devExtensions.size());
 
                 // no required extensions? try next device
                 if (!extSupported || !deviceFeatures.samplerAnisotropy || !deviceFeatures.fillModeNonSolid)
@@ -215,10 +234,13 @@ namespace vk
 
                 // if extensions are fine, query swap chain details and see if we can use this device
                 SwapChainInfo scInfo = {};
-                getSwapChainInfo(devices[i], surface, &scInfo);
+                if (surface != VK_NULL_HANDLE)
+                {
+                    getSwapChainInfo(devices[i], surface, &scInfo);
 
-                if (scInfo.formatCount == 0 || scInfo.presentModesCount == 0)
-                    continue;
+                    if (scInfo.formatCount == 0 || scInfo.presentModesCount == 0)
+                        continue;
+                }
 #endif
 
                 VkQueueFamilyProperties *queueFamilies = new VkQueueFamilyProperties[queueFamilyCount];
@@ -227,9 +249,10 @@ namespace vk
                 // secondary check - device is OK if there's at least on queue with VK_QUEUE_GRAPHICS_BIT set
                 for (uint32_t j = 0; j < queueFamilyCount; ++j)
                 {
-                    // check if this queue family has support for presentation
-                    VkBool32 presentSupported;
-                    VK_VERIFY(vkGetPhysicalDeviceSurfaceSupportKHR(devices[i], j, surface, &presentSupported));
+                    // check if this queue family has support for presentation (headless - graphics queue "presents" by copying images to the CPU)
+                    VkBool32 presentSupported = queueFamilies[j].queueFlags & VK_QUEUE_GRAPHICS_BIT ? VK_TRUE : VK_FALSE;
+                    if (surface != VK_NULL_HANDLE)
+                        VK_VERIFY(vkGetPhysicalDeviceSurfaceSupportKHR(devices[i], j, surface, &presentSupported));
 
                     // good optimization would be to find a queue where presentIdx == queueIdx for less overhead
                     if (device->presentFamilyIndex < 0 && queueFamilies[j].queueCount > 0 && presentSupported)
@@ -267,6 +290,36 @@ namespace vk
         }
     }
 
+    void getMemoryBudget(const VkInstance &instance, const Device &device, VkDeviceSize *budget, VkDeviceSize *usage)
+    {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProps = {};
+        budgetProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 memProps = {};
+        memProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memProps.pNext = &budgetProps;
+
+        auto getMemoryProperties2 = (PFN_vkGetPhysicalDeviceMemoryProperties2)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2");
+        bool hasBudget = device.memoryBudgetSupported && getMemoryProperties2;
+
+        if (hasBudget)
+            getMemoryProperties2(device.physical, &memProps);
+        else
+            vkGetPhysicalDeviceMemoryProperties(device.physical, &memProps.memoryProperties);
+
+        *budget = 0;
+        *usage  = 0;
+        for (uint32_t i = 0; i < memProps.memoryProperties.memoryHeapCount; ++i)
+        {
+            if (!(memProps.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+                continue;
+
+            // without the extension assume 80% of the heap is available (same heuristic as VMA uses)
+            *budget += hasBudget ? budgetProps.heapBudget[i] : memProps.memoryProperties.memoryHeaps[i].size * 8 / 10;
+            *usage  += hasBudget ? budgetProps.heapUsage[i] : 0;
+        }
+    }
+
     bool deviceExtensionsSupported(const VkPhysicalDevice &device, const char **requested, size_t count)
     {
         uint32_t extCount;
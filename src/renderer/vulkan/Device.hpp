@@ -13,11 +13,16 @@ namespace vk
         VkSwapchainKHR sc = VK_NULL_HANDLE;
         VkFormat format = VK_FORMAT_UNDEFINED;
         VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAX_ENUM_KHR;
+        uint32_t preferredImageCount = 0; // 0 - pick based on present mode
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; // layout of images after rendering (TRANSFER_SRC for offscreen images read back by the CPU)
         VkExtent2D extent = { 0, 0 };
         std::vector<VkImage> images;
     };
 
 
+    // surface can be null for headless rendering - swapchain extension and presentation support are not required then
     Device   createDevice(const VkInstance &instance, const VkSurfaceKHR &surface);
     VkResult createSwapChain(const Device &device, const VkSurfaceKHR &surface, SwapChain *swapChain, VkSwapchainKHR oldSwapchain);
+    // memory available to the application and currently used by it in device local heaps (usage is 0 if VK_EXT_memory_budget is not supported)
+    void getMemoryBudget(const VkInstance &instance, const Device &device, VkDeviceSize *budget, VkDeviceSize *usage);
 }
\ No newline at end of file
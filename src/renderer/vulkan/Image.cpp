@@ -1,19 +1,52 @@
 #include "renderer/vulkan/CmdBuffer.hpp"
 #include "renderer/vulkan/Image.hpp"
 #include "renderer/vulkan/Buffers.hpp"
+#include "renderer/vulkan/Upload.hpp"
 #include "Utils.hpp"
+#include <algorithm>
 
 namespace vk
 {
     // internal helpers
     static void transitionImageLayout(const Device &device, const VkCommandBuffer &cmdBuffer, const VkQueue &queue, const Texture &texture, const VkImageLayout &oldLayout, const VkImageLayout &newLayout);
-    static void copyBufferToImage(const VkCommandBuffer &cmdBuffer, const VkBuffer &buffer, const VkImage &image, uint32_t width, uint32_t height);
+    static void copyBufferToImage(const VkCommandBuffer &cmdBuffer, const VkBuffer &buffer, VkDeviceSize bufferOffset, const VkImage &image, uint32_t width, uint32_t height);
     static VkResult createImage(const Device &device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VmaMemoryUsage memUsage, Texture *texture);
     static void generateMipmaps(const VkCommandBuffer &cmdBuffer, const Texture &texture, uint32_t width, uint32_t height);
     static VkImageAspectFlags getDepthStencilAspect(VkFormat depthFormat);
+    static void imageBarrier(const VkCommandBuffer &cmdBuffer, const VkImage &image, uint32_t mipLevels, VkImageLayout oldLayout, VkImageLayout newLayout,
+                             VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage);
 
     void createTextureImage(const Device &device, Texture *dstTex, const unsigned char *data, uint32_t width, uint32_t height)
     {
+        VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        // set extra image usage flag if we're dealing with mipmapped image - will need it for copying data between mip levels
+        if (dstTex->mipLevels > 1)
+            imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+        if (device.uploadQueue)
+        {
+            uint32_t texelSize = dstTex->format == VK_FORMAT_R8G8B8_UNORM ? 3 : 4;
+            VK_VERIFY(createImage(device, width, height, dstTex->format, VK_IMAGE_TILING_OPTIMAL, imageUsage, VMA_MEMORY_USAGE_GPU_ONLY, dstTex));
+
+            // buffer offset has to be a multiple of both texel size and 4
+            VkBuffer srcBuffer;
+            VkDeviceSize srcOffset;
+            VkCommandBuffer transferCmdBuffer = stageUpload(device, *device.uploadQueue, data, width * height * texelSize, texelSize * 4, &srcBuffer, &srcOffset);
+
+            transitionImageLayout(device, transferCmdBuffer, device.transferQueue, *dstTex, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+            copyBufferToImage(transferCmdBuffer, srcBuffer, srcOffset, dstTex->image, width, height);
+
+            // mipmaps and final layout are recorded on graphics queue once all transfers of the batch are complete (vkCmdBlitImage requires GRAPHICS_BIT)
+            VkCommandBuffer drawCmdBuffer = uploadGraphicsCommand(*device.uploadQueue);
+            if (dstTex->mipLevels > 1)
+                generateMipmaps(drawCmdBuffer, *dstTex, width, height);
+            else
+                transitionImageLayout(device, drawCmdBuffer, device.graphicsQueue, *dstTex, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+            finishUpload(device, *device.uploadQueue, width * height * texelSize);
+            return;
+        }
+
         Buffer stagingBuffer;
         bool unifiedTransferAndGfx = device.transferQueue == device.graphicsQueue;
         uint32_t imageSize = width * height * (dstTex->format == VK_FORMAT_R8G8B8_UNORM ? 3 : 4);
@@ -25,11 +58,6 @@ namespace vk
         memcpy(imgData, data, (size_t)imageSize);
         vmaUnmapMemory(device.allocator, stagingBuffer.allocation);
 
-        VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-        // set extra image usage flag if we're dealing with mipmapped image - will need it for copying data between mip levels
-        if (dstTex->mipLevels > 1)
-            imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-
         VK_VERIFY(createImage(device, width, height, dstTex->format, VK_IMAGE_TILING_OPTIMAL, imageUsage, VMA_MEMORY_USAGE_GPU_ONLY, dstTex));
 
         // copy buffers
@@ -38,7 +66,7 @@ namespace vk
 
         beginCommand(transferCmdBuffer);
         transitionImageLayout(device, transferCmdBuffer, device.transferQueue, *dstTex, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-        copyBufferToImage(transferCmdBuffer, stagingBuffer.buffer, dstTex->image, width, height);
+        copyBufferToImage(transferCmdBuffer, stagingBuffer.buffer, 0, dstTex->image, width, height);
 
         if (dstTex->mipLevels > 1)
         {
@@ -82,6 +110,186 @@ namespace vk
         VK_VERIFY(createTextureSampler(device, dstTex));
     }
 
+    void createTextureImageFromMips(const Device &device, Texture *dstTex, const unsigned char *data, uint32_t width, uint32_t height)
+    {
+        std::vector<VkBufferImageCopy> regions(dstTex->mipLevels);
+        VkDeviceSize dataSize = 0;
+
+        // one copy region per mip level, all sourced from a single staging allocation
+        for (uint32_t i = 0; i < dstTex->mipLevels; ++i)
+        {
+            uint32_t mipWidth  = std::max(1u, width >> i);
+            uint32_t mipHeight = std::max(1u, height >> i);
+
+            regions[i] = {};
+            regions[i].bufferOffset = dataSize;
+            regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            regions[i].imageSubresource.mipLevel = i;
+            regions[i].imageSubresource.layerCount = 1;
+            regions[i].imageExtent = { mipWidth, mipHeight, 1 };
+
+            dataSize += getMipLevelSize(dstTex->format, mipWidth, mipHeight);
+        }
+
+        // transfer source usage allows evicting top mips later on without reloading the texture
+        VK_VERIFY(createImage(device, width, height, dstTex->format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VMA_MEMORY_USAGE_GPU_ONLY, dstTex));
+
+        if (device.uploadQueue)
+        {
+            // 16 byte alignment satisfies both block size and texel size requirements of all used formats
+            VkBuffer srcBuffer;
+            VkDeviceSize srcOffset;
+            VkCommandBuffer transferCmdBuffer = stageUpload(device, *device.uploadQueue, data, dataSize, 16, &srcBuffer, &srcOffset);
+
+            for (auto &r : regions)
+                r.bufferOffset += srcOffset;
+
+            transitionImageLayout(device, transferCmdBuffer, device.transferQueue, *dstTex, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+            vkCmdCopyBufferToImage(transferCmdBuffer, srcBuffer, dstTex->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)regions.size(), regions.data());
+            transitionImageLayout(device, uploadGraphicsCommand(*device.uploadQueue), device.graphicsQueue, *dstTex, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+            finishUpload(device, *device.uploadQueue, dataSize);
+            return;
+        }
+
+        Buffer stagingBuffer;
+        VK_VERIFY(createStagingBuffer(device, dataSize, &stagingBuffer));
+
+        void *imgData;
+        vmaMapMemory(device.allocator, stagingBuffer.allocation, &imgData);
+        memcpy(imgData, data, (size_t)dataSize);
+        vmaUnmapMemory(device.allocator, stagingBuffer.allocation);
+
+        // no mipmap generation needed, so the entire upload can be done on graphics queue
+        VkCommandBuffer cmdBuffer = createCommandBuffer(device, device.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+        beginCommand(cmdBuffer);
+        transitionImageLayout(device, cmdBuffer, device.graphicsQueue, *dstTex, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        vkCmdCopyBufferToImage(cmdBuffer, stagingBuffer.buffer, dstTex->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)regions.size(), regions.data());
+        transitionImageLayout(device, cmdBuffer, device.graphicsQueue, *dstTex, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        submitCommand(device, cmdBuffer, device.graphicsQueue);
+        vkFreeCommandBuffers(device.logical, device.commandPool, 1, &cmdBuffer);
+
+        freeBuffer(device, stagingBuffer);
+    }
+
+    void createTextureFromMips(const Device &device, Texture *dstTex, const unsigned char *data, uint32_t width, uint32_t height)
+    {
+        createTextureImageFromMips(device, dstTex, data, width, height);
+        VK_VERIFY(createImageView(device, dstTex->image, VK_IMAGE_ASPECT_COLOR_BIT, &dstTex->imageView, dstTex->format, dstTex->mipLevels));
+        VK_VERIFY(createTextureSampler(device, dstTex));
+    }
+
+    void createTextureFromMipRange(const Device &device, const Texture &srcTex, uint32_t firstMip, uint32_t width, uint32_t height, Texture *dstTex)
+    {
+        uint32_t dstWidth  = std::max(1u, width >> firstMip);
+        uint32_t dstHeight = std::max(1u, height >> firstMip);
+        dstTex->format = srcTex.format;
+        dstTex->mipLevels = srcTex.mipLevels - firstMip;
+        dstTex->minFilter = srcTex.minFilter;
+        dstTex->magFilter = srcTex.magFilter;
+
+        std::vector<VkImageCopy> regions(dstTex->mipLevels);
+        for (uint32_t i = 0; i < dstTex->mipLevels; ++i)
+        {
+            regions[i] = {};
+            regions[i].srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            regions[i].srcSubresource.mipLevel = firstMip + i;
+            regions[i].srcSubresource.layerCount = 1;
+            regions[i].dstSubresource = regions[i].srcSubresource;
+            regions[i].dstSubresource.mipLevel = i;
+            regions[i].extent = { std::max(1u, dstWidth >> i), std::max(1u, dstHeight >> i), 1 };
+        }
+
+        VK_VERIFY(createImage(device, dstWidth, dstHeight, dstTex->format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VMA_MEMORY_USAGE_GPU_ONLY, dstTex));
+
+        // everything is done on graphics queue - source image is owned by it and may still be sampled by frames in flight
+        VkCommandBuffer cmdBuffer;
+        if (device.uploadQueue)
+        {
+            cmdBuffer = beginGraphicsUpload(device, *device.uploadQueue);
+        }
+        else
+        {
+            cmdBuffer = createCommandBuffer(device, device.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+            beginCommand(cmdBuffer);
+        }
+
+        imageBarrier(cmdBuffer, srcTex.image, srcTex.mipLevels, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                     VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        imageBarrier(cmdBuffer, dstTex->image, dstTex->mipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                     0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+        vkCmdCopyImage(cmdBuffer, srcTex.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dstTex->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)regions.size(), regions.data());
+
+        // source goes back to its original layout, since it's released only after all frames using it are complete
+        imageBarrier(cmdBuffer, srcTex.image, srcTex.mipLevels, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                     VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        imageBarrier(cmdBuffer, dstTex->image, dstTex->mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                     VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+        if (device.uploadQueue)
+        {
+            finishUpload(device, *device.uploadQueue, 0);
+        }
+        else
+        {
+            submitCommand(device, cmdBuffer, device.graphicsQueue);
+            vkFreeCommandBuffers(device.logical, device.commandPool, 1, &cmdBuffer);
+        }
+
+        VK_VERIFY(createImageView(device, dstTex->image, VK_IMAGE_ASPECT_COLOR_BIT, &dstTex->imageView, dstTex->format, dstTex->mipLevels));
+        VK_VERIFY(createTextureSampler(device, dstTex));
+    }
+
+    VkDeviceSize getMipLevelSize(VkFormat format, uint32_t width, uint32_t height)
+    {
+        VkDeviceSize numBlocks = ((width + 3) / 4) * ((height + 3) / 4);
+
+        switch (format)
+        {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+            return numBlocks * 8;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+        case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+            return numBlocks * 16;
+        case VK_FORMAT_R8G8B8_UNORM:
+            return width * height * 3;
+        default:
+            return width * height * 4;
+        }
+    }
+
+    bool isFormatSampleable(const Device &device, VkFormat format)
+    {
+        // block compressed formats additionally require the corresponding device feature (enabled whenever available)
+        switch (format)
+        {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+            if (!device.features.textureCompressionBC) return false;
+            break;
+        case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+            if (!device.features.textureCompressionETC2) return false;
+            break;
+        case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+            if (!device.features.textureCompressionASTC_LDR) return false;
+            break;
+        default:
+            break;
+        }
+
+        VkFormatProperties fp = {};
+        vkGetPhysicalDeviceFormatProperties(device.physical, format, &fp);
+        return (fp.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+    }
+
     void releaseTexture(const Device &device, Texture &texture)
     {
         if (texture.image != VK_NULL_HANDLE)
@@ -174,6 +382,17 @@ namespace vk
         return depthTexture;
     }
 
+    Texture createRenderTarget(const Device &device, const SwapChain &swapChain)
+    {
+        Texture renderTarget;
+        renderTarget.format = swapChain.format;
+
+        // initial layout transition is done by the render pass
+        VK_VERIFY(createImage(device, swapChain.extent.width, swapChain.extent.height, renderTarget.format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_GPU_ONLY, &renderTarget));
+
+        return renderTarget;
+    }
+
     void transitionImageLayout(const Device &device, const VkCommandBuffer &cmdBuffer, const VkQueue &queue, const Texture &texture, const VkImageLayout &oldLayout, const VkImageLayout &newLayout)
     {
         VkPipelineStageFlags srcStage;
@@ -272,10 +491,10 @@ namespace vk
         vkCmdPipelineBarrier(cmdBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &imgBarrier);
     }
 
-    void copyBufferToImage(const VkCommandBuffer &cmdBuffer, const VkBuffer &buffer, const VkImage &image, uint32_t width, uint32_t height)
+    void copyBufferToImage(const VkCommandBuffer &cmdBuffer, const VkBuffer &buffer, VkDeviceSize bufferOffset, const VkImage &image, uint32_t width, uint32_t height)
     {
         VkBufferImageCopy region = {};
-        region.bufferOffset = 0;
+        region.bufferOffset = bufferOffset;
         region.bufferRowLength = 0;
         region.bufferImageHeight = 0;
         region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -401,4 +620,25 @@ namespace vk
             return VK_IMAGE_ASPECT_DEPTH_BIT;
         }
     }
+
+    void imageBarrier(const VkCommandBuffer &cmdBuffer, const VkImage &image, uint32_t mipLevels, VkImageLayout oldLayout, VkImageLayout newLayout,
+                      VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage)
+    {
+        VkImageMemoryBarrier imgBarrier = {};
+        imgBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imgBarrier.oldLayout = oldLayout;
+        imgBarrier.newLayout = newLayout;
+        imgBarrier.srcAccessMask = srcAccess;
+        imgBarrier.dstAccessMask = dstAccess;
+        imgBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imgBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imgBarrier.image = image;
+        imgBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        imgBarrier.subresourceRange.baseMipLevel = 0;
+        imgBarrier.subresourceRange.levelCount = mipLevels;
+        imgBarrier.subresourceRange.baseArrayLayer = 0;
+        imgBarrier.subresourceRange.layerCount = 1;
+
+        vkCmdPipelineBarrier(cmdBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &imgBarrier);
+    }
 }
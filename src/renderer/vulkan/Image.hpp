@@ -31,9 +31,18 @@ namespace vk
 
     void createTextureImage(const Device &device, Texture *dstTex, const unsigned char *data, uint32_t width, uint32_t height);
     void createTexture(const Device &device, Texture *dstTex, const unsigned char *data, uint32_t width, uint32_t height);
+    // data holds all dstTex->mipLevels levels tightly packed (mip 0 first) - used for offline generated mips and block compressed formats
+    void createTextureImageFromMips(const Device &device, Texture *dstTex, const unsigned char *data, uint32_t width, uint32_t height);
+    void createTextureFromMips(const Device &device, Texture *dstTex, const unsigned char *data, uint32_t width, uint32_t height);
+    // create dstTex out of mips [firstMip, srcTex.mipLevels) of srcTex (width and height of its mip 0) - copy is done on the GPU
+    void createTextureFromMipRange(const Device &device, const Texture &srcTex, uint32_t firstMip, uint32_t width, uint32_t height, Texture *dstTex);
+    VkDeviceSize getMipLevelSize(VkFormat format, uint32_t width, uint32_t height);
+    bool isFormatSampleable(const Device &device, VkFormat format);
     void releaseTexture(const Device &device, Texture &texture);
     VkResult createImageView(const Device &device, const VkImage &image, VkImageAspectFlags aspectFlags, VkImageView *imageView, VkFormat format, uint32_t mipLevels);
     VkResult createTextureSampler(const Device &device, Texture *texture);
     Texture  createColorBuffer(const Device &device, const SwapChain &swapChain, VkSampleCountFlagBits sampleCount);
     Texture  createDepthBuffer(const Device &device, const SwapChain &swapChain, VkSampleCountFlagBits sampleCount);
+    // single sampled color target which can be copied from - used in place of swapchain images when rendering offscreen
+    Texture  createRenderTarget(const Device &device, const SwapChain &swapChain);
 }
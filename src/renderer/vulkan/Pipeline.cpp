@@ -1,6 +1,15 @@
 #include "renderer/vulkan/Pipeline.hpp"
 #include "Utils.hpp"
+#include <cstdio>
 #include <fstream>
+#include <iterator>
+#include <string.h>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
 #ifdef __ANDROID__
 #include <android/asset_manager.h>
 
@@ -13,6 +22,8 @@ namespace vk
     {
         VkShaderModule vertShader = VK_NULL_HANDLE;
         VkShaderModule fragShader = VK_NULL_HANDLE;
+        VkShaderModule tescShader = VK_NULL_HANDLE;
+        VkShaderModule teseShader = VK_NULL_HANDLE;
     };
 
     static VkShaderModule createShaderModule(const Device &device, const uint32_t *shaderSrc, size_t codeSize)
@@ -77,22 +88,46 @@ namespace vk
         return shader;
     }
 
+    static VkShaderModule loadShaderModule(const Device &device, const char *filename)
+    {
+        size_t shaderSize = 0;
+        uint32_t *shaderSrc = ReadShaderFromFile(filename, &shaderSize);
+        VkShaderModule shaderModule = createShaderModule(device, shaderSrc, shaderSize);
+        delete[] shaderSrc;
+
+        return shaderModule;
+    }
+
+    static VkPipelineShaderStageCreateInfo shaderStageInfo(VkShaderStageFlagBits stage, VkShaderModule module)
+    {
+        VkPipelineShaderStageCreateInfo ssCreateInfo = {};
+        ssCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        ssCreateInfo.stage = stage;
+        ssCreateInfo.module = module;
+        ssCreateInfo.pName = "main";
+
+        return ssCreateInfo;
+    }
+
     VkResult createPipeline(const Device &device, const SwapChain &swapChain, const RenderPass &renderPass, const VkDescriptorSetLayout &descriptorLayout, const VertexBufferInfo *vbInfo, Pipeline *pipeline, const char **shaders)
     {
-        ShaderProgram shader = loadShader(device, shaders[0], shaders[1]);
+        // tesselation pipelines expect shaders in order: vertex, tess control, tess evaluation, fragment
+        bool tesselation = pipeline->patchControlPoints > 0;
+        ShaderProgram shader = loadShader(device, shaders[0], tesselation ? shaders[3] : shaders[1]);
+        uint32_t stageCount = 2;
 
-        VkPipelineShaderStageCreateInfo vssCreateInfo = {};
-        vssCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        vssCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-        vssCreateInfo.module = shader.vertShader;
-        vssCreateInfo.pName = "main";
-        VkPipelineShaderStageCreateInfo fssCreateInfo = {};
-        fssCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        fssCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        fssCreateInfo.module = shader.fragShader;
-        fssCreateInfo.pName = "main";
+        VkPipelineShaderStageCreateInfo ssCreateInfos[4];
+        ssCreateInfos[0] = shaderStageInfo(VK_SHADER_STAGE_VERTEX_BIT, shader.vertShader);
+        ssCreateInfos[1] = shaderStageInfo(VK_SHADER_STAGE_FRAGMENT_BIT, shader.fragShader);
 
-        VkPipelineShaderStageCreateInfo ssCreateInfos[] = { vssCreateInfo, fssCreateInfo };
+        if (tesselation)
+        {
+            shader.tescShader = loadShaderModule(device, shaders[1]);
+            shader.teseShader = loadShaderModule(device, shaders[2]);
+            ssCreateInfos[2] = shaderStageInfo(VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, shader.tescShader);
+            ssCreateInfos[3] = shaderStageInfo(VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, shader.teseShader);
+            stageCount = 4;
+        }
 
         // fixed functions setup
         VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
@@ -104,9 +139,13 @@ namespace vk
 
         VkPipelineInputAssemblyStateCreateInfo iaCreateInfo = {};
         iaCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        iaCreateInfo.topology = pipeline->topology;
+        iaCreateInfo.topology = tesselation ? VK_PRIMITIVE_TOPOLOGY_PATCH_LIST : pipeline->topology;
         iaCreateInfo.primitiveRestartEnable = VK_FALSE;
 
+        VkPipelineTessellationStateCreateInfo tsCreateInfo = {};
+        tsCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
+        tsCreateInfo.patchControlPoints = pipeline->patchControlPoints;
+
         VkViewport viewport = {};
         viewport.x = 0.f;
         viewport.y = 0.f;
@@ -210,10 +249,11 @@ namespace vk
         // create THE pipeline
         VkGraphicsPipelineCreateInfo pCreateInfo = {};
         pCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pCreateInfo.stageCount = 2;
+        pCreateInfo.stageCount = stageCount;
         pCreateInfo.pStages = ssCreateInfos;
         pCreateInfo.pVertexInputState = &vertexInputInfo;
         pCreateInfo.pInputAssemblyState = &iaCreateInfo;
+        pCreateInfo.pTessellationState = tesselation ? &tsCreateInfo : nullptr;
         pCreateInfo.pViewportState = &vpCreateInfo;
         pCreateInfo.pRasterizationState = &rCreateInfo;
         pCreateInfo.pMultisampleState = &msCreateInfo;
@@ -230,6 +270,11 @@ namespace vk
         VkResult pResult = vkCreateGraphicsPipelines(device.logical, pipeline->cache, 1, &pCreateInfo, nullptr, &pipeline->pipeline);
         vkDestroyShaderModule(device.logical, shader.vertShader, nullptr);
         vkDestroyShaderModule(device.logical, shader.fragShader, nullptr);
+        if (tesselation)
+        {
+            vkDestroyShaderModule(device.logical, shader.tescShader, nullptr);
+            vkDestroyShaderModule(device.logical, shader.teseShader, nullptr);
+        }
 
         return pResult;
     }
@@ -259,7 +304,7 @@ namespace vk
         if (msaaEnabled)
             colorAttachmentDesc.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
         else
-            colorAttachmentDesc.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+            colorAttachmentDesc.finalLayout = swapChain.finalLayout;
 
         VkAttachmentDescription depthAttachmentDesc = {};
         depthAttachmentDesc.format = getBestDepthFormat(device);
@@ -280,7 +325,7 @@ namespace vk
         colorAttachmentResolveMSAA.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         colorAttachmentResolveMSAA.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         colorAttachmentResolveMSAA.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachmentResolveMSAA.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        colorAttachmentResolveMSAA.finalLayout = swapChain.finalLayout;
 
         VkAttachmentReference colorAttachmentRef = {};
         colorAttachmentRef.attachment = 0;
@@ -331,5 +376,111 @@ namespace vk
         if (renderPass.renderPass != VK_NULL_HANDLE)
             vkDestroyRenderPass(device.logical, renderPass.renderPass, nullptr);
     }
-}
 
+    // header written by the driver at the start of pipeline cache data (VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+    struct PipelineCacheHeader
+    {
+        uint32_t headerSize;
+        uint32_t headerVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+    };
+
+    static bool pipelineCacheValid(const Device &device, const std::vector<char> &data)
+    {
+        PipelineCacheHeader header;
+        if (data.size() < sizeof(header))
+            return false;
+
+        memcpy(&header, data.data(), sizeof(header));
+        return header.headerSize >= sizeof(header) && header.headerSize <= data.size() &&
+               header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+               header.vendorID == device.properties.vendorID &&
+               header.deviceID == device.properties.deviceID &&
+               !memcmp(header.pipelineCacheUUID, device.properties.pipelineCacheUUID, VK_UUID_SIZE);
+    }
+
+    VkResult createPipelineCache(const Device &device, const char *filename, VkPipelineCache *cache, PipelineCacheStatus *status)
+    {
+        PipelineCacheStatus cacheStatus = PipelineCacheEmpty;
+        std::vector<char> data;
+        std::ifstream file(filename, std::ios::binary);
+        if (file.is_open())
+        {
+            data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+            // data from a different GPU or driver version is useless at best - start with an empty cache instead
+            if (!pipelineCacheValid(device, data))
+            {
+                LOG_MESSAGE("Discarding incompatible pipeline cache: " << filename);
+                cacheStatus = PipelineCacheIncompatible;
+                data.clear();
+            }
+        }
+
+        VkPipelineCacheCreateInfo pcInfo = {};
+        pcInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        pcInfo.initialDataSize = data.size();
+        pcInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+        VkResult result = vkCreatePipelineCache(device.logical, &pcInfo, nullptr, cache);
+
+        // driver can still reject the data - retry without it
+        if (result != VK_SUCCESS && !data.empty())
+        {
+            LOG_MESSAGE("Pipeline cache rejected by driver: " << filename);
+            cacheStatus = PipelineCacheRejected;
+            pcInfo.initialDataSize = 0;
+            pcInfo.pInitialData = nullptr;
+            result = vkCreatePipelineCache(device.logical, &pcInfo, nullptr, cache);
+        }
+        else if (!data.empty())
+        {
+            LOG_MESSAGE("Loaded pipeline cache: " << filename << " (" << data.size() << " bytes)");
+            cacheStatus = PipelineCacheLoaded;
+        }
+
+        if (status)
+            *status = cacheStatus;
+
+        return result;
+    }
+
+    bool savePipelineCache(const Device &device, const VkPipelineCache &cache, const char *filename)
+    {
+        size_t dataSize = 0;
+        if (vkGetPipelineCacheData(device.logical, cache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+            return false;
+
+        std::vector<char> data(dataSize);
+        if (vkGetPipelineCacheData(device.logical, cache, &dataSize, data.data()) != VK_SUCCESS)
+            return false;
+
+        // write to a temporary file first and swap it in place, so that a crash midway never leaves a corrupt cache behind
+        std::string tmpFilename = std::string(filename) + ".tmp";
+        {
+            std::ofstream file(tmpFilename.c_str(), std::ios::binary | std::ios::trunc);
+            if (!file.is_open())
+                return false;
+
+            file.write(data.data(), dataSize);
+            file.close();
+            if (!file.good())
+            {
+                remove(tmpFilename.c_str());
+                return false;
+            }
+        }
+
+#ifdef _WIN32
+        bool renamed = MoveFileExA(tmpFilename.c_str(), filename, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        bool renamed = rename(tmpFilename.c_str(), filename) == 0;
+#endif
+        if (!renamed)
+            remove(tmpFilename.c_str());
+
+        return renamed;
+    }
+}
@@ -23,6 +23,16 @@ namespace vk
         VkBlendFactor blendMode = VK_BLEND_FACTOR_ZERO;
         VkBool32 depthTestEnable = VK_TRUE;
         float minSampleShading = -1.f; // sample shading minimum fraction - >= 0 to enable
+        uint32_t patchControlPoints = 0; // > 0 enables tesselation stages (shaders: vert, tesc, tese, frag)
+    };
+
+    // what happened to pipeline cache data found on disk
+    enum PipelineCacheStatus
+    {
+        PipelineCacheEmpty,        // no cache file
+        PipelineCacheLoaded,
+        PipelineCacheIncompatible, // created by a different device or driver
+        PipelineCacheRejected      // rejected by the driver
     };
 
     struct RenderPass
@@ -37,4 +47,7 @@ namespace vk
     void     destroyPipeline(const Device &device, Pipeline &pipeline);
     VkResult createRenderPass(const Device &device, const SwapChain &swapChain, RenderPass *renderPass);
     void     destroyRenderPass(const Device &device, RenderPass &renderPass);
+    // pipeline cache is seeded from file if it was created by the same device and driver - empty cache otherwise
+    VkResult createPipelineCache(const Device &device, const char *filename, VkPipelineCache *cache, PipelineCacheStatus *status = nullptr);
+    bool     savePipelineCache(const Device &device, const VkPipelineCache &cache, const char *filename);
 }
@@ -0,0 +1,286 @@
+#include "renderer/vulkan/Upload.hpp"
+#include "renderer/vulkan/CmdBuffer.hpp"
+#include "Utils.hpp"
+
+namespace vk
+{
+    // internal helpers
+    static bool unifiedQueues(const Device &device) { return device.transferQueue == device.graphicsQueue; }
+
+    static bool ringAlloc(UploadQueue &queue, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *offset)
+    {
+        VkDeviceSize start = (queue.ringHead + alignment - 1) / alignment * alignment;
+
+        // free space at the end of the ring and (after wrapping around) at its start
+        if (queue.ringHead >= queue.ringTail)
+        {
+            if (start + size <= queue.ringSize)
+            {
+                *offset = start;
+                queue.ringHead = start + size;
+                return true;
+            }
+
+            // head must never catch up with tail - that state is reserved for an empty ring
+            if (size < queue.ringTail)
+            {
+                *offset = 0;
+                queue.ringHead = size;
+                return true;
+            }
+
+            return false;
+        }
+
+        // ring has wrapped around - free space lies between head and tail
+        if (start + size < queue.ringTail)
+        {
+            *offset = start;
+            queue.ringHead = start + size;
+            return true;
+        }
+
+        return false;
+    }
+
+    static bool retireBatch(const Device &device, UploadQueue &queue, UploadBatch &batch, bool wait)
+    {
+        if (!batch.pending)
+            return true;
+
+        if (wait)
+        {
+            VK_VERIFY(vkWaitForFences(device.logical, 1, &batch.fence, VK_TRUE, UINT64_MAX));
+        }
+        else if (vkGetFenceStatus(device.logical, batch.fence) != VK_SUCCESS)
+        {
+            return false;
+        }
+
+        vkResetFences(device.logical, 1, &batch.fence);
+
+        for (auto &b : batch.tempBuffers)
+            freeBuffer(device, b);
+        batch.tempBuffers.clear();
+
+        // batches complete in submission order, so everything up to the end of this one is free again
+        queue.ringTail = batch.ringEnd;
+        if (queue.ringTail == queue.ringHead)
+            queue.ringHead = queue.ringTail = 0;
+
+        batch.pending = false;
+        return true;
+    }
+
+    static void submitBatch(const Device &device, UploadQueue &queue)
+    {
+        UploadBatch &batch = queue.batches[queue.currentBatch];
+        if (!batch.recording)
+            return;
+
+        // make transfer results visible to everything recorded on graphics queue afterwards (vertex/index fetch, sampling)
+        VkMemoryBarrier memBarrier = {};
+        memBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(batch.graphicsCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &memBarrier, 0, nullptr, 0, nullptr);
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+
+        if (unifiedQueues(device))
+        {
+            VK_VERIFY(vkEndCommandBuffer(batch.transferCmd));
+            submitInfo.pCommandBuffers = &batch.transferCmd;
+            VK_VERIFY(vkQueueSubmit(device.transferQueue, 1, &submitInfo, batch.fence));
+        }
+        else
+        {
+            VK_VERIFY(vkEndCommandBuffer(batch.transferCmd));
+            VK_VERIFY(vkEndCommandBuffer(batch.graphicsCmd));
+
+            submitInfo.pCommandBuffers = &batch.transferCmd;
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &batch.semaphore;
+            VK_VERIFY(vkQueueSubmit(device.transferQueue, 1, &submitInfo, VK_NULL_HANDLE));
+
+            // graphics part of the batch waits for the transfers and signals batch completion
+            VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            submitInfo.pCommandBuffers = &batch.graphicsCmd;
+            submitInfo.signalSemaphoreCount = 0;
+            submitInfo.pSignalSemaphores = nullptr;
+            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pWaitSemaphores = &batch.semaphore;
+            submitInfo.pWaitDstStageMask = &waitStage;
+            VK_VERIFY(vkQueueSubmit(device.graphicsQueue, 1, &submitInfo, batch.fence));
+        }
+
+        batch.ringEnd = queue.ringHead;
+        batch.bytes = 0;
+        batch.recording = false;
+        batch.pending = true;
+        queue.currentBatch = (queue.currentBatch + 1) % UploadQueue::NUM_BATCHES;
+        queue.numSubmits++;
+    }
+
+    static UploadBatch &beginBatch(const Device &device, UploadQueue &queue)
+    {
+        UploadBatch &batch = queue.batches[queue.currentBatch];
+        if (batch.recording)
+            return batch;
+
+        // recycle the slot - this only blocks if all batches are still in flight
+        retireBatch(device, queue, batch, true);
+
+        VK_VERIFY(beginCommand(batch.transferCmd));
+        if (batch.graphicsCmd != batch.transferCmd)
+            VK_VERIFY(beginCommand(batch.graphicsCmd));
+
+        batch.recording = true;
+        return batch;
+    }
+
+    void createUploadQueue(const Device &device, VkDeviceSize ringSize, UploadQueue *queue)
+    {
+        VK_VERIFY(createStagingBuffer(device, ringSize, &queue->stagingRing));
+        VK_VERIFY(vmaMapMemory(device.allocator, queue->stagingRing.allocation, (void **)&queue->ringData));
+        queue->ringSize = ringSize;
+        queue->batchSize = ringSize / UploadQueue::NUM_BATCHES;
+
+        VkFenceCreateInfo fCreateInfo = {};
+        fCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        VkSemaphoreCreateInfo sCreateInfo = {};
+        sCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        for (auto &batch : queue->batches)
+        {
+            batch.transferCmd = createCommandBuffer(device, device.transferCommandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+            batch.graphicsCmd = batch.transferCmd;
+            VK_VERIFY(vkCreateFence(device.logical, &fCreateInfo, nullptr, &batch.fence));
+
+            if (!unifiedQueues(device))
+            {
+                batch.graphicsCmd = createCommandBuffer(device, device.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+                VK_VERIFY(vkCreateSemaphore(device.logical, &sCreateInfo, nullptr, &batch.semaphore));
+            }
+        }
+    }
+
+    void destroyUploadQueue(const Device &device, UploadQueue &queue)
+    {
+        waitUploads(device, queue);
+
+        for (auto &batch : queue.batches)
+        {
+            vkFreeCommandBuffers(device.logical, device.transferCommandPool, 1, &batch.transferCmd);
+            if (batch.graphicsCmd != batch.transferCmd)
+                vkFreeCommandBuffers(device.logical, device.commandPool, 1, &batch.graphicsCmd);
+            if (batch.semaphore != VK_NULL_HANDLE)
+                vkDestroySemaphore(device.logical, batch.semaphore, nullptr);
+            vkDestroyFence(device.logical, batch.fence, nullptr);
+        }
+
+        vmaUnmapMemory(device.allocator, queue.stagingRing.allocation);
+        freeBuffer(device, queue.stagingRing);
+        queue = UploadQueue();
+    }
+
+    VkCommandBuffer stageUpload(const Device &device, UploadQueue &queue, const void *data, VkDeviceSize size, VkDeviceSize alignment, VkBuffer *srcBuffer, VkDeviceSize *srcOffset)
+    {
+        // very large uploads would stall the ring, so they get a dedicated staging buffer released along with the batch
+        if (size > queue.ringSize / 2)
+        {
+            Buffer stagingBuffer;
+            VK_VERIFY(createStagingBuffer(device, size, &stagingBuffer));
+
+            void *dst;
+            vmaMapMemory(device.allocator, stagingBuffer.allocation, &dst);
+            memcpy(dst, data, (size_t)size);
+            vmaUnmapMemory(device.allocator, stagingBuffer.allocation);
+
+            UploadBatch &batch = beginBatch(device, queue);
+            batch.tempBuffers.push_back(stagingBuffer);
+            *srcBuffer = stagingBuffer.buffer;
+            *srcOffset = 0;
+            return batch.transferCmd;
+        }
+
+        // out of staging memory: submit whatever is recorded and wait for the oldest batch to free its part of the ring
+        while (!ringAlloc(queue, size, alignment, srcOffset))
+        {
+            submitBatch(device, queue);
+
+            for (int i = 0; i < UploadQueue::NUM_BATCHES; ++i)
+            {
+                UploadBatch &oldest = queue.batches[(queue.currentBatch + i) % UploadQueue::NUM_BATCHES];
+                if (oldest.pending)
+                {
+                    retireBatch(device, queue, oldest, true);
+                    break;
+                }
+            }
+        }
+
+        memcpy(queue.ringData + *srcOffset, data, (size_t)size);
+        *srcBuffer = queue.stagingRing.buffer;
+
+        return beginBatch(device, queue).transferCmd;
+    }
+
+    void uploadBuffer(const Device &device, UploadQueue &queue, const void *data, VkDeviceSize size, const Buffer &dstBuffer, VkDeviceSize dstOffset)
+    {
+        VkBuffer srcBuffer;
+        VkBufferCopy copyRegion = {};
+        copyRegion.dstOffset = dstOffset;
+        copyRegion.size = size;
+
+        VkCommandBuffer cmdBuffer = stageUpload(device, queue, data, size, 4, &srcBuffer, &copyRegion.srcOffset);
+        vkCmdCopyBuffer(cmdBuffer, srcBuffer, dstBuffer.buffer, 1, &copyRegion);
+        finishUpload(device, queue, size);
+    }
+
+    VkCommandBuffer uploadGraphicsCommand(const UploadQueue &queue)
+    {
+        const UploadBatch &batch = queue.batches[queue.currentBatch];
+        LOG_MESSAGE_ASSERT(batch.recording, "No upload batch is being recorded!");
+        return batch.graphicsCmd;
+    }
+
+    VkCommandBuffer beginGraphicsUpload(const Device &device, UploadQueue &queue)
+    {
+        return beginBatch(device, queue).graphicsCmd;
+    }
+
+    void finishUpload(const Device &device, UploadQueue &queue, VkDeviceSize size)
+    {
+        UploadBatch &batch = queue.batches[queue.currentBatch];
+        batch.bytes += size;
+        queue.numBytes += size;
+        queue.numCopies++;
+
+        if (batch.bytes >= queue.batchSize)
+            submitBatch(device, queue);
+    }
+
+    void flushUploads(const Device &device, UploadQueue &queue)
+    {
+        submitBatch(device, queue);
+
+        // recycle completed batches early (oldest first), so that staging memory is available for subsequent uploads
+        for (int i = 0; i < UploadQueue::NUM_BATCHES; ++i)
+        {
+            if (!retireBatch(device, queue, queue.batches[(queue.currentBatch + i) % UploadQueue::NUM_BATCHES], false))
+                break;
+        }
+    }
+
+    void waitUploads(const Device &device, UploadQueue &queue)
+    {
+        submitBatch(device, queue);
+
+        for (int i = 0; i < UploadQueue::NUM_BATCHES; ++i)
+            retireBatch(device, queue, queue.batches[(queue.currentBatch + i) % UploadQueue::NUM_BATCHES], true);
+    }
+}
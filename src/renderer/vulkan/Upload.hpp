@@ -0,0 +1,66 @@
+#pragma once
+
+#include "renderer/vulkan/Base.hpp"
+#include "renderer/vulkan/Buffers.hpp"
+#include <vector>
+
+/*
+ *  Batched asynchronous GPU uploads: data is copied into a persistently mapped staging ring
+ *  and transfers are recorded into a few command buffers which are submitted to the transfer queue
+ *  without waiting. Fences are only waited on when staging memory or a batch slot has to be recycled.
+ */
+
+namespace vk
+{
+    // single batch of recorded transfers
+    struct UploadBatch
+    {
+        VkCommandBuffer transferCmd = VK_NULL_HANDLE;
+        VkCommandBuffer graphicsCmd = VK_NULL_HANDLE; // layout transitions and mipmap generation (same as transferCmd if queues are unified)
+        VkFence     fence     = VK_NULL_HANDLE;
+        VkSemaphore semaphore = VK_NULL_HANDLE; // transfer -> graphics queue dependency (only if queues are not unified)
+        VkDeviceSize ringEnd = 0;              // staging ring offset released once the batch completes
+        VkDeviceSize bytes   = 0;
+        std::vector<Buffer> tempBuffers;       // dedicated staging buffers for uploads too large for the ring
+        bool recording = false;
+        bool pending   = false;
+    };
+
+    struct UploadQueue
+    {
+        static const int NUM_BATCHES = 3;
+
+        Buffer stagingRing;
+        unsigned char *ringData = nullptr;
+        VkDeviceSize ringSize = 0;
+        VkDeviceSize ringHead = 0; // next free byte
+        VkDeviceSize ringTail = 0; // oldest byte still read by the GPU
+        VkDeviceSize batchSize = 0; // batch is submitted automatically once this many bytes are recorded
+
+        UploadBatch batches[NUM_BATCHES];
+        int currentBatch = 0;
+
+        // statistics
+        uint32_t numCopies  = 0;
+        uint32_t numSubmits = 0;
+        uint64_t numBytes   = 0;
+    };
+
+
+    void createUploadQueue(const Device &device, VkDeviceSize ringSize, UploadQueue *queue);
+    void destroyUploadQueue(const Device &device, UploadQueue &queue);
+    // copy data into staging memory and record a buffer copy to dstBuffer
+    void uploadBuffer(const Device &device, UploadQueue &queue, const void *data, VkDeviceSize size, const Buffer &dstBuffer, VkDeviceSize dstOffset);
+    // copy data into staging memory and return transfer command buffer of current batch along with staging location of the data
+    VkCommandBuffer stageUpload(const Device &device, UploadQueue &queue, const void *data, VkDeviceSize size, VkDeviceSize alignment, VkBuffer *srcBuffer, VkDeviceSize *srcOffset);
+    // command buffer of current batch executed on graphics queue after all transfers of the batch are complete
+    VkCommandBuffer uploadGraphicsCommand(const UploadQueue &queue);
+    // same as above, but starts a new batch if needed - for GPU side copies which don't use staging memory
+    VkCommandBuffer beginGraphicsUpload(const Device &device, UploadQueue &queue);
+    // account for recorded upload and submit current batch if it grew large enough
+    void finishUpload(const Device &device, UploadQueue &queue, VkDeviceSize size);
+    // submit recorded transfers without waiting for them to complete
+    void flushUploads(const Device &device, UploadQueue &queue);
+    // submit recorded transfers and block until all uploads are complete
+    void waitUploads(const Device &device, UploadQueue &queue);
+}